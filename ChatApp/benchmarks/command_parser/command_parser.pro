@@ -0,0 +1,12 @@
+CONFIG += c++17 console
+CONFIG -= app_bundle qt
+
+# Скорость разбора команд клиента на одном ядре; Qt не нужен
+INCLUDEPATH += ../../common
+
+SOURCES += \
+    main.cpp \
+    ../../common/chat_protocol.cpp
+
+HEADERS += \
+    ../../common/chat_protocol.h
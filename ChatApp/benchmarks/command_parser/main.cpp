@@ -0,0 +1,213 @@
+// Разбор команд клиента на одном ядре: сообщений в секунду и выделений памяти на сообщение.
+//
+// Режимы:
+//   split  - как было раньше: splitString (istringstream + vector<string>) и склейка тела
+//            сообщения обратно через '+' для PRIVATE, MSG и GROUP_MESSAGE;
+//   views  - parseTextChatCommand в переиспользуемый ChatMessage: поля - view на байты строки;
+//   binary - parseBinaryChatMessage тех же команд в двоичном виде.
+//
+//   command_parser [--messages N] [--body B] [--repeat K]
+
+#include "chat_protocol.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::atomic<std::uint64_t> g_allocations{0};
+
+} // namespace
+
+// Счётчик выделений памяти всей программы
+void* operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+namespace {
+
+struct Options {
+    std::size_t messages = 200000;
+    std::size_t body = 64; // Длина текста сообщения
+    int repeat = 5;
+};
+
+using Clock = std::chrono::steady_clock;
+
+// Старый разбор из ChatLogicServer.cpp
+std::vector<std::string> splitString(const std::string& s, char delimiter) {
+    std::vector<std::string> tokens;
+    std::string token;
+    std::istringstream tokenStream(s);
+    while (std::getline(tokenStream, token, delimiter)) {
+        tokens.push_back(token);
+    }
+    return tokens;
+}
+
+// Типичная смесь: больше всего сообщений в чаты, текст с ':' внутри
+std::vector<std::string> buildMessages(const Options& options) {
+    std::string body;
+    for (std::size_t i = 0; body.size() < options.body; ++i) {
+        body += i % 4 == 3 ? "at 10:30 " : "word ";
+    }
+    body.resize(options.body);
+
+    const std::vector<std::string> templates = {
+        "GROUP_MESSAGE:5hG2kQ9xLm3pR7tV:" + body,
+        "GROUP_MESSAGE:5hG2kQ9xLm3pR7tV:" + body,
+        "PRIVATE:alice:" + body,
+        "GET_UNREAD_COUNT:alice",
+        "MARK_READ:bob",
+        "GET_PRIVATE_HISTORY:bob:alice",
+        "GET_USERLIST",
+        "AUTH:alice:secret",
+    };
+    std::vector<std::string> messages;
+    messages.reserve(options.messages);
+    for (std::size_t i = 0; i < options.messages; ++i) {
+        messages.push_back(templates[i % templates.size()]);
+    }
+    return messages;
+}
+
+// Возвращают контрольную сумму, чтобы компилятор не выбросил разбор
+std::uint64_t parseSplit(const std::vector<std::string>& messages) {
+    std::uint64_t checksum = 0;
+    for (const std::string& message : messages) {
+        std::vector<std::string> parts = splitString(message, ':');
+        const std::string command = parts[0];
+        if ((command == "PRIVATE" || command == "MSG" || command == "GROUP_MESSAGE") && parts.size() >= 3) {
+            std::string text;
+            for (std::size_t i = 2; i < parts.size(); ++i) {
+                text += parts[i] + (i == parts.size() - 1 ? "" : ":");
+            }
+            checksum += parts[1].size() + text.size();
+        } else {
+            checksum += parts.size() >= 2 ? parts[1].size() : 0;
+        }
+    }
+    return checksum;
+}
+
+std::uint64_t parseViews(const std::vector<std::string>& messages) {
+    std::uint64_t checksum = 0;
+    ChatMessage message;
+    for (const std::string& line : messages) {
+        parseTextChatCommand(line, message);
+        const ChatMessageType type = message.type();
+        if (type == ChatMessageType::Private || type == ChatMessageType::Msg || type == ChatMessageType::GroupMessage) {
+            checksum += message.text(0).size() + message.text(1).size();
+        } else {
+            checksum += message.size() >= 1 ? message.text(0).size() : 0;
+        }
+    }
+    return checksum;
+}
+
+std::uint64_t parseBinary(const std::vector<std::string>& messages) {
+    std::uint64_t checksum = 0;
+    ChatMessage message;
+    for (const std::string& bytes : messages) {
+        if (!parseBinaryChatMessage(bytes, message)) {
+            continue;
+        }
+        const ChatMessageType type = message.type();
+        if (type == ChatMessageType::Private || type == ChatMessageType::Msg || type == ChatMessageType::GroupMessage) {
+            checksum += message.text(0).size() + message.text(1).size();
+        } else {
+            checksum += message.size() >= 1 ? message.text(0).size() : 0;
+        }
+    }
+    return checksum;
+}
+
+struct Result {
+    double messagesPerSecond = 0.0;
+    double allocationsPerMessage = 0.0;
+    std::uint64_t checksum = 0;
+};
+
+Result measure(const Options& options, const std::vector<std::string>& messages,
+               std::uint64_t (*parse)(const std::vector<std::string>&)) {
+    Result result;
+    for (int i = 0; i < options.repeat; ++i) {
+        const std::uint64_t allocations = g_allocations.load(std::memory_order_relaxed);
+        const Clock::time_point start = Clock::now();
+        result.checksum = parse(messages);
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        result.messagesPerSecond = std::max(result.messagesPerSecond, double(messages.size()) / seconds);
+        result.allocationsPerMessage = double(g_allocations.load(std::memory_order_relaxed) - allocations)
+                                       / double(messages.size());
+    }
+    return result;
+}
+
+void print(const char* name, const Result& result, const Result& baseline) {
+    std::cout << name << ": " << result.messagesPerSecond / 1e6 << " M msg/s, "
+              << result.allocationsPerMessage << " allocations/msg, x"
+              << result.messagesPerSecond / baseline.messagesPerSecond
+              << (result.checksum == baseline.checksum ? "" : " CHECKSUM MISMATCH") << std::endl;
+}
+
+Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string key = argv[i];
+        const std::string value = argv[i + 1];
+        if (key == "--messages") {
+            options.messages = std::max<std::size_t>(1, std::stoul(value));
+        } else if (key == "--body") {
+            options.body = std::size_t(std::stoul(value));
+        } else if (key == "--repeat") {
+            options.repeat = std::max(1, std::stoi(value));
+        }
+    }
+    return options;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const Options options = parseOptions(argc, argv);
+    const std::vector<std::string> messages = buildMessages(options);
+
+    std::vector<std::string> binary;
+    binary.reserve(messages.size());
+    ChatMessage message;
+    for (const std::string& line : messages) {
+        parseTextChatCommand(line, message);
+        std::string bytes;
+        appendBinaryChatMessage(bytes, message);
+        binary.push_back(std::move(bytes));
+    }
+
+    std::cout << "messages: " << messages.size() << ", body " << options.body << " bytes, best of "
+              << options.repeat << " runs, one core" << std::endl;
+    const Result split = measure(options, messages, parseSplit);
+    print("split ", split, split);
+    print("views ", measure(options, messages, parseViews), split);
+    print("binary", measure(options, binary, parseBinary), split);
+    return 0;
+}
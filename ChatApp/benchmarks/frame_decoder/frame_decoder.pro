@@ -0,0 +1,12 @@
+CONFIG += c++17 console
+CONFIG -= app_bundle qt
+
+# Скорость разбора входящих кадров на одном ядре; Qt не нужен
+INCLUDEPATH += ../../common
+
+SOURCES += \
+    main.cpp \
+    ../../common/frame_codec.cpp
+
+HEADERS += \
+    ../../common/frame_codec.h
@@ -0,0 +1,160 @@
+// Разбор входящих кадров на одном ядре: кадров в секунду для коротких сообщений чата.
+//
+// Поток кадров заранее собран в памяти и подаётся в декодер кусками по read байт, как из сокета.
+// Режимы:
+//   direct - куски пишутся прямо в буфер декодера (prepare/commit), нагрузка берётся как view,
+//            текст QString-кадров дописывается в переиспользуемую строку;
+//   alloc  - как было с readAll(): на каждое чтение своя строка, на каждый кадр - своя копия нагрузки.
+//
+//   frame_decoder [--frames N] [--size S] [--read R] [--repeat K]
+//
+// Без --size и --read перебираются типичные сочетания.
+
+#include "frame_codec.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::size_t frames = 200000;
+    std::size_t size = 0;  // 0 - перебрать 16, 64, 256
+    std::size_t read = 0;  // 0 - перебрать 1460, 16384, 65536
+    int repeat = 5;
+};
+
+using Clock = std::chrono::steady_clock;
+
+std::string buildStream(const WireOptions& options, std::size_t frames, std::size_t size) {
+    std::string stream;
+    std::string message(size, 'a');
+    for (std::size_t i = 0; i < frames; ++i) {
+        message[i % size] = char('a' + i % 26);
+        appendMessageFrames(stream, options, message);
+    }
+    return stream;
+}
+
+// Возвращает контрольную сумму, чтобы компилятор не выбросил разбор
+std::uint64_t decodeDirect(const std::string& stream, const WireOptions& options, std::size_t readSize,
+                           std::size_t& frames) {
+    FrameDecoder decoder(options.version);
+    std::u16string text;
+    std::uint64_t checksum = 0;
+    for (std::size_t offset = 0; offset < stream.size(); offset += readSize) {
+        const std::size_t size = std::min(readSize, stream.size() - offset);
+        std::memcpy(decoder.prepare(size), stream.data() + offset, size);
+        decoder.commit(size);
+
+        std::string_view payload;
+        bool more = false;
+        while (decoder.next(payload, more) == FrameDecoder::Result::Frame) {
+            if (options.utf8) {
+                checksum += std::uint8_t(payload.back());
+            } else {
+                text.clear();
+                decodeQStringPayload(payload, text);
+                checksum += text.back();
+            }
+            ++frames;
+        }
+    }
+    return checksum;
+}
+
+std::uint64_t decodeAlloc(const std::string& stream, const WireOptions& options, std::size_t readSize,
+                          std::size_t& frames) {
+    FrameDecoder decoder(options.version);
+    std::uint64_t checksum = 0;
+    for (std::size_t offset = 0; offset < stream.size(); offset += readSize) {
+        const std::string chunk = stream.substr(offset, readSize);
+        decoder.append(chunk.data(), chunk.size());
+
+        std::string_view payload;
+        bool more = false;
+        while (decoder.next(payload, more) == FrameDecoder::Result::Frame) {
+            if (options.utf8) {
+                const std::string message(payload);
+                checksum += std::uint8_t(message.back());
+            } else {
+                std::u16string text;
+                decodeQStringPayload(payload, text);
+                checksum += text.back();
+            }
+            ++frames;
+        }
+    }
+    return checksum;
+}
+
+void run(const Options& options, std::size_t size, std::size_t readSize, bool utf8) {
+    WireOptions wire;
+    wire.version = FrameProtocol::StreamVersion;
+    wire.utf8 = utf8;
+    const std::string stream = buildStream(wire, options.frames, size);
+
+    const auto measure = [&](auto decode) {
+        double best = 0.0;
+        std::uint64_t checksum = 0;
+        for (int i = 0; i < options.repeat; ++i) {
+            std::size_t frames = 0;
+            const Clock::time_point start = Clock::now();
+            checksum += decode(stream, wire, readSize, frames);
+            const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            best = std::max(best, double(frames) / seconds);
+        }
+        return std::make_pair(best, checksum);
+    };
+    const auto direct = measure(decodeDirect);
+    const auto alloc = measure(decodeAlloc);
+
+    std::cout << (utf8 ? "utf8   " : "qstring") << " size " << size << ", read " << readSize << ": direct "
+              << direct.first / 1e6 << " M frames/s (" << direct.first * double(stream.size()) / double(options.frames) / 1e6
+              << " MB/s), alloc " << alloc.first / 1e6 << " M frames/s, x" << direct.first / alloc.first
+              << (direct.second == alloc.second ? "" : " CHECKSUM MISMATCH") << std::endl;
+}
+
+Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string key = argv[i];
+        const std::string value = argv[i + 1];
+        if (key == "--frames") {
+            options.frames = std::size_t(std::stoul(value));
+        } else if (key == "--size") {
+            options.size = std::size_t(std::stoul(value));
+        } else if (key == "--read") {
+            options.read = std::size_t(std::stoul(value));
+        } else if (key == "--repeat") {
+            options.repeat = std::max(1, std::stoi(value));
+        }
+    }
+    return options;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const Options options = parseOptions(argc, argv);
+    const std::vector<std::size_t> sizes = options.size ? std::vector<std::size_t>{options.size}
+                                                        : std::vector<std::size_t>{16, 64, 256};
+    const std::vector<std::size_t> reads = options.read ? std::vector<std::size_t>{options.read}
+                                                        : std::vector<std::size_t>{1460, 16384, 65536};
+
+    std::cout << "frames: " << options.frames << ", best of " << options.repeat << " runs, one core" << std::endl;
+    for (bool utf8 : {true, false}) {
+        for (std::size_t size : sizes) {
+            for (std::size_t readSize : reads) {
+                run(options, size, readSize, utf8);
+            }
+        }
+    }
+    return 0;
+}
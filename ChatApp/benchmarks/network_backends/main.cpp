@@ -0,0 +1,325 @@
+// Сравнение сетевых бэкендов сервера (Linux).
+//
+// Сценарий fanout: clients клиентов подключаются и согласуют кадры v2/utf8, первый присылает
+// messages сообщений размером size байт, сервер из обработчика рассылает каждое всем (как групповой чат).
+// Сценарий inbound: каждый клиент присылает messages сообщений, сервер разбирает их.
+//
+//   network_backends [--backend qt|epoll|io_uring|all] [--clients N] [--messages M] [--size S]
+//
+// Бэкенд qt собирается только вместе с Qt (network_backends.pro).
+
+#include "frame_codec.h"
+#include "network_interface.h"
+#include "epoll_network_server.h"
+#include "io_uring_network_server.h"
+#ifdef QT_CORE_LIB
+#include "qt_network_adapter.h"
+#include <QCoreApplication>
+#endif
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::string backend = "all";
+    int clients = 500;
+    int messages = 200;
+    std::size_t size = 256;
+};
+
+struct Backend {
+    std::string name;
+    std::shared_ptr<INetworkServer> server;
+    std::function<int()> port;
+    std::function<void(int)> pump; // Один проход цикла событий сервера
+    std::function<std::uint64_t()> syscalls; // io_uring_enter, если бэкенд их считает
+};
+
+using Clock = std::chrono::steady_clock;
+
+int connectClient(int port) {
+    const int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    const int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return fd;
+}
+
+void sendAll(int fd, const std::string& data) {
+    std::size_t offset = 0;
+    while (offset < data.size()) {
+        const ssize_t sent = ::send(fd, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return;
+        }
+        offset += std::size_t(sent);
+    }
+}
+
+// Читает со всех клиентских сокетов, пока не придёт expectedPerClient байт на каждый
+class Reader {
+public:
+    Reader(const std::vector<int>& fds, std::size_t expectedPerClient)
+        : m_fds(fds), m_expected(expectedPerClient), m_received(fds.size(), 0) {
+        m_thread = std::thread([this]() { run(); });
+    }
+    ~Reader() {
+        m_stop = true;
+        m_thread.join();
+    }
+    bool done() const { return m_done.load(); }
+
+private:
+    void run() {
+        const int epollFd = epoll_create1(EPOLL_CLOEXEC);
+        for (std::size_t i = 0; i < m_fds.size(); ++i) {
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.u64 = i;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, m_fds[i], &event);
+        }
+        std::vector<char> buffer(256 * 1024);
+        std::size_t finished = 0;
+        epoll_event events[256];
+        while (!m_stop && finished < m_fds.size()) {
+            const int count = epoll_wait(epollFd, events, 256, 10);
+            for (int i = 0; i < count; ++i) {
+                const std::size_t index = events[i].data.u64;
+                const ssize_t received = ::recv(m_fds[index], buffer.data(), buffer.size(), MSG_DONTWAIT);
+                if (received <= 0) {
+                    continue;
+                }
+                const bool wasDone = m_received[index] >= m_expected;
+                m_received[index] += std::size_t(received);
+                if (!wasDone && m_received[index] >= m_expected) {
+                    ++finished;
+                }
+            }
+        }
+        ::close(epollFd);
+        m_done = finished == m_fds.size();
+    }
+
+    std::vector<int> m_fds;
+    std::size_t m_expected;
+    std::vector<std::size_t> m_received;
+    std::atomic<bool> m_stop{false};
+    std::atomic<bool> m_done{false};
+    std::thread m_thread;
+};
+
+template<typename Predicate>
+bool pumpUntil(Backend& backend, Predicate predicate, double timeoutSeconds = 60.0) {
+    const auto deadline = Clock::now() + std::chrono::duration<double>(timeoutSeconds);
+    while (!predicate()) {
+        if (Clock::now() > deadline) {
+            return false;
+        }
+        backend.pump(1);
+    }
+    return true;
+}
+
+double seconds(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void runBackend(Backend& backend, const Options& options) {
+    std::vector<std::shared_ptr<INetworkClient>> serverClients;
+    std::size_t received = 0;
+    bool fanout = false;
+    backend.server->setClientConnectedCallback([&](std::shared_ptr<INetworkClient> client) {
+        serverClients.push_back(client);
+    });
+    backend.server->setMessageReceivedCallback([&](std::shared_ptr<INetworkClient>, const std::string& message) {
+        ++received;
+        if (fanout) {
+            for (const auto& client : serverClients) {
+                client->sendMessage(message);
+            }
+        }
+    });
+    if (!backend.server->start(0)) {
+        std::cout << backend.name << ": failed to start, skipped" << std::endl;
+        return;
+    }
+
+    // Подключаемся и согласуем v2 с UTF-8, как это делает клиент
+    WireOptions requested;
+    requested.version = FrameProtocol::StreamVersion;
+    requested.utf8 = true;
+    std::string hello;
+    appendMessageFrames(hello, WireOptions(), buildHello(requested));
+    std::string helloReply;
+    appendMessageFrames(helloReply, WireOptions(), buildHelloReply(negotiateWireOptions(requested)));
+
+    std::vector<int> fds;
+    for (int i = 0; i < options.clients; ++i) {
+        const int fd = connectClient(backend.port());
+        if (fd < 0) {
+            std::cout << backend.name << ": connect failed after " << i << " clients" << std::endl;
+            break;
+        }
+        sendAll(fd, hello);
+        fds.push_back(fd);
+        if (i % 64 == 63) {
+            backend.pump(0); // Не даём переполниться очереди listen
+        }
+    }
+    if (fds.empty()) {
+        backend.server->stop();
+        return;
+    }
+    if (!pumpUntil(backend, [&]() { return serverClients.size() == fds.size(); })) {
+        std::cout << backend.name << ": not all clients were accepted" << std::endl;
+    }
+    {
+        Reader handshake(fds, helloReply.size());
+        pumpUntil(backend, [&]() { return handshake.done(); });
+    }
+
+    const std::string payload(options.size, 'x');
+    std::string frames;
+    const std::size_t framesPerMessage = appendMessageFrames(frames, requested, payload);
+    const std::size_t bytesPerClient = frames.size() * std::size_t(options.messages);
+    std::string burst;
+    for (int m = 0; m < options.messages; ++m) {
+        burst += frames;
+    }
+
+    // fanout: сервер рассылает сообщения первого клиента всем
+    {
+        const std::uint64_t syscallsBefore = backend.syscalls();
+        Reader reader(fds, bytesPerClient);
+        fanout = true;
+        const auto start = Clock::now();
+        sendAll(fds.front(), burst);
+        const bool complete = pumpUntil(backend, [&]() { return reader.done(); });
+        const double elapsed = seconds(start);
+        const double deliveries = double(fds.size()) * options.messages;
+        std::cout << backend.name << " fanout: " << (complete ? "" : "INCOMPLETE ") << elapsed * 1000.0 << " ms, "
+                  << std::uint64_t(deliveries / elapsed) << " msg/s, "
+                  << (deliveries * double(frames.size()) / elapsed / (1024.0 * 1024.0)) << " MiB/s";
+        if (const std::uint64_t syscalls = backend.syscalls() - syscallsBefore) {
+            std::cout << ", io_uring_enter: " << syscalls;
+        }
+        std::cout << " (" << framesPerMessage << " frame(s) per message)" << std::endl;
+        fanout = false;
+    }
+
+    // inbound: клиенты шлют, сервер разбирает кадры
+    {
+        received = 0;
+        const std::size_t expected = fds.size() * std::size_t(options.messages);
+        const auto start = Clock::now();
+        std::thread writer([&]() {
+            for (const int fd : fds) {
+                sendAll(fd, burst);
+            }
+        });
+        const bool complete = pumpUntil(backend, [&]() { return received >= expected; });
+        writer.join();
+        const double elapsed = seconds(start);
+        std::cout << backend.name << " inbound: " << (complete ? "" : "INCOMPLETE ") << elapsed * 1000.0 << " ms, "
+                  << std::uint64_t(double(received) / elapsed) << " msg/s" << std::endl;
+    }
+
+    for (const int fd : fds) {
+        ::close(fd);
+    }
+    serverClients.clear();
+    backend.server->stop();
+}
+
+Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string key = argv[i];
+        const std::string value = argv[i + 1];
+        if (key == "--backend") {
+            options.backend = value;
+        } else if (key == "--clients") {
+            options.clients = std::stoi(value);
+        } else if (key == "--messages") {
+            options.messages = std::stoi(value);
+        } else if (key == "--size") {
+            options.size = std::size_t(std::stoul(value));
+        }
+    }
+    return options;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+#ifdef QT_CORE_LIB
+    QCoreApplication app(argc, argv);
+#endif
+    const Options options = parseOptions(argc, argv);
+
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    std::cout << "clients: " << options.clients << ", messages: " << options.messages
+              << ", size: " << options.size << std::endl;
+
+    const auto wanted = [&](const std::string& name) {
+        return options.backend == "all" || options.backend == name;
+    };
+
+#ifdef QT_CORE_LIB
+    if (wanted("qt")) {
+        auto server = std::make_shared<QtNetworkServerAdapter>();
+        Backend backend{ "qt", server,
+                         [server]() { return int(server->serverPort()); },
+                         [](int timeoutMs) { QCoreApplication::processEvents(QEventLoop::AllEvents, timeoutMs); },
+                         []() { return std::uint64_t(0); } };
+        runBackend(backend, options);
+    }
+#endif
+    if (wanted("epoll")) {
+        auto server = std::make_shared<EpollNetworkServer>();
+        Backend backend{ "epoll", server,
+                         [server]() { return server->port(); },
+                         [server](int timeoutMs) { server->processEvents(timeoutMs); },
+                         []() { return std::uint64_t(0); } };
+        runBackend(backend, options);
+    }
+    if (wanted("io_uring")) {
+        auto server = std::make_shared<IoUringNetworkServer>();
+        Backend backend{ "io_uring", server,
+                         [server]() { return server->port(); },
+                         [server](int timeoutMs) { server->processEvents(timeoutMs); },
+                         [server]() { return server->enterCalls(); } };
+        runBackend(backend, options);
+    }
+    return 0;
+}
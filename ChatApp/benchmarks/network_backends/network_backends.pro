@@ -0,0 +1,48 @@
+QT = core
+QT += core network
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+# Сравнение бэкендов qt / epoll / io_uring; без Qt main.cpp собирается только с native-бэкендами
+INCLUDEPATH += ../../common ../../server
+LIBS += -lz
+
+SOURCES += \
+    main.cpp \
+    ../../common/chat_protocol.cpp \
+    ../../common/frame_codec.cpp \
+    ../../common/ring_buffer.cpp \
+    ../../server/admission_control.cpp \
+    ../../server/heartbeat_monitor.cpp \
+    ../../server/logger.cpp \
+    ../../server/outbound_queue.cpp \
+    ../../server/qt_network_adapter.cpp \
+    ../../server/shared_frame.cpp \
+    ../../server/wire_session.cpp \
+    ../../server/epoll_network_server.cpp \
+    ../../server/frame_compression.cpp \
+    ../../server/io_uring_network_server.cpp \
+    ../../server/io_uring_queue.cpp \
+    ../../server/socket_utils.cpp
+
+HEADERS += \
+    ../../common/chat_protocol.h \
+    ../../common/frame_codec.h \
+    ../../common/ring_buffer.h \
+    ../../server/admission_control.h \
+    ../../server/connection_registry.h \
+    ../../server/heartbeat_monitor.h \
+    ../../server/logger.h \
+    ../../server/network_interface.h \
+    ../../server/outbound_queue.h \
+    ../../server/qt_network_adapter.h \
+    ../../server/shared_frame.h \
+    ../../server/timing_wheel.h \
+    ../../server/token_bucket.h \
+    ../../server/wire_session.h \
+    ../../server/epoll_network_server.h \
+    ../../server/frame_compression.h \
+    ../../server/io_uring_network_server.h \
+    ../../server/io_uring_queue.h \
+    ../../server/socket_utils.h
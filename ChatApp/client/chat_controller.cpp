@@ -2,6 +2,7 @@
 #include "mainwindow.h"
 #include <QDataStream>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
@@ -9,7 +10,9 @@
 ChatController::ChatController(QObject *parent)
     : QObject(parent),
       loginSuccessful(false),
-      nextBlockSize(0),
+      frameDecoder(FrameProtocol::LegacyVersion),
+      handshakePending(false),
+      nextRequestId(1),
       newFriendPollAttempts(0)
 {
     // Инициализация сокета
@@ -44,6 +47,10 @@ ChatController::ChatController(QObject *parent)
 
 ChatController::~ChatController()
 {
+    if (compressionStats.batches != 0) {
+        qDebug() << "Compressed batches received:" << compressionStats.batches << "ratio:" << compressionStats.ratio()
+                 << "inflate ms:" << compressionStats.cpuNanos / 1000000;
+    }
     if (socket) {
         socket->close();
         delete socket;
@@ -56,6 +63,7 @@ bool ChatController::connectToServer(const QString& host, quint16 port)
     
     if (socket->waitForConnected(5000)) {
         qDebug() << "Connected to server" << host << ":" << port;
+        startHandshake();
         emit connectionEstablished();
         return true;
     } else {
@@ -134,29 +142,175 @@ void ChatController::registerUser(const QString &username, const QString &passwo
 
 void ChatController::handleSocketReadyRead()
 {
-    QDataStream in(socket);
-    in.setVersion(QDataStream::Qt_5_15);
-    
-    if (in.status() == QDataStream::Ok) {
-        // Обработка входящих данных
-        for(;;) {
-            if (nextBlockSize == 0) {
-                if (socket->bytesAvailable() < static_cast<qint64>(sizeof(quint16))) {
-                    break;
-                }
-                in >> nextBlockSize;
+    // Всё, что есть в сокете, одним вызовом читается прямо в буфер декодера
+    const qint64 available = socket->bytesAvailable();
+    if (available > 0) {
+        const qint64 received = socket->read(frameDecoder.prepare(static_cast<std::size_t>(available)), available);
+        if (received > 0) {
+            frameDecoder.commit(static_cast<std::size_t>(received));
+        }
+    }
+
+    // Обработка входящих данных
+    for(;;) {
+        std::string_view payload;
+        bool more = false;
+        const FrameDecoder::Result result = frameDecoder.next(payload, more);
+        if (result == FrameDecoder::Result::NeedMoreData) {
+            break;
+        }
+        if (result == FrameDecoder::Result::Error) {
+            qDebug() << "Malformed frame from server, dropping connection";
+            frameDecoder.reset();
+            socket->abort();
+            return;
+        }
+        if (result == FrameDecoder::Result::Compressed) {
+            // Пачка кадров, сжатая сервером: разжимаем и разбираем дальше как обычные кадры
+            if (!inflateBatch(payload)) {
+                qDebug() << "Corrupted compressed frame from server, dropping connection";
+                frameDecoder.reset();
+                socket->abort();
+                return;
             }
-            
-            if (socket->bytesAvailable() < nextBlockSize) {
-                break;
+            continue;
+        }
+
+        if (wireOptions.utf8) {
+            partialUtf8.append(payload.data(), static_cast<qsizetype>(payload.size()));
+        } else {
+            // Фрагмент дописывается прямо в partialMessage, без QDataStream на кадр
+            std::string_view units;
+            if (!qStringPayloadUnits(payload, units)) {
+                qDebug() << "Malformed string payload from server, dropping connection";
+                frameDecoder.reset();
+                socket->abort();
+                return;
             }
-            
-            QString str;
-            in >> str;
-            nextBlockSize = 0;
-            
-            processServerResponse(str);
+            const qsizetype offset = partialMessage.size();
+            partialMessage.resize(offset + static_cast<qsizetype>(units.size() / 2));
+            decodeUtf16Be(units, reinterpret_cast<char16_t*>(partialMessage.data() + offset));
+        }
+        const std::size_t assembledSize = wireOptions.utf8 ? static_cast<std::size_t>(partialUtf8.size())
+                                                           : static_cast<std::size_t>(partialMessage.size()) * sizeof(QChar);
+        if (assembledSize > FrameProtocol::MaxMessageSize) {
+            // Сообщение собирается целиком до разбора: цепочка фрагментов без конца съела бы память
+            qDebug() << "Message from server exceeds" << FrameProtocol::MaxMessageSize << "bytes, dropping connection";
+            frameDecoder.reset();
+            partialUtf8.clear();
+            partialMessage.clear();
+            socket->abort();
+            return;
+        }
+        if (more) {
+            continue; // Сообщение продолжится в следующем кадре
+        }
+
+        QString str;
+        if (wireOptions.utf8) {
+            if (wireOptions.binary && isBinaryChatMessage(std::string_view(partialUtf8.constData(), static_cast<std::size_t>(partialUtf8.size())))) {
+                processBinaryServerMessage(std::string_view(partialUtf8.constData(), static_cast<std::size_t>(partialUtf8.size())));
+                partialUtf8.clear();
+                continue;
+            }
+            str = QString::fromUtf8(partialUtf8);
+            partialUtf8.clear();
+        } else {
+            str.swap(partialMessage);
+        }
+
+        if (handshakePending && handleHandshakeReply(str)) {
+            continue;
+        }
+        if (wireOptions.heartbeat && str == QLatin1String(FrameProtocol::PingMessage.data(), qsizetype(FrameProtocol::PingMessage.size()))) {
+            // Сервер проверяет, живо ли соединение; ответ не должен трогать таймеры ожидания ответа
+            writeFrames(QString::fromLatin1(FrameProtocol::PongMessage.data(), qsizetype(FrameProtocol::PongMessage.size())));
+            continue;
         }
+        processServerResponse(str);
+    }
+}
+
+void ChatController::startHandshake()
+{
+    // Новое соединение всегда начинается со старых кадров
+    frameDecoder.reset();
+    frameDecoder.setVersion(FrameProtocol::LegacyVersion);
+    frameDecoder.setCompressedFramesAllowed(false);
+    wireOptions = WireOptions();
+    partialMessage.clear();
+    partialUtf8.clear();
+    pendingMessages.clear();
+    pendingHistories.clear();
+
+    WireOptions requested;
+    requested.version = FrameProtocol::StreamVersion;
+    requested.utf8 = true;
+    requested.deflate = true;
+    requested.heartbeat = true;
+    requested.binary = true;
+    requested.presence = true;
+    writeFrames(QString::fromStdString(buildHello(requested)));
+    // Старый сервер отвечает на HELLO сразу (ERROR:Authentication required), поэтому ответа ждём
+    // без ограничения по времени; зависший сервер покажет таймаут входа
+    handshakePending = true;
+}
+
+bool ChatController::handleHandshakeReply(const QString &message)
+{
+    WireOptions accepted;
+    if (parseHelloReply(message.toStdString(), accepted)) {
+        wireOptions = accepted;
+        wireOptions.version = qMin(accepted.version, FrameProtocol::StreamVersion);
+        frameDecoder.setVersion(wireOptions.version);
+        frameDecoder.setCompressedFramesAllowed(wireOptions.deflate);
+        qDebug() << "Negotiated frame version" << wireOptions.version << "utf8:" << wireOptions.utf8
+                 << "deflate:" << wireOptions.deflate << "heartbeat:" << wireOptions.heartbeat
+                 << "binary:" << wireOptions.binary << "presence:" << wireOptions.presence;
+        finishHandshake();
+        return true;
+    }
+
+    // Сервер не знает HELLO - остаёмся на старых кадрах
+    qDebug() << "Server does not support frame negotiation, using legacy frames";
+    finishHandshake();
+    return message.startsWith("ERROR:Authentication required");
+}
+
+bool ChatController::inflateBatch(std::string_view payload)
+{
+    // Формат qCompress: quint32 BE размер исходных байт + поток zlib
+    if (payload.size() <= 4) {
+        return false;
+    }
+    const auto* p = reinterpret_cast<const unsigned char*>(payload.data());
+    const quint32 plainSize = (quint32(p[0]) << 24) | (quint32(p[1]) << 16) | (quint32(p[2]) << 8) | quint32(p[3]);
+    if (plainSize == 0 || plainSize > FrameProtocol::MaxFrameSize) {
+        return false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const QByteArray plain = qUncompress(reinterpret_cast<const uchar*>(payload.data()), static_cast<qsizetype>(payload.size()));
+    compressionStats.cpuNanos += quint64(timer.nsecsElapsed());
+    if (plain.size() != qsizetype(plainSize)) {
+        return false;
+    }
+    ++compressionStats.batches;
+    compressionStats.inputBytes += quint64(plain.size());
+    compressionStats.outputBytes += quint64(payload.size() + FrameProtocol::StreamHeaderSize);
+    // payload указывает в буфер декодера и после insert() недействителен, но он уже не нужен
+    frameDecoder.insert(plain.constData(), static_cast<std::size_t>(plain.size()));
+    return true;
+}
+
+void ChatController::finishHandshake()
+{
+    handshakePending = false;
+    const QList<QPair<QString, quint64>> queued = pendingMessages;
+    pendingMessages.clear();
+    for (const QPair<QString, quint64> &message : queued) {
+        writeCommand(message.first, message.second);
     }
 }
 
@@ -192,19 +346,90 @@ void ChatController::handleAuthenticationTimeout()
     currentOperation = None;
 }
 
-void ChatController::sendToServer(const QString &message)
+void ChatController::sendToServer(const QString &message, quint64 requestId)
 {
     recentSentMessages.append(message);
-    
-    QByteArray arrBlock;
-    QDataStream out(&arrBlock, QIODevice::WriteOnly);
-    out.setVersion(QDataStream::Qt_5_15);
-    
-    out << quint16(0) << message;
-    out.device()->seek(0);
-    out << quint16(arrBlock.size() - sizeof(quint16));
-    
-    socket->write(arrBlock);
+
+    if (handshakePending) {
+        // Формат кадров ещё не согласован, отправим после ответа на HELLO
+        pendingMessages.append(qMakePair(message, requestId));
+        return;
+    }
+    writeCommand(message, requestId);
+}
+
+void ChatController::writeCommand(const QString &message, quint64 requestId)
+{
+    if (!wireOptions.binary) {
+        // В текстовом виде номера нет: ответ придёт без него и пойдёт старым путём
+        if (requestId != 0) {
+            pendingHistories.remove(requestId);
+        }
+        writeFrames(message);
+        return;
+    }
+    // Сервер принимает двоичный вид: поля уходят с явной длиной и не зависят от ':' и '|' внутри.
+    // Строка, которая не является командой, уходит как Text и попадает в общий чат, как и раньше.
+    const QByteArray text = message.toUtf8();
+    parseTextChatCommand(std::string_view(text.constData(), static_cast<std::size_t>(text.size())), outgoingMessage);
+    outgoingBinary.clear();
+    appendBinaryChatMessage(outgoingBinary, outgoingMessage, requestId);
+    writeUtf8Frames(QByteArray::fromRawData(outgoingBinary.data(), static_cast<qsizetype>(outgoingBinary.size())));
+}
+
+void ChatController::writeUtf8Frames(const QByteArray &bytes)
+{
+    qsizetype offset = 0;
+    do {
+        const qsizetype count = qMin(static_cast<qsizetype>(FrameProtocol::MaxChunkSize), bytes.size() - offset);
+        const bool more = offset + count < bytes.size();
+
+        char header[FrameProtocol::StreamHeaderSize];
+        const std::size_t headerSize = encodeFrameHeader(header, FrameProtocol::StreamVersion, static_cast<std::size_t>(count), more);
+        socket->write(header, static_cast<qint64>(headerSize));
+        socket->write(bytes.constData() + offset, count);
+        offset += count;
+    } while (offset < bytes.size());
+}
+
+void ChatController::writeFrames(const QString &message)
+{
+    if (wireOptions.utf8) {
+        writeUtf8Frames(message.toUtf8());
+        return;
+    }
+
+    if (wireOptions.version < FrameProtocol::StreamVersion) {
+        QByteArray arrBlock;
+        QDataStream out(&arrBlock, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_5_15);
+
+        out << quint16(0) << message;
+        out.device()->seek(0);
+        out << quint16(arrBlock.size() - sizeof(quint16));
+
+        socket->write(arrBlock);
+        return;
+    }
+
+    // Версия 2: 32-битная длина, длинные сообщения уходят несколькими фрагментами
+    const qsizetype charsPerChunk = static_cast<qsizetype>(FrameProtocol::MaxChunkSize / sizeof(QChar));
+    qsizetype offset = 0;
+    do {
+        const qsizetype count = qMin(charsPerChunk, message.size() - offset);
+        const bool more = offset + count < message.size();
+
+        QByteArray chunk;
+        QDataStream out(&chunk, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_5_15);
+        out << message.mid(offset, count);
+
+        char header[FrameProtocol::StreamHeaderSize];
+        const std::size_t headerSize = encodeFrameHeader(header, FrameProtocol::StreamVersion, static_cast<std::size_t>(chunk.size()), more);
+        socket->write(header, static_cast<qint64>(headerSize));
+        socket->write(chunk);
+        offset += count;
+    } while (offset < message.size());
 }
 
 void ChatController::sendMessageToServer(const QString &message)
@@ -215,14 +440,37 @@ void ChatController::sendMessageToServer(const QString &message)
 void ChatController::processServerResponse(const QString &response)
 {
     qDebug() << "Received from server:" << response;
-    
+    handleServerMessage(response.split(":"), false, 0);
+}
+
+void ChatController::processBinaryServerMessage(std::string_view message)
+{
+    if (!parseBinaryChatMessage(message, incomingMessage)) {
+        qDebug() << "Malformed binary message from server, ignoring";
+        return;
+    }
+    // Поля приходят ровно такими, какими их отправил сервер, без разбора по ':'
+    QStringList parts;
+    parts.reserve(static_cast<qsizetype>(incomingMessage.size()) + 1);
+    parts.append(QString::fromLatin1(incomingMessage.name().data(), static_cast<qsizetype>(incomingMessage.name().size())));
+    for (std::size_t i = 0; i < incomingMessage.size(); ++i) {
+        const ChatMessage::Field &field = incomingMessage.at(i);
+        parts.append(field.isNumber ? QString::number(field.number)
+                                    : QString::fromUtf8(field.text.data(), static_cast<qsizetype>(field.text.size())));
+    }
+    qDebug() << "Received from server (binary):" << parts << "request" << incomingMessage.requestId();
+    handleServerMessage(parts, true, incomingMessage.requestId());
+}
+
+// typed - parts пришли из двоичного сообщения: каждое поле целиком, списки без разделителей.
+// requestId - номер запроса, на который отвечает сервер, 0 - без номера
+void ChatController::handleServerMessage(const QStringList &parts, bool typed, quint64 requestId)
+{
     // Остановка таймера ожидания ответа
     if (authTimeoutTimer && authTimeoutTimer->isActive()) { 
         authTimeoutTimer->stop();
     }
     
-    QStringList parts = response.split(":");
-    
     if (parts.isEmpty()) {
         return;
     }
@@ -268,46 +516,46 @@ void ChatController::processServerResponse(const QString &response)
     }    else if (command == "USER_LIST" || command == "USERLIST") {
         QStringList tempUserList;
         QStringList tempOnlineUsernames; 
-        int firstColonPos = response.indexOf(':');
-        if (firstColonPos == -1) {
-            qDebug() << "ChatController: Malformed USERLIST command (no colon):" << response;
+        if (parts.size() < 2 && !typed) {
+            qDebug() << "ChatController: Malformed USERLIST command (no colon):" << parts;
             return;
         }
-        QString payload = response.mid(firstColonPos + 1);
-        
-        if (payload.isEmpty()) {
-            qDebug() << "ChatController: USERLIST payload is empty. Clearing user lists. Response:" << response;
-            this->userList.clear();
-            this->onlineUsers.clear();
-            emit userListUpdated(this->userList);
-            return;
+
+        // Записи в виде username:status:type1[:type2]
+        QList<QStringList> userEntries;
+        if (typed) {
+            // Ровно 4 поля на запись, пустое четвёртое опускается
+            for (qsizetype i = 1; i + 3 < parts.size(); i += 4) {
+                QStringList details = parts.mid(i, parts[i + 3].isEmpty() ? 3 : 4);
+                userEntries.append(details);
+            }
+        } else {
+            const QString payload = parts.mid(1).join(":");
+            for (const QString &entry : payload.split(',')) {
+                if (!entry.isEmpty()) {
+                    userEntries.append(entry.split(':'));
+                }
+            }
         }
 
-        QStringList userEntries = payload.split(',');
-        if (userEntries.isEmpty() || (userEntries.size() == 1 && userEntries.first().isEmpty())) {
-            qDebug() << "ChatController: USERLIST no user entries after splitting payload. Clearing user lists. Payload:" << payload;
+        if (userEntries.isEmpty()) {
+            qDebug() << "ChatController: USERLIST has no user entries. Clearing user lists.";
             this->userList.clear();
             this->onlineUsers.clear();
             emit userListUpdated(this->userList);
             return;
         }
 
-        qDebug() << "Received user list command. Payload:" << payload << "Entries count:" << userEntries.size();
+        qDebug() << "Received user list command. Entries count:" << userEntries.size();
         
         this->userList.clear(); 
         this->onlineUsers.clear(); 
         
-        for (const QString &entry : userEntries) {
-            if (entry.isEmpty()) {
-                continue;
-            }
-            
-            // Поддержка формата с 4 частами (username:status:type1:type2)
+        for (const QStringList &userDetails : userEntries) {
             QString username;
             bool isOnline = false;
             QString userType;
             
-            QStringList userDetails = entry.split(':');
             if (userDetails.size() >= 2) {
                 username = userDetails[0].trimmed();
                 QString statusStr = userDetails[1].trimmed();
@@ -329,7 +577,7 @@ void ChatController::processServerResponse(const QString &response)
                     tempOnlineUsernames.append(username);
                 }
             } else {
-                qDebug() << "ChatController: Malformed user entry in USERLIST:" << entry 
+                qDebug() << "ChatController: Malformed user entry in USERLIST:" << userDetails
                         << "(expected at least 2 parts, got" << userDetails.size() << ")";
             }
         }
@@ -338,10 +586,41 @@ void ChatController::processServerResponse(const QString &response)
         this->onlineUsers = tempOnlineUsernames;
         
         emit userListUpdated(this->userList);
+    } else if (command == "PRESENCE") {
+        // Входы и выходы (опция presence), по 2 поля на пользователя: правим записи, не дожидаясь
+        // полного списка. Сервер склеивает изменения за короткое окно в одно сообщение
+        if (parts.size() < 3 || parts.size() % 2 == 0) {
+            qDebug() << "ChatController: Malformed PRESENCE command:" << parts;
+            return;
+        }
+        for (int i = 1; i + 1 < parts.size(); i += 2) {
+            const QString &presenceUser = parts[i];
+            const bool isOnline = parts[i + 1] == "1";
+            const QString prefix = presenceUser + ":";
+            const QString entry = prefix + (isOnline ? "1" : "0") + ":U";
+
+            bool found = false;
+            for (QString &user : userList) {
+                // Запись "имя:статус:U[:F]"; у группы третье поле "G", её не трогаем
+                if (user.startsWith(prefix) && user.section(':', 2, 2) == "U") {
+                    user = entry + user.mid(entry.size());
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                userList.append(entry); // Зарегистрировался после того, как мы получили список
+            }
+            onlineUsers.removeAll(presenceUser);
+            if (isOnline) {
+                onlineUsers.append(presenceUser);
+            }
+        }
+        emit userListUpdated(userList);
     } else if (command == "FRIEND_STATUS" || command == "NEW_FRIEND_STATUS") {
         // Обработка статуса нового друга
         if (parts.size() < 3) {
-            qDebug() << "ChatController: Malformed FRIEND_STATUS command:" << response;
+            qDebug() << "ChatController: Malformed FRIEND_STATUS command:" << parts;
             return;
         }
         
@@ -362,7 +641,7 @@ void ChatController::processServerResponse(const QString &response)
           emit friendStatusUpdated(friendUsername, (status == "1"));    } else if (command == "PRIVATE") {
         // Обработка входящего приватного сообщения в формате PRIVATE:sender:message
         if (parts.size() < 3) {
-            qDebug() << "ChatController: Malformed PRIVATE command:" << response;
+            qDebug() << "ChatController: Malformed PRIVATE command:" << parts;
             return;
         }
         
@@ -397,7 +676,7 @@ void ChatController::processServerResponse(const QString &response)
         }}else if (command == "MESSAGE_HISTORY" || command == "HISTORY") {
         // Обработка истории сообщений
         if (parts.size() < 2) {
-            qDebug() << "ChatController: Malformed MESSAGE_HISTORY command:" << response;
+            qDebug() << "ChatController: Malformed MESSAGE_HISTORY command:" << parts;
             return;
         }
         
@@ -441,26 +720,38 @@ void ChatController::processServerResponse(const QString &response)
         }
     }
 } else if (command == "PRIVATE_HISTORY_CMD") {
+    // С номером запроса история собирается в своём буфере, без номера - в общем, как раньше
+    const auto pending = requestId != 0 ? pendingHistories.find(requestId) : pendingHistories.end();
+    const bool tracked = pending != pendingHistories.end();
+    QString &target = tracked ? pending->target : currentHistoryTarget;
+    QStringList &buffer = tracked ? pending->buffer : historyBuffer;
     if (parts.size() >= 3 && parts[1] == "BEGIN") {
         // Начало получения истории приватных сообщений
-        currentHistoryTarget = parts[2];
-        historyBuffer.clear();
-        qDebug() << "Starting to receive private history for:" << currentHistoryTarget;
+        target = parts[2];
+        buffer.clear();
+        qDebug() << "Starting to receive private history for:" << target;
     } else if (parts.size() >= 2 && parts[1] == "END") {
-        // Конец получения истории
-        qDebug() << "Finished receiving private history for:" << currentHistoryTarget;
-        if (!currentHistoryTarget.isEmpty()) {
-            emit privateHistoryReceived(currentHistoryTarget, historyBuffer);
-            currentHistoryTarget.clear();
-            historyBuffer.clear();
+        // Конец получения истории. Запись убирается до сигнала: обработчик может запросить новую историю
+        const QString finishedTarget = target;
+        const QStringList finishedBuffer = buffer;
+        target.clear();
+        buffer.clear();
+        if (tracked) {
+            pendingHistories.erase(pending);
+        }
+        qDebug() << "Finished receiving private history for:" << finishedTarget;
+        if (!finishedTarget.isEmpty()) {
+            emit privateHistoryReceived(finishedTarget, finishedBuffer);
         }
     }
 } else if (command == "PRIVATE_HISTORY_MSG") {
     // Сообщение из истории: PRIVATE_HISTORY_MSG:timestamp|sender|recipient|message_text
-    if (parts.size() >= 2 && !currentHistoryTarget.isEmpty()) {
-        // Парсим данные, разделенные символом "|"
-        QString remainingData = parts.mid(1).join(":");
-        QStringList msgParts = remainingData.split("|");
+    const auto pending = requestId != 0 ? pendingHistories.find(requestId) : pendingHistories.end();
+    const bool tracked = pending != pendingHistories.end();
+    QStringList &buffer = tracked ? pending->buffer : historyBuffer;
+    if (parts.size() >= 2 && !(tracked ? pending->target : currentHistoryTarget).isEmpty()) {
+        // В тексте данные разделены символом "|", в двоичном виде это отдельные поля
+        QStringList msgParts = typed ? parts.mid(1) : parts.mid(1).join(":").split("|");
         
         if (msgParts.size() >= 4) {
             QString timestamp = msgParts[0];
@@ -470,7 +761,7 @@ void ChatController::processServerResponse(const QString &response)
             
             // Форматируем сообщение для добавления в буфер истории, включая всю информацию
             QString formattedMessage = QString("%1|%2|%3|%4").arg(timestamp, sender, recipient, message);
-            historyBuffer.append(formattedMessage);
+            buffer.append(formattedMessage);
             
             qDebug() << "Received history message:" << formattedMessage;
         }
@@ -582,10 +873,14 @@ void ChatController::requestPrivateMessageHistory(const QString &username)
     // Очищаем буфер истории перед запросом
     historyBuffer.clear();
     currentHistoryTarget = username;
+
+    // Ответ с номером собирается отдельно от других историй, которые ещё идут
+    const quint64 requestId = nextRequestId++;
+    pendingHistories.insert(requestId, PendingHistory{username, QStringList()});
     
     // Запрашиваем историю сообщений - сервер должен вернуть все сообщения между пользователями
     // ИСПРАВЛЕНО: делаем только один запрос, сервер сам обработает историю в обе стороны
-    sendToServer(QString("GET_PRIVATE_HISTORY:%1:%2").arg(this->username, username));
+    sendToServer(QString("GET_PRIVATE_HISTORY:%1:%2").arg(this->username, username), requestId);
     
     // Обновляем интерфейс, чтобы показать, что идёт загрузка
     emit historyRequestStarted(username);
@@ -650,10 +945,27 @@ void ChatController::markMessagesAsRead(const QString &username)
     sendToServer("MARK_READ:" + username);
 }
 
+void ChatController::subscribePresence(const QString &username)
+{
+    // Старый сервер не знает команды и разослал бы её в общий чат
+    if (wireOptions.presence) {
+        sendToServer("SUBSCRIBE_PRESENCE:" + username);
+    }
+}
+
+void ChatController::unsubscribePresence(const QString &username)
+{
+    if (wireOptions.presence) {
+        sendToServer("UNSUBSCRIBE_PRESENCE:" + username);
+    }
+}
+
 void ChatController::clearSocketBuffer()
 {
-    buffer.clear();
-    nextBlockSize = 0;
+    // Вызывается во время обработки уже полученного сообщения, поэтому сам декодер не трогаем,
+    // иначе потеряем следующие кадры и собьём разбор потока
+    partialMessage.clear();
+    partialUtf8.clear();
 }
 
 void ChatController::requestUserList()
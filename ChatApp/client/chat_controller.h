@@ -6,9 +6,13 @@
 #include <QString>
 #include <QStringList>
 #include <QMap>
+#include <QHash>
+#include <QPair>
 #include <QList>
 #include <QSet>
 #include <QTimer>
+#include "chat_protocol.h"
+#include "frame_codec.h"
 
 
 class MainWindow;
@@ -66,6 +70,9 @@ public:
     void requestUnreadCounts();
     void requestUnreadCountForUser(const QString &username);
     void markMessagesAsRead(const QString &username);
+    // Статус собеседника открытого окна чата, даже если он не друг и не в общих группах
+    void subscribePresence(const QString &username);
+    void unsubscribePresence(const QString &username);
     
     // Метод для отправки произвольных сообщений на сервер
     void sendMessageToServer(const QString &message);
@@ -126,8 +133,18 @@ private:
     QString username;
     QString password;
     bool loginSuccessful;
-    QByteArray buffer;
-    quint16 nextBlockSize;
+    FrameDecoder frameDecoder;
+    WireOptions wireOptions;
+    ChatMessage incomingMessage;  // Разобранное двоичное сообщение сервера
+    ChatMessage outgoingMessage;  // Команда, переводимая в двоичный вид
+    std::string outgoingBinary;
+    CompressionStats compressionStats; // Принятые сжатые пачки: inputBytes - после разжатия, outputBytes - из сети
+    QString partialMessage;      // Сообщение, собираемое из фрагментов версии 2
+    QByteArray partialUtf8;      // То же для режима utf8
+    // Ждём ответа на HELLO, исходящие сообщения копятся в pendingMessages. Таймаута нет: сервер
+    // переключает кадры, отправив HELLO_OK, и команды в старых кадрах после этого он не поймёт
+    bool handshakePending;
+    QList<QPair<QString, quint64>> pendingMessages; // Команда и номер запроса (0 - без номера)
     QStringList recentSentMessages;
     QStringList userList;
     QStringList onlineUsers;
@@ -145,6 +162,15 @@ private:
     QStringList historyBuffer;
     QString currentHistoryTarget;
 
+    // История, запрошенная с номером запроса: у каждой свой буфер, поэтому истории нескольких
+    // чатов загружаются одновременно и ответы могут приходить в любом порядке
+    struct PendingHistory {
+        QString target;
+        QStringList buffer;
+    };
+    quint64 nextRequestId;
+    QHash<quint64, PendingHistory> pendingHistories;
+
     QTimer *newFriendStatusPollTimer;     
     QString currentlyPollingFriend;        
     int newFriendPollAttempts;             
@@ -154,8 +180,17 @@ private:
     QMap<QString, QString> lastPrivateChatTimestamps;
     QMap<QString, QString> lastGroupChatTimestamps;
 
-    void sendToServer(const QString &message);
+    void sendToServer(const QString &message, quint64 requestId = 0);
+    void writeCommand(const QString &message, quint64 requestId);
+    void writeFrames(const QString &message);
+    void writeUtf8Frames(const QByteArray &bytes);
+    void startHandshake();
+    bool handleHandshakeReply(const QString &message);
+    bool inflateBatch(std::string_view payload);
+    void finishHandshake();
     void processServerResponse(const QString &response);
+    void processBinaryServerMessage(std::string_view message);
+    void handleServerMessage(const QStringList &parts, bool typed, quint64 requestId);
     void clearSocketBuffer();
     bool isMessageDuplicate(const QString &chatId, const QString &content, bool isGroup);
     void startPollingForFriendStatus(const QString& username);
@@ -8,7 +8,11 @@ CONFIG += c++17
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+INCLUDEPATH += ../common
+
 SOURCES += \
+    ../common/chat_protocol.cpp \
+    ../common/frame_codec.cpp \
     main.cpp \
     mainwindow.cpp \
     auth_window.cpp \
@@ -23,6 +27,8 @@ SOURCES += \
     privatechat_model.cpp \
 
 HEADERS += \
+    ../common/chat_protocol.h \
+    ../common/frame_codec.h \
     mainwindow.h \
     auth_window.h \
     reg_window.h \
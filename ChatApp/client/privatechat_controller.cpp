@@ -299,6 +299,9 @@ void PrivateChatController::handleChatWindowClosed(const QString &username)
         m_chatWindows[username]->hide(); // Просто скрываем окно
         qDebug() << "Window hidden instead of destroyed for" << username;
     }
+    if (m_chatController) {
+        m_chatController->unsubscribePresence(username);
+    }
     
     // Важно: НЕ удаляем модель данных, чтобы сохранить историю
     // m_chatWindows.remove(username); - эта строка удалена!
@@ -334,6 +337,10 @@ void PrivateChatController::setupConnectionsForWindow(PrivateChatWindow *window,
     connect(window, &PrivateChatWindow::shown, this, [this, username]() {
         // При показе окна сразу помечаем как прочитанные
         markMessagesAsRead(username);
+        // и следим за статусом собеседника, пока окно открыто
+        if (m_chatController) {
+            m_chatController->subscribePresence(username);
+        }
     });
     
     qDebug() << "Setup connections for chat window with" << username;
@@ -0,0 +1,387 @@
+#include "chat_protocol.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+
+namespace {
+
+// Схема текстового вида. fields < 0 - тип только от сервера, текстовые строки с таким именем
+// сервер не разбирает. rest - последнее поле забирает остаток строки вместе с ':'.
+struct TypeInfo {
+    ChatMessageType type;
+    std::string_view name;
+    int fields;
+    bool rest;
+};
+
+constexpr TypeInfo Types[] = {
+    {ChatMessageType::Auth, "AUTH", 2, false},
+    {ChatMessageType::Register, "REGISTER", 2, false},
+    {ChatMessageType::GetUserList, "GET_USERLIST", 0, false},
+    {ChatMessageType::GetUsers, "GET_USERS", 0, false},
+    {ChatMessageType::Private, "PRIVATE", 2, true},
+    {ChatMessageType::Msg, "MSG", 2, true},
+    {ChatMessageType::GetHistory, "GET_HISTORY", 0, false},
+    {ChatMessageType::GetPrivateHistory, "GET_PRIVATE_HISTORY", 2, false},
+    {ChatMessageType::CreateGroupChat, "CREATE_GROUP_CHAT", 1, false},
+    {ChatMessageType::JoinGroupChat, "JOIN_GROUP_CHAT", 1, false},
+    {ChatMessageType::GroupMessage, "GROUP_MESSAGE", 2, true},
+    {ChatMessageType::GroupAddUser, "GROUP_ADD_USER", 2, false},
+    {ChatMessageType::GroupRemoveUser, "GROUP_REMOVE_USER", 2, false},
+    {ChatMessageType::DeleteGroupChat, "DELETE_GROUP_CHAT", 1, false},
+    {ChatMessageType::GroupGetCreator, "GROUP_GET_CREATOR", 1, false},
+    {ChatMessageType::GetGroupChats, "GET_GROUP_CHATS", 0, false},
+    {ChatMessageType::MarkRead, "MARK_READ", 1, false},
+    {ChatMessageType::GetUnreadCount, "GET_UNREAD_COUNT", 1, false},
+    {ChatMessageType::SearchUsers, "SEARCH_USERS", 1, false},
+    {ChatMessageType::AddFriend, "ADD_FRIEND", 1, false},
+    {ChatMessageType::RemoveFriend, "REMOVE_FRIEND", 1, false},
+    {ChatMessageType::GetFriends, "GET_FRIENDS", 0, false},
+    {ChatMessageType::SubscribePresence, "SUBSCRIBE_PRESENCE", 1, false},
+    {ChatMessageType::UnsubscribePresence, "UNSUBSCRIBE_PRESENCE", 1, false},
+
+    {ChatMessageType::AuthSuccess, "AUTH_SUCCESS", -1, false},
+    {ChatMessageType::AuthFailed, "AUTH_FAILED", -1, false},
+    {ChatMessageType::AuthFail, "AUTH_FAIL", -1, false},
+    {ChatMessageType::RegisterSuccess, "REGISTER_SUCCESS", -1, false},
+    {ChatMessageType::RegisterFailed, "REGISTER_FAILED", -1, false},
+    {ChatMessageType::Error, "ERROR", -1, false},
+    {ChatMessageType::RateLimited, "RATE_LIMITED", -1, false},
+    {ChatMessageType::UserList, "USERLIST", -1, false},
+    {ChatMessageType::HistoryCmd, "HISTORY_CMD", -1, false},
+    {ChatMessageType::HistoryMsg, "HISTORY_MSG", -1, false},
+    {ChatMessageType::PrivateHistoryCmd, "PRIVATE_HISTORY_CMD", -1, false},
+    {ChatMessageType::PrivateHistoryMsg, "PRIVATE_HISTORY_MSG", -1, false},
+    {ChatMessageType::GroupChatCreated, "GROUP_CHAT_CREATED", -1, false},
+    {ChatMessageType::GroupChatDeleted, "GROUP_CHAT_DELETED", -1, false},
+    {ChatMessageType::GroupChatCreator, "GROUP_CHAT_CREATOR", -1, false},
+    {ChatMessageType::GroupChatInfo, "GROUP_CHAT_INFO", -1, false},
+    {ChatMessageType::GroupHistoryBegin, "GROUP_HISTORY_BEGIN", -1, false},
+    {ChatMessageType::GroupHistoryMsg, "GROUP_HISTORY_MSG", -1, false},
+    {ChatMessageType::GroupHistoryEnd, "GROUP_HISTORY_END", -1, false},
+    {ChatMessageType::GroupChatsList, "GROUP_CHATS_LIST", -1, false},
+    {ChatMessageType::FriendAdded, "FRIEND_ADDED", -1, false},
+    {ChatMessageType::FriendAddFail, "FRIEND_ADD_FAIL", -1, false},
+    {ChatMessageType::FriendRemoved, "FRIEND_REMOVED", -1, false},
+    {ChatMessageType::FriendRemoveFail, "FRIEND_REMOVE_FAIL", -1, false},
+    {ChatMessageType::FriendsList, "FRIENDS_LIST", -1, false},
+    {ChatMessageType::SearchResults, "SEARCH_RESULTS", -1, false},
+    {ChatMessageType::UnreadCount, "UNREAD_COUNT", -1, false},
+    {ChatMessageType::Presence, "PRESENCE", -1, false},
+};
+
+constexpr std::uint8_t NoEntry = 0xFF;
+static_assert(std::size(Types) < NoEntry, "номер записи Types должен помещаться в байт");
+
+// Номер записи Types по коду типа
+constexpr std::size_t TypeCodeLimit = 128;
+
+constexpr std::array<std::uint8_t, TypeCodeLimit> buildTypeIndex() {
+    std::array<std::uint8_t, TypeCodeLimit> index{};
+    for (std::uint8_t& entry : index) {
+        entry = NoEntry;
+    }
+    for (std::size_t i = 0; i < std::size(Types); ++i) {
+        index[std::size_t(Types[i].type)] = std::uint8_t(i);
+    }
+    return index;
+}
+
+constexpr std::array<std::uint8_t, TypeCodeLimit> TypeIndex = buildTypeIndex();
+
+// Имена команд клиента ищутся совершенным хешем: при компиляции подбирается seed, при котором
+// у всех команд разные слоты. Поиск - один хеш имени и одно сравнение строк, без обхода таблицы.
+constexpr std::uint32_t commandHash(std::string_view name, std::uint32_t seed) {
+    std::uint32_t hash = 2166136261u ^ seed; // FNV-1a
+    for (char c : name) {
+        hash ^= std::uint8_t(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Слот - старшие биты хеша: от seed зависят все они, а младшие - только от младших бит seed
+constexpr unsigned CommandSlotBits = 6;
+constexpr std::size_t CommandSlots = std::size_t(1) << CommandSlotBits;
+
+constexpr std::size_t commandSlot(std::string_view name, std::uint32_t seed) {
+    return commandHash(name, seed) >> (32 - CommandSlotBits);
+}
+
+struct CommandIndex {
+    bool found = false;
+    std::uint32_t seed = 0;
+    std::array<std::uint8_t, CommandSlots> slots{};
+};
+
+constexpr CommandIndex buildCommandIndex() {
+    for (std::uint32_t seed = 0; seed < 10000; ++seed) {
+        CommandIndex index;
+        index.seed = seed;
+        for (std::uint8_t& slot : index.slots) {
+            slot = NoEntry;
+        }
+        bool collision = false;
+        for (std::size_t i = 0; i < std::size(Types) && !collision; ++i) {
+            if (Types[i].fields < 0) {
+                continue;
+            }
+            std::uint8_t& slot = index.slots[commandSlot(Types[i].name, seed)];
+            collision = slot != NoEntry;
+            slot = std::uint8_t(i);
+        }
+        if (!collision) {
+            index.found = true;
+            return index;
+        }
+    }
+    return CommandIndex();
+}
+
+constexpr CommandIndex Commands = buildCommandIndex();
+static_assert(Commands.found, "не подобран seed совершенного хеша команд");
+
+const TypeInfo* findType(ChatMessageType type) {
+    const std::size_t code = std::size_t(type);
+    if (code >= TypeCodeLimit || TypeIndex[code] == NoEntry) {
+        return nullptr;
+    }
+    return &Types[TypeIndex[code]];
+}
+
+const TypeInfo* findCommand(std::string_view name) {
+    const std::uint8_t entry = Commands.slots[commandSlot(name, Commands.seed)];
+    if (entry == NoEntry || Types[entry].name != name) {
+        return nullptr;
+    }
+    return &Types[entry];
+}
+
+std::uint64_t zigzagEncode(std::int64_t value) {
+    return (std::uint64_t(value) << 1) ^ std::uint64_t(value >> 63);
+}
+
+std::int64_t zigzagDecode(std::uint64_t value) {
+    return std::int64_t(value >> 1) ^ -std::int64_t(value & 1);
+}
+
+void appendBinaryHeader(std::string& out, ChatMessageType type, std::uint64_t requestId) {
+    out += ChatProtocol::BinaryMarker;
+    appendVarint(out, (std::uint64_t(type) << 1) | (requestId != 0 ? 1 : 0));
+    if (requestId != 0) {
+        appendVarint(out, requestId);
+    }
+}
+
+std::string_view commandPrefix(std::string_view line) {
+    return line.substr(0, line.find(':'));
+}
+
+} // namespace
+
+std::string_view chatMessageTypeName(ChatMessageType type) {
+    const TypeInfo* info = findType(type);
+    return info ? info->name : std::string_view();
+}
+
+void appendVarint(std::string& out, std::uint64_t value) {
+    char bytes[10];
+    std::size_t size = 0;
+    while (value >= 0x80) {
+        bytes[size++] = char((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    bytes[size++] = char(value);
+    out.append(bytes, size);
+}
+
+bool readVarint(std::string_view& input, std::uint64_t& value) {
+    std::uint64_t result = 0;
+    const std::size_t limit = std::min<std::size_t>(input.size(), 10);
+    for (std::size_t i = 0; i < limit; ++i) {
+        const auto byte = static_cast<unsigned char>(input[i]);
+        // Десятый байт может нести только последний бит
+        if (i == 9 && byte > 1) {
+            return false;
+        }
+        result |= std::uint64_t(byte & 0x7F) << (7 * i);
+        if ((byte & 0x80) == 0) {
+            value = result;
+            input.remove_prefix(i + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+ChatMessageWriter::ChatMessageWriter(ChatMessageType type)
+    : m_type(type), m_text(chatMessageTypeName(type)) {
+    appendBinaryHeader(m_binary, type, 0);
+    m_headerSize = m_binary.size();
+}
+
+ChatMessageWriter& ChatMessageWriter::setRequestId(std::uint64_t requestId) {
+    std::string header;
+    appendBinaryHeader(header, m_type, requestId);
+    m_binary.replace(0, m_headerSize, header);
+    m_headerSize = header.size();
+    return *this;
+}
+
+void ChatMessageWriter::appendBinaryString(std::string_view value) {
+    appendVarint(m_binary, std::uint64_t(value.size()) << 1);
+    m_binary.append(value.data(), value.size());
+}
+
+ChatMessageWriter& ChatMessageWriter::field(std::string_view value, char separator) {
+    if (separator != NoSeparator) {
+        m_text += separator;
+    }
+    m_text.append(value.data(), value.size());
+    appendBinaryString(value);
+    return *this;
+}
+
+ChatMessageWriter& ChatMessageWriter::number(std::int64_t value, char separator) {
+    if (separator != NoSeparator) {
+        m_text += separator;
+    }
+    m_text += std::to_string(value);
+    value = std::clamp(value, ChatProtocol::MinFieldNumber, ChatProtocol::MaxFieldNumber);
+    appendVarint(m_binary, (zigzagEncode(value) << 1) | 1);
+    return *this;
+}
+
+ChatMessageWriter& ChatMessageWriter::textOnly(std::string_view raw) {
+    m_text.append(raw.data(), raw.size());
+    return *this;
+}
+
+ChatMessageWriter& ChatMessageWriter::binaryOnly(std::string_view value) {
+    appendBinaryString(value);
+    return *this;
+}
+
+void ChatMessage::reset(ChatMessageType type, std::string_view name, bool binary) {
+    m_type = type;
+    m_name = name;
+    m_binary = binary;
+    m_requestId = 0;
+    m_fields.clear();
+}
+
+std::int64_t ChatMessage::number(std::size_t index, std::int64_t fallback) const {
+    const Field& field = m_fields[index];
+    if (field.isNumber) {
+        return field.number;
+    }
+    std::int64_t value = 0;
+    const char* end = field.text.data() + field.text.size();
+    const auto result = std::from_chars(field.text.data(), end, value);
+    return result.ec == std::errc() && result.ptr == end ? value : fallback;
+}
+
+bool parseBinaryChatMessage(std::string_view message, ChatMessage& out) {
+    if (!isBinaryChatMessage(message)) {
+        return false;
+    }
+    std::string_view input = message.substr(1);
+    std::uint64_t header = 0;
+    if (!readVarint(input, header) || (header >> 1) > 0xFFFF) {
+        return false;
+    }
+    const std::uint64_t code = header >> 1;
+    std::uint64_t requestId = 0;
+    if ((header & 1) && (!readVarint(input, requestId) || requestId == 0)) {
+        return false;
+    }
+    const auto type = ChatMessageType(code);
+    const TypeInfo* info = type == ChatMessageType::Text ? nullptr : findType(type);
+    if (type != ChatMessageType::Text && !info) {
+        return false;
+    }
+    out.reset(type, info ? info->name : std::string_view(), true);
+    out.m_requestId = requestId;
+
+    while (!input.empty()) {
+        if (!readVarint(input, header)) {
+            return false;
+        }
+        ChatMessage::Field field;
+        if (header & 1) {
+            field.isNumber = true;
+            field.number = zigzagDecode(header >> 1);
+        } else {
+            const std::uint64_t size = header >> 1;
+            if (size > input.size()) {
+                return false;
+            }
+            field.text = input.substr(0, std::size_t(size));
+            input.remove_prefix(std::size_t(size));
+        }
+        out.m_fields.push_back(field);
+    }
+
+    if (type == ChatMessageType::Text) {
+        if (out.m_fields.size() != 1 || out.m_fields[0].isNumber) {
+            return false;
+        }
+        out.m_name = commandPrefix(out.m_fields[0].text);
+    }
+    return true;
+}
+
+void parseTextChatCommand(std::string_view line, ChatMessage& out) {
+    const std::string_view name = commandPrefix(line);
+    const TypeInfo* info = findCommand(name);
+    if (info) {
+        out.reset(info->type, name, false);
+        std::string_view rest = line.substr(name.size());
+        for (int i = 0; i < info->fields; ++i) {
+            if (rest.empty()) {
+                break; // Поля кончились раньше схемы
+            }
+            rest.remove_prefix(1); // ':'
+            ChatMessage::Field field;
+            if (info->rest && i + 1 == info->fields) {
+                field.text = rest;
+                rest = std::string_view();
+            } else {
+                const std::size_t colon = rest.find(':');
+                field.text = rest.substr(0, colon);
+                rest = colon == std::string_view::npos ? std::string_view() : rest.substr(colon);
+            }
+            out.m_fields.push_back(field);
+        }
+        if (out.m_fields.size() == std::size_t(info->fields)) {
+            return;
+        }
+    }
+
+    out.reset(ChatMessageType::Text, name, false);
+    ChatMessage::Field field;
+    field.text = line;
+    out.m_fields.push_back(field);
+}
+
+bool parseChatMessage(std::string_view message, ChatMessage& out) {
+    if (isBinaryChatMessage(message)) {
+        return parseBinaryChatMessage(message, out);
+    }
+    parseTextChatCommand(message, out);
+    return true;
+}
+
+void appendBinaryChatMessage(std::string& out, const ChatMessage& message, std::uint64_t requestId) {
+    appendBinaryHeader(out, message.type(), requestId);
+    for (std::size_t i = 0; i < message.size(); ++i) {
+        const ChatMessage::Field& field = message.at(i);
+        if (field.isNumber) {
+            appendVarint(out, (zigzagEncode(field.number) << 1) | 1);
+        } else {
+            appendVarint(out, std::uint64_t(field.text.size()) << 1);
+            out.append(field.text.data(), field.text.size());
+        }
+    }
+}
@@ -0,0 +1,197 @@
+#ifndef CHAT_PROTOCOL_H
+#define CHAT_PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Сообщения чата, общие для клиента и сервера.
+//
+// Текстовый вид (старый): "КОМАНДА:поле:поле...". Двоеточие в поле не экранируется, поэтому
+// у команд с текстом сообщения последнее поле забирает остаток строки, а у остальных лишние
+// поля отбрасываются - ровно как это всегда делал сервер.
+//
+// Двоичный вид (опция binary, frame_codec.h): нулевой байт, varint (код типа << 1 | r), при r = 1
+// varint номера запроса, и поля подряд.
+// Каждое поле начинается с varint h: чётное h - строка длиной h >> 1 байт, которая идёт следом;
+// нечётное h - целое (h >> 1) в zigzag-кодировании. Длина явная, поэтому ':', '|' и ',' в полях
+// ничего не ломают, а разбор сводится к чтению varint и view на байты сообщения.
+// Нулевой байт никогда не начинает текстовую строку, так что оба вида идут по одному соединению:
+// PING/PONG и прочие служебные строки остаются текстовыми.
+//
+// Списки (USERLIST, GROUP_CHATS_LIST, FRIENDS_LIST и т.п.) в двоичном виде - просто
+// последовательность полей без разделителей.
+//
+// Номер запроса выбирает клиент. Сервер повторяет его во всём, что отправляет этому клиенту
+// в ответ на команду, поэтому клиент может держать много запросов сразу и сопоставлять ответы
+// с запросами, не полагаясь на порядок. Уведомления (сообщения других пользователей, рассылки)
+// идут без номера. В текстовом виде номера нет: старым клиентам ответы приходят как раньше.
+namespace ChatProtocol {
+
+constexpr char BinaryMarker = '\0';
+
+// Целые в поле помещаются в 62 бита со знаком
+constexpr std::int64_t MaxFieldNumber = (std::int64_t(1) << 61) - 1;
+constexpr std::int64_t MinFieldNumber = -MaxFieldNumber - 1;
+
+} // namespace ChatProtocol
+
+enum class ChatMessageType : std::uint16_t {
+    Unknown = 0,
+    // Строка без команды: сообщение в общий чат. Поле 0 - вся строка
+    Text = 1,
+
+    // Команды клиента
+    Auth = 16,              // username, password
+    Register,               // username, password
+    GetUserList,
+    GetUsers,
+    Private,                // получатель, текст; от сервера: отправитель, текст
+    Msg,                    // получатель, текст
+    GetHistory,
+    GetPrivateHistory,      // user1, user2
+    CreateGroupChat,        // имя
+    JoinGroupChat,          // id
+    GroupMessage,           // id, текст; от сервера: id, отправитель, текст
+    GroupAddUser,           // id, username
+    GroupRemoveUser,        // id, username
+    DeleteGroupChat,        // id
+    GroupGetCreator,        // id
+    GetGroupChats,
+    MarkRead,               // собеседник
+    GetUnreadCount,         // собеседник
+    SearchUsers,            // образец
+    AddFriend,              // username
+    RemoveFriend,           // username
+    GetFriends,
+    SubscribePresence,      // username: окно чата открыто, нужны PRESENCE этого пользователя
+    UnsubscribePresence,    // username
+
+    // Ответы сервера
+    AuthSuccess = 64,
+    AuthFailed,             // [причина]
+    AuthFail,               // причина
+    RegisterSuccess,
+    RegisterFailed,         // причина
+    Error,                  // текст
+    RateLimited,            // имя предела
+    UserList,               // по 4 поля на запись: имя или id, в сети (число), "U" или "G", "F" / "" / имя группы
+    HistoryCmd,             // "BEGIN" или "END"
+    HistoryMsg,             // время, отправитель, текст
+    PrivateHistoryCmd,      // "BEGIN", собеседник или "END"
+    PrivateHistoryMsg,      // время, отправитель, получатель, текст
+    GroupChatCreated,       // id, имя
+    GroupChatDeleted,       // id
+    GroupChatCreator,       // id, создатель
+    GroupChatInfo,          // id, имя, участники...
+    GroupHistoryBegin,      // id
+    GroupHistoryMsg,        // id, время, отправитель, текст
+    GroupHistoryEnd,        // id
+    GroupChatsList,         // по 2 поля на чат: id, имя
+    FriendAdded,            // username
+    FriendAddFail,          // username
+    FriendRemoved,          // username
+    FriendRemoveFail,       // username
+    FriendsList,            // имена...
+    SearchResults,          // имена...
+    UnreadCount,            // собеседник, число
+    Presence                // по 2 поля на пользователя: username, в сети (число); только клиентам с опцией presence
+};
+
+// Имя типа в текстовом виде ("AUTH", "USERLIST"...), пусто для Unknown и Text
+std::string_view chatMessageTypeName(ChatMessageType type);
+
+// LEB128 без знака: 7 бит на байт, старший бит - продолжение
+void appendVarint(std::string& out, std::uint64_t value);
+// Читает varint из начала input и сдвигает input за него; false - обрыв или больше 64 бит
+bool readVarint(std::string_view& input, std::uint64_t& value);
+
+inline bool isBinaryChatMessage(std::string_view message) {
+    return !message.empty() && message.front() == ChatProtocol::BinaryMarker;
+}
+
+// Собирает сообщение сразу в обоих видах: отправитель выбирает вид по согласованным опциям
+// получателя. Текстовый вид повторяет старый формат байт в байт, поэтому для каждого поля
+// задаётся разделитель перед ним (NoSeparator - без разделителя).
+class ChatMessageWriter {
+public:
+    static constexpr char NoSeparator = '\0';
+
+    explicit ChatMessageWriter(ChatMessageType type);
+
+    // Номер запроса, на который отвечает сообщение (только двоичный вид); 0 - без номера
+    ChatMessageWriter& setRequestId(std::uint64_t requestId);
+
+    ChatMessageWriter& field(std::string_view value, char separator = ':');
+    ChatMessageWriter& number(std::int64_t value, char separator = ':');
+    // Кусок только текстового вида (например, ':' перед пустым списком)
+    ChatMessageWriter& textOnly(std::string_view raw);
+    // Поле только двоичного вида: в тексте его отсутствие передаётся форматом записи
+    ChatMessageWriter& binaryOnly(std::string_view value);
+
+    ChatMessageType type() const { return m_type; }
+    const std::string& text() const { return m_text; }
+    const std::string& binary() const { return m_binary; }
+    std::string takeText() { return std::move(m_text); }
+    std::string takeBinary() { return std::move(m_binary); }
+
+private:
+    void appendBinaryString(std::string_view value);
+
+    ChatMessageType m_type;
+    std::string m_text;
+    std::string m_binary;
+    std::size_t m_headerSize = 0; // Маркер, тип и номер запроса в начале m_binary
+};
+
+// Разобранное сообщение: поля - view на байты исходного сообщения, которое должно жить дольше.
+// Объект рассчитан на повторное использование: память под поля не освобождается между разборами.
+class ChatMessage {
+public:
+    struct Field {
+        std::string_view text;
+        std::int64_t number = 0;
+        bool isNumber = false;
+    };
+
+    ChatMessageType type() const { return m_type; }
+    // Имя команды; у Text - начало строки до ':', как его видел старый сервер
+    std::string_view name() const { return m_name; }
+    bool binary() const { return m_binary; }
+    // Номер запроса из двоичного сообщения, 0 - без номера
+    std::uint64_t requestId() const { return m_requestId; }
+
+    std::size_t size() const { return m_fields.size(); }
+    const Field& at(std::size_t index) const { return m_fields[index]; }
+    // Текст поля; у числового поля пусто
+    std::string_view text(std::size_t index) const { return m_fields[index].text; }
+    // Число поля; текстовое поле разбирается как десятичное, при ошибке - fallback
+    std::int64_t number(std::size_t index, std::int64_t fallback = 0) const;
+
+private:
+    friend bool parseBinaryChatMessage(std::string_view message, ChatMessage& out);
+    friend void parseTextChatCommand(std::string_view line, ChatMessage& out);
+
+    void reset(ChatMessageType type, std::string_view name, bool binary);
+
+    ChatMessageType m_type = ChatMessageType::Unknown;
+    std::string_view m_name;
+    bool m_binary = false;
+    std::uint64_t m_requestId = 0;
+    std::vector<Field> m_fields;
+};
+
+// Двоичное сообщение; false - повреждено или неизвестного типа
+bool parseBinaryChatMessage(std::string_view message, ChatMessage& out);
+// Текстовая строка по схеме команд клиента. Неизвестная команда или команда без нужных полей
+// становится Text - старый сервер рассылал такие строки в общий чат.
+void parseTextChatCommand(std::string_view line, ChatMessage& out);
+// Любой из двух видов; false - двоичное сообщение повреждено
+bool parseChatMessage(std::string_view message, ChatMessage& out);
+
+// Двоичный вид разобранного сообщения (дописывается в out), requestId - номер запроса или 0
+void appendBinaryChatMessage(std::string& out, const ChatMessage& message, std::uint64_t requestId = 0);
+
+#endif // CHAT_PROTOCOL_H
@@ -0,0 +1,444 @@
+#include "frame_codec.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+namespace {
+
+bool parseOptionsAfter(std::string_view message, std::string_view command, WireOptions& options) {
+    if (message.size() <= command.size() || message.compare(0, command.size(), command) != 0 || message[command.size()] != ':') {
+        return false;
+    }
+    std::string_view rest = message.substr(command.size() + 1);
+    std::string_view versionField = rest;
+    std::string_view features;
+    const std::size_t end = rest.find(':');
+    if (end != std::string_view::npos) {
+        versionField = rest.substr(0, end);
+        features = rest.substr(end + 1);
+    }
+
+    int parsed = 0;
+    const auto result = std::from_chars(versionField.data(), versionField.data() + versionField.size(), parsed);
+    if (result.ec != std::errc() || result.ptr != versionField.data() + versionField.size() || parsed < FrameProtocol::LegacyVersion) {
+        return false;
+    }
+
+    WireOptions parsedOptions;
+    parsedOptions.version = parsed;
+    while (!features.empty()) {
+        const std::size_t comma = features.find(',');
+        const std::string_view feature = features.substr(0, comma);
+        if (feature == FrameProtocol::FeatureUtf8) {
+            parsedOptions.utf8 = true;
+        } else if (feature == FrameProtocol::FeatureDeflate) {
+            parsedOptions.deflate = true;
+        } else if (feature == FrameProtocol::FeatureHeartbeat) {
+            parsedOptions.heartbeat = true;
+        } else if (feature == FrameProtocol::FeatureBinary) {
+            parsedOptions.binary = true;
+        } else if (feature == FrameProtocol::FeaturePresence) {
+            parsedOptions.presence = true;
+        }
+        features = comma == std::string_view::npos ? std::string_view() : features.substr(comma + 1);
+    }
+    options = parsedOptions;
+    return true;
+}
+
+std::string buildOptions(std::string_view command, const WireOptions& options) {
+    std::string message(command);
+    message += ":" + std::to_string(options.version);
+    char separator = ':';
+    if (options.utf8) {
+        message += separator;
+        message += FrameProtocol::FeatureUtf8;
+        separator = ',';
+    }
+    if (options.deflate) {
+        message += separator;
+        message += FrameProtocol::FeatureDeflate;
+        separator = ',';
+    }
+    if (options.heartbeat) {
+        message += separator;
+        message += FrameProtocol::FeatureHeartbeat;
+        separator = ',';
+    }
+    if (options.binary) {
+        message += separator;
+        message += FrameProtocol::FeatureBinary;
+        separator = ',';
+    }
+    if (options.presence) {
+        message += separator;
+        message += FrameProtocol::FeaturePresence;
+    }
+    return message;
+}
+
+} // namespace
+
+std::size_t frameHeaderSize(int version) {
+    return version >= FrameProtocol::StreamVersion ? FrameProtocol::StreamHeaderSize : FrameProtocol::LegacyHeaderSize;
+}
+
+std::size_t encodeFrameHeader(char* out, int version, std::size_t payloadSize, bool more) {
+    unsigned char* p = reinterpret_cast<unsigned char*>(out);
+    if (version >= FrameProtocol::StreamVersion) {
+        const auto length = static_cast<std::uint32_t>(payloadSize);
+        p[0] = static_cast<unsigned char>(length >> 24);
+        p[1] = static_cast<unsigned char>(length >> 16);
+        p[2] = static_cast<unsigned char>(length >> 8);
+        p[3] = static_cast<unsigned char>(length);
+        p[4] = more ? FrameProtocol::FlagMore : 0;
+        return FrameProtocol::StreamHeaderSize;
+    }
+    const auto length = static_cast<std::uint16_t>(payloadSize);
+    p[0] = static_cast<unsigned char>(length >> 8);
+    p[1] = static_cast<unsigned char>(length);
+    return FrameProtocol::LegacyHeaderSize;
+}
+
+std::size_t encodeCompressedFrameHeader(char* out, std::size_t payloadSize) {
+    encodeFrameHeader(out, FrameProtocol::StreamVersion, payloadSize, false);
+    out[4] = static_cast<char>(FrameProtocol::FlagCompressed);
+    return FrameProtocol::StreamHeaderSize;
+}
+
+std::size_t compressionBatchSize(std::string_view frames, std::size_t limit) {
+    const auto* p = reinterpret_cast<const unsigned char*>(frames.data());
+    std::size_t size = 0;
+    while (frames.size() - size >= FrameProtocol::StreamHeaderSize) {
+        const std::size_t length = (std::size_t(p[size]) << 24) | (std::size_t(p[size + 1]) << 16)
+                                 | (std::size_t(p[size + 2]) << 8) | std::size_t(p[size + 3]);
+        const std::size_t frameSize = FrameProtocol::StreamHeaderSize + length;
+        if (frameSize > frames.size() - size || size + frameSize > limit) {
+            break;
+        }
+        size += frameSize;
+    }
+    return size;
+}
+
+bool parseHello(std::string_view message, WireOptions& options) {
+    return parseOptionsAfter(message, FrameProtocol::HelloCommand, options);
+}
+
+bool parseHelloReply(std::string_view message, WireOptions& options) {
+    return parseOptionsAfter(message, FrameProtocol::HelloReply, options);
+}
+
+std::string buildHello(const WireOptions& options) {
+    return buildOptions(FrameProtocol::HelloCommand, options);
+}
+
+std::string buildHelloReply(const WireOptions& options) {
+    return buildOptions(FrameProtocol::HelloReply, options);
+}
+
+WireOptions negotiateWireOptions(const WireOptions& requested) {
+    WireOptions accepted;
+    accepted.version = requested.version < FrameProtocol::StreamVersion ? requested.version : FrameProtocol::StreamVersion;
+    // UTF-8 описан только для кадров версии 2
+    accepted.utf8 = requested.utf8 && accepted.version >= FrameProtocol::StreamVersion;
+    // Сжатые пачки - тоже кадры версии 2
+    accepted.deflate = requested.deflate && accepted.version >= FrameProtocol::StreamVersion;
+    accepted.heartbeat = requested.heartbeat;
+    // Типизированные сообщения идут сырыми байтами, это возможно только в кадрах UTF-8
+    accepted.binary = requested.binary && accepted.utf8;
+    accepted.presence = requested.presence;
+    return accepted;
+}
+
+std::u16string utf8ToUtf16(std::string_view text) {
+    std::u16string result;
+    result.reserve(text.size());
+    std::size_t i = 0;
+    while (i < text.size()) {
+        const auto lead = static_cast<unsigned char>(text[i]);
+        char32_t codePoint = 0xFFFD;
+        std::size_t length = 1;
+        if (lead < 0x80) {
+            codePoint = lead;
+        } else if ((lead >> 5) == 0x6) {
+            length = 2;
+            codePoint = lead & 0x1F;
+        } else if ((lead >> 4) == 0xE) {
+            length = 3;
+            codePoint = lead & 0x0F;
+        } else if ((lead >> 3) == 0x1E) {
+            length = 4;
+            codePoint = lead & 0x07;
+        } else {
+            length = 0; // Неожиданный байт, заменяем на U+FFFD
+        }
+
+        if (length > 1) {
+            bool valid = i + length <= text.size();
+            for (std::size_t k = 1; valid && k < length; ++k) {
+                const auto next = static_cast<unsigned char>(text[i + k]);
+                valid = (next >> 6) == 0x2;
+                codePoint = (codePoint << 6) | (next & 0x3F);
+            }
+            if (!valid || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+                codePoint = 0xFFFD;
+                length = 1;
+            }
+        } else if (length == 0) {
+            codePoint = 0xFFFD;
+            length = 1;
+        }
+
+        if (codePoint >= 0x10000) {
+            codePoint -= 0x10000;
+            result.push_back(static_cast<char16_t>(0xD800 + (codePoint >> 10)));
+            result.push_back(static_cast<char16_t>(0xDC00 + (codePoint & 0x3FF)));
+        } else {
+            result.push_back(static_cast<char16_t>(codePoint));
+        }
+        i += length;
+    }
+    return result;
+}
+
+std::string utf16ToUtf8(std::u16string_view text) {
+    std::string result;
+    result.reserve(text.size());
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        char32_t codePoint = text[i];
+        if (codePoint >= 0xD800 && codePoint <= 0xDBFF && i + 1 < text.size()
+            && text[i + 1] >= 0xDC00 && text[i + 1] <= 0xDFFF) {
+            codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (text[i + 1] - 0xDC00);
+            ++i;
+        } else if (codePoint >= 0xD800 && codePoint <= 0xDFFF) {
+            codePoint = 0xFFFD; // Одиночный суррогат
+        }
+
+        if (codePoint < 0x80) {
+            result.push_back(static_cast<char>(codePoint));
+        } else if (codePoint < 0x800) {
+            result.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+            result.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        } else if (codePoint < 0x10000) {
+            result.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+            result.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+            result.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        } else {
+            result.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+            result.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+            result.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+            result.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+    }
+    return result;
+}
+
+void appendQStringPayload(std::string& out, std::u16string_view text) {
+    const auto byteLength = static_cast<std::uint32_t>(text.size() * 2);
+    out.push_back(static_cast<char>(byteLength >> 24));
+    out.push_back(static_cast<char>(byteLength >> 16));
+    out.push_back(static_cast<char>(byteLength >> 8));
+    out.push_back(static_cast<char>(byteLength));
+    for (const char16_t unit : text) {
+        out.push_back(static_cast<char>(unit >> 8));
+        out.push_back(static_cast<char>(unit & 0xFF));
+    }
+}
+
+bool qStringPayloadUnits(std::string_view payload, std::string_view& units) {
+    if (payload.size() < 4) {
+        return false;
+    }
+    const auto* p = reinterpret_cast<const unsigned char*>(payload.data());
+    const std::uint32_t byteLength = (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16)
+                                   | (std::uint32_t(p[2]) << 8) | std::uint32_t(p[3]);
+    if (byteLength == 0xFFFFFFFFu) {
+        units = std::string_view(); // Нулевая QString
+        return true;
+    }
+    if (byteLength % 2 != 0 || byteLength > payload.size() - 4) {
+        return false;
+    }
+    units = payload.substr(4, byteLength);
+    return true;
+}
+
+void decodeUtf16Be(std::string_view units, char16_t* out) {
+    const auto* p = reinterpret_cast<const unsigned char*>(units.data());
+    for (std::size_t i = 0; i + 1 < units.size(); i += 2) {
+        *out++ = static_cast<char16_t>((p[i] << 8) | p[i + 1]);
+    }
+}
+
+bool decodeQStringPayload(std::string_view payload, std::u16string& text) {
+    std::string_view units;
+    if (!qStringPayloadUnits(payload, units)) {
+        return false;
+    }
+    const std::size_t offset = text.size();
+    text.resize(offset + units.size() / 2);
+    decodeUtf16Be(units, text.data() + offset);
+    return true;
+}
+
+std::size_t appendMessageFrames(std::string& out, const WireOptions& options, std::string_view message) {
+    char header[FrameProtocol::StreamHeaderSize];
+    if (options.version < FrameProtocol::StreamVersion) {
+        const std::u16string text = utf8ToUtf16(message);
+        const std::size_t payloadSize = 4 + text.size() * 2;
+        if (payloadSize > FrameProtocol::LegacyMaxPayload) {
+            return 0;
+        }
+        out.append(header, encodeFrameHeader(header, FrameProtocol::LegacyVersion, payloadSize, false));
+        appendQStringPayload(out, text);
+        return 1;
+    }
+
+    std::size_t frames = 0;
+    if (options.utf8) {
+        std::size_t offset = 0;
+        do {
+            const std::size_t count = std::min(FrameProtocol::MaxChunkSize, message.size() - offset);
+            const bool more = offset + count < message.size();
+            out.append(header, encodeFrameHeader(header, FrameProtocol::StreamVersion, count, more));
+            out.append(message.data() + offset, count);
+            offset += count;
+            ++frames;
+        } while (offset < message.size());
+        return frames;
+    }
+
+    // Фрагменты режутся по символам UTF-16, как это делает QString::mid на стороне Qt
+    const std::u16string text = utf8ToUtf16(message);
+    const std::size_t unitsPerChunk = FrameProtocol::MaxChunkSize / 2;
+    std::size_t offset = 0;
+    do {
+        const std::size_t count = std::min(unitsPerChunk, text.size() - offset);
+        const bool more = offset + count < text.size();
+        out.append(header, encodeFrameHeader(header, FrameProtocol::StreamVersion, 4 + count * 2, more));
+        appendQStringPayload(out, std::u16string_view(text).substr(offset, count));
+        offset += count;
+        ++frames;
+    } while (offset < text.size());
+    return frames;
+}
+
+namespace {
+
+// Столько выделяется при первом чтении: хватает на пачку небольших сообщений
+constexpr std::size_t DecoderInitialCapacity = 4096;
+
+} // namespace
+
+FrameDecoder::FrameDecoder(int version)
+    : m_version(version) {
+}
+
+void FrameDecoder::setVersion(int version) {
+    m_version = version;
+}
+
+void FrameDecoder::append(const char* data, std::size_t size) {
+    if (size == 0) {
+        return;
+    }
+    std::memcpy(prepare(size), data, size);
+    commit(size);
+}
+
+char* FrameDecoder::prepare(std::size_t size) {
+    if (m_readPos == m_writePos) {
+        // Всё разобрано: пишем с начала, ничего не сдвигая
+        m_readPos = 0;
+        m_writePos = 0;
+        m_insertedEnd = 0;
+    }
+    if (m_capacity - m_writePos < size) {
+        relocate(0, size);
+    }
+    return m_buffer.get() + m_writePos;
+}
+
+void FrameDecoder::insert(const char* data, std::size_t size) {
+    if (size == 0) {
+        return;
+    }
+    if (m_readPos < size) {
+        relocate(size, 0);
+    }
+    m_readPos -= size;
+    std::memcpy(m_buffer.get() + m_readPos, data, size);
+    m_insertedEnd = m_readPos + size;
+}
+
+FrameDecoder::Result FrameDecoder::next(std::string_view& payload, bool& more) {
+    const std::size_t available = m_writePos - m_readPos;
+    const std::size_t headerSize = frameHeaderSize(m_version);
+    if (available < headerSize) {
+        return Result::NeedMoreData;
+    }
+
+    const auto* p = reinterpret_cast<const unsigned char*>(m_buffer.get() + m_readPos);
+    std::size_t length = 0;
+    bool compressed = false;
+    more = false;
+    if (m_version >= FrameProtocol::StreamVersion) {
+        length = (std::size_t(p[0]) << 24) | (std::size_t(p[1]) << 16) | (std::size_t(p[2]) << 8) | std::size_t(p[3]);
+        const std::uint8_t flags = p[4];
+        if ((flags & ~FrameProtocol::KnownFlags) != 0 || length > FrameProtocol::MaxFrameSize) {
+            return Result::Error;
+        }
+        more = (flags & FrameProtocol::FlagMore) != 0;
+        compressed = (flags & FrameProtocol::FlagCompressed) != 0;
+        if (compressed && (!m_compressedAllowed || more || m_readPos < m_insertedEnd)) {
+            return Result::Error;
+        }
+    } else {
+        length = (std::size_t(p[0]) << 8) | std::size_t(p[1]);
+    }
+
+    if (available - headerSize < length) {
+        return Result::NeedMoreData;
+    }
+
+    payload = std::string_view(m_buffer.get() + m_readPos + headerSize, length);
+    m_readPos += headerSize + length;
+    return compressed ? Result::Compressed : Result::Frame;
+}
+
+void FrameDecoder::reset() {
+    m_readPos = 0;
+    m_writePos = 0;
+    m_insertedEnd = 0;
+}
+
+void FrameDecoder::release() {
+    if (bufferedBytes() == 0) {
+        m_buffer.reset();
+        m_capacity = 0;
+        reset();
+    }
+}
+
+void FrameDecoder::relocate(std::size_t headroom, std::size_t tailroom) {
+    const std::size_t pending = bufferedBytes();
+    const std::size_t required = headroom + pending + tailroom;
+    if (required > m_capacity) {
+        std::size_t capacity = std::max(m_capacity * 2, DecoderInitialCapacity);
+        while (capacity < required) {
+            capacity *= 2;
+        }
+        std::unique_ptr<char[]> buffer(new char[capacity]);
+        if (pending != 0) {
+            std::memcpy(buffer.get() + headroom, m_buffer.get() + m_readPos, pending);
+        }
+        m_buffer = std::move(buffer);
+        m_capacity = capacity;
+    } else if (pending != 0 && headroom != m_readPos) {
+        std::memmove(m_buffer.get() + headroom, m_buffer.get() + m_readPos, pending);
+    }
+    m_insertedEnd = m_insertedEnd > m_readPos ? m_insertedEnd - m_readPos + headroom : 0;
+    m_readPos = headroom;
+    m_writePos = headroom + pending;
+}
@@ -0,0 +1,200 @@
+#ifndef FRAME_CODEC_H
+#define FRAME_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Форматы кадров, общие для клиента и сервера.
+//
+// Версия 1 (legacy): quint16 длина (big-endian) + строка, сериализованная через QDataStream.
+// Размер кадра ограничен 64 КиБ, поэтому используется только до согласования версии.
+//
+// Версия 2 (stream): quint32 длина (big-endian) + байт флагов + фрагмент сообщения.
+// Большое сообщение передаётся цепочкой кадров: у всех кадров, кроме последнего,
+// выставлен FlagMore, поэтому ни отправителю, ни получателю не нужен кадр целиком.
+//
+// Версия согласуется первым сообщением клиента "HELLO:<версия>[:<опция>,<опция>...]"
+// (в формате версии 1). Сервер отвечает "HELLO_OK:<версия>[:<принятые опции>]" тоже в формате
+// версии 1, после чего обе стороны переключаются. Старый сервер на HELLO отвечает ошибкой,
+// и клиент остаётся на версии 1.
+//
+// Опции версии 2:
+//   utf8 - полезная нагрузка кадра содержит сырые байты UTF-8 вместо QDataStream-строки (UTF-16).
+//   deflate - сервер может слать пачку подряд идущих кадров одним кадром с FlagCompressed.
+//     Его нагрузка в формате qCompress (quint32 BE размер исходных байт + поток zlib) и разжимается
+//     в обычные кадры версии 2, которые разбираются так, будто пришли из сокета. Вложенных сжатых
+//     кадров не бывает, клиент серверу сжатые кадры не шлёт.
+//   heartbeat - клиент отвечает "PONG" на "PING" сервера. Сервер шлёт PING замолчавшему клиенту
+//     и закрывает соединение, если ответа нет. Согласуется и в версии 1.
+//   binary - команды и ответы могут идти типизированными двоичными сообщениями (chat_protocol.h)
+//     вперемешку с текстовыми строками. Только вместе с utf8.
+//   presence - клиент понимает "PRESENCE:имя:0|1": о входе и выходе других пользователей сервер
+//     сообщает одной строкой, а полный USERLIST шлёт только при входе и по запросу. Не зависит от
+//     формата кадров и согласуется и в версии 1.
+namespace FrameProtocol {
+
+constexpr int LegacyVersion = 1;
+constexpr int StreamVersion = 2;
+
+constexpr std::size_t LegacyHeaderSize = 2;
+constexpr std::size_t StreamHeaderSize = 5;
+constexpr std::size_t LegacyMaxPayload = 0xFFFF;
+
+constexpr std::uint8_t FlagMore = 0x01;
+constexpr std::uint8_t FlagCompressed = 0x02;
+constexpr std::uint8_t KnownFlags = FlagMore | FlagCompressed;
+
+// Размер фрагмента, на который отправитель режет большие сообщения
+constexpr std::size_t MaxChunkSize = 32 * 1024;
+// Всё, что больше, считаем мусором в потоке
+constexpr std::size_t MaxFrameSize = 1024 * 1024;
+// Ограничение на размер сообщения, собранного из фрагментов. Фрагменты избавляют от кадра
+// целиком только отправителя: получатель (WireSession и QtNetworkClientAdapter на сервере,
+// ChatController на клиенте) собирает сообщение полностью и лишь потом разбирает, так что это и
+// предел памяти на приём по одному соединению. Больше всего весит USERLIST со всеми
+// пользователями, около 20 байт на запись; история приходит построчно, по сообщению на строку.
+constexpr std::size_t MaxMessageSize = 64 * 1024 * 1024;
+
+// Пачки меньше этого не сжимаются: заголовки съедят выигрыш
+constexpr std::size_t MinCompressedBatch = 1024;
+// Столько байт кадров отправитель сжимает в одну пачку; разжатая пачка не может быть больше MaxFrameSize
+constexpr std::size_t MaxCompressedBatch = 256 * 1024;
+
+constexpr std::string_view HelloCommand = "HELLO";
+constexpr std::string_view HelloReply = "HELLO_OK";
+
+constexpr std::string_view FeatureUtf8 = "utf8";
+constexpr std::string_view FeatureDeflate = "deflate";
+constexpr std::string_view FeatureHeartbeat = "heartbeat";
+// Команды и ответы в типизированном двоичном виде (chat_protocol.h) вместе с текстовыми строками
+constexpr std::string_view FeatureBinary = "binary";
+constexpr std::string_view FeaturePresence = "presence";
+
+constexpr std::string_view PingMessage = "PING";
+constexpr std::string_view PongMessage = "PONG";
+
+} // namespace FrameProtocol
+
+// Параметры соединения, согласованные через HELLO
+struct WireOptions {
+    int version = FrameProtocol::LegacyVersion;
+    bool utf8 = false;
+    bool deflate = false;
+    bool heartbeat = false;
+    bool binary = false;
+    bool presence = false;
+};
+
+// Счётчики сжатия пачек кадров (опция deflate): сколько сэкономлено и во что это обошлось
+struct CompressionStats {
+    std::uint64_t batches = 0;      // Пачек, ушедших сжатыми
+    std::uint64_t skipped = 0;      // Пачек, ушедших как есть: слишком малы или не сжались
+    std::uint64_t inputBytes = 0;   // Байт кадров до сжатия
+    std::uint64_t outputBytes = 0;  // Байт, ушедших в сокет вместо них
+    std::uint64_t cpuNanos = 0;     // Время в zlib
+
+    double ratio() const { return outputBytes ? double(inputBytes) / double(outputBytes) : 0.0; }
+    void add(const CompressionStats& other) {
+        batches += other.batches;
+        skipped += other.skipped;
+        inputBytes += other.inputBytes;
+        outputBytes += other.outputBytes;
+        cpuNanos += other.cpuNanos;
+    }
+};
+
+std::size_t frameHeaderSize(int version);
+
+// Записывает заголовок кадра в out (не меньше frameHeaderSize(version) байт), возвращает его размер
+std::size_t encodeFrameHeader(char* out, int version, std::size_t payloadSize, bool more);
+// Заголовок кадра версии 2 со сжатой пачкой кадров
+std::size_t encodeCompressedFrameHeader(char* out, std::size_t payloadSize);
+// Длина начала frames (кадры версии 2), состоящего из целых кадров общим размером не больше limit.
+// Пачки для сжатия режутся только по границам кадров.
+std::size_t compressionBatchSize(std::string_view frames, std::size_t limit);
+
+// Разбор "HELLO:...". Возвращает false, если сообщение не является HELLO.
+// Неизвестные опции пропускаются.
+bool parseHello(std::string_view message, WireOptions& options);
+std::string buildHello(const WireOptions& options);
+// Сервер принимает только то, что поддерживает сам
+WireOptions negotiateWireOptions(const WireOptions& requested);
+std::string buildHelloReply(const WireOptions& options);
+bool parseHelloReply(std::string_view message, WireOptions& options);
+
+// Полезная нагрузка кадров без utf8 - строка в формате QDataStream: quint32 длина в байтах
+// (0xFFFFFFFF - пустая строка) + UTF-16BE. Функции ниже нужны стороне без Qt.
+std::u16string utf8ToUtf16(std::string_view text);
+std::string utf16ToUtf8(std::u16string_view text);
+void appendQStringPayload(std::string& out, std::u16string_view text);
+// Дописывает декодированную строку в text, false при повреждённой нагрузке
+bool decodeQStringPayload(std::string_view payload, std::u16string& text);
+// Проверяет заголовок нагрузки и отдаёт в units её байты UTF-16BE (у нулевой строки пусто).
+// Вместе с decodeUtf16Be позволяет писать строку прямо в буфер QString без QDataStream.
+bool qStringPayloadUnits(std::string_view payload, std::string_view& units);
+// Записывает units.size() / 2 символов в out
+void decodeUtf16Be(std::string_view units, char16_t* out);
+
+// Кодирует сообщение (UTF-8) в кадры согласованного формата и дописывает их в out.
+// Возвращает число кадров; 0 - сообщение не помещается в кадр версии 1 и не отправлено.
+std::size_t appendMessageFrames(std::string& out, const WireOptions& options, std::string_view message);
+
+// Потоковый декодер кадров: байты из сокета добавляются через append() или читаются прямо
+// в буфер декодера (prepare() + commit()), готовые кадры извлекаются через next() как view
+// на этот буфер, без копирования и выделения памяти на кадр.
+//
+// Буфер один на соединение и переиспользуется: разобранные байты не сдвигаются, пока в конце
+// хватает места, а когда всё разобрано, запись снова начинается с начала. Сдвигается только
+// недочитанный хвост кадра, и только когда он не помещается в конец буфера.
+class FrameDecoder {
+public:
+    enum class Result {
+        NeedMoreData,
+        Frame,
+        Compressed, // payload - сжатая пачка кадров, разжатое нужно вернуть через insert()
+        Error
+    };
+
+    explicit FrameDecoder(int version = FrameProtocol::LegacyVersion);
+
+    // Смена версии применяется к ещё не разобранным байтам
+    void setVersion(int version);
+    int version() const { return m_version; }
+
+    void append(const char* data, std::size_t size);
+    // Место под size байт в конце буфера, действительно до commit() или другого изменения буфера.
+    // Сокет читает сюда сам: socket.read(decoder.prepare(n), n), затем commit(прочитано).
+    char* prepare(std::size_t size);
+    void commit(std::size_t size) { m_writePos += size; }
+    // Сжатые кадры допускаются только там, где согласован deflate; иначе это ошибка потока
+    void setCompressedFramesAllowed(bool allowed) { m_compressedAllowed = allowed; }
+    // Вставляет разжатые кадры перед ещё не разобранными байтами
+    void insert(const char* data, std::size_t size);
+
+    // payload указывает во внутренний буфер и действителен до следующего append()/prepare()/reset().
+    // more == true означает, что сообщение продолжится в следующем кадре.
+    Result next(std::string_view& payload, bool& more);
+
+    std::size_t bufferedBytes() const { return m_writePos - m_readPos; }
+    std::size_t capacity() const { return m_capacity; }
+    void reset();
+    // Отдаёт память буфера, если в нём не осталось неразобранных байт
+    void release();
+
+private:
+    // Переносит неразобранные байты на смещение headroom так, чтобы за ними было tailroom свободных
+    void relocate(std::size_t headroom, std::size_t tailroom);
+
+    int m_version;
+    std::unique_ptr<char[]> m_buffer;
+    std::size_t m_capacity = 0;
+    std::size_t m_readPos = 0;
+    std::size_t m_writePos = 0;
+    std::size_t m_insertedEnd = 0; // Конец разжатых байт: в них сжатый кадр - ошибка
+    bool m_compressedAllowed = false;
+};
+
+#endif // FRAME_CODEC_H
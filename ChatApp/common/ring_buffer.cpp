@@ -0,0 +1,77 @@
+#include "ring_buffer.h"
+#include <algorithm>
+#include <cstring>
+
+RingBuffer::RingBuffer(std::size_t initialCapacity)
+    : m_initialCapacity(1), m_capacity(0), m_head(0), m_size(0) {
+    while (m_initialCapacity < initialCapacity) {
+        m_initialCapacity <<= 1;
+    }
+}
+
+void RingBuffer::append(const char* data, std::size_t size) {
+    if (size == 0) {
+        return;
+    }
+    reserve(m_size + size);
+    const std::size_t mask = m_capacity - 1;
+    const std::size_t tail = (m_head + m_size) & mask;
+    const std::size_t firstPart = std::min(size, m_capacity - tail);
+    std::memcpy(m_data.get() + tail, data, firstPart);
+    std::memcpy(m_data.get(), data + firstPart, size - firstPart);
+    m_size += size;
+}
+
+std::string_view RingBuffer::first() const {
+    if (m_size == 0) {
+        return std::string_view();
+    }
+    return std::string_view(m_data.get() + m_head, std::min(m_size, m_capacity - m_head));
+}
+
+std::string_view RingBuffer::second() const {
+    const std::size_t firstSize = first().size();
+    return std::string_view(m_data.get(), m_size - firstSize);
+}
+
+void RingBuffer::consume(std::size_t size) {
+    size = std::min(size, m_size);
+    m_size -= size;
+    // Пустой буфер начинаем с нуля, чтобы следующая запись легла одним куском
+    m_head = m_size == 0 ? 0 : (m_head + size) & (m_capacity - 1);
+}
+
+void RingBuffer::clear() {
+    m_head = 0;
+    m_size = 0;
+}
+
+void RingBuffer::release() {
+    if (m_size != 0) {
+        return;
+    }
+    m_data.reset();
+    m_capacity = 0;
+    m_head = 0;
+}
+
+void RingBuffer::reserve(std::size_t required) {
+    if (required <= m_capacity) {
+        return;
+    }
+    std::size_t newCapacity = m_capacity ? m_capacity : m_initialCapacity;
+    while (newCapacity < required) {
+        newCapacity <<= 1;
+    }
+    std::unique_ptr<char[]> newData(new char[newCapacity]);
+    if (m_size != 0) {
+        // Переносим данные так, чтобы они начинались с нуля
+        const std::string_view a = first();
+        const std::string_view b = second();
+        std::memcpy(newData.get(), a.data(), a.size());
+        std::memcpy(newData.get() + a.size(), b.data(), b.size());
+    }
+    m_data = std::move(newData);
+    m_capacity = newCapacity;
+    m_head = 0;
+}
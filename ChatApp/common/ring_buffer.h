@@ -0,0 +1,47 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+// Кольцевой байтовый буфер для очередей сокета.
+// Ёмкость - степень двойки, растёт по мере надобности. Память выделяется при первой записи
+// и может быть отпущена через release(), поэтому простаивающее соединение ничего не держит.
+class RingBuffer {
+public:
+    explicit RingBuffer(std::size_t initialCapacity = 4096);
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+    RingBuffer(RingBuffer&&) noexcept = default;
+    RingBuffer& operator=(RingBuffer&&) noexcept = default;
+
+    std::size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    std::size_t capacity() const { return m_capacity; }
+
+    void append(const char* data, std::size_t size);
+    void append(std::string_view data) { append(data.data(), data.size()); }
+
+    // Данные лежат не более чем двумя непрерывными кусками: first, затем second (может быть пустым).
+    // Удобно для writev/sendmsg без промежуточного копирования.
+    std::string_view first() const;
+    std::string_view second() const;
+
+    void consume(std::size_t size);
+    void clear();
+    // Освобождает память, если буфер пуст
+    void release();
+
+private:
+    void reserve(std::size_t required);
+
+    std::unique_ptr<char[]> m_data;
+    std::size_t m_initialCapacity;
+    std::size_t m_capacity;
+    std::size_t m_head; // Позиция первого непрочитанного байта
+    std::size_t m_size;
+};
+
+#endif // RING_BUFFER_H
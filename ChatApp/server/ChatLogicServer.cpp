@@ -1,22 +1,11 @@
 #include "chat_logic_server.h"
-#include <iostream> 
+#include "logger.h"
 #include <optional>
-#include <sstream>  
 #include <algorithm> 
 #include <vector>
 #include <random>
 #include <iomanip> 
-
-// Вспомогательная функция для разделения строки
-std::vector<std::string> splitString(const std::string& s, char delimiter) {
-    std::vector<std::string> tokens;
-    std::string token;
-    std::istringstream tokenStream(s);
-    while (std::getline(tokenStream, token, delimiter)) {
-        tokens.push_back(token);
-    }
-    return tokens;
-}
+#include <chrono>
 
 // Вспомогательная функция для генерации случайного ID (для group chat ID)
 std::string generateRandomId(size_t length = 16) {
@@ -34,11 +23,41 @@ std::string generateRandomId(size_t length = 16) {
 
 ChatLogicServer::ChatLogicServer(std::unique_ptr<IDatabase> db)
     : m_db(std::move(db)) {
-    std::cout << "ChatLogicServer created." << std::endl;
+    registerCommands();
+    CHAT_LOG(Debug, "logic_server_created");
 }
 
 ChatLogicServer::~ChatLogicServer() {
-    std::cout << "ChatLogicServer destroyed." << std::endl;
+    const RateLimitStats& limits = m_rateLimiter.stats();
+    if (limits.throttled() != 0) {
+        CHAT_LOG(Info, "commands_throttled").field("total", limits.throttled())
+            .field("per_connection", limits.throttledPerConnection).field("per_user", limits.throttledPerUser);
+        for (std::size_t i = 0; i < CommandClassCount; ++i) {
+            if (limits.throttledByClass[i] != 0) {
+                CHAT_LOG(Info, "commands_throttled_class").field("class", commandClassName(CommandClass(i)))
+                    .field("count", limits.throttledByClass[i]);
+            }
+        }
+        for (const auto& user : m_rateLimiter.throttledUsers()) {
+            CHAT_LOG(Info, "commands_throttled_user").field("user", user.first).field("count", user.second);
+        }
+    }
+    for (std::size_t code = 0; code < CommandTableSize; ++code) {
+        const CommandStats& stats = m_commands[code].stats;
+        if (stats.calls != 0) {
+            const std::string_view name = code == std::size_t(ChatMessageType::Text)
+                ? std::string_view("TEXT") : chatMessageTypeName(ChatMessageType(code));
+            CHAT_LOG(Info, "command_stats").field("command", name)
+                .field("calls", stats.calls).field("rejected", stats.rejected)
+                .field("total_us", stats.totalNanoseconds / 1000).field("max_us", stats.maxNanoseconds / 1000);
+        }
+    }
+    if (m_rosterStats.flushes != 0) {
+        CHAT_LOG(Info, "roster_stats").field("requested", m_rosterStats.requested).field("sent", m_rosterStats.sent)
+            .field("coalesced", m_rosterStats.coalesced()).field("flushes", m_rosterStats.flushes);
+    }
+    flushGroupMessages(); // Отложенные сообщения групп не должны теряться при остановке
+    CHAT_LOG(Debug, "logic_server_destroyed");
 }
 
 void ChatLogicServer::setNetworkServer(std::shared_ptr<INetworkServer> network) {
@@ -56,13 +75,13 @@ void ChatLogicServer::setNetworkServer(std::shared_ptr<INetworkServer> network)
             [this](std::shared_ptr<INetworkClient> client, const std::string& message) {
                 this->handleMessageReceived(client, message);
         });
-        std::cout << "Network server callbacks set." << std::endl;
+        CHAT_LOG(Debug, "network_callbacks_set");
     }
 }
 
 bool ChatLogicServer::initializeDatabase() {
     if (!m_db) {
-        std::cerr << "Database is not initialized!" << std::endl;
+        CHAT_LOG(Error, "database_missing");
         return false;
     }
     bool success = true;
@@ -74,10 +93,10 @@ bool ChatLogicServer::initializeDatabase() {
     success &= initReadMessageTable();
 
     if (success) {
-        std::cout << "Database initialized successfully." << std::endl;
+        CHAT_LOG(Info, "database_initialized");
         loadCachesFromDb();
     } else {
-        std::cerr << "Database initialization failed." << std::endl;
+        CHAT_LOG(Error, "database_init_failed");
     }
     return success;
 }
@@ -85,256 +104,397 @@ bool ChatLogicServer::initializeDatabase() {
 void ChatLogicServer::startServer(int port) {
     if (m_networkServer) {
         if (m_networkServer->start(port)) {
-            std::cout << "ChatLogicServer started on port " << port << std::endl;
+            CHAT_LOG(Info, "server_started").field("port", port);
         } else {
-            std::cerr << "ChatLogicServer failed to start on port " << port << std::endl;
+            CHAT_LOG(Error, "server_start_failed").field("port", port);
         }
     } else {
-        std::cerr << "Network server is not set. Cannot start server." << std::endl;
+        CHAT_LOG(Error, "server_start_failed").field("reason", "no network server");
     }
 }
 
 void ChatLogicServer::stopServer() {
     if (m_networkServer) {
         m_networkServer->stop();
-        std::cout << "ChatLogicServer stopped." << std::endl;
+        CHAT_LOG(Info, "server_stopped");
     }
 }
 
 void ChatLogicServer::handleClientConnected(std::shared_ptr<INetworkClient> client) {
-    std::cout << "Client connected: " << client->getClientId() << std::endl;
+    CHAT_LOG(Debug, "client_connected").field("client", client->getClientId());
 }
 
 void ChatLogicServer::handleClientDisconnected(std::shared_ptr<INetworkClient> client) {
-    std::cout << "Client disconnected: " << client->getClientId() << std::endl;
+    CHAT_LOG(Debug, "client_disconnected").field("client", client->getClientId());
+    m_rateLimiter.forgetConnection(client.get());
     std::string username_dc = getUsernameFromCache(client);
 
     if (!username_dc.empty()) {
         updateUserCacheOnLogout(username_dc);
-        std::cout << "User " << username_dc << " marked as offline in cache." << std::endl;
+        CHAT_LOG(Info, "user_offline").field("user", username_dc);
+        broadcastPresence(username_dc, false);
+        if (m_rosterFlushInterval.count() == 0) {
+            flushRosterUpdates();
+        }
     } else {
-        std::cout << "Disconnected client was not authenticated or not found in cache." << std::endl;
+        CHAT_LOG(Debug, "client_disconnected_unauthenticated");
     }
-    broadcastUserList(); 
 }
 
 void ChatLogicServer::handleMessageReceived(std::shared_ptr<INetworkClient> client, const std::string& message) {    
-    std::vector<std::string> parts = splitString(message, ':');
-    if (parts.empty()) {
-        std::cerr << "Received empty or malformed message." << std::endl;
+    std::string senderUsername = getUsernameFromCache(client);
+    // Разбор - только view на байты сообщения, а предел проверяется до запросов к БД: отказ должен стоить дёшево
+    ChatMessage& request = m_request;
+    if (!parseChatMessage(message, request)) {
+        CHAT_LOG_SAMPLED(Warn, "malformed_message", 10).field("client", client->getClientId()).field("bytes", message.size());
+        return;
+    }
+    // Всё, что уйдёт отправителю до конца обработки, - ответ на его запрос
+    struct ReplyScope {
+        ChatLogicServer& server;
+        ~ReplyScope() {
+            server.m_replyClient = nullptr;
+            server.m_replyRequestId = 0;
+        }
+    } replyScope{*this};
+    m_replyClient = client.get();
+    m_replyRequestId = request.requestId();
+    if (!m_rateLimiter.allow(client.get(), senderUsername, request.name())) {
+        sendReply(client, ChatMessageWriter(ChatMessageType::RateLimited).field(m_rateLimiter.rejectedLimit()));
         return;
     }
 
-    std::string command = parts[0];
-    std::string senderUsername = getUsernameFromCache(client);
+    const std::size_t code = std::size_t(request.type());
+    CommandEntry& entry = m_commands[code < CommandTableSize ? code : std::size_t(ChatMessageType::Unknown)];
+    const CommandContext context{client, senderUsername, request};
+    ++entry.stats.calls;
 
-    if (command == "AUTH" && parts.size() >= 3) {
-        authenticateUser(parts[1], parts[2], client);
-    } else if (command == "REGISTER" && parts.size() >= 3) {
-        registerUser(parts[1], parts[2], client);
-    } else if (command == "GET_USERLIST" || command == "GET_USERS") {
-        if (!senderUsername.empty()) {
-            sendUserList(client);
-        } else {
-            client->sendMessage("ERROR:Authentication required to get user list.");
-        }
-    } else if (command == "PRIVATE" && parts.size() >= 3) {
-        if (!senderUsername.empty()) {
-            std::string recipientUsername = parts[1];
-            std::string msgText;
-            for (size_t i = 2; i < parts.size(); ++i) {
-                msgText += parts[i] + (i == parts.size() - 1 ? "" : ":");
-            }
-            // Логируем и отправляем.
-            logMessage(senderUsername, recipientUsername, msgText);
-            sendPrivateMessageToUser(recipientUsername, msgText, senderUsername);
-        } else {
-            client->sendMessage("ERROR:Authentication required to send private messages.");
-        }
-    } else if (command == "MSG" && parts.size() >= 3) {
-         if (!senderUsername.empty()) {
-            std::string recipientUsername = parts[1];
-            std::string msgText;
-            for (size_t i = 2; i < parts.size(); ++i) {
-                msgText += parts[i] + (i == parts.size() - 1 ? "" : ":");
-            }
-            logMessage(senderUsername, recipientUsername, msgText);
-            sendPrivateMessageToUser(recipientUsername, msgText, senderUsername);
-        } else {
-            client->sendMessage("ERROR:Authentication required to send messages.");
-        }
+    if (!entry.handler) {
+        ++entry.stats.rejected;
+        rejectCommand(context);
+        return;
     }
-    else if (command == "GET_HISTORY") {
-        if (!senderUsername.empty()) {
-            sendMessageHistoryToClient(client);
-        }    } else if (command == "GET_PRIVATE_HISTORY" && parts.size() >= 3) {
-        if (!senderUsername.empty()) {
-            sendPrivateMessageHistoryToClient(client, parts[1], parts[2]);
-        }
-    } else if (command == "CREATE_GROUP_CHAT" && parts.size() >= 2) {
-        if (!senderUsername.empty()) {
-            std::string chatName = parts[1];
-            std::string chatId = generateRandomId(); // Генерируем ID для чата
-            if (createGroupChat(chatId, chatName, senderUsername)) {
-                client->sendMessage("GROUP_CHAT_CREATED:" + chatId + ":" + chatName);
-                broadcastUserList(); // Обновить списки у всех, т.к. появился новый чат
-            } else {
-                client->sendMessage("ERROR:Failed to create group chat");
-            }
-        }
-    } else if (command == "JOIN_GROUP_CHAT" && parts.size() >= 2) {
-        if (!senderUsername.empty()) {
-            std::string chatId = parts[1];
-            if (addUserToGroupChat(chatId, senderUsername)) {
-                sendGroupChatInfo(chatId, client); // Отправляем инфу о чате этому клиенту
-                sendGroupChatHistory(chatId, client); // И историю
-            } else {
-                client->sendMessage("ERROR:Failed to join group chat " + chatId);
-            }
+    // Текстовый разбор уже проверил поля по схеме, а двоичное сообщение может прийти неполным
+    if (request.size() < entry.arity) {
+        ++entry.stats.rejected;
+        CHAT_LOG_SAMPLED(Warn, "command_malformed", 10).field("command", request.name())
+            .field("fields", request.size()).field("expected", entry.arity);
+        return;
+    }
+    if (entry.requiresAuth && senderUsername.empty()) {
+        ++entry.stats.rejected;
+        if (entry.authError) {
+            sendReply(client, ChatMessageWriter(ChatMessageType::Error).field(entry.authError));
         }
-    } else if (command == "GROUP_MESSAGE" && parts.size() >= 3) {
-        if (!senderUsername.empty()) {
-            std::string chatId = parts[1];
-            std::string chatMessage;
-            for (size_t i = 2; i < parts.size(); ++i) {
-                chatMessage += parts[i] + (i == parts.size() - 1 ? "" : ":");
-            }
-            sendGroupChatMessageToClients(chatId, senderUsername, chatMessage);
+        return;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    (this->*entry.handler)(context);
+    const auto elapsed = std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    entry.stats.totalNanoseconds += elapsed;
+    entry.stats.maxNanoseconds = std::max(entry.stats.maxNanoseconds, elapsed);
+    if (m_rosterFlushInterval.count() == 0) {
+        flushGroupMessages();
+        flushRosterUpdates();
+    }
+}
+
+const ChatLogicServer::CommandStats& ChatLogicServer::commandStats(ChatMessageType type) const {
+    const std::size_t code = std::size_t(type);
+    return m_commands[code < CommandTableSize ? code : std::size_t(ChatMessageType::Unknown)].stats;
+}
+
+void ChatLogicServer::registerCommand(ChatMessageType type, CommandHandler handler, std::size_t arity, bool requiresAuth,
+                                      const char* authError) {
+    CommandEntry& entry = m_commands[std::size_t(type)];
+    entry.handler = handler;
+    entry.arity = arity;
+    entry.requiresAuth = requiresAuth;
+    entry.authError = authError;
+}
+
+void ChatLogicServer::registerCommands() {
+    registerCommand(ChatMessageType::Auth, &ChatLogicServer::onAuth, 2, false);
+    registerCommand(ChatMessageType::Register, &ChatLogicServer::onRegister, 2, false);
+    registerCommand(ChatMessageType::GetUserList, &ChatLogicServer::onGetUserList, 0, true,
+                    "Authentication required to get user list.");
+    registerCommand(ChatMessageType::GetUsers, &ChatLogicServer::onGetUserList, 0, true,
+                    "Authentication required to get user list.");
+    registerCommand(ChatMessageType::Private, &ChatLogicServer::onPrivateMessage, 2, true,
+                    "Authentication required to send private messages.");
+    registerCommand(ChatMessageType::Msg, &ChatLogicServer::onPrivateMessage, 2, true,
+                    "Authentication required to send messages.");
+    registerCommand(ChatMessageType::GetHistory, &ChatLogicServer::onGetHistory, 0, true);
+    registerCommand(ChatMessageType::GetPrivateHistory, &ChatLogicServer::onGetPrivateHistory, 2, true);
+    registerCommand(ChatMessageType::CreateGroupChat, &ChatLogicServer::onCreateGroupChat, 1, true);
+    registerCommand(ChatMessageType::JoinGroupChat, &ChatLogicServer::onJoinGroupChat, 1, true);
+    registerCommand(ChatMessageType::GroupMessage, &ChatLogicServer::onGroupMessage, 2, true);
+    registerCommand(ChatMessageType::GroupAddUser, &ChatLogicServer::onGroupAddUser, 2, true);
+    registerCommand(ChatMessageType::GroupRemoveUser, &ChatLogicServer::onGroupRemoveUser, 2, true);
+    registerCommand(ChatMessageType::DeleteGroupChat, &ChatLogicServer::onDeleteGroupChat, 1, true);
+    registerCommand(ChatMessageType::GroupGetCreator, &ChatLogicServer::onGroupGetCreator, 1, false);
+    registerCommand(ChatMessageType::GetGroupChats, &ChatLogicServer::onGetGroupChats, 0, true);
+    registerCommand(ChatMessageType::MarkRead, &ChatLogicServer::onMarkRead, 1, true);
+    registerCommand(ChatMessageType::GetUnreadCount, &ChatLogicServer::onGetUnreadCount, 1, true);
+    registerCommand(ChatMessageType::SearchUsers, &ChatLogicServer::onSearchUsers, 1, false);
+    registerCommand(ChatMessageType::AddFriend, &ChatLogicServer::onAddFriend, 1, true);
+    registerCommand(ChatMessageType::RemoveFriend, &ChatLogicServer::onRemoveFriend, 1, true);
+    registerCommand(ChatMessageType::GetFriends, &ChatLogicServer::onGetFriends, 0, true);
+    registerCommand(ChatMessageType::SubscribePresence, &ChatLogicServer::onSubscribePresence, 1, true);
+    registerCommand(ChatMessageType::UnsubscribePresence, &ChatLogicServer::onUnsubscribePresence, 1, true);
+    // Строка без команды: вошедший пишет в общий чат, остальным onText отвечает сам
+    registerCommand(ChatMessageType::Text, &ChatLogicServer::onText, 1, false);
+}
+
+// Ответ сервера, присланный клиентом, или строка от неаутентифицированного клиента
+void ChatLogicServer::rejectCommand(const CommandContext& context) {
+    if (context.username.empty()) {
+        sendReply(context.client, ChatMessageWriter(ChatMessageType::Error).field("Authentication required for this command."));
+    }
+    CHAT_LOG_SAMPLED(Warn, "command_rejected", 10).field("command", context.request.name())
+        .field("authenticated", !context.username.empty());
+}
+
+void ChatLogicServer::onAuth(const CommandContext& context) {
+    authenticateUser(context.field(0), context.field(1), context.client);
+}
+
+void ChatLogicServer::onRegister(const CommandContext& context) {
+    registerUser(context.field(0), context.field(1), context.client);
+}
+
+void ChatLogicServer::onGetUserList(const CommandContext& context) {
+    sendUserList(context.client);
+}
+
+void ChatLogicServer::onPrivateMessage(const CommandContext& context) {
+    std::string recipientUsername = context.field(0);
+    std::string msgText = context.field(1);
+    // Логируем и отправляем.
+    logMessage(context.username, recipientUsername, msgText);
+    sendPrivateMessageToUser(recipientUsername, msgText, context.username);
+}
+
+void ChatLogicServer::onGetHistory(const CommandContext& context) {
+    sendMessageHistoryToClient(context.client);
+}
+
+void ChatLogicServer::onGetPrivateHistory(const CommandContext& context) {
+    sendPrivateMessageHistoryToClient(context.client, context.field(0), context.field(1));
+}
+
+void ChatLogicServer::onCreateGroupChat(const CommandContext& context) {
+    std::string chatName = context.field(0);
+    std::string chatId = generateRandomId(); // Генерируем ID для чата
+    if (createGroupChat(chatId, chatName, context.username)) {
+        sendReply(context.client, ChatMessageWriter(ChatMessageType::GroupChatCreated).field(chatId).field(chatName));
+        refreshUserList(context.username); // Новый чат появился только в списке создателя
+    } else {
+        sendReply(context.client, ChatMessageWriter(ChatMessageType::Error).field("Failed to create group chat"));
+    }
+}
+
+void ChatLogicServer::onJoinGroupChat(const CommandContext& context) {
+    std::string chatId = context.field(0);
+    if (addUserToGroupChat(chatId, context.username)) {
+        sendGroupChatInfo(chatId, context.client); // Отправляем инфу о чате этому клиенту
+        sendGroupChatHistory(chatId, context.client); // И историю
+    } else {
+        sendReply(context.client, ChatMessageWriter(ChatMessageType::Error).field("Failed to join group chat " + chatId));
+    }
+}
+
+void ChatLogicServer::onGroupMessage(const CommandContext& context) {
+    sendGroupChatMessageToClients(context.field(0), context.username, context.field(1));
+}
+
+void ChatLogicServer::onGroupAddUser(const CommandContext& context) {
+    std::string chatId = context.field(0);
+    std::string userToAdd = context.field(1);
+    if (addUserToGroupChat(chatId, userToAdd)) {
+        sendGroupChatMessageToClients(chatId, "SYSTEM", userToAdd + " добавлен в чат пользователем " + context.username);
+    } else {
+        sendReply(context.client, ChatMessageWriter(ChatMessageType::Error).field("Failed to add user " + userToAdd + " to group " + chatId));
+    }
+}
+
+void ChatLogicServer::onGroupRemoveUser(const CommandContext& context) {
+    std::string chatId = context.field(0);
+    std::string userToRemove = context.field(1);
+    if (removeUserFromGroupChat(chatId, userToRemove)) {
+        sendGroupChatMessageToClients(chatId, "SYSTEM", userToRemove + " удален из чата пользователем " + context.username);
+    } else {
+        sendReply(context.client, ChatMessageWriter(ChatMessageType::Error).field("Failed to remove user " + userToRemove + " from group " + chatId));
+    }
+}
+
+void ChatLogicServer::onDeleteGroupChat(const CommandContext& context) {
+    std::string chatId = context.field(0);
+    bool canDelete = false;
+    if (m_cachedGroupChats.count(chatId) && m_cachedGroupChats.at(chatId).creatorUsername == context.username) {
+        canDelete = true;
+    } else {
+        auto chatInfo = m_db->fetchOne("SELECT creator_username FROM group_chats WHERE id = ?;", {chatId});
+        if(chatInfo && chatInfo.value().count("creator_username") && std::any_cast<std::string>(chatInfo.value().at("creator_username")) == context.username){
+            canDelete = true;
         }
-    } else if (command == "GROUP_ADD_USER" && parts.size() >= 3) {
-         if (!senderUsername.empty()) { // Только аутентифицированный пользователь может добавлять
-            std::string chatId = parts[1];
-            std::string userToAdd = parts[2];
-            if (addUserToGroupChat(chatId, userToAdd)) {
-                 sendGroupChatMessageToClients(chatId, "SYSTEM", userToAdd + " добавлен в чат пользователем " + senderUsername);
-            } else {
-                client->sendMessage("ERROR:Failed to add user " + userToAdd + " to group " + chatId);
+    }
+
+    if(canDelete){
+        std::vector<std::string> membersToNotify;
+        if (m_cachedGroupChats.count(chatId)) {
+            for(const auto& memberName : m_cachedGroupChats.at(chatId).memberUsernames) {
+                membersToNotify.push_back(memberName);
             }
-        }
-    } else if (command == "GROUP_REMOVE_USER" && parts.size() >= 3) {
-        if (!senderUsername.empty()) {
-            std::string chatId = parts[1];
-            std::string userToRemove = parts[2];
-            if (removeUserFromGroupChat(chatId, userToRemove)) {
-                sendGroupChatMessageToClients(chatId, "SYSTEM", userToRemove + " удален из чата пользователем " + senderUsername);
-            } else {
-                 client->sendMessage("ERROR:Failed to remove user " + userToRemove + " from group " + chatId);
+        } else {
+            auto membersResult = m_db->fetchAll("SELECT username FROM group_chat_members WHERE chat_id = ?;", {chatId});
+            for(const auto& row : membersResult){
+                membersToNotify.push_back(std::any_cast<std::string>(row.at("username")));
             }
         }
-    } else if (command == "DELETE_GROUP_CHAT" && parts.size() >= 2) {
-        if(!senderUsername.empty()){
-            std::string chatId = parts[1];
-            bool canDelete = false;
-            if (m_cachedGroupChats.count(chatId) && m_cachedGroupChats.at(chatId).creatorUsername == senderUsername) {
-                canDelete = true;
-            } else {
-                auto chatInfo = m_db->fetchOne("SELECT creator_username FROM group_chats WHERE id = ?;", {chatId});
-                if(chatInfo && chatInfo.value().count("creator_username") && std::any_cast<std::string>(chatInfo.value().at("creator_username")) == senderUsername){
-                    canDelete = true;
-                }
-            }
 
-            if(canDelete){
-                std::vector<std::string> membersToNotify;
-                if (m_cachedGroupChats.count(chatId)) {
-                    for(const auto& memberName : m_cachedGroupChats.at(chatId).memberUsernames) {
-                        membersToNotify.push_back(memberName);
-                    }
-                } else {
-                    auto membersResult = m_db->fetchAll("SELECT username FROM group_chat_members WHERE chat_id = ?;", {chatId});
-                    for(const auto& row : membersResult){
-                        membersToNotify.push_back(std::any_cast<std::string>(row.at("username")));
-                    }
-                }
-
-                m_db->execute("DELETE FROM group_chat_messages WHERE chat_id = ?;", {chatId});
-                m_db->execute("DELETE FROM group_chat_members WHERE chat_id = ?;", {chatId});
-                if(m_db->execute("DELETE FROM group_chats WHERE id = ?;", {chatId})){
-                    removeGroupChatFromCache(chatId); 
-                    std::string notification = "GROUP_CHAT_DELETED:" + chatId;
-                    for(const auto& memberName : membersToNotify){
-                        auto memberClient = getClientFromCache(memberName);
-                        if(memberClient && memberClient->isConnected()){
-                            memberClient->sendMessage(notification);
-                        }
-                    }
-                    broadcastUserList(); 
-                } else {
-                    client->sendMessage("ERROR:Failed to delete group chat from DB.");
+        flushGroupMessages(); // Иначе отложенные сообщения удалённого чата запишутся после удаления
+        m_db->execute("DELETE FROM group_chat_messages WHERE chat_id = ?;", {chatId});
+        m_db->execute("DELETE FROM group_chat_members WHERE chat_id = ?;", {chatId});
+        if(m_db->execute("DELETE FROM group_chats WHERE id = ?;", {chatId})){
+            removeGroupChatFromCache(chatId); 
+            const SharedFrame notification = makeSharedFrame(ChatMessageWriter(ChatMessageType::GroupChatDeleted).field(chatId));
+            for(const auto& memberName : membersToNotify){
+                auto memberClient = getClientFromCache(memberName);
+                if(memberClient && memberClient->isConnected()){
+                    memberClient->sendFrame(notification);
                 }
-            } else {
-                client->sendMessage("ERROR:Only the creator can delete the group chat or chat not found.");
             }
-        }
-    } else if (command == "GROUP_GET_CREATOR" && parts.size() >= 2) {
-        std::string chatId = parts[1];
-        auto result = m_db->fetchOne("SELECT creator_username FROM group_chats WHERE id = ?;", {chatId});
-        if (result && result.value().count("creator_username")) {
-            std::string creator = std::any_cast<std::string>(result.value().at("creator_username"));
-            client->sendMessage("GROUP_CHAT_CREATOR:" + chatId + ":" + creator);
+            for(const auto& memberName : membersToNotify){
+                refreshUserList(memberName);
+            }
         } else {
-            client->sendMessage("ERROR:Could not get creator for chat " + chatId);
+            sendReply(context.client, ChatMessageWriter(ChatMessageType::Error).field("Failed to delete group chat from DB."));
         }
+    } else {
+        sendReply(context.client, ChatMessageWriter(ChatMessageType::Error).field("Only the creator can delete the group chat or chat not found."));
     }
-    else if (command == "GET_GROUP_CHATS") {
-        if (!senderUsername.empty()) {
-            sendUserGroupChats(senderUsername, client);
-        }
-    } else if (command == "MARK_READ" && parts.size() >= 2) {
-        if (!senderUsername.empty()) {
-            markAllMessagesAsRead(senderUsername, parts[1]);
-            sendUnreadMessagesCount(client, senderUsername, parts[1]);
-        }
-    } else if (command == "GET_UNREAD_COUNT" && parts.size() >= 2) {
-         if (!senderUsername.empty()) {
-            sendUnreadMessagesCount(client, senderUsername, parts[1]);
-        }
+}
+
+void ChatLogicServer::onGroupGetCreator(const CommandContext& context) {
+    std::string chatId = context.field(0);
+    auto result = m_db->fetchOne("SELECT creator_username FROM group_chats WHERE id = ?;", {chatId});
+    if (result && result.value().count("creator_username")) {
+        std::string creator = std::any_cast<std::string>(result.value().at("creator_username"));
+        sendReply(context.client, ChatMessageWriter(ChatMessageType::GroupChatCreator).field(chatId).field(creator));
+    } else {
+        sendReply(context.client, ChatMessageWriter(ChatMessageType::Error).field("Could not get creator for chat " + chatId));
     }
-    else if (command == "SEARCH_USERS" && parts.size() >= 2) {
-        searchUsers(parts[1], client);
-    } else if (command == "ADD_FRIEND" && parts.size() >= 2) {
-        if (!senderUsername.empty()) {
-            if (addFriend(senderUsername, parts[1])) {
-                client->sendMessage("FRIEND_ADDED:" + parts[1]);
-                broadcastUserList();
-            } else {
-                client->sendMessage("FRIEND_ADD_FAIL:" + parts[1]);
-            }
-        }
-    } else if (command == "REMOVE_FRIEND" && parts.size() >= 2) {
-        if (!senderUsername.empty()) {
-            if (removeFriend(senderUsername, parts[1])) {
-                client->sendMessage("FRIEND_REMOVED:" + parts[1]); 
-                broadcastUserList(); 
-            } else {
-                client->sendMessage("FRIEND_REMOVE_FAIL:" + parts[1]);
-            }
+}
+
+void ChatLogicServer::onGetGroupChats(const CommandContext& context) {
+    sendUserGroupChats(context.username, context.client);
+}
+
+void ChatLogicServer::onMarkRead(const CommandContext& context) {
+    markAllMessagesAsRead(context.username, context.field(0));
+    sendUnreadMessagesCount(context.client, context.username, context.field(0));
+}
+
+void ChatLogicServer::onGetUnreadCount(const CommandContext& context) {
+    sendUnreadMessagesCount(context.client, context.username, context.field(0));
+}
+
+void ChatLogicServer::onSearchUsers(const CommandContext& context) {
+    searchUsers(context.field(0), context.client);
+}
+
+void ChatLogicServer::onAddFriend(const CommandContext& context) {
+    if (addFriend(context.username, context.field(0))) {
+        sendReply(context.client, ChatMessageWriter(ChatMessageType::FriendAdded).field(context.request.text(0)));
+        refreshUserList(context.username);
+        refreshUserList(context.field(0));
+    } else {
+        sendReply(context.client, ChatMessageWriter(ChatMessageType::FriendAddFail).field(context.request.text(0)));
+    }
+}
+
+void ChatLogicServer::onRemoveFriend(const CommandContext& context) {
+    if (removeFriend(context.username, context.field(0))) {
+        sendReply(context.client, ChatMessageWriter(ChatMessageType::FriendRemoved).field(context.request.text(0)));
+        refreshUserList(context.username);
+        refreshUserList(context.field(0));
+    } else {
+        sendReply(context.client, ChatMessageWriter(ChatMessageType::FriendRemoveFail).field(context.request.text(0)));
+    }
+}
+
+void ChatLogicServer::onGetFriends(const CommandContext& context) {
+    ChatMessageWriter response(ChatMessageType::FriendsList);
+    for(const auto& friendName : getUserFriends(context.username)) {
+        response.field(friendName);
+    }
+    sendReply(context.client, response);
+}
+
+void ChatLogicServer::onSubscribePresence(const CommandContext& context) {
+    Session* session = findSession(context.client.get());
+    const std::string target = context.field(0);
+    auto user = m_cachedUsers.find(target);
+    if (!session || target == context.username || user == m_cachedUsers.end()) {
+        return;
+    }
+    if (!session->presenceSubscriptions.count(target)) {
+        if (session->presenceSubscriptions.size() >= MaxPresenceSubscriptions) {
+            CHAT_LOG_SAMPLED(Warn, "presence_subscriptions_exceeded", 10).field("user", context.username);
+            return;
         }
-    } else if (command == "GET_FRIENDS") {
-        if (!senderUsername.empty()) {
-            std::vector<std::string> friends = getUserFriends(senderUsername);
-            std::string response = "FRIENDS_LIST";
-            for(const auto& friendName : friends) {
-                response += ":" + friendName;
-            }
-            client->sendMessage(response);
+        session->presenceSubscriptions.insert(target);
+        m_presenceSubscribers[target].insert(context.username);
+    }
+    // Окно могло открыться по устаревшему списку: сразу сообщаем, в сети ли собеседник
+    if (session->presenceDeltas) {
+        sendReply(context.client, ChatMessageWriter(ChatMessageType::Presence).field(target).number(user->second.isOnline ? 1 : 0));
+    }
+}
+
+void ChatLogicServer::onUnsubscribePresence(const CommandContext& context) {
+    Session* session = findSession(context.client.get());
+    const std::string target = context.field(0);
+    if (!session || session->presenceSubscriptions.erase(target) == 0) {
+        return;
+    }
+    auto subscribers = m_presenceSubscribers.find(target);
+    if (subscribers != m_presenceSubscribers.end()) {
+        subscribers->second.erase(context.username);
+        if (subscribers->second.empty()) {
+            m_presenceSubscribers.erase(subscribers);
         }
     }
-    else if (!senderUsername.empty()) { 
-        logMessage(senderUsername, "", message);
-        saveToHistory(senderUsername, message);
+}
+
+void ChatLogicServer::onText(const CommandContext& context) {
+    if (!context.username.empty()) {
+        // Строка без команды - сообщение в общий чат
+        const std::string line = context.field(0);
+        logMessage(context.username, "", line);
+        saveToHistory(context.username, line);
         if (m_networkServer) {
-            m_networkServer->broadcastMessage(senderUsername + ": " + message);
+            m_networkServer->broadcastMessage(context.username + ": " + line);
         }
+        return;
     }
-    else {
-        if (command != "AUTH" && command != "REGISTER") {
-             client->sendMessage("ERROR:Authentication required for this command.");
-        }
-        std::cerr << "Unknown command or unauthenticated user for command: " << command << std::endl;
+    if (context.request.name() == "AUTH" || context.request.name() == "REGISTER") {
+        // Неполный AUTH/REGISTER ошибкой не отвечается, как и раньше
+        CHAT_LOG_SAMPLED(Warn, "command_rejected", 10).field("command", context.request.name()).field("authenticated", false);
+        return;
     }
+    rejectCommand(context);
 }
 
+void ChatLogicServer::sendReply(const std::shared_ptr<INetworkClient>& client, ChatMessageWriter& reply) {
+    if (m_replyRequestId != 0 && client.get() == m_replyClient) {
+        reply.setRequestId(m_replyRequestId);
+    }
+    client->sendFrame(makeSharedFrame(reply));
+}
 
 bool ChatLogicServer::authenticateUser(const std::string& username, const std::string& password, std::shared_ptr<INetworkClient> client) {
     if (!m_db) return false;
@@ -348,8 +508,8 @@ bool ChatLogicServer::authenticateUser(const std::string& username, const std::s
         try {
             db_password = std::any_cast<std::string>(result.value().at("password"));
         } catch (const std::bad_any_cast& e) {
-            std::cerr << "AuthenticateUser: Bad any_cast for password - " << e.what() << std::endl;
-            client->sendMessage("AUTH_FAILED:Internal server error.");
+            CHAT_LOG(Error, "bad_any_cast").field("in", "authenticateUser").field("error", e.what());
+            sendReply(client, ChatMessageWriter(ChatMessageType::AuthFailed).field("Internal server error."));
             return false;
         }
 
@@ -357,34 +517,36 @@ bool ChatLogicServer::authenticateUser(const std::string& username, const std::s
             if (m_cachedUsers.count(username)) {
                 CachedUser& cachedUser = m_cachedUsers.at(username);
                 if (cachedUser.isOnline && cachedUser.client) {
-                     client->sendMessage("AUTH_FAIL:User already logged in.");
+                     sendReply(client, ChatMessageWriter(ChatMessageType::AuthFail).field("User already logged in."));
                      return false;
                 }
                 updateUserCacheOnLogin(username, client);
             } else {
-                std::cerr << "User " << username << " not found in cache during authentication, but exists in DB!" << std::endl;
+                CHAT_LOG(Warn, "cache_miss").field("user", username).field("in", "authenticateUser");
                 auto userRow = m_db->fetchOne("SELECT id FROM users WHERE username = ?;", {username});
                  if (userRow && userRow.value().count("id")) {
                     long long userId = std::any_cast<long long>(userRow.value().at("id"));
                     m_cachedUsers[username] = {username, userId, false, nullptr, {}, {}}; // Создаем запись. Загружаем друзей и группы для этого пользователя, 
                     updateUserCacheOnLogin(username, client);
-                    std::cout << "Cache emergency update: User " << username << " loaded and set online." << std::endl;
+                    CHAT_LOG(Info, "cache_user_loaded").field("user", username).field("online", true);
                 } else {
-                    client->sendMessage("AUTH_FAILED:User data inconsistency.");
+                    sendReply(client, ChatMessageWriter(ChatMessageType::AuthFailed).field("User data inconsistency."));
                     return false;
                 }
             }
             
-            client->sendMessage("AUTH_SUCCESS");
-            std::cout << "User " << username << " authenticated." << std::endl;
+            client->markAuthenticated(); // Таймаут входа к клиенту больше не применяется
+            sendReply(client, ChatMessageWriter(ChatMessageType::AuthSuccess));
+            CHAT_LOG(Info, "user_authenticated").field("user", username).field("client", client->getClientId());
             sendStoredOfflineMessages(username, client);
             sendMessageHistoryToClient(client); 
             sendUserGroupChats(username, client); 
-            broadcastUserList(); 
+            sendUserList(client);
+            broadcastPresence(username, true);
             return true;
         }
     }
-    client->sendMessage("AUTH_FAILED");
+    sendReply(client, ChatMessageWriter(ChatMessageType::AuthFailed));
     return false;
 }
 
@@ -394,101 +556,193 @@ bool ChatLogicServer::registerUser(const std::string& username, const std::strin
     auto existing_user = m_db->fetchOne(check_query, {username});
 
     if (existing_user.has_value()) {
-        client->sendMessage("REGISTER_FAILED:Username already exists.");
+        sendReply(client, ChatMessageWriter(ChatMessageType::RegisterFailed).field("Username already exists."));
         return false;
     }
 
     std::string insert_query = "INSERT INTO users (username, password) VALUES (?, ?);";
     if (m_db->execute(insert_query, {username, password})) {
-        client->sendMessage("REGISTER_SUCCESS");
-        std::cout << "User " << username << " registered." << std::endl;
+        sendReply(client, ChatMessageWriter(ChatMessageType::RegisterSuccess));
+        CHAT_LOG(Info, "user_registered").field("user", username);
         auto userRow = m_db->fetchOne("SELECT id FROM users WHERE username = ?;", {username});
         if (userRow && userRow.value().count("id")) {
             try {
                 long long userId = std::any_cast<long long>(userRow.value().at("id"));
                 m_cachedUsers[username] = {username, userId, false, nullptr, {}, {}};
-                std::cout << "Cache updated: New user " << username << " added to cache." << std::endl;
+                CHAT_LOG(Debug, "cache_user_added").field("user", username);
             } catch (const std::bad_any_cast& e) {
-                std::cerr << "Error casting new user ID for cache: " << e.what() << std::endl;
+                CHAT_LOG(Error, "bad_any_cast").field("in", "registerUser").field("error", e.what());
             }
         } else {
-             std::cerr << "Could not retrieve ID for newly registered user " << username << " for cache update." << std::endl;
+             CHAT_LOG(Error, "cache_user_load_failed").field("user", username).field("in", "registerUser");
         }
         return true;
     } else {
-        client->sendMessage("REGISTER_FAILED:Database error.");
-        std::cerr << "Failed to register user " << username << ": " << m_db->lastError() << std::endl;
+        sendReply(client, ChatMessageWriter(ChatMessageType::RegisterFailed).field("Database error."));
+        CHAT_LOG(Warn, "register_failed").field("user", username).field("error", m_db->lastError());
         return false;
     }
 }
 
 void ChatLogicServer::sendUserList(std::shared_ptr<INetworkClient> client) {
     if (!client) return;
-    std::string currentUsername = getUsernameFromCache(client);
-    if (currentUsername.empty() || !m_cachedUsers.count(currentUsername)) {
-        std::cerr << "sendUserList: Client not authenticated or not in cache." << std::endl;
+    const Session* session = findSession(client.get());
+    if (!session) {
+        CHAT_LOG(Warn, "user_list_rejected").field("client", client->getClientId());
         return; 
     }
+    const std::string& currentUsername = session->username;
 
-    const CachedUser& currentUserData = m_cachedUsers.at(currentUsername);
-    std::vector<std::string> userEntries;
+    const CachedUser& currentUserData = *session->user;
+    // Текст: "USERLIST:имя:1:U[:F],id:1:G:название,...". В двоичном виде у каждой записи ровно 4 поля,
+    // пустое четвёртое - не друг
+    ChatMessageWriter userList(ChatMessageType::UserList);
+    userList.textOnly(":");
+    char separator = ChatMessageWriter::NoSeparator;
 
     for (const auto& pair : m_cachedUsers) {
         const CachedUser& otherUser = pair.second;
         if (otherUser.username == currentUsername) continue; // Пропускаем самого себя
 
         bool is_friend = currentUserData.friendUsernames.count(otherUser.username);
-        std::string status = otherUser.isOnline ? "1" : "0";
-        userEntries.push_back(otherUser.username + ":" + status + ":U" + (is_friend ? ":F" : ""));
+        userList.field(otherUser.username, separator).number(otherUser.isOnline ? 1 : 0).field("U");
+        if (is_friend) {
+            userList.field("F");
+        } else {
+            userList.binaryOnly("");
+        }
+        separator = ',';
     }
     
     for (const std::string& chatId : currentUserData.groupChatIds) {
         if (m_cachedGroupChats.count(chatId)) {
             const CachedGroupChat& groupChat = m_cachedGroupChats.at(chatId);
-            userEntries.push_back(groupChat.id + ":1:G:" + groupChat.name);
+            userList.field(groupChat.id, separator).number(1).field("G").field(groupChat.name);
+            separator = ',';
         }
     }
+    sendReply(client, userList);
+}
+
+void ChatLogicServer::broadcastPresence(const std::string& username, bool online) {
+    // Вход и выход в одном окне - одно изменение с последним статусом
+    PendingPresence& pending = m_pendingPresence[username];
+    pending.online = online;
+    ++pending.changes;
+}
 
-    std::string userListMsg = "USERLIST:";
-    if (!userEntries.empty()) {
-        for (size_t i = 0; i < userEntries.size(); ++i) {
-            userListMsg += userEntries[i];
-            if (i < userEntries.size() - 1) {
-                userListMsg += ",";
+void ChatLogicServer::flushRosterUpdates() {
+    // Отправка может отключить медленного клиента, и его выход вернётся сюда же: он подождёт следующего сброса
+    if (m_flushingRoster || (m_pendingPresence.empty() && m_dirtyRosters.empty())) {
+        return;
+    }
+    m_flushingRoster = true;
+    m_flushPresence.swap(m_pendingPresence);
+    m_flushRosters.swap(m_dirtyRosters);
+    ++m_rosterStats.flushes;
+
+    // Кому всё равно уйдёт полный список, тому PRESENCE не нужен: статусы в нём уже есть
+    std::uint64_t changes = 0;
+    for (const auto& change : m_flushPresence) {
+        changes += change.second.changes;
+        collectPresenceRecipients(change.first);
+        for (const CachedUser* recipient : m_presenceRecipients) {
+            const Session* session = findSession(recipient->client.get());
+            if (!session || !session->presenceDeltas) {
+                continue; // Клиентам без presence список уходит ниже
+            }
+            if (!m_flushRosters.count(recipient->username)) {
+                PresenceBatch& batch = m_presenceBatches[recipient];
+                batch.writer.field(change.first).number(change.second.online ? 1 : 0);
+                batch.changes += change.second.changes;
+            } else {
+                m_flushRosters[recipient->username] += change.second.changes;
             }
         }
     }
-    client->sendMessage(userListMsg);
-}
-
-void ChatLogicServer::broadcastUserList() {
-    if (!m_networkServer) return;
-    
-    // Логирование текущего состояния кэша
-    std::cout << "Broadcasting user list. Current cache state:" << std::endl;
-    for (const auto& pair : m_cachedUsers) {
-        std::cout << "User: " << pair.first << " - " << (pair.second.isOnline ? "ONLINE" : "offline") << std::endl;
+    // Клиент без presence показывает статусы всех из своего USERLIST и узнать об изменении может
+    // только из нового списка: он получает его при любом входе и выходе, один за окно
+    if (changes != 0) {
+        for (const auto& entry : m_sessions) {
+            const Session& session = entry.second;
+            if (session.presenceDeltas) {
+                continue;
+            }
+            auto own = m_flushPresence.find(session.username);
+            const std::uint64_t others = changes - (own != m_flushPresence.end() ? own->second.changes : 0);
+            if (others != 0) {
+                m_flushRosters[session.username] += others;
+            }
+        }
     }
-    
-    // Отправляем обновленный список всем подключенным пользователям
-    for (const auto& pair : m_cachedUsers) {
-        const CachedUser& user = pair.second;
-        if (user.isOnline && user.client) {
-            sendUserList(user.client);
+    for (auto& batch : m_presenceBatches) {
+        const CachedUser* recipient = batch.first;
+        if (recipient->client && findSession(recipient->client.get())) {
+            recipient->client->sendFrame(makeSharedFrame(batch.second.writer));
+            m_rosterStats.requested += batch.second.changes;
+            ++m_rosterStats.sent;
+        }
+    }
+    for (const auto& dirty : m_flushRosters) {
+        if (auto client = getClientFromCache(dirty.first)) {
+            sendUserList(client);
+            m_rosterStats.requested += dirty.second;
+            ++m_rosterStats.sent;
         }
     }
+    CHAT_LOG(Debug, "roster_flushed").field("presence", m_flushPresence.size())
+        .field("presence_recipients", m_presenceBatches.size()).field("user_lists", m_flushRosters.size());
+
+    m_flushPresence.clear();
+    m_flushRosters.clear();
+    m_presenceBatches.clear();
+    m_flushingRoster = false;
 }
 
+void ChatLogicServer::collectPresenceRecipients(const std::string& username) {
+    m_presenceRecipients.clear();
+    const auto add = [this, &username](const std::string& name) {
+        auto it = m_cachedUsers.find(name);
+        if (name != username && it != m_cachedUsers.end() && it->second.isOnline && it->second.client) {
+            m_presenceRecipients.insert(&it->second);
+        }
+    };
 
-std::string ChatLogicServer::getUsernameFromCache(std::shared_ptr<INetworkClient> client) {
-    if (!client) return "";
-    for (const auto& pair : m_cachedUsers) {
-        const CachedUser& cachedUser = pair.second;
-        if (cachedUser.isOnline && cachedUser.client && cachedUser.client->getClientId() == client->getClientId()) {
-            return cachedUser.username;
+    auto user = m_cachedUsers.find(username);
+    if (user != m_cachedUsers.end()) {
+        for (const std::string& friendName : user->second.friendUsernames) {
+            add(friendName);
+        }
+        for (const std::string& chatId : user->second.groupChatIds) {
+            auto chat = m_cachedGroupChats.find(chatId);
+            if (chat != m_cachedGroupChats.end()) {
+                for (const std::string& memberName : chat->second.memberUsernames) {
+                    add(memberName);
+                }
+            }
+        }
+    }
+    auto subscribers = m_presenceSubscribers.find(username);
+    if (subscribers != m_presenceSubscribers.end()) {
+        for (const std::string& subscriber : subscribers->second) {
+            add(subscriber);
         }
     }
-    return "";
+}
+
+void ChatLogicServer::refreshUserList(const std::string& username) {
+    ++m_dirtyRosters[username];
+}
+
+
+std::string ChatLogicServer::getUsernameFromCache(const std::shared_ptr<INetworkClient>& client) {
+    const Session* session = findSession(client.get());
+    return session ? session->username : std::string();
+}
+
+ChatLogicServer::Session* ChatLogicServer::findSession(const INetworkClient* client) {
+    auto it = m_sessions.find(client);
+    return it != m_sessions.end() ? &it->second : nullptr;
 }
 
 std::shared_ptr<INetworkClient> ChatLogicServer::getClientFromCache(const std::string& username) {
@@ -515,7 +769,9 @@ bool ChatLogicServer::initUserTable() {
                         "username TEXT UNIQUE NOT NULL, "
                         "password TEXT NOT NULL);";
     bool success = m_db->execute(query);
-    if (!success) std::cerr << "Failed to create users table: " << m_db->lastError() << std::endl;
+    if (!success) {
+        CHAT_LOG(Error, "db_failed").field("op", "create users table").field("error", m_db->lastError());
+    }
     return success;
 }
 
@@ -528,7 +784,9 @@ bool ChatLogicServer::initMessageTable() {
                         "message TEXT NOT NULL, "
                         "timestamp DATETIME DEFAULT CURRENT_TIMESTAMP);";
     bool success = m_db->execute(query);
-    if (!success) std::cerr << "Failed to create messages table: " << m_db->lastError() << std::endl;
+    if (!success) {
+        CHAT_LOG(Error, "db_failed").field("op", "create messages table").field("error", m_db->lastError());
+    }
     return success;
 }
 
@@ -540,7 +798,9 @@ bool ChatLogicServer::initHistoryTable() {
                         "message TEXT NOT NULL, "
                         "timestamp DATETIME DEFAULT CURRENT_TIMESTAMP);";
     bool success = m_db->execute(query);
-    if (!success) std::cerr << "Failed to create history table: " << m_db->lastError() << std::endl;
+    if (!success) {
+        CHAT_LOG(Error, "db_failed").field("op", "create history table").field("error", m_db->lastError());
+    }
     return success;
 }
 
@@ -553,7 +813,9 @@ bool ChatLogicServer::initFriendshipsTable() {
                         "FOREIGN KEY(friend_id) REFERENCES users(id) ON DELETE CASCADE, "
                         "PRIMARY KEY (user_id, friend_id));";
     bool success = m_db->execute(query);
-    if (!success) std::cerr << "Failed to create friendships table: " << m_db->lastError() << std::endl;
+    if (!success) {
+        CHAT_LOG(Error, "db_failed").field("op", "create friendships table").field("error", m_db->lastError());
+    }
     return success;
 }
 
@@ -566,7 +828,9 @@ bool ChatLogicServer::initGroupChatTables() {
                                "creator_username TEXT NOT NULL, "
                                "timestamp DATETIME DEFAULT CURRENT_TIMESTAMP);";
     success &= m_db->execute(query_groups);
-    if (!success) std::cerr << "Failed to create group_chats table: " << m_db->lastError() << std::endl;
+    if (!success) {
+        CHAT_LOG(Error, "db_failed").field("op", "create group_chats table").field("error", m_db->lastError());
+    }
 
     std::string query_members = "CREATE TABLE IF NOT EXISTS group_chat_members ("
                                 "chat_id TEXT NOT NULL, "
@@ -575,7 +839,9 @@ bool ChatLogicServer::initGroupChatTables() {
                                 "FOREIGN KEY(username) REFERENCES users(username) ON DELETE CASCADE, "
                                 "PRIMARY KEY (chat_id, username));";
     success &= m_db->execute(query_members);
-    if (!success) std::cerr << "Failed to create group_chat_members table: " << m_db->lastError() << std::endl;
+    if (!success) {
+        CHAT_LOG(Error, "db_failed").field("op", "create group_chat_members table").field("error", m_db->lastError());
+    }
 
     std::string query_messages = "CREATE TABLE IF NOT EXISTS group_chat_messages ("
                                  "id INTEGER PRIMARY KEY AUTOINCREMENT, "
@@ -586,7 +852,9 @@ bool ChatLogicServer::initGroupChatTables() {
                                  "FOREIGN KEY(chat_id) REFERENCES group_chats(id) ON DELETE CASCADE, "
                                  "FOREIGN KEY(sender_username) REFERENCES users(username) ON DELETE CASCADE);";
     success &= m_db->execute(query_messages);
-    if (!success) std::cerr << "Failed to create group_chat_messages table: " << m_db->lastError() << std::endl;
+    if (!success) {
+        CHAT_LOG(Error, "db_failed").field("op", "create group_chat_messages table").field("error", m_db->lastError());
+    }
     return success;
 }
 
@@ -598,7 +866,9 @@ bool ChatLogicServer::initReadMessageTable() {
                         "last_read_message_id INTEGER NOT NULL, "
                         "PRIMARY KEY (username, chat_partner));";
     bool success = m_db->execute(query);
-    if (!success) std::cerr << "Failed to create read_messages table: " << m_db->lastError() << std::endl;
+    if (!success) {
+        CHAT_LOG(Error, "db_failed").field("op", "create read_messages table").field("error", m_db->lastError());
+    }
     return success;
 }
 
@@ -606,7 +876,9 @@ bool ChatLogicServer::logMessage(const std::string &sender, const std::string &r
     if (!m_db) return false;
     std::string query = "INSERT INTO messages (sender, recipient, message) VALUES (?, ?, ?);";
     bool success = m_db->execute(query, {sender, recipient, message});
-    if (!success) std::cerr << "Failed to log message: " << m_db->lastError() << std::endl;
+    if (!success) {
+        CHAT_LOG(Error, "db_failed").field("op", "log message").field("error", m_db->lastError());
+    }
     return success;
 }
 
@@ -614,33 +886,36 @@ bool ChatLogicServer::saveToHistory(const std::string &sender, const std::string
     if (!m_db) return false;
     std::string query = "INSERT INTO history (sender, message) VALUES (?, ?);";
     bool success = m_db->execute(query, {sender, message});
-    if (!success) std::cerr << "Failed to save to history: " << m_db->lastError() << std::endl;
+    if (!success) {
+        CHAT_LOG(Error, "db_failed").field("op", "save to history").field("error", m_db->lastError());
+    }
     return success;
 }
 
 void ChatLogicServer::sendMessageHistoryToClient(std::shared_ptr<INetworkClient> client) {
     if (!m_db || !client) return;
     
-    client->sendMessage("HISTORY_CMD:BEGIN");
+    sendReply(client, ChatMessageWriter(ChatMessageType::HistoryCmd).field("BEGIN"));
 
     std::string query_str = "SELECT sender, message, timestamp FROM history WHERE timestamp >= datetime('now','-7 days') ORDER BY timestamp ASC;";
     auto results = m_db->fetchAll(query_str);
     
     if (results.empty()) {
-        client->sendMessage("HISTORY_MSG:0000-00-00 00:00:00|Система|История сообщений пуста");
+        sendReply(client, ChatMessageWriter(ChatMessageType::HistoryMsg)
+            .field("0000-00-00 00:00:00").field("Система", '|').field("История сообщений пуста", '|'));
     } else {
         for (const auto& row : results) {
             try {
                 std::string sender = std::any_cast<std::string>(row.at("sender"));
                 std::string message = std::any_cast<std::string>(row.at("message"));
                 std::string timestamp = std::any_cast<std::string>(row.at("timestamp"));
-                client->sendMessage("HISTORY_MSG:" + timestamp + "|" + sender + "|" + message);
+                sendReply(client, ChatMessageWriter(ChatMessageType::HistoryMsg).field(timestamp).field(sender, '|').field(message, '|'));
             } catch (const std::bad_any_cast& e) {
-                std::cerr << "Bad any_cast in sendMessageHistoryToClient: " << e.what() << std::endl;
+                CHAT_LOG(Error, "bad_any_cast").field("in", "sendMessageHistoryToClient").field("error", e.what());
             }
         }
     }
-    client->sendMessage("HISTORY_CMD:END");
+    sendReply(client, ChatMessageWriter(ChatMessageType::HistoryCmd).field("END"));
 }
 
 void ChatLogicServer::sendPrivateMessageHistoryToClient(std::shared_ptr<INetworkClient> client, const std::string& user1, const std::string& user2) {
@@ -648,12 +923,12 @@ void ChatLogicServer::sendPrivateMessageHistoryToClient(std::shared_ptr<INetwork
 
     std::string requesterUsername = getUsernameFromCache(client);
     if (requesterUsername.empty()) {
-        client->sendMessage("ERROR:Authentication required to get private history.");
+        sendReply(client, ChatMessageWriter(ChatMessageType::Error).field("Authentication required to get private history."));
         return;
     }
 
     std::string otherUser = (requesterUsername == user1) ? user2 : user1;
-    client->sendMessage("PRIVATE_HISTORY_CMD:BEGIN:" + otherUser);
+    sendReply(client, ChatMessageWriter(ChatMessageType::PrivateHistoryCmd).field("BEGIN").field(otherUser));
 
     std::string query_str = "SELECT sender, recipient, message, timestamp FROM messages "
                             "WHERE ((sender = ? AND recipient = ?) OR (sender = ? AND recipient = ?)) "
@@ -662,7 +937,8 @@ void ChatLogicServer::sendPrivateMessageHistoryToClient(std::shared_ptr<INetwork
     auto results = m_db->fetchAll(query_str, {user1, user2, user2, user1});
 
     if (results.empty()) {
-        client->sendMessage("PRIVATE_HISTORY_MSG:0000-00-00 00:00:00|Система|История личных сообщений пуста");
+        sendReply(client, ChatMessageWriter(ChatMessageType::PrivateHistoryMsg)
+            .field("0000-00-00 00:00:00").field("Система", '|').field("История личных сообщений пуста", '|'));
     } else {
         for (const auto& row : results) {
             try {
@@ -670,29 +946,30 @@ void ChatLogicServer::sendPrivateMessageHistoryToClient(std::shared_ptr<INetwork
                 std::string recipient = std::any_cast<std::string>(row.at("recipient"));
                 std::string message_text = std::any_cast<std::string>(row.at("message"));
                 std::string timestamp = std::any_cast<std::string>(row.at("timestamp"));
-                client->sendMessage("PRIVATE_HISTORY_MSG:" + timestamp + "|" + sender + "|" + recipient + "|" + message_text);
+                sendReply(client, ChatMessageWriter(ChatMessageType::PrivateHistoryMsg)
+                    .field(timestamp).field(sender, '|').field(recipient, '|').field(message_text, '|'));
             } catch (const std::bad_any_cast& e) {
-                std::cerr << "Bad any_cast in sendPrivateMessageHistoryToClient: " << e.what() << std::endl;
+                CHAT_LOG(Error, "bad_any_cast").field("in", "sendPrivateMessageHistoryToClient").field("error", e.what());
             }
         }
     }
-    client->sendMessage("PRIVATE_HISTORY_CMD:END");
+    sendReply(client, ChatMessageWriter(ChatMessageType::PrivateHistoryCmd).field("END"));
 }
 
 bool ChatLogicServer::sendPrivateMessageToUser(const std::string& recipientUsername, const std::string& message, const std::string& senderUsername) {
     if (senderUsername == recipientUsername) {
         auto senderClient = getClientFromCache(senderUsername);
-        if(senderClient) senderClient->sendMessage("ERROR:You cannot send messages to yourself this way.");
+        if(senderClient) sendReply(senderClient, ChatMessageWriter(ChatMessageType::Error).field("You cannot send messages to yourself this way."));
         return false;
     }
 
     auto recipientClient = getClientFromCache(recipientUsername); 
     if (recipientClient && recipientClient->isConnected()) {
-        recipientClient->sendMessage("PRIVATE:" + senderUsername + ":" + message);
+        sendReply(recipientClient, ChatMessageWriter(ChatMessageType::Private).field(senderUsername).field(message));
         return true;
     } else {
         storeOfflineMessage(senderUsername, recipientUsername, message);
-        std::cout << "User " << recipientUsername << " is offline. Storing message." << std::endl;
+        CHAT_LOG(Debug, "offline_message_stored").field("recipient", recipientUsername);
         return true; 
     }
 }
@@ -706,7 +983,7 @@ bool ChatLogicServer::storeOfflineMessage(const std::string &sender, const std::
     auto check_result = m_db->fetchOne(check_query_str, {sender, recipient, message});
     if (check_result && check_result.value().count("count")) {
         if (std::any_cast<long long>(check_result.value().at("count")) > 0) {
-            std::cout << "Duplicate offline message detected, not storing again." << std::endl;
+            CHAT_LOG(Debug, "offline_message_duplicate");
             return false; // Не сохраняем дубликат
         }
     }
@@ -723,9 +1000,9 @@ void ChatLogicServer::sendStoredOfflineMessages(const std::string &username, std
         try {
             std::string sender = std::any_cast<std::string>(row.at("sender"));
             std::string message_text = std::any_cast<std::string>(row.at("message"));
-            client->sendMessage("PRIVATE:" + sender + ":" + message_text);
+            sendReply(client, ChatMessageWriter(ChatMessageType::Private).field(sender).field(message_text));
         } catch (const std::bad_any_cast& e) {
-            std::cerr << "Bad any_cast in sendStoredOfflineMessages: " << e.what() << std::endl;
+            CHAT_LOG(Error, "bad_any_cast").field("in", "sendStoredOfflineMessages").field("error", e.what());
         }
     }
 }
@@ -735,15 +1012,15 @@ void ChatLogicServer::searchUsers(const std::string &query, std::shared_ptr<INet
     std::string currentUsername = getUsernameFromCache(client);
     std::string sql = "SELECT username FROM users WHERE username LIKE ? AND username != ?;";
     auto results = m_db->fetchAll(sql, {"%" + query + "%", currentUsername});
-    std::string response = "SEARCH_RESULTS";
+    ChatMessageWriter response(ChatMessageType::SearchResults);
     for (const auto& row : results) {
         try {
-            response += ":" + std::any_cast<std::string>(row.at("username"));
+            response.field(std::any_cast<std::string>(row.at("username")));
         } catch (const std::bad_any_cast& e) {
-            std::cerr << "Bad any_cast in searchUsers: " << e.what() << std::endl;
+            CHAT_LOG(Error, "bad_any_cast").field("in", "searchUsers").field("error", e.what());
         }
     }
-    client->sendMessage(response);
+    sendReply(client, response);
 }
 
 bool ChatLogicServer::addFriend(const std::string &username, const std::string &friendName) {
@@ -766,12 +1043,12 @@ bool ChatLogicServer::addFriend(const std::string &username, const std::string &
         };
         if (userId == -1) {
             auto idOpt = getUserIdFromDb(username);
-            if (!idOpt) { std::cerr << "Cannot add friend: user " << username << " not found." << std::endl; return false; }
+            if (!idOpt) { CHAT_LOG(Warn, "friend_add_failed").field("user", username).field("reason", "no such user"); return false; }
             userId = idOpt.value();
         }
         if (friendId == -1) {
             auto idOpt = getUserIdFromDb(friendName);
-            if (!idOpt) { std::cerr << "Cannot add friend: user " << friendName << " not found." << std::endl; return false; }
+            if (!idOpt) { CHAT_LOG(Warn, "friend_add_failed").field("user", friendName).field("reason", "no such user"); return false; }
             friendId = idOpt.value();
         }
     }
@@ -792,14 +1069,11 @@ bool ChatLogicServer::addFriend(const std::string &username, const std::string &
       if (success1 || success2) {
         addFriendToCache(username, friendName); // Обновляем кэш
         
-        // Broadcast the updated user list to all clients to ensure statuses are current
-        std::cout << "Friend relation between " << username << " and " << friendName 
-                  << " established. Broadcasting user list." << std::endl;
-        broadcastUserList();
+        CHAT_LOG(Info, "friend_added").field("user", username).field("friend", friendName);
         
         return true;
     }
-    std::cerr << "Failed to add friend relationship between " << username << " and " << friendName << " in DB: " << m_db->lastError() << std::endl;
+    CHAT_LOG(Error, "friend_add_failed").field("user", username).field("friend", friendName).field("error", m_db->lastError());
     return false;
 }
 
@@ -820,12 +1094,12 @@ bool ChatLogicServer::removeFriend(const std::string &username, const std::strin
         };
         if (userId == -1) {
             auto idOpt = getUserIdFromDb(username);
-            if (!idOpt) { std::cerr << "Cannot remove friend: user " << username << " not found." << std::endl; return false; }
+            if (!idOpt) { CHAT_LOG(Warn, "friend_remove_failed").field("user", username).field("reason", "no such user"); return false; }
             userId = idOpt.value();
         }
         if (friendId == -1) {
             auto idOpt = getUserIdFromDb(friendName);
-            if (!idOpt) { std::cerr << "Cannot remove friend: user " << friendName << " not found." << std::endl; return false; }
+            if (!idOpt) { CHAT_LOG(Warn, "friend_remove_failed").field("user", friendName).field("reason", "no such user"); return false; }
             friendId = idOpt.value();
         }
     }
@@ -834,7 +1108,7 @@ bool ChatLogicServer::removeFriend(const std::string &username, const std::strin
     bool success2 = m_db->execute("DELETE FROM friendships WHERE user_id = ? AND friend_id = ?;", {friendId, userId});
     
     if (!m_db->lastError().empty() && !success1 && !success2) {
-         std::cerr << "DB error while trying to remove friend relationship between " << username << " and " << friendName << ": " << m_db->lastError() << std::endl;
+         CHAT_LOG(Error, "friend_remove_failed").field("user", username).field("friend", friendName).field("error", m_db->lastError());
          return false;
     }
     removeFriendFromCache(username, friendName); // Обновляем кэш в любом случае
@@ -856,7 +1130,7 @@ std::vector<std::string> ChatLogicServer::getUserFriends(const std::string &user
         try {
             friends.push_back(std::any_cast<std::string>(row.at("username")));
         } catch (const std::bad_any_cast& e) {
-            std::cerr << "Bad any_cast in getUserFriends: " << e.what() << std::endl;
+            CHAT_LOG(Error, "bad_any_cast").field("in", "getUserFriends").field("error", e.what());
         }
     }
     return friends;
@@ -884,11 +1158,11 @@ bool ChatLogicServer::createGroupChat(const std::string &chatId, const std::stri
             return true;
         } else {
             removeGroupChatFromCache(chatId);
-            std::cerr << "Failed to add creator " << creator << " to newly created group chat " << chatId << std::endl;
+            CHAT_LOG(Error, "group_create_failed").field("chat", chatId).field("creator", creator).field("reason", "creator not added");
             return false;
         }
     }
-    std::cerr << "Failed to create group chat " << chatId << " in DB: " << m_db->lastError() << std::endl;
+    CHAT_LOG(Error, "group_create_failed").field("chat", chatId).field("error", m_db->lastError());
     return false;
 }
 
@@ -896,11 +1170,11 @@ bool ChatLogicServer::addUserToGroupChat(const std::string &chatId, const std::s
     if (!m_db) return false;
     // Проверки существования чата и пользователя (как и раньше)
     if (!(m_db->fetchOne("SELECT 1 FROM group_chats WHERE id = ?;", {chatId})).has_value()){
-        std::cerr << "Attempt to add user to non-existent group chat: " << chatId << std::endl;
+        CHAT_LOG(Warn, "group_add_failed").field("chat", chatId).field("reason", "no such chat");
         return false;
     }
     if (!m_cachedUsers.count(username) && !(m_db->fetchOne("SELECT 1 FROM users WHERE username = ?;", {username})).has_value()){
-        std::cerr << "Attempt to add non-existent user to group chat: " << username << std::endl;
+        CHAT_LOG(Warn, "group_add_failed").field("user", username).field("reason", "no such user");
         return false;
     }
      // Проверка, не является ли уже участником (через кэш, если чат там есть)
@@ -920,7 +1194,7 @@ bool ChatLogicServer::addUserToGroupChat(const std::string &chatId, const std::s
         broadcastGroupChatInfo(chatId); 
         sendGroupChatMessageToClients(chatId, "SYSTEM", username + " присоединился к чату.");
     } else {
-        std::cerr << "Failed to add user " << username << " to group " << chatId << " in DB: " << m_db->lastError() << std::endl;
+        CHAT_LOG(Error, "group_add_failed").field("chat", chatId).field("user", username).field("error", m_db->lastError());
     }
     return success;
 }
@@ -934,17 +1208,18 @@ bool ChatLogicServer::removeUserFromGroupChat(const std::string &chatId, const s
 
         auto members_left_result = m_db->fetchAll("SELECT username FROM group_chat_members WHERE chat_id = ?;", {chatId});
         if (members_left_result.empty()) {
-            std::cout << "Last user left group " << chatId << ". Deleting group." << std::endl;
+            CHAT_LOG(Info, "group_deleted").field("chat", chatId).field("reason", "empty");
+            flushGroupMessages();
             m_db->execute("DELETE FROM group_chat_messages WHERE chat_id = ?;", {chatId});
             m_db->execute("DELETE FROM group_chats WHERE id = ?;", {chatId});
             removeGroupChatFromCache(chatId); // Удаляем чат из кэша
-            broadcastUserList(); 
         } else {
             broadcastGroupChatInfo(chatId);
             sendGroupChatMessageToClients(chatId, "SYSTEM", username + " покинул чат.");
         }
+        refreshUserList(username); // Чат пропал из списка вышедшего
     } else {
-        std::cerr << "Failed to remove user " << username << " from group " << chatId << " in DB: " << m_db->lastError() << std::endl;
+        CHAT_LOG(Error, "group_remove_failed").field("chat", chatId).field("user", username).field("error", m_db->lastError());
     }
     return success;
 }
@@ -953,7 +1228,7 @@ void ChatLogicServer::sendGroupChatInfo(const std::string &chatId, std::shared_p
     if (!m_db || !client) return;
     auto chatInfoOpt = m_db->fetchOne("SELECT name, creator_username FROM group_chats WHERE id = ?;", {chatId});
     if (!chatInfoOpt || !chatInfoOpt.value().count("name")) { // Проверяем наличие поля name
-        client->sendMessage("ERROR:Group chat " + chatId + " not found or info incomplete.");
+        sendReply(client, ChatMessageWriter(ChatMessageType::Error).field("Group chat " + chatId + " not found or info incomplete."));
         return;
     }
     std::string chatName = std::any_cast<std::string>(chatInfoOpt.value().at("name"));
@@ -961,15 +1236,13 @@ void ChatLogicServer::sendGroupChatInfo(const std::string &chatId, std::shared_p
 
     std::string membersQuery = "SELECT username FROM group_chat_members WHERE chat_id = ?;";
     auto membersResult = m_db->fetchAll(membersQuery, {chatId});
-    std::string membersStr;
+    ChatMessageWriter info(ChatMessageType::GroupChatInfo);
+    info.field(chatId).field(chatName).textOnly(":");
     for (size_t i = 0; i < membersResult.size(); ++i) {
-        membersStr += std::any_cast<std::string>(membersResult[i].at("username"));
-        if (i < membersResult.size() - 1) {
-            membersStr += ",";
-        }
+        info.field(std::any_cast<std::string>(membersResult[i].at("username")), i == 0 ? ChatMessageWriter::NoSeparator : ',');
     }
-    client->sendMessage("GROUP_CHAT_INFO:" + chatId + ":" + chatName + ":" + membersStr);
-    client->sendMessage("GROUP_CHAT_CREATOR:" + chatId + ":" + creator);
+    sendReply(client, info);
+    sendReply(client, ChatMessageWriter(ChatMessageType::GroupChatCreator).field(chatId).field(creator));
 }
 
 void ChatLogicServer::broadcastGroupChatInfo(const std::string &chatId) {
@@ -982,82 +1255,128 @@ void ChatLogicServer::broadcastGroupChatInfo(const std::string &chatId) {
 
     std::string membersQuery = "SELECT username FROM group_chat_members WHERE chat_id = ?;";
     auto membersResult = m_db->fetchAll(membersQuery, {chatId});
-    std::string membersStr;
+    ChatMessageWriter info(ChatMessageType::GroupChatInfo);
+    info.field(chatId).field(chatName).textOnly(":");
     std::vector<std::string> memberUsernames;
 
     for (size_t i = 0; i < membersResult.size(); ++i) {
         std::string memberUsername = std::any_cast<std::string>(membersResult[i].at("username"));
+        info.field(memberUsername, i == 0 ? ChatMessageWriter::NoSeparator : ',');
         memberUsernames.push_back(memberUsername);
-        membersStr += memberUsername;
-        if (i < membersResult.size() - 1) {
-            membersStr += ",";
-        }
     }
 
-    std::string infoMessage = "GROUP_CHAT_INFO:" + chatId + ":" + chatName + ":" + membersStr;
-    std::string creatorMessage = "GROUP_CHAT_CREATOR:" + chatId + ":" + creator;
+    const SharedFrame infoMessage = makeSharedFrame(info);
+    const SharedFrame creatorMessage = makeSharedFrame(ChatMessageWriter(ChatMessageType::GroupChatCreator).field(chatId).field(creator));
 
     for (const std::string& memberUsername : memberUsernames) {
         auto memberClient = getClientFromCache(memberUsername);
         if (memberClient && memberClient->isConnected()) {
-            memberClient->sendMessage(infoMessage);
-            memberClient->sendMessage(creatorMessage);
+            memberClient->sendFrame(infoMessage);
+            memberClient->sendFrame(creatorMessage);
         }
     }
-    broadcastUserList(); // Обновляем списки у всех, т.к. состав чата мог измениться
+    // Состав чата мог измениться: чат есть в списках только его участников
+    for (const std::string& memberUsername : memberUsernames) {
+        refreshUserList(memberUsername);
+    }
 }
 
 bool ChatLogicServer::saveGroupChatMessage(const std::string &chatId, const std::string &sender, const std::string &message) {
     if (!m_db) return false;
     std::string query = "INSERT INTO group_chat_messages (chat_id, sender_username, message) VALUES (?, ?, ?);";
     bool success = m_db->execute(query, {chatId, sender, message});
-    if (!success) std::cerr << "Failed to save group message to " << chatId << ": " << m_db->lastError() << std::endl;
+    if (!success) {
+        CHAT_LOG(Error, "db_failed").field("op", "save group message").field("chat", chatId).field("error", m_db->lastError());
+    }
     return success;
 }
 
 void ChatLogicServer::sendGroupChatMessageToClients(const std::string &chatId, const std::string &sender, const std::string &message) {
-    if (!m_db || !m_networkServer) return;
-    if (!saveGroupChatMessage(chatId, sender, message)) { // Сначала сохраняем
-        std::cerr << "Message not sent because it failed to save to DB." << std::endl;
+    if (!m_networkServer) return;
+    auto chat = m_cachedGroupChats.find(chatId);
+    if (chat == m_cachedGroupChats.end()) {
+        CHAT_LOG(Warn, "group_message_dropped").field("chat", chatId).field("reason", "no such chat");
         return;
     }
+    m_groupMessageQueue.push_back({chatId, sender, message});
+    if (m_groupMessageQueue.size() >= GroupMessageBatchSize) {
+        flushGroupMessages();
+    }
 
-    std::string membersQuery = "SELECT username FROM group_chat_members WHERE chat_id = ?;";
-    auto membersResult = m_db->fetchAll(membersQuery, {chatId});
-    std::string formattedMessage = "GROUP_MESSAGE:" + chatId + ":" + sender + ":" + message;
+    // Кадры кодируются один раз, получателям достаётся ссылка на них
+    const SharedFrame formattedMessage = makeSharedFrame(ChatMessageWriter(ChatMessageType::GroupMessage).field(chatId).field(sender).field(message));
+    for (const CachedUser* member : chat->second.onlineMembers) {
+        if (member->client && member->client->isConnected()) {
+            member->client->sendFrame(formattedMessage);
+        }
+    }
+}
 
-    for (const auto& row : membersResult) { 
-        std::string memberUsername = std::any_cast<std::string>(row.at("username"));
-        auto memberClient = getClientFromCache(memberUsername);
-        if (memberClient && memberClient->isConnected()) {
-            memberClient->sendMessage(formattedMessage);
+void ChatLogicServer::flushGroupMessages() {
+    if (m_groupMessageQueue.empty() || !m_db) {
+        return;
+    }
+    std::size_t failed = 0;
+    std::set<std::string> lostChats;
+    const auto saveAll = [this, &failed, &lostChats]() {
+        failed = 0;
+        lostChats.clear();
+        for (const PendingGroupMessage& pending : m_groupMessageQueue) {
+            if (!saveGroupChatMessage(pending.chatId, pending.sender, pending.message)) {
+                ++failed;
+                lostChats.insert(pending.chatId);
+            }
+        }
+    };
+    // Одна транзакция на пачку: SQLite не синхронизирует журнал на каждую строку
+    const bool transaction = m_db->execute("BEGIN TRANSACTION;");
+    saveAll();
+    if (transaction && !m_db->execute("COMMIT;")) {
+        // Участники сообщения уже получили: после отката каждая строка пишется сама по себе,
+        // и теряются только те, что не записались и так
+        CHAT_LOG(Warn, "db_failed").field("op", "commit group messages").field("count", m_groupMessageQueue.size())
+            .field("error", m_db->lastError());
+        m_db->execute("ROLLBACK;");
+        saveAll();
+    }
+    if (failed != 0) {
+        std::string chats;
+        for (const std::string& chatId : lostChats) {
+            chats += chats.empty() ? chatId : "," + chatId;
         }
+        CHAT_LOG(Error, "group_messages_lost").field("count", failed).field("total", m_groupMessageQueue.size())
+            .field("chats", chats);
     }
+    CHAT_LOG(Debug, "group_messages_saved").field("count", m_groupMessageQueue.size() - failed);
+    m_groupMessageQueue.clear();
 }
 
 void ChatLogicServer::sendGroupChatHistory(const std::string &chatId, std::shared_ptr<INetworkClient> client) {
     if (!m_db || !client) return;
+    flushGroupMessages(); // История должна включать ещё не записанные сообщения
     
-    client->sendMessage("GROUP_HISTORY_BEGIN:" + chatId);
+    sendReply(client, ChatMessageWriter(ChatMessageType::GroupHistoryBegin).field(chatId));
 
     std::string query_str = "SELECT sender_username, message, timestamp FROM group_chat_messages WHERE chat_id = ? ORDER BY timestamp ASC;";
     auto results = m_db->fetchAll(query_str, {chatId});
     
     if (results.empty()) {
-        client->sendMessage("GROUP_HISTORY_MSG:" + chatId + "|0000-00-00 00:00:00|SYSTEM|История группового чата пуста");
+        sendReply(client, ChatMessageWriter(ChatMessageType::GroupHistoryMsg)
+            .field(chatId).field("0000-00-00 00:00:00", '|').field("SYSTEM", '|').field("История группового чата пуста", '|'));
     } else {
         for (const auto& row : results) {
             try {
                 std::string sender = std::any_cast<std::string>(row.at("sender_username"));
                 std::string message_text = std::any_cast<std::string>(row.at("message"));
                 std::string timestamp = std::any_cast<std::string>(row.at("timestamp"));
-                client->sendMessage("GROUP_HISTORY_MSG:" + chatId + "|" + timestamp + "|" + sender + "|" + message_text);
+                sendReply(client, ChatMessageWriter(ChatMessageType::GroupHistoryMsg)
+                    .field(chatId).field(timestamp, '|').field(sender, '|').field(message_text, '|'));
             } catch (const std::bad_any_cast& e) {
-                std::cerr << "Bad any_cast in sendGroupChatHistory: " << e.what() << std::endl;
+                CHAT_LOG(Error, "bad_any_cast").field("in", "sendGroupChatHistory").field("error", e.what());
             }
         }
     }
-    client->sendMessage("GROUP_HISTORY_END:" + chatId);
+    sendReply(client, ChatMessageWriter(ChatMessageType::GroupHistoryEnd).field(chatId));
 }
 
 void ChatLogicServer::sendUserGroupChats(const std::string &username, std::shared_ptr<INetworkClient> client) {
@@ -1067,38 +1386,21 @@ void ChatLogicServer::sendUserGroupChats(const std::string &username, std::share
                         "WHERE gcm.username = ?;";
     auto results = m_db->fetchAll(query, {username});
     
-    std::string response = "GROUP_CHATS_LIST";
-    if (!results.empty()) {
-         for (size_t i = 0; i < results.size(); ++i) {
-            try {
-                std::string chatId = std::any_cast<std::string>(results[i].at("id"));
-                std::string chatName = std::any_cast<std::string>(results[i].at("name"));
-                response += (i == 0 ? ":" : ",") + chatId + ":" + chatName; 
-            } catch (const std::bad_any_cast& e) {
-                std::cerr << "Bad any_cast in sendUserGroupChats: " << e.what() << std::endl;
-            }
-        }
-    } else {
-        response += ":";
-    }
-    std::vector<std::string> chatEntries;
-     for (const auto& row : results) {
+    // Текст: "GROUP_CHATS_LIST:id:название,id:название"; в двоичном виде по 2 поля на чат
+    ChatMessageWriter response(ChatMessageType::GroupChatsList);
+    response.textOnly(":");
+    char separator = ChatMessageWriter::NoSeparator;
+    for (const auto& row : results) {
         try {
             std::string chatId = std::any_cast<std::string>(row.at("id"));
             std::string chatName = std::any_cast<std::string>(row.at("name"));
-            chatEntries.push_back(chatId + ":" + chatName);
+            response.field(chatId, separator).field(chatName);
+            separator = ',';
         } catch (const std::bad_any_cast& e) {
-            std::cerr << "Bad any_cast in sendUserGroupChats: " << e.what() << std::endl;
-        }
-    }
-    response = "GROUP_CHATS_LIST:";
-    for(size_t i=0; i < chatEntries.size(); ++i){
-        response += chatEntries[i];
-        if(i < chatEntries.size() -1){
-            response += ",";
+            CHAT_LOG(Error, "bad_any_cast").field("in", "sendUserGroupChats").field("error", e.what());
         }
     }
-    client->sendMessage(response);
+    sendReply(client, response);
 }
 
 bool ChatLogicServer::updateLastReadMessage(const std::string &username, const std::string &chatPartner, int64_t messageId) {
@@ -1106,7 +1408,9 @@ bool ChatLogicServer::updateLastReadMessage(const std::string &username, const s
     std::string query = "INSERT INTO read_messages (username, chat_partner, last_read_message_id) VALUES (?, ?, ?) "
                         "ON CONFLICT(username, chat_partner) DO UPDATE SET last_read_message_id = excluded.last_read_message_id;";
     bool success = m_db->execute(query, {username, chatPartner, messageId});
-    if (!success) std::cerr << "Failed to update last read message for " << username << " with " << chatPartner << ": " << m_db->lastError() << std::endl;
+    if (!success) {
+        CHAT_LOG(Error, "db_failed").field("op", "update last read").field("user", username).field("partner", chatPartner).field("error", m_db->lastError());
+    }
     return success;
 }
 
@@ -1117,7 +1421,7 @@ int64_t ChatLogicServer::getLastReadMessageId(const std::string &username, const
         try {
             return std::any_cast<long long>(result.value().at("last_read_message_id"));
         } catch (const std::bad_any_cast& e) {
-             std::cerr << "Bad any_cast for last_read_message_id: " << e.what() << std::endl;
+             CHAT_LOG(Error, "bad_any_cast").field("in", "last_read_message_id").field("error", e.what());
              return -1;
         }
     }
@@ -1133,6 +1437,7 @@ int ChatLogicServer::getUnreadMessageCount(const std::string &username, const st
     bool isGroupChat = (m_db->fetchOne("SELECT 1 FROM group_chats WHERE id = ?", {chatPartner})).has_value();
 
     if (isGroupChat) {
+        flushGroupMessages();
         query_str = "SELECT COUNT(*) as unread_count FROM group_chat_messages WHERE chat_id = ? AND id > ? AND sender_username != ?;";
         results = m_db->fetchAll(query_str, {chatPartner, lastReadId, username});
     } else {
@@ -1144,7 +1449,7 @@ int ChatLogicServer::getUnreadMessageCount(const std::string &username, const st
         try {
             return static_cast<int>(std::any_cast<long long>(results[0].at("unread_count")));
         } catch (const std::bad_any_cast& e) {
-            std::cerr << "Bad any_cast for unread_count: " << e.what() << std::endl;
+            CHAT_LOG(Error, "bad_any_cast").field("in", "unread_count").field("error", e.what());
             return 0;
         }
     }
@@ -1160,6 +1465,7 @@ bool ChatLogicServer::markAllMessagesAsRead(const std::string &username, const s
     bool isGroupChat = (m_db->fetchOne("SELECT 1 FROM group_chats WHERE id = ?", {chatPartner})).has_value();
 
     if (isGroupChat) {
+        flushGroupMessages();
         query_str = "SELECT MAX(id) as max_id FROM group_chat_messages WHERE chat_id = ?;";
         result_row = m_db->fetchOne(query_str, {chatPartner});
     } else {
@@ -1178,13 +1484,13 @@ bool ChatLogicServer::markAllMessagesAsRead(const std::string &username, const s
                 latestMessageId = std::stoll(std::any_cast<std::string>(val));
             }
         } catch (const std::bad_any_cast& e) {
-            std::cerr << "Bad any_cast for max_id in markAllMessagesAsRead: " << e.what() << std::endl;
+            CHAT_LOG(Error, "bad_any_cast").field("in", "markAllMessagesAsRead").field("error", e.what());
             latestMessageId = 0; 
         } catch (const std::invalid_argument& ia) {
-            std::cerr << "Invalid argument for stoll (max_id): " << ia.what() << std::endl;
+            CHAT_LOG(Error, "bad_number").field("in", "markAllMessagesAsRead").field("error", ia.what());
             latestMessageId = 0;
         } catch (const std::out_of_range& oor) {
-            std::cerr << "Out of range for stoll (max_id): " << oor.what() << std::endl;
+            CHAT_LOG(Error, "bad_number").field("in", "markAllMessagesAsRead").field("error", oor.what());
             latestMessageId = 0;
         }
     }
@@ -1194,15 +1500,19 @@ bool ChatLogicServer::markAllMessagesAsRead(const std::string &username, const s
 void ChatLogicServer::sendUnreadMessagesCount(std::shared_ptr<INetworkClient> client, const std::string &username, const std::string &chatPartner) {
     if (!client) return;
     int count = getUnreadMessageCount(username, chatPartner);
-    client->sendMessage("UNREAD_COUNT:" + chatPartner + ":" + std::to_string(count));
+    sendReply(client, ChatMessageWriter(ChatMessageType::UnreadCount).field(chatPartner).number(count));
 }
 
 void ChatLogicServer::loadCachesFromDb() {
     if (!m_db) {
-        std::cerr << "Cannot load caches: Database not available." << std::endl;
+        CHAT_LOG(Error, "cache_load_failed").field("reason", "no database");
         return;
     }
-    std::cout << "Loading caches from database..." << std::endl;
+    CHAT_LOG(Info, "cache_load_started");
+    m_sessions.clear(); // Сессии указывают на записи m_cachedUsers
+    m_presenceSubscribers.clear();
+    m_pendingPresence.clear(); // Отложенные обновления ссылаются на пользователей по имени, их могло не стать
+    m_dirtyRosters.clear();
     m_cachedUsers.clear();
     m_cachedGroupChats.clear();
 
@@ -1213,10 +1523,9 @@ void ChatLogicServer::loadCachesFromDb() {
             long long userId = std::any_cast<long long>(row.at("id"));
             m_cachedUsers[username] = {username, userId, false, nullptr, {}, {}};
         } catch (const std::bad_any_cast& e) {
-            std::cerr << "Error casting user data during cache load: " << e.what() << std::endl;
+            CHAT_LOG(Error, "bad_any_cast").field("in", "loadCachesFromDb users").field("error", e.what());
         }
     }
-    std::cout << "Loaded " << m_cachedUsers.size() << " users into cache." << std::endl;
 
     for (auto& pair : m_cachedUsers) {
         CachedUser& cachedUser = pair.second;
@@ -1228,11 +1537,10 @@ void ChatLogicServer::loadCachesFromDb() {
             try {
                 cachedUser.friendUsernames.insert(std::any_cast<std::string>(row.at("username")));
             } catch (const std::bad_any_cast& e) {
-                std::cerr << "Error casting friend username for " << cachedUser.username << ": " << e.what() << std::endl;
+                CHAT_LOG(Error, "bad_any_cast").field("in", "loadCachesFromDb friends").field("user", cachedUser.username).field("error", e.what());
             }
         }
     }
-    std::cout << "Loaded friend lists into cache." << std::endl;
 
     auto groupChatsResult = m_db->fetchAll("SELECT id, name, creator_username FROM group_chats;");
     for (const auto& row : groupChatsResult) {
@@ -1240,12 +1548,11 @@ void ChatLogicServer::loadCachesFromDb() {
             std::string chatId = std::any_cast<std::string>(row.at("id"));
             std::string chatName = std::any_cast<std::string>(row.at("name"));
             std::string creatorUsername = std::any_cast<std::string>(row.at("creator_username"));
-            m_cachedGroupChats[chatId] = {chatId, chatName, creatorUsername, {}};
+            m_cachedGroupChats[chatId] = {chatId, chatName, creatorUsername, {}, {}};
         } catch (const std::bad_any_cast& e) {
-            std::cerr << "Error casting group chat data during cache load: " << e.what() << std::endl;
+            CHAT_LOG(Error, "bad_any_cast").field("in", "loadCachesFromDb groups").field("error", e.what());
         }
     }
-    std::cout << "Loaded " << m_cachedGroupChats.size() << " group chats into cache." << std::endl;
 
     for (auto& pair : m_cachedGroupChats) {
         CachedGroupChat& cachedChat = pair.second;
@@ -1260,12 +1567,11 @@ void ChatLogicServer::loadCachesFromDb() {
                     m_cachedUsers[memberUsername].groupChatIds.insert(cachedChat.id);
                 }
             } catch (const std::bad_any_cast& e) {
-                std::cerr << "Error casting group chat member for chat " << cachedChat.id << ": " << e.what() << std::endl;
+                CHAT_LOG(Error, "bad_any_cast").field("in", "loadCachesFromDb members").field("chat", cachedChat.id).field("error", e.what());
             }
         }
     }
-    std::cout << "Loaded group chat memberships into cache." << std::endl;
-    std::cout << "Cache loading complete." << std::endl;
+    CHAT_LOG(Info, "cache_loaded").field("users", m_cachedUsers.size()).field("groups", m_cachedGroupChats.size());
 }
 
 
@@ -1285,7 +1591,7 @@ void ChatLogicServer::removeFriendFromCache(const std::string& username1, const
     if (m_cachedUsers.count(username2)) {
         m_cachedUsers.at(username2).friendUsernames.erase(username1);
     }
-    std::cout << "Cache updated: Friend relationship removed between " << username1 << " and " << username2 << std::endl;
+    CHAT_LOG(Debug, "cache_friend_removed").field("user", username1).field("friend", username2);
 }
 
 void ChatLogicServer::addOrUpdateGroupChatInCache(const std::string& chatId, const std::string& chatName, const std::string& creatorUsername) {
@@ -1294,11 +1600,11 @@ void ChatLogicServer::addOrUpdateGroupChatInCache(const std::string& chatId, con
         CachedGroupChat& chat = m_cachedGroupChats.at(chatId);
         chat.name = chatName;
         // chat.creatorUsername обычно не меняется, но можно добавить, если нужно
-        std::cout << "Cache updated: Group chat " << chatId << " updated." << std::endl;
+        CHAT_LOG(Debug, "cache_group_updated").field("chat", chatId);
     } else {
         // Добавляем новый
-        m_cachedGroupChats[chatId] = {chatId, chatName, creatorUsername, {}};
-        std::cout << "Cache updated: Group chat " << chatId << " added." << std::endl;
+        m_cachedGroupChats[chatId] = {chatId, chatName, creatorUsername, {}, {}};
+        CHAT_LOG(Debug, "cache_group_added").field("chat", chatId);
     }
 }
 
@@ -1312,60 +1618,131 @@ void ChatLogicServer::removeGroupChatFromCache(const std::string& chatId) {
             }
         }
         m_cachedGroupChats.erase(chatId);
-        std::cout << "Cache updated: Group chat " << chatId << " removed." << std::endl;
+        CHAT_LOG(Debug, "cache_group_removed").field("chat", chatId);
     }
 }
 
 void ChatLogicServer::addUserToGroupChatInCache(const std::string& username, const std::string& chatId) {
-    if (m_cachedGroupChats.count(chatId)) {
-        m_cachedGroupChats.at(chatId).memberUsernames.insert(username);
-    }
-    if (m_cachedUsers.count(username)) {
-        m_cachedUsers.at(username).groupChatIds.insert(chatId);
+    auto chat = m_cachedGroupChats.find(chatId);
+    auto user = m_cachedUsers.find(username);
+    if (chat != m_cachedGroupChats.end()) {
+        chat->second.memberUsernames.insert(username);
+    }
+    if (user != m_cachedUsers.end()) {
+        user->second.groupChatIds.insert(chatId);
+        if (chat != m_cachedGroupChats.end()) {
+            setOnlineMember(chat->second, user->second, user->second.isOnline);
+        }
     }
-    std::cout << "Cache updated: User " << username << " added to group chat " << chatId << std::endl;
+    CHAT_LOG(Debug, "cache_member_added").field("chat", chatId).field("user", username);
 }
 
 void ChatLogicServer::removeUserFromGroupChatInCache(const std::string& username, const std::string& chatId) {
-    if (m_cachedGroupChats.count(chatId)) {
-        m_cachedGroupChats.at(chatId).memberUsernames.erase(username);
+    auto chat = m_cachedGroupChats.find(chatId);
+    auto user = m_cachedUsers.find(username);
+    if (chat != m_cachedGroupChats.end()) {
+        chat->second.memberUsernames.erase(username);
+        if (user != m_cachedUsers.end()) {
+            setOnlineMember(chat->second, user->second, false);
+        }
     }
-    if (m_cachedUsers.count(username)) {
-        m_cachedUsers.at(username).groupChatIds.erase(chatId);
+    if (user != m_cachedUsers.end()) {
+        user->second.groupChatIds.erase(chatId);
+    }
+    CHAT_LOG(Debug, "cache_member_removed").field("chat", chatId).field("user", username);
+}
+
+void ChatLogicServer::setOnlineMember(CachedGroupChat& chat, const CachedUser& user, bool online) {
+    auto it = std::find(chat.onlineMembers.begin(), chat.onlineMembers.end(), &user);
+    if (online && it == chat.onlineMembers.end()) {
+        chat.onlineMembers.push_back(&user);
+    } else if (!online && it != chat.onlineMembers.end()) {
+        *it = chat.onlineMembers.back(); // Порядок рассылки не важен
+        chat.onlineMembers.pop_back();
+    }
+}
+
+void ChatLogicServer::updateOnlineMemberships(const CachedUser& user) {
+    for (const std::string& chatId : user.groupChatIds) {
+        auto chat = m_cachedGroupChats.find(chatId);
+        if (chat != m_cachedGroupChats.end()) {
+            setOnlineMember(chat->second, user, user.isOnline);
+        }
     }
-    std::cout << "Cache updated: User " << username << " removed from group chat " << chatId << std::endl;
 }
 
 void ChatLogicServer::updateUserCacheOnLogin(const std::string& username, std::shared_ptr<INetworkClient> client) {
+    // Соединение, вошедшее под другим именем, сначала выходит из прежней сессии
+    if (const Session* previous = findSession(client.get()); previous && previous->username != username) {
+        const std::string previousUsername = previous->username;
+        updateUserCacheOnLogout(previousUsername);
+        broadcastPresence(previousUsername, false);
+    }
     if (m_cachedUsers.count(username)) {
         CachedUser& user = m_cachedUsers.at(username);
+        if (user.client && user.client != client) {
+            endSession(user.client.get());
+        }
         user.isOnline = true;
         user.client = client;
-        std::cout << "Cache updated: User " << username << " is online." << std::endl;
+        beginSession(client.get(), user);
+        updateOnlineMemberships(user);
+        CHAT_LOG(Debug, "cache_user_online").field("user", username);
     } else {
-        std::cerr << "User " << username << " not found in cache during login update. Attempting to load from DB..." << std::endl;
+        CHAT_LOG(Warn, "cache_miss").field("user", username).field("in", "updateUserCacheOnLogin");
         auto userRow = m_db->fetchOne("SELECT id FROM users WHERE username = ?;", {username});
         if (userRow && userRow.value().count("id")) {
             try {
                 long long userId = std::any_cast<long long>(userRow.value().at("id"));
-                m_cachedUsers[username] = {username, userId, true, client, {}, {}}; // Сразу ставим онлайн
+                CachedUser& user = m_cachedUsers[username];
+                user = {username, userId, true, client, {}, {}}; // Сразу ставим онлайн
+                beginSession(client.get(), user);
                 
-                std::cout << "Cache updated: User " << username << " (re)loaded and set online." << std::endl;
+                CHAT_LOG(Info, "cache_user_loaded").field("user", username).field("online", true);
             } catch (const std::bad_any_cast& e) {
-                std::cerr << "Error casting user ID for cache during login update: " << e.what() << std::endl;
+                CHAT_LOG(Error, "bad_any_cast").field("in", "updateUserCacheOnLogin").field("error", e.what());
             }
         } else {
-            std::cerr << "Failed to load user " << username << " into cache during login update." << std::endl;
+            CHAT_LOG(Error, "cache_user_load_failed").field("user", username).field("in", "updateUserCacheOnLogin");
         }
     }
 }
 
+void ChatLogicServer::beginSession(const INetworkClient* client, CachedUser& user) {
+    // Повторный AUTH под тем же именем сохраняет подписки сессии
+    Session& session = m_sessions[client];
+    session.username = user.username;
+    session.user = &user;
+    session.presenceDeltas = client->wireOptions().presence;
+}
+
+void ChatLogicServer::endSession(const INetworkClient* client) {
+    auto session = m_sessions.find(client);
+    if (session == m_sessions.end()) {
+        return;
+    }
+    for (const std::string& target : session->second.presenceSubscriptions) {
+        auto subscribers = m_presenceSubscribers.find(target);
+        if (subscribers != m_presenceSubscribers.end()) {
+            subscribers->second.erase(session->second.username);
+            if (subscribers->second.empty()) {
+                m_presenceSubscribers.erase(subscribers);
+            }
+        }
+    }
+    m_sessions.erase(session);
+}
+
 void ChatLogicServer::updateUserCacheOnLogout(const std::string& username) {
     if (m_cachedUsers.count(username)) {
         CachedUser& user = m_cachedUsers.at(username);
+        if (user.client) {
+            endSession(user.client.get());
+        }
         user.isOnline = false;
         user.client = nullptr;
-        std::cout << "Cache updated: User " << username << " is offline." << std::endl;
+        updateOnlineMemberships(user);
+        CHAT_LOG(Debug, "cache_user_offline").field("user", username);
     }
 }
 
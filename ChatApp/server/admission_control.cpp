@@ -0,0 +1,61 @@
+#include "admission_control.h"
+
+AdmissionController::AdmissionController(const AdmissionLimits& limits) {
+    setLimits(limits);
+}
+
+void AdmissionController::setLimits(const AdmissionLimits& limits) {
+    m_limits = limits;
+    const double burst = limits.acceptBurst > 0.0 ? limits.acceptBurst : limits.acceptRate;
+    m_acceptBucket = TokenBucket(limits.acceptRate, burst);
+}
+
+AdmissionController::Decision AdmissionController::admit(const std::string& peer, Clock::time_point now) {
+    if (m_limits.maxConnections != 0 && m_connections >= m_limits.maxConnections) {
+        ++m_stats.rejectedCapacity;
+        return Decision::RejectCapacity;
+    }
+    std::size_t* peerConnections = nullptr;
+    if (!peer.empty()) {
+        peerConnections = &m_perPeer[peer];
+        if (m_limits.maxConnectionsPerIp != 0 && *peerConnections >= m_limits.maxConnectionsPerIp) {
+            ++m_stats.rejectedPerIp;
+            return Decision::RejectPerIp;
+        }
+    }
+    // Токен тратится последним: отказ по пределам не должен съедать скорость приёма
+    if (!m_acceptBucket.tryTake(now)) {
+        if (peerConnections && *peerConnections == 0) {
+            m_perPeer.erase(peer);
+        }
+        ++m_stats.rejectedRate;
+        return Decision::RejectRate;
+    }
+    ++m_connections;
+    if (peerConnections) {
+        ++*peerConnections;
+    }
+    ++m_stats.accepted;
+    return Decision::Accept;
+}
+
+void AdmissionController::release(const std::string& peer) {
+    if (m_connections != 0) {
+        --m_connections;
+    }
+    if (peer.empty()) {
+        return;
+    }
+    const auto it = m_perPeer.find(peer);
+    if (it != m_perPeer.end() && --it->second == 0) {
+        m_perPeer.erase(it);
+    }
+}
+
+void AdmissionController::startPreAuth(std::uint64_t key, Clock::time_point now) {
+    if (m_limits.preAuthTimeout.count() <= 0) {
+        return;
+    }
+    m_preAuthQueue.emplace_back(now + m_limits.preAuthTimeout, key);
+    m_preAuthPending.insert(key);
+}
@@ -0,0 +1,83 @@
+#ifndef ADMISSION_CONTROL_H
+#define ADMISSION_CONTROL_H
+
+#include "network_interface.h"
+#include "token_bucket.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+struct AdmissionLimits {
+    std::size_t maxConnections = 0;       // 0 - без ограничения
+    std::size_t maxConnectionsPerIp = 0;  // 0 - без ограничения
+    double acceptRate = 0.0;              // Новых соединений в секунду, 0 - без ограничения
+    double acceptBurst = 0.0;             // Сколько можно принять разом; 0 - столько же, сколько за секунду
+    std::chrono::milliseconds preAuthTimeout{0}; // Сколько ждать AUTH, 0 - не ограничено
+};
+
+// Допуск соединений до того, как на них потрачено что-то кроме accept(): общий предел, предел
+// на адрес, скорость приёма (ведро токенов), а потом таймаут на вход. Бэкенд спрашивает admit()
+// на каждое принятое соединение и закрывает его сразу, если ответ не Accept. Не потокобезопасен:
+// вызывается из того потока, где бэкенд ведёт список соединений.
+class AdmissionController {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Decision {
+        Accept,
+        RejectCapacity,
+        RejectPerIp,
+        RejectRate
+    };
+
+    explicit AdmissionController(const AdmissionLimits& limits = AdmissionLimits());
+
+    // Действует для соединений, принятых после вызова
+    void setLimits(const AdmissionLimits& limits);
+    const AdmissionLimits& limits() const { return m_limits; }
+
+    // peer - адрес без порта; пустой - не учитывать адрес (Unix-сокет).
+    // Принятое соединение нужно вернуть через release() с тем же peer
+    Decision admit(const std::string& peer, Clock::time_point now = Clock::now());
+    void release(const std::string& peer);
+
+    // Таймаут входа. key уникален на всё время работы бэкенда (номер не переиспользуется)
+    void startPreAuth(std::uint64_t key, Clock::time_point now = Clock::now());
+    // Клиент вошёл или соединение закрыто - таймаут снимается
+    void finishPreAuth(std::uint64_t key) { m_preAuthPending.erase(key); }
+    // Вызывает reap(key) для соединений, не вошедших вовремя, возвращает их число.
+    // Дедлайны идут в порядке приёма, поэтому проверяется только начало очереди
+    template<typename Fn>
+    std::size_t reapExpired(Clock::time_point now, Fn&& reap) {
+        std::size_t reaped = 0;
+        while (!m_preAuthQueue.empty() && m_preAuthQueue.front().first <= now) {
+            const std::uint64_t key = m_preAuthQueue.front().second;
+            m_preAuthQueue.pop_front();
+            if (m_preAuthPending.erase(key) != 0) {
+                ++m_stats.reapedPreAuth;
+                ++reaped;
+                reap(key);
+            }
+        }
+        return reaped;
+    }
+
+    std::size_t connections() const { return m_connections; }
+    const AdmissionStats& stats() const { return m_stats; }
+
+private:
+    AdmissionLimits m_limits;
+    TokenBucket m_acceptBucket;
+    std::size_t m_connections = 0;
+    std::unordered_map<std::string, std::size_t> m_perPeer;
+    std::deque<std::pair<Clock::time_point, std::uint64_t>> m_preAuthQueue;
+    std::unordered_set<std::uint64_t> m_preAuthPending;
+    AdmissionStats m_stats;
+};
+
+#endif // ADMISSION_CONTROL_H
@@ -3,11 +3,17 @@
 
 #include "network_interface.h"
 #include "database_interface.h"
+#include "inbound_rate_limiter.h"
+#include "chat_protocol.h"
+#include <array>
+#include <chrono>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <map>
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
 #include <set>          
 
 // Объявляно заранее чтобы избежать ошибок компиляции
@@ -28,12 +34,111 @@ public:
     void handleClientDisconnected(std::shared_ptr<INetworkClient> client);
     void handleMessageReceived(std::shared_ptr<INetworkClient> client, const std::string& message);
 
+    // Пределы скорости команд настраиваются до startServer()
+    InboundRateLimiter& rateLimiter() { return m_rateLimiter; }
+
+    // Счётчики по типу команды: вызовы, отказы (нет обработчика, не хватает полей, нужен вход)
+    // и время в обработчике
+    struct CommandStats {
+        std::uint64_t calls = 0;
+        std::uint64_t rejected = 0;
+        std::uint64_t totalNanoseconds = 0;
+        std::uint64_t maxNanoseconds = 0;
+    };
+    const CommandStats& commandStats(ChatMessageType type) const;
+
+    // Изменения списков (USERLIST) и статусов (PRESENCE) копятся и уходят одним сообщением на клиента
+    // за окно. Нулевое окно - отправка после каждой команды; иначе flushRosterUpdates() вызывает
+    // таймер с этим периодом
+    void setRosterFlushInterval(std::chrono::milliseconds interval) { m_rosterFlushInterval = interval; }
+    std::chrono::milliseconds rosterFlushInterval() const { return m_rosterFlushInterval; }
+    void flushRosterUpdates();
+    // Сообщения групп уходят участникам сразу, а в БД пишутся пачкой в одной транзакции: по тому же
+    // окну, при накоплении GroupMessageBatchSize и перед чтением group_chat_messages. Если COMMIT не
+    // прошёл, строки пишутся по одной без транзакции; незаписанные попадают в журнал как ошибка
+    void flushGroupMessages();
+
+    // Счётчики склейки: requested - сколько сообщений ушло бы без неё, sent - сколько ушло
+    struct RosterStats {
+        std::uint64_t requested = 0;
+        std::uint64_t sent = 0;
+        std::uint64_t flushes = 0;
+
+        std::uint64_t coalesced() const { return requested - sent; }
+    };
+    const RosterStats& rosterStats() const { return m_rosterStats; }
+
 private:
+    // Что видит обработчик команды
+    struct CommandContext {
+        const std::shared_ptr<INetworkClient>& client;
+        const std::string& username; // Пусто - клиент не вошёл
+        const ChatMessage& request;
+
+        std::string field(std::size_t index) const { return std::string(request.text(index)); }
+    };
+    using CommandHandler = void (ChatLogicServer::*)(const CommandContext& context);
+
+    // Запись таблицы команд. Обработчик сам объявляет, сколько полей ему нужно и нужен ли вход,
+    // проверки делает handleMessageReceived до вызова
+    struct CommandEntry {
+        CommandHandler handler = nullptr;
+        std::size_t arity = 0;
+        bool requiresAuth = true;
+        const char* authError = nullptr; // ERROR для клиента без входа; nullptr - отказ молча
+        CommandStats stats;
+    };
+    // Индекс - код типа сообщения, поиск обработчика - одно обращение к массиву
+    static constexpr std::size_t CommandTableSize = 128;
+    static_assert(std::size_t(ChatMessageType::Presence) < CommandTableSize, "код типа вне таблицы команд");
+    std::array<CommandEntry, CommandTableSize> m_commands;
+
+    void registerCommands();
+    void registerCommand(ChatMessageType type, CommandHandler handler, std::size_t arity, bool requiresAuth,
+                         const char* authError = nullptr);
+    void rejectCommand(const CommandContext& context);
+
+    // Обработчики команд клиента
+    void onAuth(const CommandContext& context);
+    void onRegister(const CommandContext& context);
+    void onGetUserList(const CommandContext& context);
+    void onPrivateMessage(const CommandContext& context);
+    void onGetHistory(const CommandContext& context);
+    void onGetPrivateHistory(const CommandContext& context);
+    void onCreateGroupChat(const CommandContext& context);
+    void onJoinGroupChat(const CommandContext& context);
+    void onGroupMessage(const CommandContext& context);
+    void onGroupAddUser(const CommandContext& context);
+    void onGroupRemoveUser(const CommandContext& context);
+    void onDeleteGroupChat(const CommandContext& context);
+    void onGroupGetCreator(const CommandContext& context);
+    void onGetGroupChats(const CommandContext& context);
+    void onMarkRead(const CommandContext& context);
+    void onGetUnreadCount(const CommandContext& context);
+    void onSearchUsers(const CommandContext& context);
+    void onAddFriend(const CommandContext& context);
+    void onRemoveFriend(const CommandContext& context);
+    void onGetFriends(const CommandContext& context);
+    void onSubscribePresence(const CommandContext& context);
+    void onUnsubscribePresence(const CommandContext& context);
+    void onText(const CommandContext& context);
+
     bool authenticateUser(const std::string& username, const std::string& password, std::shared_ptr<INetworkClient> client);
     bool registerUser(const std::string& username, const std::string& password, std::shared_ptr<INetworkClient> client);
     void sendUserList(std::shared_ptr<INetworkClient> client);
-    void broadcastUserList();
+    // Вход или выход пользователя уходит клиентам с опцией presence в PRESENCE, но только тем, кому он
+    // интересен (collectPresenceRecipients); статус остальных они узнают по SUBSCRIBE_PRESENCE, когда
+    // открывают окно чата. Клиентам без presence - полный USERLIST, как раньше, всем вошедшим.
+    // Оба только помечают изменение, отправляет flushRosterUpdates()
+    void broadcastPresence(const std::string& username, bool online);
+    // Вошедшие друзья, участники общих групп и подписчики пользователя - в m_presenceRecipients
+    void collectPresenceRecipients(const std::string& username);
+    // Изменился список самого пользователя (друзья, группы): новый USERLIST только ему
+    void refreshUserList(const std::string& username);
     bool sendPrivateMessageToUser(const std::string& recipientUsername, const std::string& message, const std::string& senderUsername);
+    // Ответ уходит клиенту в том виде (текст или двоичный), который он согласовал
+    void sendReply(const std::shared_ptr<INetworkClient>& client, ChatMessageWriter& reply);
+    void sendReply(const std::shared_ptr<INetworkClient>& client, ChatMessageWriter&& reply) { sendReply(client, reply); }
 
     // Структура для кэширования информации о пользователе
     struct CachedUser {
@@ -45,14 +150,36 @@ private:
         std::set<std::string> groupChatIds;
     };
     std::unordered_map<std::string, CachedUser> m_cachedUsers; 
+    // Сессия вошедшего пользователя по соединению. Запись есть ровно пока пользователь в сети
+    // с этим соединением: её ставит updateUserCacheOnLogin и убирает updateUserCacheOnLogout
+    struct Session {
+        std::string username;
+        CachedUser* user = nullptr; // Узлы m_cachedUsers не переезжают при росте таблицы
+        bool presenceDeltas = false; // Клиент согласовал presence и получает PRESENCE вместо USERLIST
+        std::unordered_set<std::string> presenceSubscriptions; // Чьи PRESENCE нужны открытым окнам чатов
+    };
+    std::unordered_map<const INetworkClient*, Session> m_sessions;
+    // Обратный индекс подписок: пользователь -> кто из вошедших на него подписан. Друзья и участники
+    // общих групп берутся из friendUsernames и memberUsernames, которые кэш и так поддерживает
+    std::unordered_map<std::string, std::unordered_set<std::string>> m_presenceSubscribers;
+    static constexpr std::size_t MaxPresenceSubscriptions = 256; // На одну сессию
+    std::unordered_set<const CachedUser*> m_presenceRecipients; // Переиспользуется между рассылками
+    void beginSession(const INetworkClient* client, CachedUser& user);
+    // Убирает сессию соединения вместе с её подписками
+    void endSession(const INetworkClient* client);
     // Структура для кэширования информации о групповом чате
     struct CachedGroupChat {
         std::string id;
         std::string name;
         std::string creatorUsername;
         std::set<std::string> memberUsernames;
+        // Вошедшие участники: рассылка сообщения идёт прямо по их соединениям, без БД и поиска по имени
+        std::vector<const CachedUser*> onlineMembers;
     };
     std::unordered_map<std::string, CachedGroupChat> m_cachedGroupChats; 
+    void setOnlineMember(CachedGroupChat& chat, const CachedUser& user, bool online);
+    // Приводит onlineMembers всех групп пользователя к его isOnline
+    void updateOnlineMemberships(const CachedUser& user);
     void loadCachesFromDb(); // Загрузка начальных данных из БД
     void updateUserCacheOnLogin(const std::string& username, std::shared_ptr<INetworkClient> client);
     void updateUserCacheOnLogout(const std::string& username);
@@ -72,7 +199,8 @@ private:
 
     // Вспомогательные функции для работы с кэшем (заменят m_authenticatedUsers)
     std::shared_ptr<INetworkClient> getClientFromCache(const std::string& username);
-    std::string getUsernameFromCache(std::shared_ptr<INetworkClient> client);
+    std::string getUsernameFromCache(const std::shared_ptr<INetworkClient>& client);
+    Session* findSession(const INetworkClient* client); // nullptr - соединение не вошло
     bool isUserOnlineInCache(const std::string& username);
 
     // Создание таблицы пользователей друзей сообщений и так далее.
@@ -120,6 +248,38 @@ private:
 
     std::unique_ptr<IDatabase> m_db;
     std::shared_ptr<INetworkServer> m_networkServer;
+    InboundRateLimiter m_rateLimiter;
+    // Отложенные обновления до flushRosterUpdates(). Счётчики - сколько изменений склеено в одно
+    struct PendingPresence {
+        bool online = false; // Последний статус за окно
+        std::uint64_t changes = 0;
+    };
+    struct PresenceBatch {
+        ChatMessageWriter writer{ChatMessageType::Presence};
+        std::uint64_t changes = 0;
+    };
+    std::chrono::milliseconds m_rosterFlushInterval{0};
+    std::unordered_map<std::string, PendingPresence> m_pendingPresence;
+    std::unordered_map<std::string, std::uint64_t> m_dirtyRosters;
+    // Рабочие таблицы сброса: новые изменения во время отправки копятся до следующего
+    std::unordered_map<std::string, PendingPresence> m_flushPresence;
+    std::unordered_map<std::string, std::uint64_t> m_flushRosters;
+    std::unordered_map<const CachedUser*, PresenceBatch> m_presenceBatches;
+    bool m_flushingRoster = false;
+    RosterStats m_rosterStats;
+
+    struct PendingGroupMessage {
+        std::string chatId;
+        std::string sender;
+        std::string message;
+    };
+    static constexpr std::size_t GroupMessageBatchSize = 256;
+    std::vector<PendingGroupMessage> m_groupMessageQueue;
+
+    ChatMessage m_request; // Разобранное входящее сообщение, память под поля переиспользуется
+    // Клиент, чья команда сейчас обрабатывается, и номер запроса: ответы ему несут этот номер
+    const INetworkClient* m_replyClient = nullptr;
+    std::uint64_t m_replyRequestId = 0;
 };
 
 #endif // CHAT_LOGIC_SERVER_H
\ No newline at end of file
@@ -0,0 +1,130 @@
+#ifndef CONNECTION_REGISTRY_H
+#define CONNECTION_REGISTRY_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Реестр соединений: добавление, поиск и удаление за O(1) по плотному числовому id.
+// Id - номер слота, освободившиеся слоты переиспользуются, поэтому id остаются маленькими
+// даже после миллионов переподключений. Живые записи лежат подряд в m_live (удаление -
+// перестановкой последней на место удалённой), обход идёт по этому массиву.
+// Во время forEach удаление лишь помечает запись, и обход не пропускает и не повторяет записей.
+template<typename T>
+class ConnectionRegistry {
+public:
+    using Id = std::uint32_t;
+
+    Id add(T value) {
+        Id id;
+        if (!m_freeIds.empty()) {
+            id = m_freeIds.back();
+            m_freeIds.pop_back();
+        } else {
+            id = Id(m_slots.size());
+            m_slots.emplace_back();
+        }
+        Slot& slot = m_slots[id];
+        slot.value = std::move(value);
+        slot.livePosition = m_live.size();
+        slot.used = true;
+        m_live.push_back(id);
+        ++m_count;
+        return id;
+    }
+
+    // nullptr, если id свободен
+    T* find(Id id) {
+        return contains(id) ? &m_slots[id].value : nullptr;
+    }
+
+    bool contains(Id id) const {
+        return id < m_slots.size() && m_slots[id].used && !m_slots[id].removed;
+    }
+
+    bool remove(Id id) {
+        if (!contains(id)) {
+            return false;
+        }
+        --m_count;
+        if (m_iterating != 0) {
+            // Переставлять m_live под идущим обходом нельзя, доделаем после него
+            m_slots[id].removed = true;
+            m_pendingRemovals.push_back(id);
+            return true;
+        }
+        erase(id);
+        return true;
+    }
+
+    // Обход всех живых записей; fn может добавлять и удалять записи
+    template<typename Fn>
+    void forEach(Fn&& fn) {
+        ++m_iterating;
+        // Добавленные во время обхода записи в него не попадают
+        const std::size_t end = m_live.size();
+        for (std::size_t i = 0; i < end; ++i) {
+            Slot& slot = m_slots[m_live[i]];
+            if (!slot.removed) {
+                fn(m_live[i], slot.value);
+            }
+        }
+        if (--m_iterating == 0) {
+            for (Id id : m_pendingRemovals) {
+                erase(id);
+            }
+            m_pendingRemovals.clear();
+        }
+    }
+
+    template<typename Fn>
+    void forEach(Fn&& fn) const {
+        for (Id id : m_live) {
+            if (!m_slots[id].removed) {
+                fn(id, m_slots[id].value);
+            }
+        }
+    }
+
+    void clear() {
+        m_slots.clear();
+        m_live.clear();
+        m_freeIds.clear();
+        m_pendingRemovals.clear();
+        m_count = 0;
+    }
+
+    // Число живых соединений
+    std::size_t size() const { return m_count; }
+    bool empty() const { return m_count == 0; }
+    // Сколько слотов выделено (наибольшее число одновременных соединений)
+    std::size_t capacity() const { return m_slots.size(); }
+
+private:
+    struct Slot {
+        T value{};
+        std::size_t livePosition = 0;
+        bool used = false;
+        bool removed = false; // Удалён во время обхода, ждёт erase
+    };
+
+    void erase(Id id) {
+        Slot& slot = m_slots[id];
+        const std::size_t position = slot.livePosition;
+        const Id last = m_live.back();
+        m_live[position] = last;
+        m_slots[last].livePosition = position;
+        m_live.pop_back();
+        slot = Slot(); // Отпускаем значение (shared_ptr соединения) сразу
+        m_freeIds.push_back(id);
+    }
+
+    std::vector<Slot> m_slots;
+    std::vector<Id> m_live;
+    std::vector<Id> m_freeIds;
+    std::vector<Id> m_pendingRemovals;
+    std::size_t m_count = 0;
+    int m_iterating = 0;
+};
+
+#endif // CONNECTION_REGISTRY_H
@@ -0,0 +1,535 @@
+#include "epoll_network_server.h"
+#include "socket_utils.h"
+#include "logger.h"
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int MaxEventsPerWait = 256;
+constexpr std::size_t ReadBufferSize = 64 * 1024;
+
+} // namespace
+
+EpollClient::EpollClient(EpollNetworkServer* server, int fd, std::string clientId)
+    : m_server(server), m_fd(fd), m_clientId(std::move(clientId)), m_output(4096),
+      m_outboundGuard(server->m_outboundLimits) {
+}
+
+EpollClient::~EpollClient() {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+void EpollClient::sendMessage(const std::string& message) {
+    if (!admit(message)) {
+        return;
+    }
+    std::string& frames = m_server->m_encodeBuffer;
+    frames.clear();
+    enqueue(message, frames, m_session.encode(message, frames));
+}
+
+void EpollClient::sendFrame(const SharedFrame& frame) {
+    if (!admit(frame->message())) {
+        return;
+    }
+    // Кадры уже закодированы для этого формата одним из предыдущих получателей
+    const WireOptions& options = m_session.options();
+    enqueue(frame->message(), frame->frames(options), frame->frameCount(options));
+}
+
+bool EpollClient::admit(const std::string& message) {
+    if (!isConnected()) {
+        CHAT_LOG_SAMPLED(Debug, "message_dropped", 10).field("client", m_clientId).field("reason", "not connected");
+        return false;
+    }
+    switch (m_outboundGuard.admit(message, queuedBytes())) {
+    case OutboundQueueGuard::Action::Send:
+        return true;
+    case OutboundQueueGuard::Action::Skip:
+        break;
+    case OutboundQueueGuard::Action::Disconnect:
+        m_server->evictClient(*this);
+        break;
+    }
+    return false;
+}
+
+void EpollClient::enqueue(const std::string& message, std::string_view frames, std::size_t frameCount) {
+    if (frameCount == 0) {
+        CHAT_LOG_SAMPLED(Warn, "message_dropped", 10).field("client", m_clientId)
+            .field("bytes", message.size()).field("reason", "exceeds legacy frame");
+        return;
+    }
+    if (m_session.options().deflate) {
+        m_batch.append(frames);
+    } else {
+        m_output.append(frames);
+    }
+    m_pendingFrames += frameCount;
+    m_server->queueFlush(*this);
+}
+
+OutboundQueueStats EpollClient::outboundStats() const {
+    OutboundQueueStats stats = m_outboundGuard.stats();
+    stats.queuedBytes = queuedBytes();
+    return stats;
+}
+
+std::string EpollClient::getClientId() const {
+    return m_clientId;
+}
+
+bool EpollClient::isConnected() const {
+    return m_fd >= 0 && !m_closing;
+}
+
+void EpollClient::markAuthenticated() {
+    if (m_fd >= 0) {
+        m_server->m_admission.finishPreAuth(m_timerKey);
+    }
+}
+
+void EpollClient::disconnectClient() {
+    if (m_fd < 0 || m_closing) {
+        return;
+    }
+    m_closing = true;
+    // Сначала отправляем очередь, закрытие - после неё (см. flushClient)
+    m_server->queueFlush(*this);
+}
+
+EpollNetworkServer::EpollNetworkServer()
+    : m_epollFd(epoll_create1(EPOLL_CLOEXEC)), m_listenFd(-1), m_port(0), m_dispatching(false),
+      m_readBuffer(ReadBufferSize) {
+    if (m_epollFd < 0) {
+        CHAT_LOG(Error, "syscall_failed").field("call", "epoll_create1").field("error", std::strerror(errno));
+    }
+}
+
+EpollNetworkServer::~EpollNetworkServer() {
+    stop();
+    if (m_epollFd >= 0) {
+        ::close(m_epollFd);
+    }
+}
+
+bool EpollNetworkServer::start(int port) {
+    if (m_epollFd < 0 || m_listenFd >= 0) {
+        return false;
+    }
+    const int fd = createListenSocket(port, true);
+    if (fd < 0) {
+        CHAT_LOG(Error, "network_start_failed").field("backend", "epoll").field("port", port).field("error", std::strerror(errno));
+        return false;
+    }
+    if (!startListening(fd)) {
+        return false;
+    }
+    m_port = boundPort(m_listenFd);
+    CHAT_LOG(Info, "network_started").field("backend", "epoll").field("port", m_port);
+    return true;
+}
+
+bool EpollNetworkServer::startListening(int listenFd) {
+    if (m_epollFd < 0 || m_listenFd >= 0) {
+        ::close(listenFd);
+        return false;
+    }
+    if (::listen(listenFd, SOMAXCONN) != 0) {
+        CHAT_LOG(Error, "syscall_failed").field("call", "listen").field("error", std::strerror(errno));
+        ::close(listenFd);
+        return false;
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.fd = listenFd;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, listenFd, &event) != 0) {
+        CHAT_LOG(Error, "syscall_failed").field("call", "epoll_ctl").field("error", std::strerror(errno));
+        ::close(listenFd);
+        return false;
+    }
+    m_listenFd = listenFd;
+    return true;
+}
+
+void EpollNetworkServer::stop() {
+    if (m_listenFd >= 0) {
+        epoll_ctl(m_epollFd, EPOLL_CTL_DEL, m_listenFd, nullptr);
+        ::close(m_listenFd);
+        m_listenFd = -1;
+        const NetworkWriteStats stats = writeStats();
+        const OutboundQueueStats outbound = outboundStats();
+        const CompressionStats compression = compressionStats();
+        CHAT_LOG(Info, "network_stopped").field("backend", "epoll")
+            .field("frames", stats.frames).field("flushes", stats.flushes)
+            .field("frames_per_flush", stats.framesPerFlush()).field("max_frames_per_flush", stats.maxFramesPerFlush)
+            .field("max_queued_bytes", outbound.maxQueuedBytes).field("dropped", outbound.dropped)
+            .field("coalesced", outbound.coalesced).field("evicted", outbound.evicted)
+            .field("compression_ratio", compression.ratio()).field("compression_ms", compression.cpuNanos / 1000000)
+            .field("rejected", m_admission.stats().rejected()).field("reaped_pre_auth", m_admission.stats().reapedPreAuth)
+            .field("pings", m_heartbeats.stats().pingsSent).field("reaped_idle", m_heartbeats.stats().idleReaped);
+    }
+    // Закрываем все клиентские соединения, отправив то, что успели поставить в очередь
+    std::vector<std::shared_ptr<EpollClient>> clients;
+    clients.reserve(m_clients.size());
+    for (const auto& entry : m_clients) {
+        clients.push_back(entry.second);
+    }
+    for (const auto& client : clients) {
+        flushClient(*client);
+        closeClient(client, false);
+    }
+    m_flushQueue.clear();
+}
+
+void EpollNetworkServer::broadcastMessage(const std::string& message) {
+    const SharedFrame frame = makeSharedFrame(message);
+    for (const auto& entry : m_clients) {
+        if (entry.second->isConnected()) {
+            entry.second->sendFrame(frame);
+        }
+    }
+}
+
+void EpollNetworkServer::setClientConnectedCallback(ClientConnectedCallback cb) {
+    m_clientConnectedCb = cb;
+}
+
+void EpollNetworkServer::setClientDisconnectedCallback(ClientDisconnectedCallback cb) {
+    m_clientDisconnectedCb = cb;
+}
+
+void EpollNetworkServer::setMessageReceivedCallback(MessageReceivedCallback cb) {
+    m_messageReceivedCb = cb;
+}
+
+NetworkWriteStats EpollNetworkServer::writeStats() const {
+    NetworkWriteStats total = m_closedWriteStats;
+    for (const auto& entry : m_clients) {
+        total.add(entry.second->writeStats());
+    }
+    return total;
+}
+
+OutboundQueueStats EpollNetworkServer::outboundStats() const {
+    OutboundQueueStats total = m_closedOutboundStats;
+    for (const auto& entry : m_clients) {
+        total.add(entry.second->outboundStats());
+    }
+    return total;
+}
+
+CompressionStats EpollNetworkServer::compressionStats() const {
+    CompressionStats total = m_closedCompressionStats;
+    for (const auto& entry : m_clients) {
+        total.add(entry.second->compressionStats());
+    }
+    return total;
+}
+
+void EpollNetworkServer::processEvents(int timeoutMs) {
+    if (m_epollFd < 0) {
+        return;
+    }
+    epoll_event events[MaxEventsPerWait];
+    const int count = epoll_wait(m_epollFd, events, MaxEventsPerWait, timeoutMs);
+    if (count < 0) {
+        if (errno != EINTR) {
+            CHAT_LOG(Error, "syscall_failed").field("call", "epoll_wait").field("error", std::strerror(errno));
+        }
+        return;
+    }
+
+    m_dispatching = true;
+    for (int i = 0; i < count; ++i) {
+        const int fd = events[i].data.fd;
+        if (fd == m_listenFd) {
+            acceptConnections();
+            continue;
+        }
+        const auto it = m_clients.find(fd);
+        if (it == m_clients.end()) {
+            continue; // Соединение уже закрыто раньше в этом же проходе
+        }
+        const std::shared_ptr<EpollClient> client = it->second;
+        const uint32_t flags = events[i].events;
+
+        if (flags & (EPOLLIN | EPOLLRDHUP)) {
+            handleReadable(client);
+        }
+        if (client->m_fd >= 0 && (flags & EPOLLOUT)) {
+            flushClient(*client);
+        }
+        if (client->m_fd >= 0 && (flags & (EPOLLHUP | EPOLLERR))) {
+            closeClient(client, true);
+        }
+    }
+    m_dispatching = false;
+
+    flushQueued();
+    checkTimeouts();
+}
+
+void EpollNetworkServer::checkTimeouts() {
+    const AdmissionController::Clock::time_point now = AdmissionController::Clock::now();
+    m_admission.reapExpired(now, [this](std::uint64_t key) {
+        if (const std::shared_ptr<EpollClient> client = findByTimerKey(key)) {
+            CHAT_LOG(Info, "client_reaped").field("client", client->m_clientId).field("reason", "auth timeout");
+            closeClient(client, true);
+        }
+    });
+    m_heartbeats.tick(now, [this](std::uint64_t key) {
+        if (const std::shared_ptr<EpollClient> client = findByTimerKey(key)) {
+            client->sendMessage(std::string(FrameProtocol::PingMessage));
+        }
+    }, [this](std::uint64_t key) {
+        if (const std::shared_ptr<EpollClient> client = findByTimerKey(key)) {
+            CHAT_LOG(Info, "client_reaped").field("client", client->m_clientId).field("reason", "idle");
+            closeClient(client, true);
+        }
+    });
+}
+
+std::shared_ptr<EpollClient> EpollNetworkServer::findByTimerKey(std::uint64_t key) const {
+    const auto it = m_clients.find(int(key & 0xFFFFFFFFu));
+    if (it == m_clients.end() || it->second->m_timerKey != key) {
+        return nullptr;
+    }
+    return it->second;
+}
+
+void EpollNetworkServer::acceptConnections() {
+    for (;;) { // Edge-triggered: принимаем, пока очередь не опустеет
+        sockaddr_storage address{};
+        socklen_t addressLength = sizeof(address);
+        const int fd = accept4(m_listenFd, reinterpret_cast<sockaddr*>(&address), &addressLength,
+                               SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                CHAT_LOG_SAMPLED(Warn, "accept_failed", 10).field("backend", "epoll").field("error", std::strerror(errno));
+            }
+            return;
+        }
+
+        // Решение принимается до того, как на соединение потрачено что-то ещё
+        const std::string host = address.ss_family == AF_UNIX ? std::string() : peerHost(address);
+        if (m_admission.admit(host) != AdmissionController::Decision::Accept) {
+            ::close(fd);
+            continue;
+        }
+
+        std::string clientId;
+        if (address.ss_family == AF_UNIX) {
+            clientId = describeUnixPeer(fd);
+        } else {
+            // Запись и так копится за проход, Нейгл только добавит задержку
+            const int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            clientId = describePeer(address);
+        }
+
+        auto client = std::make_shared<EpollClient>(this, fd, std::move(clientId));
+        client->m_peerHost = host;
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.fd = fd;
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            CHAT_LOG(Error, "syscall_failed").field("call", "epoll_ctl").field("client", client->getClientId()).field("error", std::strerror(errno));
+            m_admission.release(host);
+            continue; // Деструктор клиента закроет сокет
+        }
+        m_clients[fd] = client;
+        client->m_timerKey = (std::uint64_t(++m_acceptGeneration) << 32) | std::uint32_t(fd);
+        m_admission.startPreAuth(client->m_timerKey);
+
+        if (m_clientConnectedCb) {
+            m_clientConnectedCb(client);
+        }
+    }
+}
+
+void EpollNetworkServer::handleReadable(const std::shared_ptr<EpollClient>& client) {
+    while (client->m_fd >= 0) {
+        const ssize_t received = ::recv(client->m_fd, m_readBuffer.data(), m_readBuffer.size(), 0);
+        if (received == 0) {
+            closeClient(client, true);
+            return;
+        }
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                closeClient(client, true);
+            }
+            break;
+        }
+
+        client->m_session.append(m_readBuffer.data(), std::size_t(received));
+        m_heartbeats.touch(client->m_timerKey, HeartbeatMonitor::Clock::now());
+        std::string message;
+        for (;;) {
+            const WireSession::Result result = client->m_session.next(message);
+            if (result == WireSession::Result::NeedMoreData) {
+                break;
+            }
+            if (result == WireSession::Result::Error) {
+                CHAT_LOG(Warn, "client_protocol_error").field("client", client->m_clientId).field("reason", "malformed frame");
+                closeClient(client, true);
+                return;
+            }
+            if (result == WireSession::Result::Handshake) {
+                client->m_output.append(message);
+                client->m_pendingFrames += 1;
+                queueFlush(*client);
+                if (client->m_session.options().heartbeat) {
+                    m_heartbeats.add(client->m_timerKey);
+                }
+                continue;
+            }
+            if (message == FrameProtocol::PongMessage) {
+                continue; // Ответ на PING нужен только для touch() выше
+            }
+            if (m_messageReceivedCb) {
+                m_messageReceivedCb(client, message);
+            }
+            if (client->m_fd < 0) {
+                return; // Закрыт из обработчика
+            }
+        }
+    }
+    client->m_session.release();
+}
+
+void EpollNetworkServer::queueFlush(EpollClient& client) {
+    if (!m_dispatching || client.queuedBytes() >= FlushThreshold) {
+        flushClient(client);
+        return;
+    }
+    if (!client.m_flushQueued) {
+        client.m_flushQueued = true;
+        m_flushQueue.push_back(client.shared_from_this());
+    }
+}
+
+void EpollNetworkServer::flushQueued() {
+    std::vector<std::shared_ptr<EpollClient>> queue;
+    queue.swap(m_flushQueue);
+    for (const auto& client : queue) {
+        client->m_flushQueued = false;
+        flushClient(*client);
+    }
+}
+
+void EpollNetworkServer::flushClient(EpollClient& client) {
+    if (client.m_fd < 0) {
+        return;
+    }
+    sealBatch(client);
+    std::size_t written = 0;
+    while (!client.m_output.empty()) {
+        const std::string_view first = client.m_output.first();
+        const std::string_view second = client.m_output.second();
+        iovec parts[2] = {
+            { const_cast<char*>(first.data()), first.size() },
+            { const_cast<char*>(second.data()), second.size() },
+        };
+        msghdr header{};
+        header.msg_iov = parts;
+        header.msg_iovlen = second.empty() ? 1 : 2;
+        const ssize_t sent = ::sendmsg(client.m_fd, &header, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                // Закрытие придёт через EPOLLHUP/EPOLLERR в processEvents
+                client.m_output.clear();
+                ::shutdown(client.m_fd, SHUT_RDWR);
+            }
+            break; // Остаток уйдёт по EPOLLOUT
+        }
+        client.m_output.consume(std::size_t(sent));
+        written += std::size_t(sent);
+    }
+
+    if (written != 0 && client.m_pendingFrames != 0) {
+        client.m_writeStats.frames += client.m_pendingFrames;
+        client.m_writeStats.flushes += 1;
+        client.m_writeStats.maxFramesPerFlush = std::max(client.m_writeStats.maxFramesPerFlush, client.m_pendingFrames);
+        client.m_pendingFrames = 0;
+    }
+    client.m_writeStats.bytes += written;
+
+    if (client.m_output.empty()) {
+        client.m_output.release();
+        std::string().swap(client.m_batch);
+        if (client.m_closing) {
+            // Отправленное уже в ядре, FIN уйдёт после него; закрытие придёт через EPOLLHUP
+            ::shutdown(client.m_fd, SHUT_RDWR);
+        }
+    }
+
+    std::vector<std::string> deferred;
+    if (written != 0 && client.m_outboundGuard.drained(client.m_output.size(), deferred)) {
+        for (const std::string& message : deferred) {
+            client.sendMessage(message);
+        }
+    }
+}
+
+void EpollNetworkServer::sealBatch(EpollClient& client) {
+    if (client.m_batch.empty()) {
+        return;
+    }
+    // Одна пачка на сброс: история при входе сжимается целиком, а не по сообщению
+    m_compressBuffer.clear();
+    m_compressor.compress(client.m_batch, m_compressBuffer, client.m_compressionStats);
+    client.m_output.append(m_compressBuffer);
+    client.m_batch.clear();
+}
+
+void EpollNetworkServer::evictClient(EpollClient& client) {
+    CHAT_LOG(Warn, "client_evicted").field("client", client.m_clientId).field("queued_bytes", client.queuedBytes());
+    client.m_closing = true;
+    client.m_output.clear();
+    client.m_output.release();
+    std::string().swap(client.m_batch);
+    ::shutdown(client.m_fd, SHUT_RDWR);
+}
+
+void EpollNetworkServer::closeClient(const std::shared_ptr<EpollClient>& client, bool notify) {
+    if (client->m_fd < 0) {
+        return;
+    }
+    const int fd = client->m_fd;
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    client->m_fd = -1;
+    client->m_output.clear();
+    client->m_output.release();
+    std::string().swap(client->m_batch);
+    m_closedWriteStats.add(client->m_writeStats);
+    m_closedOutboundStats.add(client->outboundStats());
+    m_closedCompressionStats.add(client->m_compressionStats);
+    m_admission.release(client->m_peerHost);
+    m_admission.finishPreAuth(client->m_timerKey);
+    m_heartbeats.remove(client->m_timerKey);
+    m_clients.erase(fd);
+
+    if (notify && m_clientDisconnectedCb) {
+        m_clientDisconnectedCb(client);
+    }
+}
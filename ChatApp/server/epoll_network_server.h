@@ -0,0 +1,147 @@
+#ifndef EPOLL_NETWORK_SERVER_H
+#define EPOLL_NETWORK_SERVER_H
+
+#include "admission_control.h"
+#include "frame_compression.h"
+#include "heartbeat_monitor.h"
+#include "network_interface.h"
+#include "outbound_queue.h"
+#include "ring_buffer.h"
+#include "wire_session.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class EpollNetworkServer;
+
+// Соединение epoll-бэкенда. Обычный объект без QObject: неблокирующий сокет, очередь записи
+// в кольцевом буфере, который отпускает память, как только всё отправлено.
+class EpollClient : public INetworkClient, public std::enable_shared_from_this<EpollClient> {
+public:
+    EpollClient(EpollNetworkServer* server, int fd, std::string clientId);
+    ~EpollClient() override;
+
+    void sendMessage(const std::string& message) override;
+    void sendFrame(const SharedFrame& frame) override;
+    std::string getClientId() const override;
+    bool isConnected() const override;
+    void disconnectClient() override;
+    void markAuthenticated() override;
+    WireOptions wireOptions() const override { return m_session.options(); }
+
+    int fd() const { return m_fd; }
+    const NetworkWriteStats& writeStats() const { return m_writeStats; }
+    OutboundQueueStats outboundStats() const;
+    const CompressionStats& compressionStats() const { return m_compressionStats; }
+
+private:
+    friend class EpollNetworkServer;
+
+    // Проверка соединения и ограничения очереди; false - сообщение не отправляется
+    bool admit(const std::string& message);
+    void enqueue(const std::string& message, std::string_view frames, std::size_t frameCount);
+    std::size_t queuedBytes() const { return m_output.size() + m_batch.size(); }
+
+    EpollNetworkServer* m_server;
+    int m_fd;
+    std::string m_clientId;
+    std::string m_peerHost;          // Для предела соединений с адреса
+    // Ключ таймеров входа и живости: номер поколения << 32 | fd. fd переиспользуется, ключ - нет
+    std::uint64_t m_timerKey = 0;
+    WireSession m_session;
+    RingBuffer m_output;
+    std::string m_batch; // deflate: кадры, которые сожмутся одной пачкой при сбросе
+    std::uint64_t m_pendingFrames = 0;
+    NetworkWriteStats m_writeStats;
+    OutboundQueueGuard m_outboundGuard;
+    CompressionStats m_compressionStats;
+    bool m_closing = false;     // disconnectClient(): закрыть после отправки очереди
+    bool m_flushQueued = false;
+};
+
+// INetworkServer поверх epoll (только Linux). Сокеты неблокирующие, события edge-triggered.
+// Своего потока нет: владелец встраивает pollFd() в свой цикл событий и вызывает processEvents(),
+// поэтому колбэки ChatLogicServer выполняются в том же потоке, что и вызов processEvents().
+class EpollNetworkServer : public INetworkServer {
+public:
+    EpollNetworkServer();
+    ~EpollNetworkServer() override;
+
+    bool start(int port) override;
+    void stop() override;
+    void broadcastMessage(const std::string& message) override;
+
+    void setClientConnectedCallback(ClientConnectedCallback cb) override;
+    void setClientDisconnectedCallback(ClientDisconnectedCallback cb) override;
+    void setMessageReceivedCallback(MessageReceivedCallback cb) override;
+
+    // Дескриптор epoll становится читаемым, когда есть готовые события
+    int pollFd() const { return m_epollFd; }
+    // Обрабатывает готовые события, timeoutMs как у epoll_wait
+    void processEvents(int timeoutMs = 0);
+
+    // Фактический порт (полезно при start(0))
+    int port() const { return m_port; }
+    std::size_t connectionCount() const { return m_clients.size(); }
+    NetworkWriteStats writeStats() const;
+    // Действует для соединений, принятых после вызова
+    void setOutboundLimits(const OutboundQueueLimits& limits) { m_outboundLimits = limits; }
+    OutboundQueueStats outboundStats() const;
+    CompressionStats compressionStats() const;
+    void setAdmissionLimits(const AdmissionLimits& limits) { m_admission.setLimits(limits); }
+    const AdmissionStats& admissionStats() const { return m_admission.stats(); }
+    // Действует для соединений, принятых после вызова
+    void setHeartbeatLimits(const HeartbeatLimits& limits) { m_heartbeats.setLimits(limits); }
+    const HeartbeatStats& heartbeatStats() const { return m_heartbeats.stats(); }
+    // Закрывает соединения, не вошедшие вовремя, шлёт PING замолчавшим и закрывает не ответивших.
+    // Вызывается из processEvents(), а когда событий нет - владельцем по таймеру
+    void checkTimeouts();
+
+    // Очередь сбрасывается сразу, если в ней накопилось больше этого числа байт
+    static constexpr std::size_t FlushThreshold = 64 * 1024;
+
+protected:
+    // Начинает принимать соединения на уже привязанном сокете (TCP или Unix), забирает fd
+    bool startListening(int listenFd);
+    bool isListening() const { return m_listenFd >= 0; }
+
+private:
+    friend class EpollClient;
+
+    void acceptConnections();
+    void handleReadable(const std::shared_ptr<EpollClient>& client);
+    void queueFlush(EpollClient& client);
+    void flushClient(EpollClient& client);
+    // Сжимает накопленную пачку в очередь записи
+    void sealBatch(EpollClient& client);
+    void flushQueued();
+    // Клиент не читает: очередь выбрасывается, закрытие придёт через EPOLLHUP
+    void evictClient(EpollClient& client);
+    void closeClient(const std::shared_ptr<EpollClient>& client, bool notify);
+    std::shared_ptr<EpollClient> findByTimerKey(std::uint64_t key) const;
+
+    int m_epollFd;
+    int m_listenFd;
+    int m_port;
+    bool m_dispatching; // Внутри processEvents(): запись откладывается до конца прохода
+    std::unordered_map<int, std::shared_ptr<EpollClient>> m_clients;
+    std::vector<std::shared_ptr<EpollClient>> m_flushQueue;
+    std::vector<char> m_readBuffer;  // Общий для всех соединений, у простаивающих буфера чтения нет
+    std::string m_encodeBuffer;
+    FrameCompressor m_compressor;
+    std::string m_compressBuffer;
+    NetworkWriteStats m_closedWriteStats;
+    OutboundQueueLimits m_outboundLimits;
+    OutboundQueueStats m_closedOutboundStats;
+    CompressionStats m_closedCompressionStats;
+    AdmissionController m_admission;
+    HeartbeatMonitor m_heartbeats;
+    std::uint32_t m_acceptGeneration = 0;
+
+    ClientConnectedCallback m_clientConnectedCb;
+    ClientDisconnectedCallback m_clientDisconnectedCb;
+    MessageReceivedCallback m_messageReceivedCb;
+};
+
+#endif // EPOLL_NETWORK_SERVER_H
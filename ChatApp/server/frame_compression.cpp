@@ -0,0 +1,77 @@
+#include "frame_compression.h"
+#include "logger.h"
+#include <chrono>
+#include <zlib.h>
+
+FrameCompressor::FrameCompressor(int level)
+    : m_stream(std::make_unique<z_stream_s>()), m_ready(false) {
+    m_ready = deflateInit(m_stream.get(), level) == Z_OK;
+    if (!m_ready) {
+        CHAT_LOG(Error, "deflate_init_failed");
+    }
+}
+
+FrameCompressor::~FrameCompressor() {
+    if (m_ready) {
+        deflateEnd(m_stream.get());
+    }
+}
+
+void FrameCompressor::compress(std::string_view frames, std::string& out, CompressionStats& stats) {
+    while (!frames.empty()) {
+        std::size_t size = compressionBatchSize(frames, FrameProtocol::MaxCompressedBatch);
+        if (size == 0) {
+            size = frames.size(); // Не кадры версии 2, такое не сжимаем
+        }
+        const std::string_view batch = frames.substr(0, size);
+        frames.remove_prefix(size);
+
+        const std::size_t before = out.size();
+        bool compressed = false;
+        if (m_ready && size >= FrameProtocol::MinCompressedBatch) {
+            const auto started = std::chrono::steady_clock::now();
+            compressed = compressBatch(batch, out);
+            stats.cpuNanos += std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - started).count());
+        }
+        if (compressed) {
+            ++stats.batches;
+        } else {
+            out.append(batch);
+            ++stats.skipped;
+        }
+        stats.inputBytes += size;
+        stats.outputBytes += out.size() - before;
+    }
+}
+
+bool FrameCompressor::compressBatch(std::string_view batch, std::string& out) {
+    // Кадр: заголовок версии 2 + quint32 BE размер исходных байт + поток zlib, как у qCompress
+    constexpr std::size_t prefixSize = FrameProtocol::StreamHeaderSize + 4;
+    const std::size_t start = out.size();
+    const uLong bound = deflateBound(m_stream.get(), uLong(batch.size()));
+    out.resize(start + prefixSize + bound);
+
+    deflateReset(m_stream.get());
+    m_stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(batch.data()));
+    m_stream->avail_in = uInt(batch.size());
+    m_stream->next_out = reinterpret_cast<Bytef*>(&out[start + prefixSize]);
+    m_stream->avail_out = uInt(bound);
+    const int result = deflate(m_stream.get(), Z_FINISH);
+    const std::size_t compressedSize = bound - m_stream->avail_out;
+
+    if (result != Z_STREAM_END || prefixSize + compressedSize >= batch.size()) {
+        out.resize(start); // Не сжалось, отправим как есть
+        return false;
+    }
+
+    char* p = &out[start];
+    encodeCompressedFrameHeader(p, 4 + compressedSize);
+    const auto size = std::uint32_t(batch.size());
+    p[FrameProtocol::StreamHeaderSize] = static_cast<char>(size >> 24);
+    p[FrameProtocol::StreamHeaderSize + 1] = static_cast<char>(size >> 16);
+    p[FrameProtocol::StreamHeaderSize + 2] = static_cast<char>(size >> 8);
+    p[FrameProtocol::StreamHeaderSize + 3] = static_cast<char>(size);
+    out.resize(start + prefixSize + compressedSize);
+    return true;
+}
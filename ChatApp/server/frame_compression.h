@@ -0,0 +1,36 @@
+#ifndef FRAME_COMPRESSION_H
+#define FRAME_COMPRESSION_H
+
+#include "frame_codec.h"
+#include <memory>
+#include <string>
+#include <string_view>
+
+struct z_stream_s;
+
+// Сжатие исходящих кадров для соединений с опцией deflate в бэкендах без Qt.
+// Пачка в формате qCompress, поэтому клиент разжимает её qUncompress. Состояние zlib одно
+// на объект и переиспользуется между пачками, так что один FrameCompressor на поток.
+class FrameCompressor {
+public:
+    explicit FrameCompressor(int level = DefaultLevel);
+    ~FrameCompressor();
+
+    FrameCompressor(const FrameCompressor&) = delete;
+    FrameCompressor& operator=(const FrameCompressor&) = delete;
+
+    // Дописывает кадры версии 2 из frames в out пачками до MaxCompressedBatch байт.
+    // Пачка уходит сжатым кадром, только если стала меньше; иначе кадры копируются как есть.
+    void compress(std::string_view frames, std::string& out, CompressionStats& stats);
+
+    // Как у qCompress по умолчанию
+    static constexpr int DefaultLevel = 6;
+
+private:
+    bool compressBatch(std::string_view batch, std::string& out);
+
+    std::unique_ptr<z_stream_s> m_stream;
+    bool m_ready;
+};
+
+#endif // FRAME_COMPRESSION_H
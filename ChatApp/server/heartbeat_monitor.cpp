@@ -0,0 +1,39 @@
+#include "heartbeat_monitor.h"
+#include <algorithm>
+
+HeartbeatMonitor::HeartbeatMonitor(const HeartbeatLimits& limits, Clock::time_point now)
+    : m_limits(limits), m_wheel(resolutionFor(limits), now) {
+    if (m_limits.idleTimeout < m_limits.pingInterval) {
+        m_limits.idleTimeout = m_limits.pingInterval;
+    }
+}
+
+std::chrono::milliseconds HeartbeatMonitor::resolutionFor(const HeartbeatLimits& limits) {
+    if (limits.pingInterval.count() <= 0) {
+        return std::chrono::milliseconds(1000);
+    }
+    // Восьмая часть интервала PING, но не реже раза в секунду и не чаще раза в 10 мс
+    return std::clamp(limits.pingInterval / 8, std::chrono::milliseconds(10), std::chrono::milliseconds(1000));
+}
+
+void HeartbeatMonitor::setLimits(const HeartbeatLimits& limits, Clock::time_point now) {
+    const HeartbeatStats stats = m_stats;
+    *this = HeartbeatMonitor(limits, now);
+    m_stats = stats;
+}
+
+void HeartbeatMonitor::add(std::uint64_t key, Clock::time_point now) {
+    if (!enabled()) {
+        return;
+    }
+    Connection& connection = m_connections[key];
+    connection.lastActivity = now;
+    connection.awaitingPong = false;
+    m_wheel.schedule(key, nextDeadline(connection));
+}
+
+void HeartbeatMonitor::remove(std::uint64_t key) {
+    if (m_connections.erase(key) != 0) {
+        m_wheel.cancel(key);
+    }
+}
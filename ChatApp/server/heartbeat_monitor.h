@@ -0,0 +1,92 @@
+#ifndef HEARTBEAT_MONITOR_H
+#define HEARTBEAT_MONITOR_H
+
+#include "network_interface.h"
+#include "timing_wheel.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+struct HeartbeatLimits {
+    std::chrono::milliseconds pingInterval{0}; // Тишина, после которой клиенту уходит PING; 0 - выключено
+    std::chrono::milliseconds idleTimeout{0};  // Тишина, после которой соединение закрывается
+};
+
+// Проверка живости соединений, согласовавших опцию heartbeat. Любые входящие данные продлевают
+// жизнь соединения (touch() только запоминает время), молчащему клиенту шлётся PING, а не
+// ответившему за idleTimeout соединение закрывается. У каждого соединения один таймер в колесе,
+// он переставляется только когда срабатывает, а не на каждое сообщение. Мёртвое соединение
+// обнаруживается не позже idleTimeout плюс шаг колеса и интервал вызова tick().
+// Не потокобезопасен: вызывается из того потока, где бэкенд ведёт список соединений.
+class HeartbeatMonitor {
+public:
+    using Clock = TimingWheel::Clock;
+
+    explicit HeartbeatMonitor(const HeartbeatLimits& limits = HeartbeatLimits(), Clock::time_point now = Clock::now());
+
+    // Вызывается до приёма соединений: отслеживаемые соединения забываются
+    void setLimits(const HeartbeatLimits& limits, Clock::time_point now = Clock::now());
+    const HeartbeatLimits& limits() const { return m_limits; }
+    bool enabled() const { return m_limits.pingInterval.count() > 0; }
+    // Шаг колеса: чаще вызывать tick() смысла нет
+    std::chrono::milliseconds resolution() const { return m_wheel.resolution(); }
+    static std::chrono::milliseconds resolutionFor(const HeartbeatLimits& limits);
+
+    // key уникален на всё время работы бэкенда (номер не переиспользуется)
+    void add(std::uint64_t key, Clock::time_point now = Clock::now());
+    void touch(std::uint64_t key, Clock::time_point now) {
+        const auto it = m_connections.find(key);
+        if (it != m_connections.end()) {
+            it->second.lastActivity = now;
+            it->second.awaitingPong = false;
+        }
+    }
+    void remove(std::uint64_t key);
+
+    // Вызывает ping(key) для замолчавших соединений и expire(key) для не ответивших.
+    // expire() обязан закрыть соединение; remove() для него уже не нужен
+    template<typename PingFn, typename ExpireFn>
+    void tick(Clock::time_point now, PingFn&& ping, ExpireFn&& expire) {
+        m_wheel.advance(now, [&](std::uint64_t key) {
+            const auto it = m_connections.find(key);
+            if (it == m_connections.end()) {
+                return;
+            }
+            Connection& connection = it->second;
+            const Clock::duration silence = now - connection.lastActivity;
+            if (silence >= m_limits.idleTimeout) {
+                m_connections.erase(it);
+                ++m_stats.idleReaped;
+                expire(key);
+                return;
+            }
+            if (silence >= m_limits.pingInterval && !connection.awaitingPong) {
+                connection.awaitingPong = true;
+                ++m_stats.pingsSent;
+                ping(key);
+            }
+            m_wheel.schedule(key, nextDeadline(connection));
+        });
+    }
+
+    std::size_t size() const { return m_connections.size(); }
+    const HeartbeatStats& stats() const { return m_stats; }
+
+private:
+    struct Connection {
+        Clock::time_point lastActivity;
+        bool awaitingPong = false;
+    };
+
+    Clock::time_point nextDeadline(const Connection& connection) const {
+        return connection.lastActivity + (connection.awaitingPong ? m_limits.idleTimeout : m_limits.pingInterval);
+    }
+
+    HeartbeatLimits m_limits;
+    TimingWheel m_wheel;
+    std::unordered_map<std::uint64_t, Connection> m_connections;
+    HeartbeatStats m_stats;
+};
+
+#endif // HEARTBEAT_MONITOR_H
@@ -0,0 +1,249 @@
+#include "inbound_rate_limiter.h"
+#include "logger.h"
+#include <charconv>
+#include <iterator>
+
+namespace {
+
+constexpr std::size_t NoLimit = std::size_t(-1);
+// Раз в столько проверок из таблицы пользователей выбрасываются полные ведра
+constexpr std::uint64_t PruneInterval = 4096;
+
+struct ClassInfo {
+    const char* name;
+    RateLimit defaults;
+};
+
+// В порядке CommandClass
+constexpr ClassInfo Classes[CommandClassCount] = {
+    {"auth", {1.0, 5.0}},
+    {"search", {2.0, 5.0}},
+    {"history", {2.0, 10.0}},
+    {"message", {20.0, 50.0}},
+    {"group", {2.0, 10.0}},
+    {"query", {50.0, 200.0}}, // После входа клиент спрашивает непрочитанное по каждому собеседнику
+};
+
+bool parseNumber(std::string_view text, double& value) {
+    // from_chars для double есть не во всех стандартных библиотеках, разбираем целое и дробь сами
+    const std::size_t dot = text.find('.');
+    const std::string_view whole = text.substr(0, dot);
+    const std::string_view fraction = dot == std::string_view::npos ? std::string_view() : text.substr(dot + 1);
+    if (whole.empty() && fraction.empty()) {
+        return false;
+    }
+    unsigned long long integer = 0;
+    if (!whole.empty()) {
+        const auto result = std::from_chars(whole.data(), whole.data() + whole.size(), integer);
+        if (result.ec != std::errc() || result.ptr != whole.data() + whole.size()) {
+            return false;
+        }
+    }
+    value = double(integer);
+    double scale = 0.1;
+    for (const char digit : fraction) {
+        if (digit < '0' || digit > '9') {
+            return false;
+        }
+        value += (digit - '0') * scale;
+        scale /= 10.0;
+    }
+    return true;
+}
+
+} // namespace
+
+CommandClass classifyCommand(std::string_view command) {
+    static const std::unordered_map<std::string_view, CommandClass> commands = {
+        {"AUTH", CommandClass::Auth},
+        {"REGISTER", CommandClass::Auth},
+        {"SEARCH_USERS", CommandClass::Search},
+        {"GET_HISTORY", CommandClass::History},
+        {"GET_PRIVATE_HISTORY", CommandClass::History},
+        {"CREATE_GROUP_CHAT", CommandClass::Group},
+        {"JOIN_GROUP_CHAT", CommandClass::Group},
+        {"GROUP_ADD_USER", CommandClass::Group},
+        {"GROUP_REMOVE_USER", CommandClass::Group},
+        {"DELETE_GROUP_CHAT", CommandClass::Group},
+        {"ADD_FRIEND", CommandClass::Group},
+        {"REMOVE_FRIEND", CommandClass::Group},
+        {"GET_USERLIST", CommandClass::Query},
+        {"GET_USERS", CommandClass::Query},
+        {"GET_FRIENDS", CommandClass::Query},
+        {"GET_GROUP_CHATS", CommandClass::Query},
+        {"GROUP_GET_CREATOR", CommandClass::Query},
+        {"MARK_READ", CommandClass::Query},
+        {"GET_UNREAD_COUNT", CommandClass::Query},
+        {"SUBSCRIBE_PRESENCE", CommandClass::Query},
+        {"UNSUBSCRIBE_PRESENCE", CommandClass::Query},
+    };
+    const auto it = commands.find(command);
+    // Всё остальное сервер рассылает как сообщение в общий чат
+    return it != commands.end() ? it->second : CommandClass::Message;
+}
+
+const char* commandClassName(CommandClass commandClass) {
+    return Classes[std::size_t(commandClass)].name;
+}
+
+InboundRateLimiter::InboundRateLimiter() {
+    for (std::size_t i = 0; i < CommandClassCount; ++i) {
+        m_limits.push_back(Limit{Classes[i].name, CommandClass(i), Classes[i].defaults, Classes[i].defaults});
+    }
+    // До входа пользователя нет, ведро пользователя для AUTH не создаётся
+}
+
+std::size_t InboundRateLimiter::findLimit(std::string_view name) const {
+    for (std::size_t i = 0; i < CommandClassCount; ++i) {
+        if (name == m_limits[i].name) {
+            return i;
+        }
+    }
+    const auto it = m_commandLimits.find(name);
+    return it != m_commandLimits.end() ? it->second : NoLimit;
+}
+
+void InboundRateLimiter::setLimit(std::string_view name, Scope scope, RateLimit limit) {
+    std::size_t index = findLimit(name);
+    if (index == NoLimit) {
+        // Отдельная команда получает свой предел, по умолчанию такой же, как у её класса
+        const CommandClass commandClass = classifyCommand(name);
+        Limit command = m_limits[std::size_t(commandClass)];
+        command.name = std::string(name);
+        index = m_limits.size();
+        m_limits.push_back(command);
+        m_commandLimits.emplace(std::string(name), index);
+    }
+    if (scope == Scope::Connection) {
+        m_limits[index].perConnection = limit;
+    } else {
+        m_limits[index].perUser = limit;
+    }
+}
+
+bool InboundRateLimiter::applySpec(std::string_view spec) {
+    bool connection = true;
+    bool user = true;
+    if (spec.compare(0, 5, "conn:") == 0) {
+        user = false;
+        spec.remove_prefix(5);
+    } else if (spec.compare(0, 5, "user:") == 0) {
+        connection = false;
+        spec.remove_prefix(5);
+    }
+    const std::size_t equals = spec.find('=');
+    if (equals == 0 || equals == std::string_view::npos) {
+        return false;
+    }
+    const std::string_view name = spec.substr(0, equals);
+    std::string_view value = spec.substr(equals + 1);
+    RateLimit limit;
+    const std::size_t slash = value.find('/');
+    if (!parseNumber(value.substr(0, slash), limit.rate)) {
+        return false;
+    }
+    limit.burst = limit.rate;
+    if (slash != std::string_view::npos && !parseNumber(value.substr(slash + 1), limit.burst)) {
+        return false;
+    }
+    if (connection) {
+        setLimit(name, Scope::Connection, limit);
+    }
+    if (user) {
+        setLimit(name, Scope::User, limit);
+    }
+    return true;
+}
+
+std::size_t InboundRateLimiter::limitFor(std::string_view command) const {
+    if (!m_commandLimits.empty()) {
+        const auto it = m_commandLimits.find(command);
+        if (it != m_commandLimits.end()) {
+            return it->second;
+        }
+    }
+    return std::size_t(classifyCommand(command));
+}
+
+TokenBucket* InboundRateLimiter::bucketFor(Buckets& buckets, std::size_t limit, const RateLimit& rate, Clock::time_point now) {
+    if (rate.rate <= 0.0) {
+        return nullptr;
+    }
+    if (buckets.size() <= limit) {
+        buckets.resize(m_limits.size());
+    }
+    Bucket& bucket = buckets[limit];
+    if (!bucket.created) {
+        bucket.bucket = TokenBucket(rate.rate, rate.burst, now);
+        bucket.created = true;
+    }
+    return &bucket.bucket;
+}
+
+bool InboundRateLimiter::allow(const void* connection, const std::string& user, std::string_view command, Clock::time_point now) {
+    if (!m_enabled) {
+        return true;
+    }
+    if (++m_checksSincePrune >= PruneInterval) {
+        pruneUsers(now);
+    }
+    const std::size_t limit = limitFor(command);
+    const Limit& settings = m_limits[limit];
+
+    Buckets& connectionBuckets = m_connections[connection];
+    TokenBucket* perConnection = bucketFor(connectionBuckets, limit, settings.perConnection, now);
+    if (perConnection && perConnection->available(now) < 1.0) {
+        ++m_stats.throttledPerConnection;
+        reject(connectionBuckets, limit, Scope::Connection, user);
+        return false;
+    }
+    Buckets* userBuckets = nullptr;
+    TokenBucket* perUser = nullptr;
+    if (!user.empty()) {
+        userBuckets = &m_users[user];
+        perUser = bucketFor(*userBuckets, limit, settings.perUser, now);
+        if (perUser && !perUser->tryTake(now)) {
+            ++m_stats.throttledPerUser;
+            reject(*userBuckets, limit, Scope::User, user);
+            return false;
+        }
+        if (perUser) { // При скорости 0 ведра нет, и вектор пользователя мог остаться пустым
+            (*userBuckets)[limit].throttling = false;
+        }
+    }
+    if (perConnection) {
+        perConnection->tryTake(now);
+        connectionBuckets[limit].throttling = false;
+    }
+    ++m_stats.allowed;
+    return true;
+}
+
+void InboundRateLimiter::reject(Buckets& buckets, std::size_t limit, Scope scope, const std::string& subject) {
+    const Limit& settings = m_limits[limit];
+    ++m_stats.throttledByClass[std::size_t(settings.commandClass)];
+    if (!subject.empty()) {
+        ++m_throttledUsers[subject];
+    }
+    m_rejectedLimit = settings.name;
+    Bucket& bucket = buckets[limit];
+    if (!bucket.throttling) {
+        bucket.throttling = true;
+        CHAT_LOG(Warn, "rate_limited").field("limit", settings.name).field("scope", scope == Scope::User ? "user" : "connection")
+            .field("user", subject);
+    }
+}
+
+void InboundRateLimiter::pruneUsers(Clock::time_point now) {
+    m_checksSincePrune = 0;
+    for (auto it = m_users.begin(); it != m_users.end();) {
+        bool full = true;
+        for (Bucket& bucket : it->second) {
+            if (bucket.created && !bucket.bucket.full(now)) {
+                full = false;
+                break;
+            }
+        }
+        it = full ? m_users.erase(it) : std::next(it);
+    }
+}
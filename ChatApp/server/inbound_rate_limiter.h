@@ -0,0 +1,115 @@
+#ifndef INBOUND_RATE_LIMITER_H
+#define INBOUND_RATE_LIMITER_H
+
+#include "token_bucket.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Классы команд клиента по цене обработки: у каждого свой предел
+enum class CommandClass {
+    Auth,     // AUTH, REGISTER: проверка пароля в БД
+    Search,   // SEARCH_USERS: LIKE по таблице пользователей
+    History,  // GET_HISTORY, GET_PRIVATE_HISTORY: выборка сотен сообщений
+    Message,  // PRIVATE, MSG, GROUP_MESSAGE и прочий текст: запись в БД и рассылка
+    Group,    // Создание и удаление групп, состав групп, друзья
+    Query,    // Списки пользователей, друзей, групп, счётчики непрочитанного
+    Count
+};
+
+constexpr std::size_t CommandClassCount = std::size_t(CommandClass::Count);
+
+CommandClass classifyCommand(std::string_view command);
+const char* commandClassName(CommandClass commandClass);
+
+// Ведро токенов: rate команд в секунду, не больше burst подряд; rate 0 - без ограничения
+struct RateLimit {
+    double rate = 0.0;
+    double burst = 0.0;
+};
+
+// Счётчики ограничения входящих команд
+struct RateLimitStats {
+    std::uint64_t allowed = 0;
+    std::uint64_t throttledPerConnection = 0;
+    std::uint64_t throttledPerUser = 0;
+    std::array<std::uint64_t, CommandClassCount> throttledByClass{};
+
+    std::uint64_t throttled() const { return throttledPerConnection + throttledPerUser; }
+};
+
+// Ограничение скорости входящих команд до их разбора и обращений к БД. Предел задаётся
+// для класса команд или для отдельной команды и действует отдельно на соединение и на
+// пользователя, так что флуд с нескольких соединений одного пользователя тоже упирается в предел.
+// Отказ стоит поиска в двух хеш-таблицах. Не потокобезопасен: вызывается в потоке ChatLogicServer.
+class InboundRateLimiter {
+public:
+    using Clock = TokenBucket::Clock;
+
+    enum class Scope {
+        Connection,
+        User
+    };
+
+    // Пределы по умолчанию рассчитаны на обычного клиента, включая всплеск запросов после входа
+    InboundRateLimiter();
+
+    // name - имя класса ("search") или команды ("SEARCH_USERS"); действует на новые ведра
+    void setLimit(std::string_view name, Scope scope, RateLimit limit);
+    // "[conn:|user:]<класс|КОМАНДА>=<rate>[/<burst>]", без области - для обеих. false - ошибка в строке
+    bool applySpec(std::string_view spec);
+    // Пределы сняты целиком (например, для тестов и нагрузочных прогонов)
+    void setEnabled(bool enabled) { m_enabled = enabled; }
+
+    // connection - любой уникальный для соединения указатель; user пуст до входа.
+    // false - команду нужно отклонить, rejectedLimit() называет сработавший предел
+    bool allow(const void* connection, const std::string& user, std::string_view command,
+               Clock::time_point now = Clock::now());
+    const std::string& rejectedLimit() const { return m_rejectedLimit; }
+
+    void forgetConnection(const void* connection) { m_connections.erase(connection); }
+
+    const RateLimitStats& stats() const { return m_stats; }
+    // Сколько команд каждого пользователя отклонено
+    const std::unordered_map<std::string, std::uint64_t>& throttledUsers() const { return m_throttledUsers; }
+
+private:
+    struct Limit {
+        std::string name;
+        CommandClass commandClass;
+        RateLimit perConnection;
+        RateLimit perUser;
+    };
+    struct Bucket {
+        TokenBucket bucket;
+        bool created = false;
+        bool throttling = false; // Отказы уже идут: в журнал пишется только начало
+    };
+    using Buckets = std::vector<Bucket>; // Индекс - номер предела в m_limits
+
+    std::size_t findLimit(std::string_view name) const;
+    std::size_t limitFor(std::string_view command) const;
+    // nullptr - предел не ограничен
+    TokenBucket* bucketFor(Buckets& buckets, std::size_t limit, const RateLimit& rate, Clock::time_point now);
+    void reject(Buckets& buckets, std::size_t limit, Scope scope, const std::string& subject);
+    void pruneUsers(Clock::time_point now);
+
+    std::vector<Limit> m_limits; // Сначала классы в порядке CommandClass, потом отдельные команды
+    // Пределы отдельных команд, их единицы. std::less<> ищет прямо по string_view, без копии имени
+    std::map<std::string, std::size_t, std::less<>> m_commandLimits;
+    std::unordered_map<const void*, Buckets> m_connections;
+    std::unordered_map<std::string, Buckets> m_users;
+    std::uint64_t m_checksSincePrune = 0;
+    bool m_enabled = true;
+    std::string m_rejectedLimit;
+    RateLimitStats m_stats;
+    std::unordered_map<std::string, std::uint64_t> m_throttledUsers;
+};
+
+#endif // INBOUND_RATE_LIMITER_H
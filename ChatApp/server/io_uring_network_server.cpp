@@ -0,0 +1,550 @@
+#include "io_uring_network_server.h"
+#include "socket_utils.h"
+#include "logger.h"
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::uint16_t RecvBufferGroup = 1;
+
+std::uint64_t makeUserData(std::uint64_t id, std::uint8_t operation) {
+    return (id << 8) | operation;
+}
+
+} // namespace
+
+IoUringClient::IoUringClient(IoUringNetworkServer* server, int fd, std::uint64_t id, std::string clientId)
+    : m_server(server), m_fd(fd), m_id(id), m_clientId(std::move(clientId)),
+      m_outboundGuard(server->m_outboundLimits) {
+}
+
+IoUringClient::~IoUringClient() {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+void IoUringClient::sendMessage(const std::string& message) {
+    if (!admit(message)) {
+        return;
+    }
+    std::string& frames = m_server->m_encodeBuffer;
+    frames.clear();
+    enqueue(message, frames, m_session.encode(message, frames));
+}
+
+void IoUringClient::sendFrame(const SharedFrame& frame) {
+    if (!admit(frame->message())) {
+        return;
+    }
+    // Кадры уже закодированы для этого формата одним из предыдущих получателей
+    const WireOptions& options = m_session.options();
+    enqueue(frame->message(), frame->frames(options), frame->frameCount(options));
+}
+
+bool IoUringClient::admit(const std::string& message) {
+    if (!isConnected()) {
+        CHAT_LOG_SAMPLED(Debug, "message_dropped", 10).field("client", m_clientId).field("reason", "not connected");
+        return false;
+    }
+    switch (m_outboundGuard.admit(message, queuedBytes())) {
+    case OutboundQueueGuard::Action::Send:
+        return true;
+    case OutboundQueueGuard::Action::Skip:
+        break;
+    case OutboundQueueGuard::Action::Disconnect:
+        m_server->evictClient(*this);
+        break;
+    }
+    return false;
+}
+
+void IoUringClient::enqueue(const std::string& message, std::string_view frames, std::size_t frameCount) {
+    if (frameCount == 0) {
+        CHAT_LOG_SAMPLED(Warn, "message_dropped", 10).field("client", m_clientId)
+            .field("bytes", message.size()).field("reason", "exceeds legacy frame");
+        return;
+    }
+    if (m_session.options().deflate) {
+        m_batch += frames;
+    } else {
+        m_pending += frames;
+    }
+    m_pendingFrames += frameCount;
+    m_server->queueSend(*this);
+}
+
+OutboundQueueStats IoUringClient::outboundStats() const {
+    OutboundQueueStats stats = m_outboundGuard.stats();
+    stats.queuedBytes = queuedBytes();
+    return stats;
+}
+
+std::string IoUringClient::getClientId() const {
+    return m_clientId;
+}
+
+bool IoUringClient::isConnected() const {
+    return m_open && !m_closing;
+}
+
+void IoUringClient::markAuthenticated() {
+    if (m_open) {
+        m_server->m_admission.finishPreAuth(m_id);
+    }
+}
+
+void IoUringClient::disconnectClient() {
+    if (!m_open || m_closing) {
+        return;
+    }
+    m_closing = true;
+    // Сокет закрывается после того, как очередь уйдёт в ядро (см. startSend)
+    m_server->queueSend(*this);
+}
+
+IoUringNetworkServer::IoUringNetworkServer(unsigned queueDepth)
+    : m_ringReady(false), m_listenFd(-1), m_port(0), m_acceptArmed(false), m_dispatching(false),
+      m_nextClientId(1), m_openConnections(0) {
+    m_ringReady = m_ring.init(queueDepth) && m_ring.setupBufferRing(RecvBufferGroup, RecvBufferCount, RecvBufferSize);
+}
+
+IoUringNetworkServer::~IoUringNetworkServer() {
+    stop();
+}
+
+bool IoUringNetworkServer::start(int port) {
+    if (!m_ringReady || m_listenFd >= 0) {
+        return false;
+    }
+    m_listenFd = createListenSocket(port, false);
+    if (m_listenFd < 0 || ::listen(m_listenFd, SOMAXCONN) != 0) {
+        CHAT_LOG(Error, "network_start_failed").field("backend", "io_uring").field("port", port).field("error", std::strerror(errno));
+        if (m_listenFd >= 0) {
+            ::close(m_listenFd);
+            m_listenFd = -1;
+        }
+        return false;
+    }
+    m_port = boundPort(m_listenFd);
+    armAccept();
+    m_ring.submit();
+    CHAT_LOG(Info, "network_started").field("backend", "io_uring").field("port", m_port);
+    return true;
+}
+
+void IoUringNetworkServer::stop() {
+    if (m_listenFd >= 0) {
+        // shutdown завершает multishot accept, close сам по себе запрос в ядре не отменит
+        ::shutdown(m_listenFd, SHUT_RDWR);
+        ::close(m_listenFd);
+        m_listenFd = -1;
+        const NetworkWriteStats stats = writeStats();
+        const OutboundQueueStats outbound = outboundStats();
+        const CompressionStats compression = compressionStats();
+        CHAT_LOG(Info, "network_stopped").field("backend", "io_uring")
+            .field("frames", stats.frames).field("flushes", stats.flushes)
+            .field("frames_per_flush", stats.framesPerFlush()).field("max_frames_per_flush", stats.maxFramesPerFlush)
+            .field("io_uring_enter_calls", m_ring.enterCalls())
+            .field("max_queued_bytes", outbound.maxQueuedBytes).field("dropped", outbound.dropped)
+            .field("coalesced", outbound.coalesced).field("evicted", outbound.evicted)
+            .field("compression_ratio", compression.ratio()).field("compression_ms", compression.cpuNanos / 1000000)
+            .field("rejected", m_admission.stats().rejected()).field("reaped_pre_auth", m_admission.stats().reapedPreAuth)
+            .field("pings", m_heartbeats.stats().pingsSent).field("reaped_idle", m_heartbeats.stats().idleReaped);
+    }
+
+    std::vector<std::shared_ptr<IoUringClient>> clients;
+    clients.reserve(m_clients.size());
+    for (const auto& entry : m_clients) {
+        clients.push_back(entry.second);
+    }
+    for (const auto& client : clients) {
+        closeClient(client, false);
+    }
+    m_sendQueue.clear();
+
+    // Ждём, пока ядро вернёт все запросы: в них указатели на наши буферы
+    for (int attempt = 0; attempt < 50 && (!m_clients.empty() || m_acceptArmed); ++attempt) {
+        processEvents(20);
+    }
+}
+
+void IoUringNetworkServer::broadcastMessage(const std::string& message) {
+    const SharedFrame frame = makeSharedFrame(message);
+    for (const auto& entry : m_clients) {
+        if (entry.second->isConnected()) {
+            entry.second->sendFrame(frame);
+        }
+    }
+}
+
+void IoUringNetworkServer::setClientConnectedCallback(ClientConnectedCallback cb) {
+    m_clientConnectedCb = cb;
+}
+
+void IoUringNetworkServer::setClientDisconnectedCallback(ClientDisconnectedCallback cb) {
+    m_clientDisconnectedCb = cb;
+}
+
+void IoUringNetworkServer::setMessageReceivedCallback(MessageReceivedCallback cb) {
+    m_messageReceivedCb = cb;
+}
+
+NetworkWriteStats IoUringNetworkServer::writeStats() const {
+    NetworkWriteStats total = m_closedWriteStats;
+    for (const auto& entry : m_clients) {
+        total.add(entry.second->writeStats());
+    }
+    return total;
+}
+
+OutboundQueueStats IoUringNetworkServer::outboundStats() const {
+    OutboundQueueStats total = m_closedOutboundStats;
+    for (const auto& entry : m_clients) {
+        total.add(entry.second->outboundStats());
+    }
+    return total;
+}
+
+CompressionStats IoUringNetworkServer::compressionStats() const {
+    CompressionStats total = m_closedCompressionStats;
+    for (const auto& entry : m_clients) {
+        total.add(entry.second->compressionStats());
+    }
+    return total;
+}
+
+void IoUringNetworkServer::processEvents(int timeoutMs) {
+    if (!m_ringReady) {
+        return;
+    }
+    if (timeoutMs != 0) {
+        pollfd descriptor{ m_ring.fd(), POLLIN, 0 };
+        ::poll(&descriptor, 1, timeoutMs);
+    }
+
+    m_dispatching = true;
+    m_ring.forEachCompletion([this](const io_uring_cqe& cqe) { handleCompletion(cqe); });
+    m_dispatching = false;
+
+    flushSends();
+    checkTimeouts();
+}
+
+void IoUringNetworkServer::checkTimeouts() {
+    const AdmissionController::Clock::time_point now = AdmissionController::Clock::now();
+    m_admission.reapExpired(now, [this](std::uint64_t key) {
+        if (const std::shared_ptr<IoUringClient> client = findOpenClient(key)) {
+            CHAT_LOG(Info, "client_reaped").field("client", client->m_clientId).field("reason", "auth timeout");
+            closeClient(client, true);
+        }
+    });
+    m_heartbeats.tick(now, [this](std::uint64_t key) {
+        if (const std::shared_ptr<IoUringClient> client = findOpenClient(key)) {
+            client->sendMessage(std::string(FrameProtocol::PingMessage));
+        }
+    }, [this](std::uint64_t key) {
+        if (const std::shared_ptr<IoUringClient> client = findOpenClient(key)) {
+            CHAT_LOG(Info, "client_reaped").field("client", client->m_clientId).field("reason", "idle");
+            closeClient(client, true);
+        }
+    });
+    m_ring.submit();
+}
+
+std::shared_ptr<IoUringClient> IoUringNetworkServer::findOpenClient(std::uint64_t id) const {
+    const auto it = m_clients.find(id);
+    if (it == m_clients.end() || !it->second->m_open) {
+        return nullptr;
+    }
+    return it->second;
+}
+
+void IoUringNetworkServer::armAccept() {
+    io_uring_sqe* sqe = m_ring.nextSqe();
+    if (!sqe) {
+        CHAT_LOG(Error, "io_uring_sq_full").field("op", "accept");
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = m_listenFd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = makeUserData(0, std::uint8_t(Operation::Accept));
+    m_acceptArmed = true;
+}
+
+void IoUringNetworkServer::armRecv(IoUringClient& client) {
+    io_uring_sqe* sqe = m_ring.nextSqe();
+    if (!sqe) {
+        CHAT_LOG(Error, "io_uring_sq_full").field("op", "recv").field("client", client.m_clientId);
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = client.m_fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RecvBufferGroup;
+    sqe->user_data = makeUserData(client.m_id, std::uint8_t(Operation::Recv));
+    client.m_recvArmed = true;
+}
+
+void IoUringNetworkServer::handleCompletion(const io_uring_cqe& cqe) {
+    const auto operation = Operation(cqe.user_data & 0xFF);
+    if (operation == Operation::Accept) {
+        handleAccept(cqe);
+        return;
+    }
+
+    const auto it = m_clients.find(cqe.user_data >> 8);
+    if (it == m_clients.end()) {
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            m_ring.recycleBuffer(std::uint16_t(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+        }
+        return;
+    }
+    const std::shared_ptr<IoUringClient> client = it->second;
+    if (operation == Operation::Recv) {
+        handleRecv(client, cqe);
+    } else {
+        handleSend(client, cqe);
+    }
+    releaseIfIdle(client);
+}
+
+void IoUringNetworkServer::handleAccept(const io_uring_cqe& cqe) {
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        m_acceptArmed = false;
+    }
+    if (cqe.res < 0) {
+        if (m_listenFd >= 0 && cqe.res != -ECANCELED) {
+            CHAT_LOG_SAMPLED(Warn, "accept_failed", 10).field("backend", "io_uring").field("error", std::strerror(-cqe.res));
+        }
+    } else if (m_listenFd < 0) {
+        ::close(cqe.res); // Соединение успело прийти во время stop()
+    } else {
+        const int fd = cqe.res;
+        sockaddr_storage address{};
+        socklen_t addressLength = sizeof(address);
+        getpeername(fd, reinterpret_cast<sockaddr*>(&address), &addressLength);
+        // Решение принимается до того, как на соединение потрачено что-то ещё
+        const std::string host = peerHost(address);
+        if (m_admission.admit(host) != AdmissionController::Decision::Accept) {
+            ::close(fd);
+        } else {
+            acceptClient(fd, host, describePeer(address));
+        }
+    }
+    if (!m_acceptArmed && m_listenFd >= 0) {
+        armAccept(); // Ядро сняло multishot (например, при нехватке места в очереди завершения)
+    }
+}
+
+void IoUringNetworkServer::acceptClient(int fd, const std::string& host, std::string clientId) {
+    // Отправки и так копятся за проход, Нейгл только добавит задержку
+    const int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    auto client = std::make_shared<IoUringClient>(this, fd, m_nextClientId++, std::move(clientId));
+    client->m_peerHost = host;
+    m_clients[client->m_id] = client;
+    ++m_openConnections;
+    m_admission.startPreAuth(client->m_id);
+    armRecv(*client);
+
+    if (m_clientConnectedCb) {
+        m_clientConnectedCb(client);
+    }
+}
+
+void IoUringNetworkServer::handleRecv(const std::shared_ptr<IoUringClient>& client, const io_uring_cqe& cqe) {
+    const bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+    if (!more) {
+        client->m_recvArmed = false;
+    }
+
+    if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER)) {
+        const auto bufferId = std::uint16_t(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        client->m_session.append(m_ring.buffer(bufferId), std::size_t(cqe.res));
+        m_ring.recycleBuffer(bufferId); // Данные уже скопированы в декодер соединения
+        m_heartbeats.touch(client->m_id, HeartbeatMonitor::Clock::now());
+
+        std::string message;
+        while (client->m_open) {
+            const WireSession::Result result = client->m_session.next(message);
+            if (result == WireSession::Result::NeedMoreData) {
+                break;
+            }
+            if (result == WireSession::Result::Error) {
+                CHAT_LOG(Warn, "client_protocol_error").field("client", client->m_clientId).field("reason", "malformed frame");
+                closeClient(client, true);
+                return;
+            }
+            if (result == WireSession::Result::Handshake) {
+                client->m_pending += message;
+                client->m_pendingFrames += 1;
+                queueSend(*client);
+                if (client->m_session.options().heartbeat) {
+                    m_heartbeats.add(client->m_id);
+                }
+                continue;
+            }
+            if (message == FrameProtocol::PongMessage) {
+                continue; // Ответ на PING нужен только для touch() выше
+            }
+            if (m_messageReceivedCb) {
+                m_messageReceivedCb(client, message);
+            }
+        }
+        client->m_session.release();
+    } else if (cqe.res == 0 || (cqe.res < 0 && cqe.res != -ENOBUFS)) {
+        closeClient(client, true); // Клиент закрыл соединение или ошибка сокета
+        return;
+    }
+
+    // -ENOBUFS: все буферы были заняты; к этому моменту они уже возвращены в кольцо
+    if (!client->m_recvArmed && client->m_open) {
+        armRecv(*client);
+    }
+}
+
+void IoUringNetworkServer::handleSend(const std::shared_ptr<IoUringClient>& client, const io_uring_cqe& cqe) {
+    client->m_sendInFlight = false;
+    if (cqe.res < 0) {
+        client->m_inflight.clear();
+        client->m_inflightOffset = 0;
+        if (client->m_open) {
+            closeClient(client, true);
+        }
+        return;
+    }
+    client->m_inflightOffset += std::size_t(cqe.res);
+    client->m_writeStats.bytes += std::uint64_t(cqe.res);
+    if (client->m_inflightOffset < client->m_inflight.size()) {
+        startSend(*client); // Ядро приняло не всё, досылаем остаток
+        return;
+    }
+    client->m_inflight.clear();
+    client->m_inflightOffset = 0;
+    std::vector<std::string> deferred;
+    if (client->m_outboundGuard.drained(client->queuedBytes(), deferred)) {
+        for (const std::string& message : deferred) {
+            client->sendMessage(message);
+        }
+    }
+    if (!client->m_pending.empty() || !client->m_batch.empty() || client->m_closing) {
+        queueSend(*client);
+    }
+}
+
+void IoUringNetworkServer::evictClient(IoUringClient& client) {
+    CHAT_LOG(Warn, "client_evicted").field("client", client.m_clientId).field("queued_bytes", client.queuedBytes());
+    client.m_closing = true;
+    client.m_pending.clear();
+    std::string().swap(client.m_batch);
+    ::shutdown(client.m_fd, SHUT_RDWR);
+}
+
+void IoUringNetworkServer::queueSend(IoUringClient& client) {
+    if (!client.m_sendQueued) {
+        client.m_sendQueued = true;
+        m_sendQueue.push_back(client.shared_from_this());
+    }
+    if (!m_dispatching) {
+        flushSends(); // Вызов вне processEvents(): отправляем сразу
+    }
+}
+
+void IoUringNetworkServer::flushSends() {
+    std::vector<std::shared_ptr<IoUringClient>> queue;
+    queue.swap(m_sendQueue);
+    for (const auto& client : queue) {
+        client->m_sendQueued = false;
+        if (client->m_open && !client->m_sendInFlight) {
+            startSend(*client);
+        }
+    }
+    // Все отправки прохода - одним системным вызовом
+    m_ring.submit();
+}
+
+void IoUringNetworkServer::startSend(IoUringClient& client) {
+    if (client.m_inflightOffset >= client.m_inflight.size()) {
+        if (!client.m_batch.empty()) {
+            // Всё накопленное за время предыдущей отправки сжимается одной пачкой
+            m_compressor.compress(client.m_batch, client.m_pending, client.m_compressionStats);
+            client.m_batch.clear();
+        }
+        if (client.m_pending.empty()) {
+            if (client.m_closing) {
+                // Всё отправлено; recv завершится с 0, и соединение закроется обычным путём
+                ::shutdown(client.m_fd, SHUT_RDWR);
+            }
+            return;
+        }
+        client.m_inflight.swap(client.m_pending);
+        client.m_pending.clear();
+        client.m_inflightOffset = 0;
+        client.m_writeStats.frames += client.m_pendingFrames;
+        client.m_writeStats.flushes += 1;
+        client.m_writeStats.maxFramesPerFlush = std::max(client.m_writeStats.maxFramesPerFlush, client.m_pendingFrames);
+        client.m_pendingFrames = 0;
+    }
+
+    io_uring_sqe* sqe = m_ring.nextSqe();
+    if (!sqe) {
+        // Повторим в следующем проходе
+        if (!client.m_sendQueued) {
+            client.m_sendQueued = true;
+            m_sendQueue.push_back(client.shared_from_this());
+        }
+        return;
+    }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = client.m_fd;
+    sqe->addr = reinterpret_cast<std::uint64_t>(client.m_inflight.data() + client.m_inflightOffset);
+    sqe->len = std::uint32_t(client.m_inflight.size() - client.m_inflightOffset);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = makeUserData(client.m_id, std::uint8_t(Operation::Send));
+    client.m_sendInFlight = true;
+}
+
+void IoUringNetworkServer::closeClient(const std::shared_ptr<IoUringClient>& client, bool notify) {
+    if (!client->m_open) {
+        return;
+    }
+    client->m_open = false;
+    --m_openConnections;
+    // Прерывает recv и send в ядре; сам дескриптор закрывается в releaseIfIdle
+    ::shutdown(client->m_fd, SHUT_RDWR);
+    client->m_pending.clear();
+    std::string().swap(client->m_batch);
+    m_admission.release(client->m_peerHost);
+    m_admission.finishPreAuth(client->m_id);
+    m_heartbeats.remove(client->m_id);
+
+    if (notify && m_clientDisconnectedCb) {
+        m_clientDisconnectedCb(client);
+    }
+    releaseIfIdle(client);
+}
+
+void IoUringNetworkServer::releaseIfIdle(const std::shared_ptr<IoUringClient>& client) {
+    if (client->m_open || client->m_recvArmed || client->m_sendInFlight || client->m_fd < 0) {
+        return;
+    }
+    ::close(client->m_fd);
+    client->m_fd = -1;
+    client->m_inflight.clear();
+    client->m_inflightOffset = 0;
+    m_closedWriteStats.add(client->m_writeStats);
+    m_closedOutboundStats.add(client->outboundStats());
+    m_closedCompressionStats.add(client->m_compressionStats);
+    m_clients.erase(client->m_id);
+}
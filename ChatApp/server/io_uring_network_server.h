@@ -0,0 +1,158 @@
+#ifndef IO_URING_NETWORK_SERVER_H
+#define IO_URING_NETWORK_SERVER_H
+
+#include "admission_control.h"
+#include "heartbeat_monitor.h"
+#include "frame_compression.h"
+#include "network_interface.h"
+#include "io_uring_queue.h"
+#include "outbound_queue.h"
+#include "wire_session.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class IoUringNetworkServer;
+
+// Соединение io_uring-бэкенда. Пока ядро отправляет m_inflight, новые кадры копятся в m_pending
+// и уходят следующим запросом, поэтому буфер, отданный ядру, не меняется до завершения.
+class IoUringClient : public INetworkClient, public std::enable_shared_from_this<IoUringClient> {
+public:
+    IoUringClient(IoUringNetworkServer* server, int fd, std::uint64_t id, std::string clientId);
+    ~IoUringClient() override;
+
+    void sendMessage(const std::string& message) override;
+    void sendFrame(const SharedFrame& frame) override;
+    std::string getClientId() const override;
+    bool isConnected() const override;
+    void disconnectClient() override;
+    void markAuthenticated() override;
+    WireOptions wireOptions() const override { return m_session.options(); }
+
+    const NetworkWriteStats& writeStats() const { return m_writeStats; }
+    OutboundQueueStats outboundStats() const;
+    const CompressionStats& compressionStats() const { return m_compressionStats; }
+
+private:
+    friend class IoUringNetworkServer;
+
+    // Проверка соединения и ограничения очереди; false - сообщение не отправляется
+    bool admit(const std::string& message);
+    void enqueue(const std::string& message, std::string_view frames, std::size_t frameCount);
+
+    std::size_t queuedBytes() const { return m_batch.size() + m_pending.size() + m_inflight.size() - m_inflightOffset; }
+
+    IoUringNetworkServer* m_server;
+    int m_fd;
+    std::uint64_t m_id; // Ключ в user_data запросов: дескриптор может быть переиспользован раньше, чем придёт завершение
+    std::string m_clientId;
+    std::string m_peerHost; // Для предела соединений с адреса
+    WireSession m_session;
+    std::string m_batch; // deflate: кадры, которые сожмутся одной пачкой перед отправкой
+    std::string m_pending;
+    std::string m_inflight;
+    std::size_t m_inflightOffset = 0;
+    std::uint64_t m_pendingFrames = 0;
+    NetworkWriteStats m_writeStats;
+    OutboundQueueGuard m_outboundGuard;
+    CompressionStats m_compressionStats;
+    bool m_open = true;          // До closeClient()
+    bool m_closing = false;      // disconnectClient(): закрыть после отправки очереди
+    bool m_recvArmed = false;
+    bool m_sendInFlight = false;
+    bool m_sendQueued = false;
+};
+
+// INetworkServer поверх io_uring (Linux 6.0+): multishot accept, multishot recv в кольцо буферов,
+// отправки всех соединений за проход уходят в ядро одним io_uring_enter.
+// Как и EpollNetworkServer, своего потока нет: pollFd() встраивается во внешний цикл событий.
+class IoUringNetworkServer : public INetworkServer {
+public:
+    explicit IoUringNetworkServer(unsigned queueDepth = 4096);
+    ~IoUringNetworkServer() override;
+
+    bool start(int port) override;
+    void stop() override;
+    void broadcastMessage(const std::string& message) override;
+
+    void setClientConnectedCallback(ClientConnectedCallback cb) override;
+    void setClientDisconnectedCallback(ClientDisconnectedCallback cb) override;
+    void setMessageReceivedCallback(MessageReceivedCallback cb) override;
+
+    // Дескриптор кольца становится читаемым, когда есть завершённые запросы
+    int pollFd() const { return m_ring.fd(); }
+    // Разбирает завершения и отправляет накопленные запросы, timeoutMs как у poll
+    void processEvents(int timeoutMs = 0);
+
+    int port() const { return m_port; }
+    std::size_t connectionCount() const { return m_openConnections; }
+    NetworkWriteStats writeStats() const;
+    std::uint64_t enterCalls() const { return m_ring.enterCalls(); }
+    // Действует для соединений, принятых после вызова
+    void setOutboundLimits(const OutboundQueueLimits& limits) { m_outboundLimits = limits; }
+    OutboundQueueStats outboundStats() const;
+    CompressionStats compressionStats() const;
+    void setAdmissionLimits(const AdmissionLimits& limits) { m_admission.setLimits(limits); }
+    const AdmissionStats& admissionStats() const { return m_admission.stats(); }
+    // Действует для соединений, принятых после вызова
+    void setHeartbeatLimits(const HeartbeatLimits& limits) { m_heartbeats.setLimits(limits); }
+    const HeartbeatStats& heartbeatStats() const { return m_heartbeats.stats(); }
+    // Закрывает соединения, не вошедшие вовремя, шлёт PING замолчавшим и закрывает не ответивших.
+    // Вызывается из processEvents(), а когда событий нет - владельцем по таймеру
+    void checkTimeouts();
+
+    static constexpr unsigned RecvBufferCount = 512;
+    static constexpr unsigned RecvBufferSize = 16 * 1024;
+
+private:
+    friend class IoUringClient;
+
+    enum class Operation : std::uint8_t {
+        Accept = 1,
+        Recv = 2,
+        Send = 3
+    };
+
+    void armAccept();
+    void armRecv(IoUringClient& client);
+    void handleCompletion(const io_uring_cqe& cqe);
+    void handleAccept(const io_uring_cqe& cqe);
+    void acceptClient(int fd, const std::string& host, std::string clientId);
+    void handleRecv(const std::shared_ptr<IoUringClient>& client, const io_uring_cqe& cqe);
+    void handleSend(const std::shared_ptr<IoUringClient>& client, const io_uring_cqe& cqe);
+    void queueSend(IoUringClient& client);
+    void startSend(IoUringClient& client);
+    void flushSends();
+    // Клиент не читает: очередь выбрасывается, recv завершится с 0 и закроет соединение
+    void evictClient(IoUringClient& client);
+    void closeClient(const std::shared_ptr<IoUringClient>& client, bool notify);
+    std::shared_ptr<IoUringClient> findOpenClient(std::uint64_t id) const;
+    // Удаляет соединение, когда у ядра не осталось запросов с его буферами
+    void releaseIfIdle(const std::shared_ptr<IoUringClient>& client);
+
+    IoUringQueue m_ring;
+    bool m_ringReady;
+    int m_listenFd;
+    int m_port;
+    bool m_acceptArmed;
+    bool m_dispatching; // Внутри processEvents(): отправки копятся до конца прохода
+    std::uint64_t m_nextClientId;
+    std::size_t m_openConnections;
+    std::unordered_map<std::uint64_t, std::shared_ptr<IoUringClient>> m_clients;
+    std::vector<std::shared_ptr<IoUringClient>> m_sendQueue;
+    std::string m_encodeBuffer;
+    FrameCompressor m_compressor;
+    NetworkWriteStats m_closedWriteStats;
+    OutboundQueueLimits m_outboundLimits;
+    OutboundQueueStats m_closedOutboundStats;
+    CompressionStats m_closedCompressionStats;
+    AdmissionController m_admission; // Ключ таймеров здесь и в m_heartbeats - m_id соединения
+    HeartbeatMonitor m_heartbeats;
+
+    ClientConnectedCallback m_clientConnectedCb;
+    ClientDisconnectedCallback m_clientDisconnectedCb;
+    MessageReceivedCallback m_messageReceivedCb;
+};
+
+#endif // IO_URING_NETWORK_SERVER_H
@@ -0,0 +1,204 @@
+#include "io_uring_queue.h"
+#include "logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+int ioUringSetup(unsigned entries, io_uring_params* params) {
+    return int(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return int(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+int ioUringRegister(int fd, unsigned opcode, void* arg, unsigned argCount) {
+    return int(syscall(__NR_io_uring_register, fd, opcode, arg, argCount));
+}
+
+template<typename T>
+T* ringField(void* ring, std::uint32_t offset) {
+    return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+} // namespace
+
+IoUringQueue::~IoUringQueue() {
+    if (m_bufferRing) {
+        io_uring_buf_reg reg{};
+        reg.bgid = m_bufferGroup;
+        ioUringRegister(m_ringFd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+        munmap(m_bufferRing, m_bufferRingSize);
+    }
+    if (m_sqes) {
+        munmap(m_sqes, m_sqesSize);
+    }
+    if (m_cqRing && m_cqRing != m_sqRing) {
+        munmap(m_cqRing, m_cqRingSize);
+    }
+    if (m_sqRing) {
+        munmap(m_sqRing, m_sqRingSize);
+    }
+    if (m_ringFd >= 0) {
+        ::close(m_ringFd);
+    }
+}
+
+bool IoUringQueue::init(unsigned entries) {
+    std::memset(&m_params, 0, sizeof(m_params));
+    // Очередь завершения больше: multishot accept/recv дают много записей на один запрос
+    m_params.flags = IORING_SETUP_CQSIZE;
+    m_params.cq_entries = entries * 8;
+    m_ringFd = ioUringSetup(entries, &m_params);
+    if (m_ringFd < 0) {
+        CHAT_LOG(Error, "syscall_failed").field("call", "io_uring_setup").field("error", std::strerror(errno));
+        return false;
+    }
+
+    m_sqRingSize = m_params.sq_off.array + m_params.sq_entries * sizeof(unsigned);
+    m_cqRingSize = m_params.cq_off.cqes + m_params.cq_entries * sizeof(io_uring_cqe);
+    const bool singleMmap = (m_params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap) {
+        m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+    }
+
+    void* sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        CHAT_LOG(Error, "syscall_failed").field("call", "io_uring SQ ring mmap").field("error", std::strerror(errno));
+        return false;
+    }
+    m_sqRing = sqRing;
+    if (singleMmap) {
+        m_cqRing = m_sqRing;
+    } else {
+        void* cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            CHAT_LOG(Error, "syscall_failed").field("call", "io_uring CQ ring mmap").field("error", std::strerror(errno));
+            return false;
+        }
+        m_cqRing = cqRing;
+    }
+
+    m_sqesSize = m_params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        CHAT_LOG(Error, "syscall_failed").field("call", "io_uring SQE mmap").field("error", std::strerror(errno));
+        return false;
+    }
+    m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+    m_sqHead = ringField<unsigned>(m_sqRing, m_params.sq_off.head);
+    m_sqTail = ringField<unsigned>(m_sqRing, m_params.sq_off.tail);
+    m_sqMask = *ringField<unsigned>(m_sqRing, m_params.sq_off.ring_mask);
+    m_sqArray = ringField<unsigned>(m_sqRing, m_params.sq_off.array);
+    m_sqeTail = m_submittedTail = *m_sqTail;
+
+    m_cqHead = ringField<unsigned>(m_cqRing, m_params.cq_off.head);
+    m_cqTail = ringField<unsigned>(m_cqRing, m_params.cq_off.tail);
+    m_cqMask = *ringField<unsigned>(m_cqRing, m_params.cq_off.ring_mask);
+    m_cqes = ringField<io_uring_cqe>(m_cqRing, m_params.cq_off.cqes);
+    return true;
+}
+
+io_uring_sqe* IoUringQueue::nextSqe() {
+    const unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    if (m_sqeTail - head >= m_params.sq_entries) {
+        submit();
+        if (m_sqeTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_params.sq_entries) {
+            return nullptr;
+        }
+    }
+    const unsigned index = m_sqeTail & m_sqMask;
+    io_uring_sqe* sqe = &m_sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    m_sqArray[index] = index;
+    ++m_sqeTail;
+    return sqe;
+}
+
+int IoUringQueue::submit(bool waitForCompletion) {
+    const unsigned toSubmit = m_sqeTail - m_submittedTail;
+    if (toSubmit == 0 && !waitForCompletion) {
+        return 0;
+    }
+    __atomic_store_n(m_sqTail, m_sqeTail, __ATOMIC_RELEASE);
+    int result = 0;
+    do {
+        ++m_enterCalls;
+        result = ioUringEnter(m_ringFd, toSubmit, waitForCompletion ? 1 : 0, waitForCompletion ? IORING_ENTER_GETEVENTS : 0);
+    } while (result < 0 && errno == EINTR);
+    if (result < 0) {
+        CHAT_LOG(Error, "syscall_failed").field("call", "io_uring_enter").field("error", std::strerror(errno));
+        return result;
+    }
+    m_submittedTail += unsigned(result);
+    return result;
+}
+
+unsigned IoUringQueue::forEachCompletion(const std::function<void(const io_uring_cqe&)>& handler) {
+    unsigned handled = 0;
+    unsigned head = *m_cqHead;
+    for (;;) {
+        const unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            break;
+        }
+        // Копия: обработчик может сам ставить запросы, а место в кольце нужно вернуть ядру сразу
+        const io_uring_cqe cqe = m_cqes[head & m_cqMask];
+        ++head;
+        __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+        handler(cqe);
+        ++handled;
+    }
+    return handled;
+}
+
+bool IoUringQueue::setupBufferRing(std::uint16_t groupId, unsigned count, unsigned bufferSize) {
+    // Размер кольца буферов - степень двойки
+    unsigned entries = 1;
+    while (entries < count) {
+        entries <<= 1;
+    }
+    m_bufferRingSize = entries * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, m_bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        CHAT_LOG(Error, "syscall_failed").field("call", "Buffer ring mmap").field("error", std::strerror(errno));
+        return false;
+    }
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<std::uint64_t>(ring);
+    reg.ring_entries = entries;
+    reg.bgid = groupId;
+    if (ioUringRegister(m_ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        CHAT_LOG(Error, "syscall_failed").field("call", "IORING_REGISTER_PBUF_RING").field("error", std::strerror(errno));
+        munmap(ring, m_bufferRingSize);
+        return false;
+    }
+
+    m_bufferRing = static_cast<io_uring_buf_ring*>(ring);
+    m_bufferRingMask = entries - 1;
+    m_bufferGroup = groupId;
+    m_bufferSize = bufferSize;
+    m_buffers.reset(new char[std::size_t(entries) * bufferSize]);
+    m_bufferRing->tail = 0;
+    for (unsigned i = 0; i < entries; ++i) {
+        recycleBuffer(std::uint16_t(i));
+    }
+    return true;
+}
+
+void IoUringQueue::recycleBuffer(std::uint16_t bufferId) {
+    const std::uint16_t tail = m_bufferRing->tail;
+    // Не через bufs[]: в C++ пустая структура в __DECLARE_FLEX_ARRAY занимает байт и сдвигает массив
+    io_uring_buf& slot = reinterpret_cast<io_uring_buf*>(m_bufferRing)[tail & m_bufferRingMask];
+    slot.addr = reinterpret_cast<std::uint64_t>(buffer(bufferId));
+    slot.len = m_bufferSize;
+    slot.bid = bufferId;
+    __atomic_store_n(&m_bufferRing->tail, std::uint16_t(tail + 1), __ATOMIC_RELEASE);
+}
@@ -0,0 +1,77 @@
+#ifndef IO_URING_QUEUE_H
+#define IO_URING_QUEUE_H
+
+#include <linux/io_uring.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+// Минимальная обёртка над системными вызовами io_uring (без liburing): кольца очередей
+// отправки и завершения и кольцо буферов, из которого ядро само выбирает буфер для recv.
+class IoUringQueue {
+public:
+    IoUringQueue() = default;
+    ~IoUringQueue();
+
+    IoUringQueue(const IoUringQueue&) = delete;
+    IoUringQueue& operator=(const IoUringQueue&) = delete;
+
+    bool init(unsigned entries);
+    bool isValid() const { return m_ringFd >= 0; }
+    // Дескриптор кольца становится читаемым, когда в очереди завершения есть записи
+    int fd() const { return m_ringFd; }
+
+    // Свободная запись очереди отправки; если очередь заполнена, накопленное отправляется в ядро
+    io_uring_sqe* nextSqe();
+    // Отправляет накопленные запросы одним io_uring_enter, возвращает число принятых ядром
+    int submit(bool waitForCompletion = false);
+    unsigned pendingSubmissions() const { return m_sqeTail - m_submittedTail; }
+
+    // Обходит готовые записи очереди завершения и освобождает их
+    unsigned forEachCompletion(const std::function<void(const io_uring_cqe&)>& handler);
+
+    // Кольцо из count буферов по bufferSize байт для IOSQE_BUFFER_SELECT
+    bool setupBufferRing(std::uint16_t groupId, unsigned count, unsigned bufferSize);
+    char* buffer(std::uint16_t bufferId) const { return m_buffers.get() + std::size_t(bufferId) * m_bufferSize; }
+    unsigned bufferSize() const { return m_bufferSize; }
+    // Возвращает буфер ядру после того, как данные из него разобраны
+    void recycleBuffer(std::uint16_t bufferId);
+
+    // Сколько раз вызывался io_uring_enter - для сравнения с числом send/recv у других бэкендов
+    std::uint64_t enterCalls() const { return m_enterCalls; }
+
+private:
+    int m_ringFd = -1;
+    io_uring_params m_params{};
+
+    void* m_sqRing = nullptr;
+    std::size_t m_sqRingSize = 0;
+    void* m_cqRing = nullptr;
+    std::size_t m_cqRingSize = 0;
+    io_uring_sqe* m_sqes = nullptr;
+    std::size_t m_sqesSize = 0;
+
+    unsigned* m_sqHead = nullptr;
+    unsigned* m_sqTail = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned* m_sqArray = nullptr;
+    unsigned m_sqeTail = 0;       // Следующая свободная запись (ещё не видна ядру)
+    unsigned m_submittedTail = 0; // Сколько записей уже передано ядру
+
+    unsigned* m_cqHead = nullptr;
+    unsigned* m_cqTail = nullptr;
+    unsigned m_cqMask = 0;
+    io_uring_cqe* m_cqes = nullptr;
+
+    io_uring_buf_ring* m_bufferRing = nullptr;
+    std::size_t m_bufferRingSize = 0;
+    unsigned m_bufferRingMask = 0;
+    std::uint16_t m_bufferGroup = 0;
+    std::unique_ptr<char[]> m_buffers;
+    unsigned m_bufferSize = 0;
+
+    std::uint64_t m_enterCalls = 0;
+};
+
+#endif // IO_URING_QUEUE_H
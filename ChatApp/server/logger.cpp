@@ -0,0 +1,349 @@
+#include "logger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <utility>
+
+namespace {
+
+constexpr std::string_view Ellipsis = "...";
+// Столько фоновый поток спит, если его никто не будит
+constexpr auto WriterIdleInterval = std::chrono::milliseconds(20);
+
+bool needsQuotes(std::string_view value) {
+    if (value.empty()) {
+        return true;
+    }
+    for (char c : value) {
+        if (static_cast<unsigned char>(c) <= ' ' || c == '=' || c == '"') {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+const char* logLevelName(LogLevel level) {
+    switch (level) {
+    case LogLevel::Trace: return "TRACE";
+    case LogLevel::Debug: return "DEBUG";
+    case LogLevel::Info: return "INFO";
+    case LogLevel::Warn: return "WARN";
+    case LogLevel::Error: return "ERROR";
+    case LogLevel::Off: return "OFF";
+    }
+    return "?";
+}
+
+bool parseLogLevel(std::string_view text, LogLevel& level) {
+    static constexpr std::pair<std::string_view, LogLevel> names[] = {
+        {"trace", LogLevel::Trace}, {"debug", LogLevel::Debug}, {"info", LogLevel::Info},
+        {"warn", LogLevel::Warn}, {"warning", LogLevel::Warn}, {"error", LogLevel::Error},
+        {"off", LogLevel::Off},
+    };
+    for (const auto& [name, value] : names) {
+        if (name == text) {
+            level = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Слот кольца (очередь Вьюкова): sequence == pos - свободен для записи с номером pos,
+// sequence == pos + 1 - запись pos готова к выводу
+struct Logger::Slot {
+    std::atomic<std::size_t> sequence{0};
+    std::chrono::system_clock::time_point time;
+    LogLevel level = LogLevel::Info;
+    std::uint16_t size = 0;
+    char text[RecordCapacity];
+};
+
+static_assert((Logger::SlotCount & (Logger::SlotCount - 1)) == 0, "SlotCount must be a power of two");
+
+Logger& Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger()
+    : m_slots(new Slot[SlotCount]) {
+    for (std::size_t i = 0; i < SlotCount; ++i) {
+        m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    m_thread = std::thread([this] { run(); });
+}
+
+Logger::~Logger() {
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_stopping = true;
+    }
+    m_wakeCondition.notify_one();
+    m_thread.join();
+}
+
+bool Logger::push(LogLevel level, std::string_view text) {
+    std::size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &m_slots[pos & (SlotCount - 1)];
+        const std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        const auto diff = std::intptr_t(sequence) - std::intptr_t(pos);
+        if (diff == 0) {
+            if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Фоновый поток не успевает: теряем запись, но не тормозим вызывающего
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = m_enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    const std::size_t size = std::min(text.size(), RecordCapacity);
+    slot->time = std::chrono::system_clock::now();
+    slot->level = level;
+    slot->size = std::uint16_t(size);
+    std::memcpy(slot->text, text.data(), size);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+
+    // Обычно фоновый поток просыпается сам; будим его, только если запись срочная или кольцо почти полно
+    const std::size_t pending = pos + 1 - m_writtenPos.load(std::memory_order_relaxed);
+    if (level >= LogLevel::Error || pending >= SlotCount * 3 / 4) {
+        wake();
+    }
+    return true;
+}
+
+void Logger::wake() {
+    if (!m_wakeRequested.exchange(true, std::memory_order_relaxed)) {
+        m_wakeCondition.notify_one();
+    }
+}
+
+void Logger::flush() {
+    const std::size_t target = m_enqueuePos.load(std::memory_order_acquire);
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_wakeRequested.store(true, std::memory_order_relaxed);
+    }
+    m_wakeCondition.notify_one();
+    std::unique_lock<std::mutex> lock(m_wakeMutex);
+    m_flushedCondition.wait(lock, [&] { return m_writtenPos.load(std::memory_order_acquire) >= target; });
+}
+
+void Logger::setSink(Sink sink) {
+    std::lock_guard<std::mutex> lock(m_sinkMutex);
+    m_sink = std::move(sink);
+}
+
+LogStats Logger::stats() const {
+    LogStats stats;
+    stats.written = m_written.load(std::memory_order_relaxed);
+    stats.dropped = m_dropped.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void Logger::run() {
+    for (;;) {
+        const bool drained = drain();
+        std::unique_lock<std::mutex> lock(m_wakeMutex);
+        if (drained) {
+            m_flushedCondition.notify_all();
+            continue;
+        }
+        if (m_stopping) {
+            break;
+        }
+        m_wakeCondition.wait_for(lock, WriterIdleInterval, [this] {
+            return m_stopping || m_wakeRequested.exchange(false, std::memory_order_relaxed);
+        });
+    }
+}
+
+bool Logger::drain() {
+    std::lock_guard<std::mutex> lock(m_sinkMutex);
+
+    // Время форматируется с точностью до секунды один раз на секунду, миллисекунды дописываются к готовому
+    std::time_t cachedSecond = -1;
+    char secondText[32] = {};
+    std::size_t secondSize = 0;
+    std::string line;
+
+    auto emit = [&](std::chrono::system_clock::time_point time, LogLevel level, std::string_view text) {
+        const auto sinceEpoch = time.time_since_epoch();
+        const std::time_t second = std::time_t(std::chrono::duration_cast<std::chrono::seconds>(sinceEpoch).count());
+        if (second != cachedSecond) {
+            std::tm parts{};
+#ifdef _WIN32
+            gmtime_s(&parts, &second);
+#else
+            gmtime_r(&second, &parts);
+#endif
+            secondSize = std::strftime(secondText, sizeof(secondText), "%Y-%m-%dT%H:%M:%S", &parts);
+            cachedSecond = second;
+        }
+        const int millis = int(std::chrono::duration_cast<std::chrono::milliseconds>(sinceEpoch).count() % 1000);
+        char millisText[8];
+        std::snprintf(millisText, sizeof(millisText), ".%03dZ ", millis);
+
+        line.assign(secondText, secondSize);
+        line += millisText;
+        line += logLevelName(level);
+        line += ' ';
+        line += text;
+        if (m_sink) {
+            m_sink(level, line);
+            return;
+        }
+        std::string& batch = level >= LogLevel::Warn ? m_stderrBatch : m_stdoutBatch;
+        batch += line;
+        batch += '\n';
+    };
+
+    // Не больше одного оборота кольца за раз, иначе под потоком записей пачка не кончится
+    std::size_t count = 0;
+    while (count < SlotCount) {
+        Slot& slot = m_slots[m_dequeuePos & (SlotCount - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != m_dequeuePos + 1) {
+            break;
+        }
+        emit(slot.time, slot.level, std::string_view(slot.text, slot.size));
+        slot.sequence.store(m_dequeuePos + SlotCount, std::memory_order_release);
+        ++m_dequeuePos;
+        ++count;
+    }
+
+    const std::uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+    if (dropped != m_droppedReported) {
+        char text[64];
+        std::snprintf(text, sizeof(text), "log_dropped count=%llu",
+                      static_cast<unsigned long long>(dropped - m_droppedReported));
+        emit(std::chrono::system_clock::now(), LogLevel::Warn, text);
+        m_droppedReported = dropped;
+    }
+
+    if (!m_stdoutBatch.empty()) {
+        std::fwrite(m_stdoutBatch.data(), 1, m_stdoutBatch.size(), stdout);
+        std::fflush(stdout);
+        m_stdoutBatch.clear();
+    }
+    if (!m_stderrBatch.empty()) {
+        std::fwrite(m_stderrBatch.data(), 1, m_stderrBatch.size(), stderr);
+        std::fflush(stderr);
+        m_stderrBatch.clear();
+    }
+
+    if (count == 0) {
+        return false;
+    }
+    m_written.fetch_add(count, std::memory_order_relaxed);
+    m_writtenPos.store(m_dequeuePos, std::memory_order_release);
+    return true;
+}
+
+LogRecord::LogRecord(LogLevel level, std::string_view event)
+    : m_level(level) {
+    append(event);
+}
+
+LogRecord::~LogRecord() {
+    if (!m_discarded) {
+        Logger::instance().push(m_level, text());
+    }
+}
+
+void LogRecord::append(std::string_view text) {
+    if (m_truncated) {
+        return;
+    }
+    const std::size_t usable = Logger::RecordCapacity - Ellipsis.size();
+    if (m_size + text.size() <= usable) {
+        std::memcpy(m_text + m_size, text.data(), text.size());
+        m_size += text.size();
+        return;
+    }
+    const std::size_t fits = usable - m_size;
+    std::memcpy(m_text + m_size, text.data(), fits);
+    std::memcpy(m_text + usable, Ellipsis.data(), Ellipsis.size());
+    m_size = Logger::RecordCapacity;
+    m_truncated = true;
+}
+
+void LogRecord::appendKey(std::string_view key) {
+    append(" ");
+    append(key);
+    append("=");
+}
+
+LogRecord& LogRecord::raw(std::string_view key, std::string_view value) {
+    appendKey(key);
+    append(value);
+    return *this;
+}
+
+LogRecord& LogRecord::field(std::string_view key, std::string_view value) {
+    if (!needsQuotes(value)) {
+        return raw(key, value);
+    }
+    appendKey(key);
+    append("\"");
+    std::size_t plainStart = 0;
+    for (std::size_t i = 0; i < value.size(); ++i) {
+        const char c = value[i];
+        std::string_view escape;
+        switch (c) {
+        case '"': escape = "\\\""; break;
+        case '\\': escape = "\\\\"; break;
+        case '\n': escape = "\\n"; break;
+        case '\r': escape = "\\r"; break;
+        case '\t': escape = "\\t"; break;
+        default: continue;
+        }
+        append(value.substr(plainStart, i - plainStart));
+        append(escape);
+        plainStart = i + 1;
+    }
+    append(value.substr(plainStart));
+    append("\"");
+    return *this;
+}
+
+LogRecord& LogRecord::field(std::string_view key, double value) {
+    char text[32];
+    const int size = std::snprintf(text, sizeof(text), "%g", value);
+    return raw(key, std::string_view(text, std::size_t(size)));
+}
+
+LogRecord& LogRecord::integer(std::string_view key, std::int64_t value) {
+    char text[24];
+    const int size = std::snprintf(text, sizeof(text), "%lld", static_cast<long long>(value));
+    return raw(key, std::string_view(text, std::size_t(size)));
+}
+
+LogRecord& LogRecord::unsignedInteger(std::string_view key, std::uint64_t value) {
+    char text[24];
+    const int size = std::snprintf(text, sizeof(text), "%llu", static_cast<unsigned long long>(value));
+    return raw(key, std::string_view(text, std::size_t(size)));
+}
+
+bool LogSampler::admit(Clock::time_point now, std::uint64_t& suppressed) {
+    const std::int64_t second = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
+    std::int64_t window = m_window.load(std::memory_order_relaxed);
+    if (window != second && m_window.compare_exchange_strong(window, second, std::memory_order_relaxed)) {
+        m_count.store(0, std::memory_order_relaxed);
+    }
+    if (m_count.fetch_add(1, std::memory_order_relaxed) < m_perSecond) {
+        suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+    m_suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
@@ -0,0 +1,196 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+// Асинхронный журнал сервера.
+//
+// Запись собирается на стеке вызывающего потока в строку вида
+//   event key=value key="value with spaces"
+// и кладётся в кольцо фиксированных слотов без блокировок. Фоновый поток забирает записи пачками,
+// дописывает время и уровень и выводит одним fwrite на пачку (WARN и выше - в stderr, остальное -
+// в stdout). Если кольцо переполнено, запись отбрасывается, а не ждёт: число потерянных записей
+// потом попадает в журнал событием log_dropped.
+//
+// Уровни отсекаются дважды: CHAT_LOG_COMPILE_LEVEL убирает вызовы из сборки, Logger::setLevel -
+// во время работы. Выключенная запись стоит одной атомарной загрузки, аргументы не вычисляются.
+//
+//   CHAT_LOG(Info, "client_connected").field("client", id).field("ip", address);
+//   CHAT_LOG_SAMPLED(Debug, "message_received", 10).field("client", id).field("bytes", size);
+//
+// Вторая форма выпускает не больше 10 записей в секунду с этого места в коде, а первая выпущенная
+// после перерыва запись несёт поле suppressed с числом пропущенных.
+
+enum class LogLevel {
+    Trace,
+    Debug,
+    Info,
+    Warn,
+    Error,
+    Off
+};
+
+// Уровни ниже этого не компилируются (0 - Trace, 1 - Debug, ...)
+#ifndef CHAT_LOG_COMPILE_LEVEL
+#define CHAT_LOG_COMPILE_LEVEL 1
+#endif
+
+const char* logLevelName(LogLevel level);
+// "trace", "debug", "info", "warn", "error", "off"
+bool parseLogLevel(std::string_view text, LogLevel& level);
+
+struct LogStats {
+    std::uint64_t written = 0;
+    std::uint64_t dropped = 0;  // Кольцо было переполнено
+};
+
+class Logger {
+public:
+    // Столько байт помещается в одну запись, остальное обрезается
+    static constexpr std::size_t RecordCapacity = 496;
+    static constexpr std::size_t SlotCount = 2048;
+
+    // Запуск фонового потока при первом обращении, при выходе из программы он дописывает всё накопленное
+    static Logger& instance();
+
+    static void setLevel(LogLevel level) { s_level.store(int(level), std::memory_order_relaxed); }
+    static LogLevel level() { return LogLevel(s_level.load(std::memory_order_relaxed)); }
+    static bool enabled(LogLevel level) { return int(level) >= s_level.load(std::memory_order_relaxed); }
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    // Кладёт готовую запись в кольцо; false - кольцо заполнено и запись потеряна
+    bool push(LogLevel level, std::string_view text);
+    // Ждёт, пока фоновый поток выведет всё, что положено до вызова
+    void flush();
+
+    // Вместо stdout/stderr строки (без перевода строки) отдаются sink в фоновом потоке.
+    // Пустой sink возвращает вывод в консоль. Нужно тестам.
+    using Sink = std::function<void(LogLevel level, std::string_view line)>;
+    void setSink(Sink sink);
+
+    LogStats stats() const;
+
+private:
+    struct Slot;
+
+    Logger();
+    ~Logger();
+
+    void run();
+    // Забирает из кольца всё готовое, false - забирать было нечего
+    bool drain();
+    void wake();
+
+    inline static std::atomic<int> s_level{int(LogLevel::Info)};
+
+    std::unique_ptr<Slot[]> m_slots;
+    alignas(64) std::atomic<std::size_t> m_enqueuePos{0};
+    alignas(64) std::size_t m_dequeuePos = 0;           // Меняет только фоновый поток
+    std::atomic<std::size_t> m_writtenPos{0};           // Выведено записей, для flush()
+    std::atomic<std::uint64_t> m_dropped{0};
+    std::uint64_t m_droppedReported = 0;
+    std::atomic<std::uint64_t> m_written{0};
+
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wakeCondition;
+    std::condition_variable m_flushedCondition;
+    std::atomic<bool> m_wakeRequested{false};
+    bool m_stopping = false;
+
+    std::mutex m_sinkMutex;
+    Sink m_sink;
+    std::string m_stdoutBatch;
+    std::string m_stderrBatch;
+
+    std::thread m_thread;
+};
+
+inline bool chatLogEnabled(LogLevel level) {
+    return int(level) >= CHAT_LOG_COMPILE_LEVEL && Logger::enabled(level);
+}
+
+// Одна запись журнала. Собирается в буфере на стеке, в журнал уходит в деструкторе.
+class LogRecord {
+public:
+    LogRecord(LogLevel level, std::string_view event);
+    ~LogRecord();
+
+    LogRecord(const LogRecord&) = delete;
+    LogRecord& operator=(const LogRecord&) = delete;
+
+    LogRecord& field(std::string_view key, std::string_view value);
+    LogRecord& field(std::string_view key, const char* value) { return field(key, std::string_view(value ? value : "")); }
+    LogRecord& field(std::string_view key, const std::string& value) { return field(key, std::string_view(value)); }
+    LogRecord& field(std::string_view key, bool value) { return raw(key, value ? "true" : "false"); }
+    LogRecord& field(std::string_view key, double value);
+
+    template<typename T, typename = std::enable_if_t<std::is_integral_v<T>>>
+    LogRecord& field(std::string_view key, T value) {
+        if constexpr (std::is_signed_v<T>) {
+            return integer(key, std::int64_t(value));
+        } else {
+            return unsignedInteger(key, std::uint64_t(value));
+        }
+    }
+
+    // Поле suppressed, если перед этой записью что-то было пропущено
+    LogRecord& suppressed(std::uint64_t count) { return count ? field("suppressed", count) : *this; }
+
+    std::string_view text() const { return std::string_view(m_text, m_size); }
+    // Запись собрана, но в журнал не пойдёт (нужно тестам форматирования)
+    void discard() { m_discarded = true; }
+
+private:
+    LogRecord& raw(std::string_view key, std::string_view value);
+    LogRecord& integer(std::string_view key, std::int64_t value);
+    LogRecord& unsignedInteger(std::string_view key, std::uint64_t value);
+    void append(std::string_view text);
+    void appendKey(std::string_view key);
+
+    char m_text[Logger::RecordCapacity];
+    std::size_t m_size = 0;
+    LogLevel m_level;
+    bool m_truncated = false;
+    bool m_discarded = false;
+};
+
+// Ограничение частоты записей с одного места в коде: не больше perSecond в секунду
+class LogSampler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit LogSampler(std::uint32_t perSecond) : m_perSecond(perSecond) {}
+
+    // true - запись выпускается, suppressed - сколько пропущено перед ней
+    bool admit(Clock::time_point now, std::uint64_t& suppressed);
+    bool admit(std::uint64_t& suppressed) { return admit(Clock::now(), suppressed); }
+
+private:
+    const std::uint32_t m_perSecond;
+    std::atomic<std::int64_t> m_window{-1};
+    std::atomic<std::uint32_t> m_count{0};
+    std::atomic<std::uint64_t> m_suppressed{0};
+};
+
+#define CHAT_LOG(level, event) \
+    if (!chatLogEnabled(LogLevel::level)) {} else LogRecord(LogLevel::level, event)
+
+#define CHAT_LOG_SAMPLED(level, event, perSecond) \
+    if (std::uint64_t chatLogSuppressed = 0; !chatLogEnabled(LogLevel::level)) {} \
+    else if (static LogSampler chatLogSampler(perSecond); !chatLogSampler.admit(chatLogSuppressed)) {} \
+    else LogRecord(LogLevel::level, event).suppressed(chatLogSuppressed)
+
+#endif // LOGGER_H
@@ -1,18 +1,258 @@
 #include <QCoreApplication>
+#include <QCommandLineParser>
 #include "chat_logic_server.h"
 #include "qt_network_adapter.h"
 #include "qt_database_adapter.h"
+#include "logger.h"
 #include <QDir>
+#include <QTimer>
+#include <algorithm>
+#include <chrono>
 #include <memory>
-#include <iostream>
+#ifdef Q_OS_LINUX
+#include "epoll_network_server.h"
+#include "io_uring_network_server.h"
+#include "multi_network_server.h"
+#include "unix_socket_network_server.h"
+#include <QSocketNotifier>
+#include <sys/resource.h>
+#endif
+
+#ifdef Q_OS_LINUX
+// Десятки тысяч соединений не помещаются в стандартный лимит 1024 дескриптора
+static void raiseFileDescriptorLimit() {
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+#endif
 
 int main(int argc, char *argv[])
 {
     QCoreApplication a(argc, argv);
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption ioThreadsOption("io-threads",
+                                       "Number of network I/O threads (0 - handle sockets in the main thread).",
+                                       "count", "0");
+    parser.addOption(ioThreadsOption);
+    QCommandLineOption backendOption("backend",
+                                     "Network backend: qt (QTcpServer), epoll or io_uring (Linux only).",
+                                     "name", "qt");
+    parser.addOption(backendOption);
+    QCommandLineOption highWaterOption("out-high-water",
+                                       "Per-client outbound queue size (KiB) at which presence updates are merged, "
+                                       "user lists coalesced and clients that stop reading disconnected.",
+                                       "kib", QString::number(OutboundQueueLimits().highWaterMark / 1024));
+    parser.addOption(highWaterOption);
+    QCommandLineOption lowWaterOption("out-low-water",
+                                      "Outbound queue size (KiB) below which a congested client is served normally again.",
+                                      "kib", QString::number(OutboundQueueLimits().lowWaterMark / 1024));
+    parser.addOption(lowWaterOption);
+    QCommandLineOption unixSocketOption("unix-socket",
+                                        "Also accept local clients (bots, gateways) on this Unix domain socket path (Linux only).",
+                                        "path");
+    parser.addOption(unixSocketOption);
+    QCommandLineOption maxConnectionsOption("max-connections",
+                                            "Refuse new connections beyond this many open ones (0 - unlimited).",
+                                            "count", "0");
+    parser.addOption(maxConnectionsOption);
+    QCommandLineOption maxPerIpOption("max-connections-per-ip",
+                                      "Refuse new connections from an address that already has this many (0 - unlimited).",
+                                      "count", "0");
+    parser.addOption(maxPerIpOption);
+    QCommandLineOption acceptRateOption("accept-rate",
+                                        "Accept at most this many new connections per second, refusing the rest (0 - unlimited).",
+                                        "per-second", "0");
+    parser.addOption(acceptRateOption);
+    QCommandLineOption acceptBurstOption("accept-burst",
+                                         "How many connections may be accepted at once under --accept-rate "
+                                         "(0 - one second worth).",
+                                         "count", "0");
+    parser.addOption(acceptBurstOption);
+    QCommandLineOption authTimeoutOption("auth-timeout",
+                                         "Disconnect clients that have not authenticated within this many seconds "
+                                         "(0 - never).",
+                                         "seconds", "0");
+    parser.addOption(authTimeoutOption);
+    QCommandLineOption heartbeatOption("heartbeat-interval",
+                                       "Send PING to a client that supports heartbeats after this many seconds of silence "
+                                       "(0 - no heartbeats).",
+                                       "seconds", "30");
+    parser.addOption(heartbeatOption);
+    QCommandLineOption idleTimeoutOption("idle-timeout",
+                                         "Disconnect a client that supports heartbeats and stays silent this many seconds, "
+                                         "PONG included.",
+                                         "seconds", "90");
+    parser.addOption(idleTimeoutOption);
+    QCommandLineOption rateLimitOption("rate-limit",
+                                       "Limit commands per second: [conn:|user:]<class|COMMAND>=<rate>[/<burst>]. "
+                                       "Classes: auth, search, history, message, group, query; rate 0 lifts the limit. "
+                                       "May be repeated.",
+                                       "spec");
+    parser.addOption(rateLimitOption);
+    QCommandLineOption noRateLimitsOption("no-rate-limits", "Do not limit the rate of client commands.");
+    parser.addOption(noRateLimitsOption);
+    QCommandLineOption rosterFlushOption("roster-flush-interval",
+                                         "Collect user list and presence changes for this many milliseconds and send "
+                                         "each client at most one update per interval; group messages are written "
+                                         "to the database in batches on the same interval (0 - after every command).",
+                                         "ms", "100");
+    parser.addOption(rosterFlushOption);
+    QCommandLineOption logLevelOption("log-level",
+                                      "Least severe log records to print: trace, debug, info, warn, error or off. "
+                                      "Per-message records are debug and sampled.",
+                                      "level", "info");
+    parser.addOption(logLevelOption);
+    parser.process(a);
+
+    LogLevel logLevel = LogLevel::Info;
+    if (!parseLogLevel(parser.value(logLevelOption).toStdString(), logLevel)) {
+        qCritical() << "Invalid --log-level value:" << parser.value(logLevelOption);
+        return 1;
+    }
+    Logger::setLevel(logLevel);
+
+    bool ioThreadsOk = false;
+    const int ioThreads = parser.value(ioThreadsOption).toInt(&ioThreadsOk);
+    if (!ioThreadsOk || ioThreads < 0) {
+        qCritical() << "Invalid --io-threads value:" << parser.value(ioThreadsOption);
+        return 1;
+    }
+
+    bool highWaterOk = false;
+    bool lowWaterOk = false;
+    OutboundQueueLimits outboundLimits;
+    outboundLimits.highWaterMark = std::size_t(parser.value(highWaterOption).toULongLong(&highWaterOk)) * 1024;
+    outboundLimits.lowWaterMark = std::size_t(parser.value(lowWaterOption).toULongLong(&lowWaterOk)) * 1024;
+    if (!highWaterOk || !lowWaterOk || outboundLimits.highWaterMark == 0
+        || outboundLimits.lowWaterMark > outboundLimits.highWaterMark) {
+        qCritical() << "Invalid outbound queue water marks:" << parser.value(highWaterOption) << parser.value(lowWaterOption);
+        return 1;
+    }
+
+    bool maxConnectionsOk = false;
+    bool maxPerIpOk = false;
+    bool acceptRateOk = false;
+    bool acceptBurstOk = false;
+    bool authTimeoutOk = false;
+    AdmissionLimits admissionLimits;
+    admissionLimits.maxConnections = std::size_t(parser.value(maxConnectionsOption).toULongLong(&maxConnectionsOk));
+    admissionLimits.maxConnectionsPerIp = std::size_t(parser.value(maxPerIpOption).toULongLong(&maxPerIpOk));
+    admissionLimits.acceptRate = parser.value(acceptRateOption).toDouble(&acceptRateOk);
+    admissionLimits.acceptBurst = parser.value(acceptBurstOption).toDouble(&acceptBurstOk);
+    const int authTimeout = parser.value(authTimeoutOption).toInt(&authTimeoutOk);
+    if (!maxConnectionsOk || !maxPerIpOk || !acceptRateOk || !acceptBurstOk || !authTimeoutOk
+        || admissionLimits.acceptRate < 0 || admissionLimits.acceptBurst < 0 || authTimeout < 0) {
+        qCritical() << "Invalid connection admission limits";
+        return 1;
+    }
+    admissionLimits.preAuthTimeout = std::chrono::seconds(authTimeout);
+
+    bool heartbeatOk = false;
+    bool idleTimeoutOk = false;
+    const int heartbeatInterval = parser.value(heartbeatOption).toInt(&heartbeatOk);
+    const int idleTimeout = parser.value(idleTimeoutOption).toInt(&idleTimeoutOk);
+    if (!heartbeatOk || !idleTimeoutOk || heartbeatInterval < 0 || (heartbeatInterval > 0 && idleTimeout <= heartbeatInterval)) {
+        qCritical() << "Invalid heartbeat settings:" << parser.value(heartbeatOption) << parser.value(idleTimeoutOption);
+        return 1;
+    }
+    HeartbeatLimits heartbeatLimits;
+    heartbeatLimits.pingInterval = std::chrono::seconds(heartbeatInterval);
+    heartbeatLimits.idleTimeout = std::chrono::seconds(idleTimeout);
+
+    bool rosterFlushOk = false;
+    const int rosterFlushInterval = parser.value(rosterFlushOption).toInt(&rosterFlushOk);
+    if (!rosterFlushOk || rosterFlushInterval < 0) {
+        qCritical() << "Invalid --roster-flush-interval value:" << parser.value(rosterFlushOption);
+        return 1;
+    }
+
     // Создаем адаптеры
     auto dbAdapter = std::make_unique<QtDatabaseAdapter>("QSQLITE");
-    auto networkAdapter = std::make_shared<QtNetworkServerAdapter>(); 
+    const QString backend = parser.value(backendOption);
+    std::shared_ptr<INetworkServer> networkAdapter;
+#ifdef Q_OS_LINUX
+    std::unique_ptr<QSocketNotifier> nativeNotifier;
+    // Нативные бэкенды проверяют таймауты входа и живости после каждой пачки событий, а этот
+    // таймер нужен, чтобы просроченные соединения закрывались и когда событий нет
+    QTimer nativeTimeoutTimer;
+    nativeTimeoutTimer.setInterval(std::min(HeartbeatMonitor::resolutionFor(heartbeatLimits), std::chrono::milliseconds(1000)));
+#endif
+    if (backend == "qt") {
+        auto qtServer = std::make_shared<QtNetworkServerAdapter>(ioThreads);
+        qtServer->setOutboundLimits(outboundLimits);
+        qtServer->setAdmissionLimits(admissionLimits);
+        qtServer->setHeartbeatLimits(heartbeatLimits);
+        networkAdapter = qtServer;
+#ifdef Q_OS_LINUX
+    } else if (backend == "epoll") {
+        if (ioThreads > 0) {
+            qWarning() << "--io-threads is ignored by the epoll backend";
+        }
+        raiseFileDescriptorLimit();
+        auto epollServer = std::make_shared<EpollNetworkServer>();
+        epollServer->setOutboundLimits(outboundLimits);
+        epollServer->setAdmissionLimits(admissionLimits);
+        epollServer->setHeartbeatLimits(heartbeatLimits);
+        // События epoll разбираются в главном потоке, там же, где работает ChatLogicServer
+        EpollNetworkServer* epollServerPtr = epollServer.get();
+        nativeNotifier = std::make_unique<QSocketNotifier>(epollServer->pollFd(), QSocketNotifier::Read);
+        QObject::connect(nativeNotifier.get(), &QSocketNotifier::activated, [epollServerPtr]() {
+            epollServerPtr->processEvents(0);
+        });
+        QObject::connect(&nativeTimeoutTimer, &QTimer::timeout, [epollServerPtr]() { epollServerPtr->checkTimeouts(); });
+        networkAdapter = epollServer;
+    } else if (backend == "io_uring") {
+        if (ioThreads > 0) {
+            qWarning() << "--io-threads is ignored by the io_uring backend";
+        }
+        raiseFileDescriptorLimit();
+        auto uringServer = std::make_shared<IoUringNetworkServer>();
+        uringServer->setOutboundLimits(outboundLimits);
+        uringServer->setAdmissionLimits(admissionLimits);
+        uringServer->setHeartbeatLimits(heartbeatLimits);
+        // Завершения io_uring тоже разбираются в главном потоке
+        IoUringNetworkServer* uringServerPtr = uringServer.get();
+        nativeNotifier = std::make_unique<QSocketNotifier>(uringServer->pollFd(), QSocketNotifier::Read);
+        QObject::connect(nativeNotifier.get(), &QSocketNotifier::activated, [uringServerPtr]() {
+            uringServerPtr->processEvents(0);
+        });
+        QObject::connect(&nativeTimeoutTimer, &QTimer::timeout, [uringServerPtr]() { uringServerPtr->checkTimeouts(); });
+        networkAdapter = uringServer;
+#endif
+    } else {
+        qCritical() << "Unknown network backend:" << backend;
+        return 1;
+    }
+
+    const QString unixSocketPath = parser.value(unixSocketOption);
+#ifdef Q_OS_LINUX
+    std::unique_ptr<QSocketNotifier> unixNotifier;
+    if (!unixSocketPath.isEmpty()) {
+        auto unixServer = std::make_shared<UnixSocketNetworkServer>(unixSocketPath.toStdString());
+        unixServer->setOutboundLimits(outboundLimits);
+        unixServer->setAdmissionLimits(admissionLimits);
+        unixServer->setHeartbeatLimits(heartbeatLimits);
+        // Как и epoll-бэкенд, работает в главном потоке, поэтому колбэки ChatLogicServer не пересекаются
+        UnixSocketNetworkServer* unixServerPtr = unixServer.get();
+        unixNotifier = std::make_unique<QSocketNotifier>(unixServer->pollFd(), QSocketNotifier::Read);
+        QObject::connect(unixNotifier.get(), &QSocketNotifier::activated, [unixServerPtr]() {
+            unixServerPtr->processEvents(0);
+        });
+        QObject::connect(&nativeTimeoutTimer, &QTimer::timeout, [unixServerPtr]() { unixServerPtr->checkTimeouts(); });
+        networkAdapter = std::make_shared<MultiNetworkServer>(
+            std::vector<std::shared_ptr<INetworkServer>>{networkAdapter, unixServer});
+    }
+#else
+    if (!unixSocketPath.isEmpty()) {
+        qCritical() << "--unix-socket is supported on Linux only";
+        return 1;
+    }
+#endif
     QDir appDir(QCoreApplication::applicationDirPath());
     appDir.cdUp(); // Я уже не помню где бд изначально лежит, потом поправлю.
     appDir.cdUp(); 
@@ -33,6 +273,21 @@ int main(int argc, char *argv[])
     }
     ChatLogicServer logicServer(std::move(dbAdapter));
     logicServer.setNetworkServer(networkAdapter);
+    logicServer.setRosterFlushInterval(std::chrono::milliseconds(rosterFlushInterval));
+    // Сброс отложенных USERLIST, PRESENCE и записей сообщений групп в том же главном потоке, что и колбэки сети
+    QTimer rosterFlushTimer;
+    rosterFlushTimer.setInterval(rosterFlushInterval);
+    QObject::connect(&rosterFlushTimer, &QTimer::timeout, [&logicServer]() {
+        logicServer.flushGroupMessages();
+        logicServer.flushRosterUpdates();
+    });
+    logicServer.rateLimiter().setEnabled(!parser.isSet(noRateLimitsOption));
+    for (const QString& spec : parser.values(rateLimitOption)) {
+        if (!logicServer.rateLimiter().applySpec(spec.toStdString())) {
+            qCritical() << "Invalid --rate-limit value:" << spec;
+            return 1;
+        }
+    }
 
     // Обработка ошибки
     if (!logicServer.initializeDatabase()) {
@@ -41,8 +296,16 @@ int main(int argc, char *argv[])
     }
     //Запускаем сервер
     logicServer.startServer(5402);
+#ifdef Q_OS_LINUX
+    if (admissionLimits.preAuthTimeout.count() > 0 || heartbeatLimits.pingInterval.count() > 0) {
+        nativeTimeoutTimer.start();
+    }
+#endif
+    if (rosterFlushInterval > 0) {
+        rosterFlushTimer.start();
+    }
 
     int result = a.exec();
-    std::cout << "Server application event loop finished. Exiting..." << std::endl;
+    CHAT_LOG(Info, "event_loop_finished").field("result", result);
     return result;
 }
@@ -0,0 +1,47 @@
+#include "multi_network_server.h"
+
+MultiNetworkServer::MultiNetworkServer(std::vector<std::shared_ptr<INetworkServer>> servers)
+    : m_servers(std::move(servers)) {
+}
+
+bool MultiNetworkServer::start(int port) {
+    for (std::size_t i = 0; i < m_servers.size(); ++i) {
+        if (!m_servers[i]->start(port)) {
+            for (std::size_t started = 0; started < i; ++started) {
+                m_servers[started]->stop();
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+void MultiNetworkServer::stop() {
+    for (const auto& server : m_servers) {
+        server->stop();
+    }
+}
+
+void MultiNetworkServer::broadcastMessage(const std::string& message) {
+    for (const auto& server : m_servers) {
+        server->broadcastMessage(message);
+    }
+}
+
+void MultiNetworkServer::setClientConnectedCallback(ClientConnectedCallback cb) {
+    for (const auto& server : m_servers) {
+        server->setClientConnectedCallback(cb);
+    }
+}
+
+void MultiNetworkServer::setClientDisconnectedCallback(ClientDisconnectedCallback cb) {
+    for (const auto& server : m_servers) {
+        server->setClientDisconnectedCallback(cb);
+    }
+}
+
+void MultiNetworkServer::setMessageReceivedCallback(MessageReceivedCallback cb) {
+    for (const auto& server : m_servers) {
+        server->setMessageReceivedCallback(cb);
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef MULTI_NETWORK_SERVER_H
+#define MULTI_NETWORK_SERVER_H
+
+#include "network_interface.h"
+#include <memory>
+#include <vector>
+
+// Несколько транспортов под одним ChatLogicServer (например, TCP и Unix-сокет в одном процессе).
+// Колбэки, start/stop и рассылка передаются всем; соединения остаются у своих транспортов.
+// Транспорты должны вызывать колбэки в одном потоке - в том, где работает ChatLogicServer.
+class MultiNetworkServer : public INetworkServer {
+public:
+    explicit MultiNetworkServer(std::vector<std::shared_ptr<INetworkServer>> servers);
+
+    // Успешен, если запустились все транспорты; иначе уже запущенные останавливаются
+    bool start(int port) override;
+    void stop() override;
+    void broadcastMessage(const std::string& message) override;
+
+    void setClientConnectedCallback(ClientConnectedCallback cb) override;
+    void setClientDisconnectedCallback(ClientDisconnectedCallback cb) override;
+    void setMessageReceivedCallback(MessageReceivedCallback cb) override;
+
+private:
+    std::vector<std::shared_ptr<INetworkServer>> m_servers;
+};
+
+#endif // MULTI_NETWORK_SERVER_H
@@ -1,13 +1,68 @@
 #ifndef NETWORK_INTERFACE_H
 #define NETWORK_INTERFACE_H
 
+#include <algorithm>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <functional>
 #include <memory>
+#include "shared_frame.h"
 
 class INetworkClient;
 
+// Счётчики исходящего потока: сколько кадров уходит за один сброс буфера в сокет
+struct NetworkWriteStats {
+    std::uint64_t frames = 0;
+    std::uint64_t flushes = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t maxFramesPerFlush = 0;
+
+    double framesPerFlush() const { return flushes ? double(frames) / double(flushes) : 0.0; }
+    void add(const NetworkWriteStats& other) {
+        frames += other.frames;
+        flushes += other.flushes;
+        bytes += other.bytes;
+        maxFramesPerFlush = std::max(maxFramesPerFlush, other.maxFramesPerFlush);
+    }
+};
+
+// Счётчики ограничения исходящих очередей: медленные клиенты и что с их сообщениями сделано
+struct OutboundQueueStats {
+    std::uint64_t queuedBytes = 0;    // Сейчас ждут отправки
+    std::uint64_t maxQueuedBytes = 0;
+    std::uint64_t congestions = 0;    // Сколько раз очередь доходила до верхней отметки
+    std::uint64_t dropped = 0;
+    std::uint64_t coalesced = 0;
+    std::uint64_t evicted = 0;        // Отключено клиентов
+
+    void add(const OutboundQueueStats& other) {
+        queuedBytes += other.queuedBytes;
+        maxQueuedBytes = std::max(maxQueuedBytes, other.maxQueuedBytes);
+        congestions += other.congestions;
+        dropped += other.dropped;
+        coalesced += other.coalesced;
+        evicted += other.evicted;
+    }
+};
+
+// Счётчики допуска соединений: сколько принято, отклонено по каждой причине и закрыто без входа
+struct AdmissionStats {
+    std::uint64_t accepted = 0;
+    std::uint64_t rejectedCapacity = 0; // Достигнут общий предел соединений
+    std::uint64_t rejectedPerIp = 0;    // Достигнут предел соединений с одного адреса
+    std::uint64_t rejectedRate = 0;     // Превышена скорость приёма
+    std::uint64_t reapedPreAuth = 0;    // Не вошли за отведённое время
+
+    std::uint64_t rejected() const { return rejectedCapacity + rejectedPerIp + rejectedRate; }
+};
+
+// Счётчики проверки живости: сколько PING отправлено и сколько молчащих соединений закрыто
+struct HeartbeatStats {
+    std::uint64_t pingsSent = 0;
+    std::uint64_t idleReaped = 0;
+};
+
 class INetworkServer {
 public:
     virtual ~INetworkServer() = default;
@@ -28,9 +83,15 @@ class INetworkClient {
 public:
     virtual ~INetworkClient() = default;
     virtual void sendMessage(const std::string& message) = 0;
+    // Рассылка одного сообщения многим: кадры кодируются один раз на всех получателей
+    virtual void sendFrame(const SharedFrame& frame) { sendMessage(frame->message()); }
     virtual std::string getClientId() const = 0;
     virtual bool isConnected() const = 0;
     virtual void disconnectClient() = 0;
+    // Клиент прошёл AUTH: с этого момента таймаут входа к нему не применяется
+    virtual void markAuthenticated() {}
+    // Опции, согласованные через HELLO. Логике нужны те, что меняют состав сообщений (presence)
+    virtual WireOptions wireOptions() const { return WireOptions(); }
 };
 
 #endif // NETWORK_INTERFACE_H
\ No newline at end of file
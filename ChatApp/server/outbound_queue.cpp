@@ -0,0 +1,114 @@
+#include "outbound_queue.h"
+#include <algorithm>
+
+namespace {
+
+bool startsWith(std::string_view text, std::string_view prefix) {
+    return text.substr(0, prefix.size()) == prefix;
+}
+
+} // namespace
+
+OutboundClass classifyOutboundMessage(std::string_view message) {
+    if (startsWith(message, "PRESENCE:")) {
+        return OutboundClass::Presence;
+    }
+    if (startsWith(message, "USERLIST:")) {
+        return OutboundClass::Roster;
+    }
+    return OutboundClass::Regular;
+}
+
+OverflowPolicy OutboundQueueLimits::policyFor(OutboundClass messageClass) const {
+    switch (messageClass) {
+    case OutboundClass::Presence:
+        return presence;
+    case OutboundClass::Roster:
+        return roster;
+    case OutboundClass::Regular:
+        break;
+    }
+    return regular;
+}
+
+OutboundQueueGuard::OutboundQueueGuard(const OutboundQueueLimits& limits)
+    : m_limits(limits) {
+    m_limits.lowWaterMark = std::min(m_limits.lowWaterMark, m_limits.highWaterMark);
+}
+
+OutboundQueueGuard::Action OutboundQueueGuard::admit(const std::string& message, std::size_t queuedBytes) {
+    m_stats.maxQueuedBytes = std::max<std::uint64_t>(m_stats.maxQueuedBytes, queuedBytes);
+    const bool overHighWater = queuedBytes >= m_limits.highWaterMark;
+    if (overHighWater && !m_congested) {
+        m_congested = true;
+        ++m_stats.congestions;
+    }
+    if (!m_congested) {
+        return Action::Send;
+    }
+
+    switch (m_limits.policyFor(classifyOutboundMessage(message))) {
+    case OverflowPolicy::Drop:
+        ++m_stats.dropped;
+        return Action::Skip;
+    case OverflowPolicy::Coalesce:
+        // Предыдущее отложенное сообщение устарело и не будет отправлено
+        ++m_stats.coalesced;
+        m_deferred = message;
+        m_hasDeferred = true;
+        if (classifyOutboundMessage(message) == OutboundClass::Roster) {
+            m_deferredPresence.clear(); // Статусы уже есть в полном списке
+        }
+        return Action::Skip;
+    case OverflowPolicy::Merge: {
+        // "PRESENCE:имя:статус[:имя:статус...]": от каждого пользователя нужен только последний статус
+        ++m_stats.coalesced;
+        std::string_view fields = std::string_view(message).substr(message.find(':') + 1);
+        while (!fields.empty()) {
+            const std::size_t nameEnd = fields.find(':');
+            if (nameEnd == std::string_view::npos) {
+                break;
+            }
+            const std::size_t statusEnd = fields.find(':', nameEnd + 1);
+            m_deferredPresence[std::string(fields.substr(0, nameEnd))] = fields.substr(nameEnd + 1, statusEnd - nameEnd - 1) == "1";
+            fields = statusEnd == std::string_view::npos ? std::string_view() : fields.substr(statusEnd + 1);
+        }
+        return Action::Skip;
+    }
+    case OverflowPolicy::Disconnect:
+        // Между отметками сообщения ещё принимаются, разрываем только при переполнении
+        if (!overHighWater) {
+            return Action::Send;
+        }
+        ++m_stats.evicted;
+        return Action::Disconnect;
+    }
+    return Action::Send;
+}
+
+bool OutboundQueueGuard::drained(std::size_t queuedBytes, std::vector<std::string>& deferred) {
+    if (!m_congested || queuedBytes > m_limits.lowWaterMark) {
+        return false;
+    }
+    m_congested = false;
+    if (!m_hasDeferred && m_deferredPresence.empty()) {
+        return false;
+    }
+    if (m_hasDeferred) {
+        m_hasDeferred = false;
+        deferred.push_back(std::move(m_deferred));
+        m_deferred.clear();
+        m_deferred.shrink_to_fit();
+    }
+    if (!m_deferredPresence.empty()) {
+        std::string presence = "PRESENCE";
+        for (const auto& status : m_deferredPresence) {
+            presence += ':';
+            presence += status.first;
+            presence += status.second ? ":1" : ":0";
+        }
+        deferred.push_back(std::move(presence));
+        m_deferredPresence.clear();
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+#ifndef OUTBOUND_QUEUE_H
+#define OUTBOUND_QUEUE_H
+
+#include "network_interface.h"
+#include <cstddef>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Класс исходящего сообщения: от него зависит, что делать, когда клиент не успевает читать
+enum class OutboundClass {
+    Regular,  // Ответы и сообщения чатов - терять нельзя
+    Presence, // PRESENCE:... - изменения статусов; повторно их никто не пришлёт, терять нельзя
+    Roster    // USERLIST:... - каждый следующий заменяет предыдущий целиком
+};
+
+enum class OverflowPolicy {
+    Disconnect, // Отключить клиента
+    Drop,       // Не отправлять
+    Coalesce,   // Отложить, оставив только последнее, и отправить, когда очередь разгрузится
+    Merge       // PRESENCE: отложить последний статус каждого пользователя и отправить одним сообщением
+};
+
+OutboundClass classifyOutboundMessage(std::string_view message);
+
+// Отметки считаются в байтах, ещё не принятых ядром. Выше highWaterMark соединение перегружено
+// и остаётся таким, пока очередь не опустится до lowWaterMark.
+struct OutboundQueueLimits {
+    std::size_t highWaterMark = 8 * 1024 * 1024;
+    std::size_t lowWaterMark = 2 * 1024 * 1024;
+    OverflowPolicy regular = OverflowPolicy::Disconnect;
+    OverflowPolicy presence = OverflowPolicy::Merge;
+    OverflowPolicy roster = OverflowPolicy::Coalesce;
+
+    OverflowPolicy policyFor(OutboundClass messageClass) const;
+};
+
+// Решает судьбу каждого исходящего сообщения одного соединения. Сама байты не хранит:
+// бэкенд передаёт текущий размер своей очереди и сообщает, когда она уменьшилась.
+class OutboundQueueGuard {
+public:
+    enum class Action {
+        Send,
+        Skip,      // Сообщение отброшено или отложено
+        Disconnect // Клиент не читает, соединение нужно разорвать
+    };
+
+    explicit OutboundQueueGuard(const OutboundQueueLimits& limits = OutboundQueueLimits());
+
+    Action admit(const std::string& message, std::size_t queuedBytes);
+    // Очередь уменьшилась до queuedBytes. true - перегрузка снята и в deferred отложенные
+    // сообщения, которые нужно отправить по порядку: USERLIST, затем склеенный PRESENCE
+    bool drained(std::size_t queuedBytes, std::vector<std::string>& deferred);
+
+    bool congested() const { return m_congested; }
+    const OutboundQueueLimits& limits() const { return m_limits; }
+    // queuedBytes в счётчиках заполняет бэкенд
+    const OutboundQueueStats& stats() const { return m_stats; }
+
+private:
+    OutboundQueueLimits m_limits;
+    OutboundQueueStats m_stats;
+    bool m_congested = false;
+    bool m_hasDeferred = false;
+    std::string m_deferred;
+    std::map<std::string, bool> m_deferredPresence; // Пользователь -> последний статус
+};
+
+#endif // OUTBOUND_QUEUE_H
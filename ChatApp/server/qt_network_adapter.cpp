@@ -1,117 +1,544 @@
 #include "qt_network_adapter.h"
-#include <QDebug> 
+#include "logger.h"
+#include <QElapsedTimer>
 #include <QUuid>
+#include <QMutexLocker>
+#include <algorithm>
+#ifdef Q_OS_WIN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Адрес клиента по дескриптору, ещё без QTcpSocket: отказ не должен стоить создания сокета
+std::string descriptorPeerHost(qintptr socketDescriptor) {
+    sockaddr_storage address{};
+    socklen_t length = sizeof(address);
+    if (::getpeername(socketDescriptor, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+        return std::string();
+    }
+    return QHostAddress(reinterpret_cast<const sockaddr*>(&address)).toString().toStdString();
+}
 
+void closeDescriptor(qintptr socketDescriptor) {
+#ifdef Q_OS_WIN
+    ::closesocket(SOCKET(socketDescriptor));
+#else
+    ::close(int(socketDescriptor));
+#endif
+}
+
+} // namespace
 
 QtNetworkClientAdapter::QtNetworkClientAdapter(QTcpSocket* socket, QtNetworkServerAdapter* serverAdapter, QObject* parent)
-    : QObject(parent), m_socket(socket), m_nextBlockSize(0), m_serverAdapter(serverAdapter) {
+    : QObject(parent), m_socket(socket), m_pendingFrames(0), m_flushScheduled(false),
+      m_outboundGuard(serverAdapter ? serverAdapter->outboundLimits() : OutboundQueueLimits()), m_queuedBytes(0),
+      m_connected(socket && socket->state() == QAbstractSocket::ConnectedState),
+      m_frameDecoder(FrameProtocol::LegacyVersion), m_handshakeDone(false), m_connectionId(0),
+      m_timerKey(0), m_serverAdapter(serverAdapter) {
     if (m_socket) {
         connect(m_socket, &QTcpSocket::readyRead, this, &QtNetworkClientAdapter::onReadyRead);
         connect(m_socket, &QTcpSocket::disconnected, this, &QtNetworkClientAdapter::onSocketDisconnected);
         connect(m_socket, QOverload<QAbstractSocket::SocketError>::of(&QTcpSocket::errorOccurred), this, &QtNetworkClientAdapter::onSocketError);
+        connect(m_socket, &QTcpSocket::bytesWritten, this, &QtNetworkClientAdapter::onBytesWritten);
         // Генерируем ID клиента на основе его адреса и порта для простоты
         m_clientId = m_socket->peerAddress().toString().toStdString() + ":" + std::to_string(m_socket->peerPort());
-        qDebug() << "QtNetworkClientAdapter created for" << QString::fromStdString(m_clientId);
+        CHAT_LOG(Trace, "client_adapter_created").field("client", m_clientId);
     }
 }
 
 QtNetworkClientAdapter::~QtNetworkClientAdapter() {
-    qDebug() << "QtNetworkClientAdapter for" << QString::fromStdString(m_clientId) << "destroyed.";
+    CHAT_LOG(Trace, "client_adapter_destroyed").field("client", m_clientId);
 }
 
 void QtNetworkClientAdapter::sendMessage(const std::string& message) {
-    if (m_socket && m_socket->isOpen() && m_socket->state() == QAbstractSocket::ConnectedState) {
-        QByteArray block;
-        QDataStream out(&block, QIODevice::WriteOnly);
-        out.setVersion(QDataStream::Qt_6_2);
-        out << quint16(0);
-        out << QString::fromStdString(message);
-        out.device()->seek(0);
-        out << quint16(block.size() - sizeof(quint16));
-        m_socket->write(block);
-        m_socket->flush(); // Убедимся, что данные отправлены немедленно
-        qDebug() << "Sent to" << QString::fromStdString(m_clientId) << ":" << QString::fromStdString(message);
+    if (QThread::currentThread() != thread()) {
+        // Кодирование и запись выполняются в потоке ввода-вывода, которому принадлежит сокет
+        if (m_connected.load(std::memory_order_acquire)) {
+            auto self = shared_from_this();
+            QMetaObject::invokeMethod(this, [self, message]() { self->sendMessage(message); }, Qt::QueuedConnection);
+        }
+        return;
+    }
+    if (!admit(message)) {
+        return;
+    }
+    if (m_wireOptions.utf8) {
+        writeUtf8Frames(message); // Строка уже в UTF-8, уходит в сокет без перекодирования
+    } else if (m_wireOptions.version >= FrameProtocol::StreamVersion) {
+        writeStreamFrames(QString::fromStdString(message));
+    } else {
+        writeLegacyFrame(QString::fromStdString(message));
+    }
+    queueOutput();
+    CHAT_LOG_SAMPLED(Debug, "message_sent", 10).field("client", m_clientId).field("bytes", message.size());
+}
+
+void QtNetworkClientAdapter::sendFrame(const SharedFrame& frame) {
+    if (QThread::currentThread() != thread()) {
+        // В поток ввода-вывода уходит только ссылка на уже готовое сообщение
+        if (m_connected.load(std::memory_order_acquire)) {
+            auto self = shared_from_this();
+            QMetaObject::invokeMethod(this, [self, frame]() { self->sendFrame(frame); }, Qt::QueuedConnection);
+        }
+        return;
+    }
+    if (!admit(frame->message())) {
+        return;
+    }
+    std::string_view frames = frame->frames(m_wireOptions);
+    if (frames.empty()) {
+        CHAT_LOG_SAMPLED(Warn, "message_dropped", 10).field("client", m_clientId)
+            .field("bytes", frame->message().size()).field("reason", "exceeds legacy frame");
+        return;
+    }
+    if (m_wireOptions.version < FrameProtocol::StreamVersion) {
+        m_outBuffer.append(frames.data(), qsizetype(frames.size()));
+        m_pendingFrames += frame->frameCount(m_wireOptions);
+        queueOutput();
+        return;
+    }
+    // Кадры дописываются по одному, как в writeUtf8Frames. Все кадры сообщения, кроме последнего, -
+    // полные фрагменты, так что за шаг берётся ровно один кадр
+    constexpr std::size_t MaxStreamFrame = FrameProtocol::StreamHeaderSize + FrameProtocol::MaxChunkSize;
+    while (!frames.empty()) {
+        std::size_t size = compressionBatchSize(frames, MaxStreamFrame);
+        if (size == 0) {
+            size = frames.size();
+        }
+        m_outBuffer.append(frames.data(), qsizetype(size));
+        ++m_pendingFrames;
+        if (m_outBuffer.size() >= FlushThreshold) {
+            flushOutput(); // Большое сообщение не держим в буфере целиком
+        }
+        frames.remove_prefix(size);
+    }
+    queueOutput();
+}
+
+bool QtNetworkClientAdapter::admit(const std::string& message) {
+    if (!m_socket || !m_socket->isOpen() || m_socket->state() != QAbstractSocket::ConnectedState) {
+        CHAT_LOG_SAMPLED(Debug, "message_dropped", 10).field("client", m_clientId).field("reason", "not connected");
+        return false;
+    }
+    OutboundQueueGuard::Action action;
+    {
+        QMutexLocker locker(&m_statsMutex);
+        action = m_outboundGuard.admit(message, queuedBytes());
+    }
+    if (action == OutboundQueueGuard::Action::Disconnect) {
+        evict();
+    }
+    return action == OutboundQueueGuard::Action::Send;
+}
+
+void QtNetworkClientAdapter::queueOutput() {
+    // Не пишем в сокет на каждое сообщение: вход пользователя порождает сотни кадров подряд
+    if (m_outBuffer.size() >= FlushThreshold) {
+        flushOutput();
     } else {
-        qWarning() << "Cannot send message, socket not connected or invalid for client" << QString::fromStdString(m_clientId);
+        scheduleFlush();
     }
 }
 
+void QtNetworkClientAdapter::writeLegacyFrame(const QString& message) {
+    QByteArray block;
+    QDataStream out(&block, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_2);
+    out << quint16(0);
+    out << message;
+    const qsizetype payloadSize = block.size() - qsizetype(sizeof(quint16));
+    if (payloadSize > qsizetype(FrameProtocol::LegacyMaxPayload)) {
+        // Клиент не согласовал версию 2, а в 16-битную длину сообщение не помещается
+        CHAT_LOG_SAMPLED(Warn, "message_dropped", 10).field("client", m_clientId)
+            .field("bytes", payloadSize).field("reason", "exceeds legacy frame");
+        return;
+    }
+    out.device()->seek(0);
+    out << quint16(payloadSize);
+    m_outBuffer.append(block);
+    ++m_pendingFrames;
+}
+
+void QtNetworkClientAdapter::writeStreamFrames(const QString& message) {
+    // Режем сообщение на фрагменты, каждый фрагмент - отдельный кадр
+    const qsizetype charsPerChunk = qsizetype(FrameProtocol::MaxChunkSize / sizeof(QChar));
+    qsizetype offset = 0;
+    do {
+        const qsizetype count = qMin(charsPerChunk, message.size() - offset);
+        const bool more = offset + count < message.size();
+
+        QByteArray chunk;
+        QDataStream out(&chunk, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_6_2);
+        out << message.mid(offset, count);
+
+        char header[FrameProtocol::StreamHeaderSize];
+        const std::size_t headerSize = encodeFrameHeader(header, FrameProtocol::StreamVersion, std::size_t(chunk.size()), more);
+        m_outBuffer.append(header, qsizetype(headerSize));
+        m_outBuffer.append(chunk);
+        ++m_pendingFrames;
+        if (m_outBuffer.size() >= FlushThreshold) {
+            flushOutput(); // Большое сообщение не держим в буфере целиком
+        }
+        offset += count;
+    } while (offset < message.size());
+}
+
+void QtNetworkClientAdapter::writeUtf8Frames(const std::string& message) {
+    std::size_t offset = 0;
+    do {
+        const std::size_t count = std::min(FrameProtocol::MaxChunkSize, message.size() - offset);
+        const bool more = offset + count < message.size();
+
+        char header[FrameProtocol::StreamHeaderSize];
+        const std::size_t headerSize = encodeFrameHeader(header, FrameProtocol::StreamVersion, count, more);
+        m_outBuffer.append(header, qsizetype(headerSize));
+        m_outBuffer.append(message.data() + offset, qsizetype(count));
+        ++m_pendingFrames;
+        if (m_outBuffer.size() >= FlushThreshold) {
+            flushOutput(); // Большое сообщение не держим в буфере целиком
+        }
+        offset += count;
+    } while (offset < message.size());
+}
+
+void QtNetworkClientAdapter::scheduleFlush() {
+    if (m_flushScheduled) {
+        return;
+    }
+    m_flushScheduled = true;
+    // Сработает после того, как текущий обработчик отдаст управление циклу событий
+    QMetaObject::invokeMethod(this, &QtNetworkClientAdapter::flushOutput, Qt::QueuedConnection);
+}
+
+void QtNetworkClientAdapter::flushOutput() {
+    m_flushScheduled = false;
+    if (m_outBuffer.isEmpty()) {
+        return;
+    }
+    if (!m_socket || m_socket->state() != QAbstractSocket::ConnectedState) {
+        m_outBuffer.clear();
+        m_pendingFrames = 0;
+        return;
+    }
+
+    const QByteArray& output = m_wireOptions.deflate ? compressOutput() : m_outBuffer;
+    m_socket->write(output);
+    m_socket->flush();
+
+    {
+        QMutexLocker locker(&m_statsMutex);
+        m_writeStats.frames += m_pendingFrames;
+        m_writeStats.flushes += 1;
+        m_writeStats.bytes += quint64(output.size());
+        m_writeStats.maxFramesPerFlush = std::max(m_writeStats.maxFramesPerFlush, m_pendingFrames);
+    }
+    m_pendingFrames = 0;
+    m_outBuffer.resize(0); // resize, а не clear: память буфера переиспользуется
+    m_compressBuffer.resize(0);
+    m_queuedBytes.store(quint64(m_socket->bytesToWrite()), std::memory_order_relaxed);
+}
+
+const QByteArray& QtNetworkClientAdapter::compressOutput() {
+    // Сжимается весь сброс сразу: при входе это сотни строк истории с общими префиксами
+    CompressionStats stats;
+    QElapsedTimer timer;
+    std::string_view frames(m_outBuffer.constData(), std::size_t(m_outBuffer.size()));
+    while (!frames.empty()) {
+        std::size_t size = compressionBatchSize(frames, FrameProtocol::MaxCompressedBatch);
+        if (size == 0) {
+            size = frames.size(); // Не кадры версии 2, такое не сжимаем
+        }
+        const qsizetype before = m_compressBuffer.size();
+        QByteArray packed;
+        if (size >= FrameProtocol::MinCompressedBatch) {
+            timer.start();
+            packed = qCompress(reinterpret_cast<const uchar*>(frames.data()), qsizetype(size));
+            stats.cpuNanos += quint64(timer.nsecsElapsed());
+        }
+        if (!packed.isEmpty() && std::size_t(packed.size()) + FrameProtocol::StreamHeaderSize < size) {
+            char header[FrameProtocol::StreamHeaderSize];
+            m_compressBuffer.append(header, qsizetype(encodeCompressedFrameHeader(header, std::size_t(packed.size()))));
+            m_compressBuffer.append(packed);
+            ++stats.batches;
+        } else {
+            m_compressBuffer.append(frames.data(), qsizetype(size)); // Не сжалось, отправим как есть
+            ++stats.skipped;
+        }
+        stats.inputBytes += size;
+        stats.outputBytes += quint64(m_compressBuffer.size() - before);
+        frames.remove_prefix(size);
+    }
+
+    QMutexLocker locker(&m_statsMutex);
+    m_compressionStats.add(stats);
+    return m_compressBuffer;
+}
+
+std::size_t QtNetworkClientAdapter::queuedBytes() const {
+    const qint64 socketBytes = m_socket ? m_socket->bytesToWrite() : 0;
+    return std::size_t(m_outBuffer.size()) + std::size_t(socketBytes);
+}
+
+void QtNetworkClientAdapter::onBytesWritten(qint64 bytes) {
+    Q_UNUSED(bytes);
+    const std::size_t queued = queuedBytes();
+    m_queuedBytes.store(queued, std::memory_order_relaxed);
+    std::vector<std::string> deferred;
+    {
+        QMutexLocker locker(&m_statsMutex);
+        m_outboundGuard.drained(queued, deferred);
+    }
+    // Клиент разгрузился: отправляем последний отложенный USERLIST и пропущенные статусы
+    for (const std::string& message : deferred) {
+        sendMessage(message);
+    }
+}
+
+void QtNetworkClientAdapter::evict() {
+    CHAT_LOG(Warn, "client_evicted").field("client", m_clientId).field("queued_bytes", queuedBytes());
+    m_outBuffer.clear();
+    m_pendingFrames = 0;
+    m_queuedBytes.store(0, std::memory_order_relaxed);
+    m_socket->abort(); // Ждать отправки очереди бессмысленно, disconnected придёт сразу
+}
+
 std::string QtNetworkClientAdapter::getClientId() const {
     return m_clientId;
 }
 
 bool QtNetworkClientAdapter::isConnected() const {
-    return m_socket && m_socket->isOpen() && m_socket->state() == QAbstractSocket::ConnectedState;
+    return m_connected.load(std::memory_order_acquire);
+}
+
+NetworkWriteStats QtNetworkClientAdapter::writeStats() const {
+    QMutexLocker locker(&m_statsMutex);
+    return m_writeStats;
+}
+
+CompressionStats QtNetworkClientAdapter::compressionStats() const {
+    QMutexLocker locker(&m_statsMutex);
+    return m_compressionStats;
+}
+
+OutboundQueueStats QtNetworkClientAdapter::outboundStats() const {
+    QMutexLocker locker(&m_statsMutex);
+    OutboundQueueStats stats = m_outboundGuard.stats();
+    stats.queuedBytes = m_queuedBytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void QtNetworkClientAdapter::markAuthenticated() {
+    if (m_serverAdapter) {
+        m_serverAdapter->clientAuthenticated(*this);
+    }
 }
 
 void QtNetworkClientAdapter::disconnectClient() {
+    if (QThread::currentThread() != thread()) {
+        auto self = shared_from_this();
+        QMetaObject::invokeMethod(this, [self]() { self->disconnectClient(); }, Qt::QueuedConnection);
+        return;
+    }
     if (m_socket && m_socket->isOpen()) {
-        qDebug() << "Disconnecting client" << QString::fromStdString(m_clientId);
+        CHAT_LOG(Debug, "client_disconnecting").field("client", m_clientId);
+        flushOutput(); // disconnectFromHost дождётся отправки того, что уже в сокете
         m_socket->disconnectFromHost();
     }
 }
 
+void QtNetworkClientAdapter::abortClient() {
+    if (QThread::currentThread() != thread()) {
+        auto self = shared_from_this();
+        QMetaObject::invokeMethod(this, [self]() { self->abortClient(); }, Qt::QueuedConnection);
+        return;
+    }
+    if (m_socket && m_socket->isOpen()) {
+        m_outBuffer.clear();
+        m_pendingFrames = 0;
+        m_queuedBytes.store(0, std::memory_order_relaxed);
+        m_socket->abort(); // disconnected придёт сразу
+    }
+}
+
 void QtNetworkClientAdapter::onReadyRead() {
     if (!m_socket) return;
 
-    QDataStream in(m_socket);
-    in.setVersion(QDataStream::Qt_6_2);
+    // Всё, что есть в сокете, одним вызовом читается прямо в буфер декодера
+    const qint64 available = m_socket->bytesAvailable();
+    if (available > 0) {
+        const qint64 received = m_socket->read(m_frameDecoder.prepare(std::size_t(available)), available);
+        if (received > 0) {
+            m_frameDecoder.commit(std::size_t(received));
+        }
+    }
 
-    forever { // Читаем все доступные сообщения
-        if (m_nextBlockSize == 0) {
-            if (m_socket->bytesAvailable() < sizeof(quint16)) {
-                break; // Недостаточно данных для размера блока
-            }
-            in >> m_nextBlockSize;
+    forever { // Читаем все доступные кадры
+        std::string_view payload;
+        bool more = false;
+        const FrameDecoder::Result result = m_frameDecoder.next(payload, more);
+        if (result == FrameDecoder::Result::NeedMoreData) {
+            break;
+        }
+        if (result == FrameDecoder::Result::Error) {
+            CHAT_LOG(Warn, "client_protocol_error").field("client", m_clientId).field("reason", "malformed frame");
+            m_frameDecoder.reset();
+            m_socket->abort();
+            return;
         }
 
-        if (m_socket->bytesAvailable() < m_nextBlockSize) {
-            break; // Недостаточно данных для полного сообщения
+        std::size_t assembledSize = 0;
+        if (m_wireOptions.utf8) {
+            m_partialMessage.append(payload.data(), payload.size());
+            assembledSize = m_partialMessage.size();
+        } else {
+            if (!decodePayload(payload, m_partialText)) {
+                m_frameDecoder.reset();
+                m_socket->abort();
+                return;
+            }
+            assembledSize = std::size_t(m_partialText.size()) * sizeof(QChar);
+        }
+        if (assembledSize > FrameProtocol::MaxMessageSize) {
+            CHAT_LOG(Warn, "client_protocol_error").field("client", m_clientId).field("reason", "message too large");
+            m_partialMessage.clear();
+            m_partialText.clear();
+            m_socket->abort();
+            return;
+        }
+        if (more) {
+            continue; // Ждём продолжения сообщения
         }
 
-        QString messageStr;
-        in >> messageStr;
+        std::string message;
+        if (m_wireOptions.utf8) {
+            message.swap(m_partialMessage);
+        } else {
+            message = m_partialText.toStdString();
+            m_partialText.clear();
+        }
 
-        if (in.status() != QDataStream::Ok) {
-            qWarning() << "DataStream error while reading for client" << QString::fromStdString(m_clientId) << "status:" << in.status();
-            m_nextBlockSize = 0; // Сбрасываем, чтобы избежать зацикливания
-            break;
+        if (!m_handshakeDone) {
+            m_handshakeDone = true;
+            if (handleHandshake(message)) {
+                continue;
+            }
         }
 
-        qDebug() << "Received from" << QString::fromStdString(m_clientId) << ":" << messageStr;
-        m_nextBlockSize = 0; // Сбрасываем для следующего сообщения
+        CHAT_LOG_SAMPLED(Debug, "message_received", 10).field("client", m_clientId).field("bytes", message.size());
 
         // Передаем сообщение в QtNetworkServerAdapter, который вызовет callback ChatLogicServer
-        emit messageReceivedInternal(shared_from_this(), messageStr.toStdString());
+        if (auto self = weak_from_this().lock()) {
+            emit messageReceivedInternal(self, message);
+        }
     }
 }
 
+bool QtNetworkClientAdapter::decodePayload(std::string_view payload, QString& text) const {
+    // Фрагмент дописывается прямо в text, без QDataStream и промежуточной QString на кадр
+    std::string_view units;
+    if (!qStringPayloadUnits(payload, units)) {
+        CHAT_LOG(Warn, "client_protocol_error").field("client", m_clientId).field("reason", "bad string payload");
+        return false;
+    }
+    const qsizetype offset = text.size();
+    text.resize(offset + qsizetype(units.size() / 2));
+    decodeUtf16Be(units, reinterpret_cast<char16_t*>(text.data() + offset));
+    return true;
+}
+
+bool QtNetworkClientAdapter::handleHandshake(const std::string& message) {
+    WireOptions requested;
+    if (!parseHello(message, requested)) {
+        return false; // Старый клиент, остаёмся на версии 1
+    }
+    const WireOptions accepted = negotiateWireOptions(requested);
+    // Ответ уходит ещё в старом формате, всё после него - уже в согласованном
+    writeLegacyFrame(QString::fromStdString(buildHelloReply(accepted)));
+    flushOutput(); // Сразу: с deflate ответ попал бы в сжатую пачку, а клиент о ней ещё не знает
+    m_wireOptions = accepted;
+    m_frameDecoder.setVersion(accepted.version);
+    CHAT_LOG(Debug, "wire_negotiated").field("client", m_clientId).field("version", accepted.version)
+        .field("utf8", accepted.utf8).field("deflate", accepted.deflate).field("heartbeat", accepted.heartbeat);
+    if (accepted.heartbeat) {
+        if (auto self = weak_from_this().lock()) {
+            emit heartbeatNegotiatedInternal(self);
+        }
+    }
+    return true;
+}
+
 void QtNetworkClientAdapter::onSocketDisconnected() {
-    qDebug() << "Socket disconnected for client" << QString::fromStdString(m_clientId);
-    emit disconnectedInternal(shared_from_this());
+    CHAT_LOG(Debug, "socket_disconnected").field("client", m_clientId);
+    m_connected.store(false, std::memory_order_release);
+    // Адаптер уже может ждать удаления через deleteLater, тогда сообщать некому
+    if (auto self = weak_from_this().lock()) {
+        emit disconnectedInternal(self);
+    }
 }
 
 void QtNetworkClientAdapter::onSocketError(QAbstractSocket::SocketError socketError) {
-    qWarning() << "Socket error for client" << QString::fromStdString(m_clientId) << ":" << m_socket->errorString();
+    CHAT_LOG(Debug, "socket_error").field("client", m_clientId).field("error", m_socket->errorString().toStdString());
+
+}
 
+void QtTcpListener::incomingConnection(qintptr socketDescriptor) {
+    emit socketDescriptorReady(socketDescriptor);
 }
 
-QtNetworkServerAdapter::QtNetworkServerAdapter(QObject* parent) : QObject(parent) {
-    connect(&m_tcpServer, &QTcpServer::newConnection, this, &QtNetworkServerAdapter::handleNewConnection);
-    qDebug() << "QtNetworkServerAdapter created.";
+QtNetworkServerAdapter::QtNetworkServerAdapter(int ioThreads, QObject* parent)
+    : QObject(parent), m_acceptGeneration(0), m_nextIoThread(0), m_drainScheduled(false) {
+    connect(&m_tcpServer, &QtTcpListener::socketDescriptorReady, this, &QtNetworkServerAdapter::handleNewConnection);
+    m_timeoutTimer.setInterval(1000);
+    connect(&m_timeoutTimer, &QTimer::timeout, this, &QtNetworkServerAdapter::checkTimeouts);
+    for (int i = 0; i < ioThreads; ++i) {
+        auto* thread = new QThread(this);
+        thread->setObjectName(QStringLiteral("network-io-%1").arg(i));
+        auto* context = new QObject;
+        context->moveToThread(thread);
+        connect(thread, &QThread::finished, context, &QObject::deleteLater);
+        thread->start();
+        m_ioThreads.push_back(thread);
+        m_ioContexts.push_back(context);
+    }
+    CHAT_LOG(Debug, "network_created").field("backend", "qt").field("io_threads", ioThreads);
 }
 
 QtNetworkServerAdapter::~QtNetworkServerAdapter() {
     stop();
-    qDebug() << "QtNetworkServerAdapter destroyed.";
+    stopIoThreads();
+    CHAT_LOG(Debug, "network_destroyed").field("backend", "qt");
+}
+
+void QtNetworkServerAdapter::stopIoThreads() {
+    for (QThread* thread : m_ioThreads) {
+        thread->quit();
+    }
+    for (QThread* thread : m_ioThreads) {
+        thread->wait();
+    }
+    m_ioThreads.clear();
+    m_ioContexts.clear();
 }
 
 bool QtNetworkServerAdapter::start(int port) {
     if (m_tcpServer.listen(QHostAddress::Any, static_cast<quint16>(port))) {
-        qDebug() << "QtNetworkServerAdapter started on port" << port;
+        CHAT_LOG(Info, "network_started").field("backend", "qt").field("port", port);
+        if (m_heartbeats.enabled()) {
+            m_timeoutTimer.setInterval(std::min(m_heartbeats.resolution(), std::chrono::milliseconds(1000)));
+        }
+        if (m_admission.limits().preAuthTimeout.count() > 0 || m_heartbeats.enabled()) {
+            m_timeoutTimer.start();
+        }
         return true;
     } else {
-        qWarning() << "QtNetworkServerAdapter failed to start on port" << port << ":" << m_tcpServer.errorString();
+        CHAT_LOG(Error, "network_start_failed").field("backend", "qt").field("port", port)
+            .field("error", m_tcpServer.errorString().toStdString());
         return false;
     }
 }
@@ -119,24 +546,58 @@ bool QtNetworkServerAdapter::start(int port) {
 void QtNetworkServerAdapter::stop() {
     if (m_tcpServer.isListening()) {
         m_tcpServer.close();
-        qDebug() << "QtNetworkServerAdapter stopped.";
+        const NetworkWriteStats stats = writeStats();
+        const OutboundQueueStats outbound = outboundStats();
+        const CompressionStats compression = compressionStats();
+        CHAT_LOG(Info, "network_stopped").field("backend", "qt")
+            .field("frames", stats.frames).field("flushes", stats.flushes)
+            .field("frames_per_flush", stats.framesPerFlush()).field("max_frames_per_flush", stats.maxFramesPerFlush)
+            .field("max_queued_bytes", outbound.maxQueuedBytes).field("dropped", outbound.dropped)
+            .field("coalesced", outbound.coalesced).field("evicted", outbound.evicted)
+            .field("compression_ratio", compression.ratio()).field("compression_ms", compression.cpuNanos / 1000000)
+            .field("rejected", m_admission.stats().rejected()).field("reaped_pre_auth", m_admission.stats().reapedPreAuth)
+            .field("pings", m_heartbeats.stats().pingsSent).field("reaped_idle", m_heartbeats.stats().idleReaped);
     }
+    m_timeoutTimer.stop();
     // Закрываем все клиентские соединения
-    for (const auto& client : qAsConst(m_clients)) {
-        if (client) {
-            client->disconnectClient();
-        }
-    }
+    m_clients.forEach([](std::uint32_t, const std::shared_ptr<QtNetworkClientAdapter>& client) {
+        client->disconnectClient();
+    });
     m_clients.clear(); // Очищаем список клиентов
 }
 
 void QtNetworkServerAdapter::broadcastMessage(const std::string& message) {
-    qDebug() << "Broadcasting message:" << QString::fromStdString(message);
-    for (const auto& client : qAsConst(m_clients)) {
-        if (client && client->isConnected()) {
-            client->sendMessage(message);
+    CHAT_LOG_SAMPLED(Debug, "message_broadcast", 10).field("bytes", message.size()).field("clients", m_clients.size());
+    const SharedFrame frame = makeSharedFrame(message);
+    m_clients.forEach([&frame](std::uint32_t, const std::shared_ptr<QtNetworkClientAdapter>& client) {
+        if (client->isConnected()) {
+            client->sendFrame(frame);
         }
-    }
+    });
+}
+
+NetworkWriteStats QtNetworkServerAdapter::writeStats() const {
+    NetworkWriteStats total = m_closedWriteStats;
+    m_clients.forEach([&total](std::uint32_t, const std::shared_ptr<QtNetworkClientAdapter>& client) {
+        total.add(client->writeStats());
+    });
+    return total;
+}
+
+OutboundQueueStats QtNetworkServerAdapter::outboundStats() const {
+    OutboundQueueStats total = m_closedOutboundStats;
+    m_clients.forEach([&total](std::uint32_t, const std::shared_ptr<QtNetworkClientAdapter>& client) {
+        total.add(client->outboundStats());
+    });
+    return total;
+}
+
+CompressionStats QtNetworkServerAdapter::compressionStats() const {
+    CompressionStats total = m_closedCompressionStats;
+    m_clients.forEach([&total](std::uint32_t, const std::shared_ptr<QtNetworkClientAdapter>& client) {
+        total.add(client->compressionStats());
+    });
+    return total;
 }
 
 void QtNetworkServerAdapter::setClientConnectedCallback(ClientConnectedCallback cb) {
@@ -151,49 +612,164 @@ void QtNetworkServerAdapter::setMessageReceivedCallback(MessageReceivedCallback
     m_messageReceivedCb = cb;
 }
 
-void QtNetworkServerAdapter::handleNewConnection() {
-    while (m_tcpServer.hasPendingConnections()) {
-        QTcpSocket* socket = m_tcpServer.nextPendingConnection();
-        if (socket) {
-            qDebug() << "New connection from" << socket->peerAddress().toString() << ":" << socket->peerPort();
-            auto clientAdapter = std::make_shared<QtNetworkClientAdapter>(socket, this);
-            connect(clientAdapter.get(), &QtNetworkClientAdapter::disconnectedInternal, this, &QtNetworkServerAdapter::onClientAdapterDisconnected);
-            connect(clientAdapter.get(), &QtNetworkClientAdapter::messageReceivedInternal, this, &QtNetworkServerAdapter::onClientAdapterMessageReceived);
-
-            m_clients.append(clientAdapter);
+void QtNetworkServerAdapter::handleNewConnection(qintptr socketDescriptor) {
+    // Во время шторма переподключений отказ должен стоить только accept() и close()
+    std::string peerHost = descriptorPeerHost(socketDescriptor);
+    if (m_admission.admit(peerHost) != AdmissionController::Decision::Accept) {
+        closeDescriptor(socketDescriptor);
+        return;
+    }
+    if (m_ioContexts.empty()) {
+        createClient(socketDescriptor, std::move(peerHost));
+        return;
+    }
+    // Раздаём соединения потокам по кругу
+    QObject* context = m_ioContexts[m_nextIoThread];
+    m_nextIoThread = (m_nextIoThread + 1) % m_ioContexts.size();
+    QMetaObject::invokeMethod(context, [this, socketDescriptor, peerHost]() { createClient(socketDescriptor, peerHost); },
+                              Qt::QueuedConnection);
+}
 
-            if (m_clientConnectedCb) {
-                m_clientConnectedCb(clientAdapter);
-            }
-        }
+void QtNetworkServerAdapter::createClient(qintptr socketDescriptor, std::string peerHost) {
+    auto* socket = new QTcpSocket;
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        CHAT_LOG(Warn, "accept_failed").field("backend", "qt").field("error", socket->errorString().toStdString());
+        delete socket;
+        // Место, занятое в admit(), возвращается в потоке логики
+        QMetaObject::invokeMethod(this, [this, peerHost]() { m_admission.release(peerHost); }, Qt::QueuedConnection);
+        return;
     }
+    CHAT_LOG(Debug, "connection_accepted").field("peer", peerHost).field("port", socket->peerPort());
+
+    // Адаптер удаляется в своём потоке, даже если последняя ссылка на него отпущена в потоке логики
+    std::shared_ptr<QtNetworkClientAdapter> clientAdapter(new QtNetworkClientAdapter(socket, this),
+                                                         [](QtNetworkClientAdapter* adapter) { adapter->deleteLater(); });
+    socket->setParent(clientAdapter.get());
+    clientAdapter->setPeerHost(std::move(peerHost));
+
+    // Сигналы обрабатываются прямо в потоке ввода-вывода: событие просто кладётся в очередь
+    connect(clientAdapter.get(), &QtNetworkClientAdapter::disconnectedInternal, clientAdapter.get(),
+            [this](std::shared_ptr<QtNetworkClientAdapter> client) { postEvent(NetworkEvent::Type::Disconnected, client); },
+            Qt::DirectConnection);
+    connect(clientAdapter.get(), &QtNetworkClientAdapter::messageReceivedInternal, clientAdapter.get(),
+            [this](std::shared_ptr<QtNetworkClientAdapter> client, const std::string& message) {
+                postEvent(NetworkEvent::Type::Message, client, message);
+            },
+            Qt::DirectConnection);
+    connect(clientAdapter.get(), &QtNetworkClientAdapter::heartbeatNegotiatedInternal, clientAdapter.get(),
+            [this](std::shared_ptr<QtNetworkClientAdapter> client) { postEvent(NetworkEvent::Type::HeartbeatNegotiated, client); },
+            Qt::DirectConnection);
+
+    postEvent(NetworkEvent::Type::Connected, clientAdapter);
 }
 
-void QtNetworkServerAdapter::onClientAdapterDisconnected(std::shared_ptr<QtNetworkClientAdapter> client) {
-    if (client) {
-        qDebug() << "Client adapter disconnected event for" << QString::fromStdString(client->getClientId());
-        if (m_clientDisconnectedCb) {
-            m_clientDisconnectedCb(client);
+void QtNetworkServerAdapter::postEvent(NetworkEvent::Type type, std::shared_ptr<QtNetworkClientAdapter> client, std::string message) {
+    bool scheduleDrain = false;
+    {
+        QMutexLocker locker(&m_eventsMutex);
+        m_pendingEvents.push_back(NetworkEvent{type, std::move(client), std::move(message)});
+        if (!m_drainScheduled) {
+            m_drainScheduled = true;
+            scheduleDrain = true;
         }
-        // Удаляем клиента из списка
-        removeClient(client);
+    }
+    // Одна задача на пачку событий, а не на каждое сообщение
+    if (scheduleDrain) {
+        QMetaObject::invokeMethod(this, &QtNetworkServerAdapter::drainEvents, Qt::QueuedConnection);
     }
 }
 
-void QtNetworkServerAdapter::onClientAdapterMessageReceived(std::shared_ptr<QtNetworkClientAdapter> client, const std::string& message) {
-    if (client && m_messageReceivedCb) {
-        m_messageReceivedCb(client, message);
+void QtNetworkServerAdapter::drainEvents() {
+    std::vector<NetworkEvent> events;
+    {
+        QMutexLocker locker(&m_eventsMutex);
+        events.swap(m_pendingEvents);
+        m_drainScheduled = false;
+    }
+
+    const HeartbeatMonitor::Clock::time_point now = HeartbeatMonitor::Clock::now();
+    for (NetworkEvent& event : events) {
+        switch (event.type) {
+        case NetworkEvent::Type::Connected:
+            event.client->setConnectionId(m_clients.add(event.client));
+            // Id в реестре переиспользуются, поэтому ключ таймаута дополнен номером поколения
+            event.client->setTimerKey((std::uint64_t(++m_acceptGeneration) << 32) | event.client->connectionId());
+            m_admission.startPreAuth(event.client->timerKey());
+            if (m_clientConnectedCb) {
+                m_clientConnectedCb(event.client);
+            }
+            break;
+        case NetworkEvent::Type::Message:
+            m_heartbeats.touch(event.client->timerKey(), now);
+            if (event.message == FrameProtocol::PongMessage) {
+                break; // Ответ на PING нужен только для touch()
+            }
+            if (m_messageReceivedCb) {
+                m_messageReceivedCb(event.client, event.message);
+            }
+            break;
+        case NetworkEvent::Type::HeartbeatNegotiated:
+            m_heartbeats.add(event.client->timerKey(), now);
+            break;
+        case NetworkEvent::Type::Disconnected:
+            CHAT_LOG(Trace, "client_disconnected_event").field("client", event.client->getClientId());
+            if (m_clientDisconnectedCb) {
+                m_clientDisconnectedCb(event.client);
+            }
+            // Удаляем клиента из списка
+            removeClient(event.client);
+            break;
+        }
     }
 }
 
 void QtNetworkServerAdapter::removeClient(std::shared_ptr<QtNetworkClientAdapter> client) {
     if (!client) return;
-    // Безопасное удаление из списка
-    for (int i = 0; i < m_clients.size(); ++i) {
-        if (m_clients.at(i) == client) {
-            m_clients.removeAt(i);
-            qDebug() << "Removed client" << QString::fromStdString(client->getClientId()) << "from list. Remaining clients:" << m_clients.size();
-            break;
+    // Id мог уже достаться другому соединению (например, после stop()), сверяем указатель
+    const std::shared_ptr<QtNetworkClientAdapter>* registered = m_clients.find(client->connectionId());
+    if (!registered || *registered != client) {
+        return;
+    }
+    m_closedWriteStats.add(client->writeStats());
+    OutboundQueueStats outbound = client->outboundStats();
+    outbound.queuedBytes = 0;
+    m_closedOutboundStats.add(outbound);
+    m_closedCompressionStats.add(client->compressionStats());
+    m_admission.release(client->peerHost());
+    m_admission.finishPreAuth(client->timerKey());
+    m_heartbeats.remove(client->timerKey());
+    m_clients.remove(client->connectionId());
+    CHAT_LOG(Debug, "client_removed").field("client", client->getClientId()).field("remaining", m_clients.size());
+}
+
+void QtNetworkServerAdapter::clientAuthenticated(const QtNetworkClientAdapter& client) {
+    m_admission.finishPreAuth(client.timerKey());
+}
+
+void QtNetworkServerAdapter::checkTimeouts() {
+    const AdmissionController::Clock::time_point now = AdmissionController::Clock::now();
+    m_admission.reapExpired(now, [this](std::uint64_t key) {
+        if (QtNetworkClientAdapter* client = findByTimerKey(key)) {
+            CHAT_LOG(Info, "client_reaped").field("client", client->getClientId()).field("reason", "auth timeout");
+            client->disconnectClient(); // Отключение придёт обычным путём и вызовет removeClient
         }
+    });
+    m_heartbeats.tick(now, [this](std::uint64_t key) {
+        if (QtNetworkClientAdapter* client = findByTimerKey(key)) {
+            client->sendMessage(std::string(FrameProtocol::PingMessage));
+        }
+    }, [this](std::uint64_t key) {
+        if (QtNetworkClientAdapter* client = findByTimerKey(key)) {
+            CHAT_LOG(Info, "client_reaped").field("client", client->getClientId()).field("reason", "idle");
+            client->abortClient(); // Присланное ему уже не уйдёт; отключение вызовет removeClient
+        }
+    });
+}
+
+QtNetworkClientAdapter* QtNetworkServerAdapter::findByTimerKey(std::uint64_t key) {
+    std::shared_ptr<QtNetworkClientAdapter>* client = m_clients.find(std::uint32_t(key & 0xFFFFFFFFu));
+    if (!client || (*client)->timerKey() != key) {
+        return nullptr;
     }
+    return client->get();
 }
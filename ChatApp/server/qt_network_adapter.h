@@ -2,13 +2,23 @@
 #define QT_NETWORK_ADAPTER_H
 
 #include "network_interface.h"
+#include "admission_control.h"
+#include "heartbeat_monitor.h"
+#include "connection_registry.h"
+#include "frame_codec.h"
+#include "outbound_queue.h"
 #include <QTcpServer>
 #include <QTcpSocket>
 #include <QObject>
 #include <QMap>
 #include <QDataStream>
 #include <QHostAddress>
+#include <QMutex>
+#include <QThread>
+#include <QTimer>
+#include <atomic>
 #include <memory>
+#include <vector>
 
 class QtNetworkServerAdapter;
 
@@ -19,32 +29,114 @@ public:
     ~QtNetworkClientAdapter() override;
 
     void sendMessage(const std::string& message) override;
+    void sendFrame(const SharedFrame& frame) override;
     std::string getClientId() const override;
     bool isConnected() const override;
     void disconnectClient() override;
+    // Закрывает сокет, не дожидаясь отправки очереди: собеседник уже не отвечает
+    void abortClient();
+    // Вызывается в потоке логики, как и остальные обращения ChatLogicServer
+    void markAuthenticated() override;
+    // Согласуются до первого сообщения клиента, дальше не меняются
+    WireOptions wireOptions() const override { return m_wireOptions; }
 
     QTcpSocket* getSocket() const { return m_socket; }
+    // Номер в реестре QtNetworkServerAdapter, назначается и читается только в потоке логики
+    std::uint32_t connectionId() const { return m_connectionId; }
+    void setConnectionId(std::uint32_t id) { m_connectionId = id; }
+    // Адрес без порта для AdmissionController и ключ таймеров входа и живости (поток логики)
+    const std::string& peerHost() const { return m_peerHost; }
+    void setPeerHost(std::string host) { m_peerHost = std::move(host); }
+    std::uint64_t timerKey() const { return m_timerKey; }
+    void setTimerKey(std::uint64_t key) { m_timerKey = key; }
+    // Можно вызывать из любого потока
+    NetworkWriteStats writeStats() const;
+    OutboundQueueStats outboundStats() const;
+    CompressionStats compressionStats() const;
+
+    // Буфер сбрасывается сразу, если в нём накопилось больше этого числа байт
+    static constexpr qsizetype FlushThreshold = 64 * 1024;
 
 signals:
     void disconnectedInternal(std::shared_ptr<QtNetworkClientAdapter> client);
     void messageReceivedInternal(std::shared_ptr<QtNetworkClientAdapter> client, const std::string& message);
+    void heartbeatNegotiatedInternal(std::shared_ptr<QtNetworkClientAdapter> client);
+
+public slots:
+    // Отправляет накопленные кадры одним вызовом write()
+    void flushOutput();
 
 private slots:
     void onReadyRead();
     void onSocketDisconnected();
     void onSocketError(QAbstractSocket::SocketError socketError);
+    void onBytesWritten(qint64 bytes);
 
 private:
+    void writeLegacyFrame(const QString& message);
+    void writeStreamFrames(const QString& message);
+    void writeUtf8Frames(const std::string& message);
+    // Дописывает фрагмент из нагрузки кадра к text
+    bool decodePayload(std::string_view payload, QString& text) const;
+    bool handleHandshake(const std::string& message);
+    // deflate: кадры из m_outBuffer пачками через qCompress, результат в m_compressBuffer
+    const QByteArray& compressOutput();
+    // Проверка сокета и ограничения очереди; false - сообщение не отправляется
+    bool admit(const std::string& message);
+    // Сбросить буфер сразу или в конце итерации цикла событий
+    void queueOutput();
+    void scheduleFlush();
+    // Байты, ещё не принятые ядром: наш буфер и буфер QTcpSocket
+    std::size_t queuedBytes() const;
+    void evict();
+
     QTcpSocket* m_socket;
-    quint16 m_nextBlockSize;
+    // Кадры копятся здесь и уходят в сокет один раз за итерацию цикла событий
+    QByteArray m_outBuffer;
+    QByteArray m_compressBuffer;
+    std::uint64_t m_pendingFrames;
+    bool m_flushScheduled;
+    NetworkWriteStats m_writeStats;
+    CompressionStats m_compressionStats;
+    // Буфер QTcpSocket растёт без ограничений, поэтому сообщения медленному клиенту проходят через guard
+    OutboundQueueGuard m_outboundGuard;
+    std::atomic<std::uint64_t> m_queuedBytes;
+    mutable QMutex m_statsMutex; // Защищает m_writeStats, m_compressionStats и m_outboundGuard
+    // Сокет живёт в потоке ввода-вывода, а isConnected() спрашивают из потока логики
+    std::atomic<bool> m_connected;
+    FrameDecoder m_frameDecoder;
+    WireOptions m_wireOptions;
+    bool m_handshakeDone; // HELLO принимается только первым сообщением
+    // Сообщение, собираемое из фрагментов версии 2: байты UTF-8 либо текст из QString-фрагментов
+    std::string m_partialMessage;
+    QString m_partialText;
     std::string m_clientId;
+    std::uint32_t m_connectionId;
+    std::string m_peerHost;
+    std::uint64_t m_timerKey;
     QtNetworkServerAdapter* m_serverAdapter;
 };
 
+// Отдаёт дескриптор принятого сокета, чтобы QTcpSocket можно было создать в нужном потоке
+class QtTcpListener : public QTcpServer {
+    Q_OBJECT
+public:
+    using QTcpServer::QTcpServer;
+
+signals:
+    void socketDescriptorReady(qintptr socketDescriptor);
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+};
+
+// Сокеты распределяются по ioThreads потокам ввода-вывода (0 - всё в текущем потоке).
+// Кадры разбираются и собираются в потоках ввода-вывода, а подключения, сообщения и отключения
+// складываются в общую очередь и вызывают колбэки ChatLogicServer только в потоке, где создан адаптер.
 class QtNetworkServerAdapter : public QObject, public INetworkServer {
     Q_OBJECT
 public:
-    explicit QtNetworkServerAdapter(QObject* parent = nullptr);
+    explicit QtNetworkServerAdapter(int ioThreads = 0, QObject* parent = nullptr);
     ~QtNetworkServerAdapter() override;
 
     bool start(int port) override;
@@ -56,16 +148,70 @@ public:
     void setMessageReceivedCallback(MessageReceivedCallback cb) override;
 
     void removeClient(std::shared_ptr<QtNetworkClientAdapter> client);
+    void clientAuthenticated(const QtNetworkClientAdapter& client);
+    // Число открытых соединений
+    std::size_t connectionCount() const { return m_clients.size(); }
+
+    // Суммарные счётчики по всем соединениям, включая уже закрытые
+    NetworkWriteStats writeStats() const;
+    OutboundQueueStats outboundStats() const;
+    CompressionStats compressionStats() const;
+    // Действует для соединений, принятых после вызова
+    void setOutboundLimits(const OutboundQueueLimits& limits) { m_outboundLimits = limits; }
+    const OutboundQueueLimits& outboundLimits() const { return m_outboundLimits; }
+    // Пределы числа и скорости новых соединений и таймаут входа; действуют для новых соединений
+    void setAdmissionLimits(const AdmissionLimits& limits) { m_admission.setLimits(limits); }
+    const AdmissionStats& admissionStats() const { return m_admission.stats(); }
+    // Интервал PING и таймаут молчания для клиентов с опцией heartbeat; вызывается до start()
+    void setHeartbeatLimits(const HeartbeatLimits& limits) { m_heartbeats.setLimits(limits); }
+    const HeartbeatStats& heartbeatStats() const { return m_heartbeats.stats(); }
+    int ioThreadCount() const { return int(m_ioThreads.size()); }
 
 private slots:
-    void handleNewConnection();
-    void onClientAdapterDisconnected(std::shared_ptr<QtNetworkClientAdapter> client);
-    void onClientAdapterMessageReceived(std::shared_ptr<QtNetworkClientAdapter> client, const std::string& message);
-
+    void handleNewConnection(qintptr socketDescriptor);
+    void drainEvents();
+    // Закрывает соединения, не вошедшие за AdmissionLimits::preAuthTimeout, шлёт PING
+    // замолчавшим клиентам и закрывает не ответивших
+    void checkTimeouts();
 
 private:
-    QTcpServer m_tcpServer;
-    QList<std::shared_ptr<QtNetworkClientAdapter>> m_clients;
+    struct NetworkEvent {
+        enum class Type {
+            Connected,
+            Message,
+            HeartbeatNegotiated,
+            Disconnected
+        };
+        Type type;
+        std::shared_ptr<QtNetworkClientAdapter> client;
+        std::string message;
+    };
+
+    // Выполняется в потоке ввода-вывода
+    void createClient(qintptr socketDescriptor, std::string peerHost);
+    void postEvent(NetworkEvent::Type type, std::shared_ptr<QtNetworkClientAdapter> client, std::string message = std::string());
+    void stopIoThreads();
+    QtNetworkClientAdapter* findByTimerKey(std::uint64_t key);
+
+    QtTcpListener m_tcpServer;
+    ConnectionRegistry<std::shared_ptr<QtNetworkClientAdapter>> m_clients;
+    NetworkWriteStats m_closedWriteStats;
+    OutboundQueueLimits m_outboundLimits;
+    OutboundQueueStats m_closedOutboundStats;
+    CompressionStats m_closedCompressionStats;
+    // Решения о приёме и таймауты входа - в потоке логики, до создания QTcpSocket
+    AdmissionController m_admission;
+    std::uint32_t m_acceptGeneration;
+    HeartbeatMonitor m_heartbeats; // Тоже в потоке логики: время активности - по событиям Message
+    QTimer m_timeoutTimer; // Один на все соединения
+
+    std::vector<QThread*> m_ioThreads;
+    std::vector<QObject*> m_ioContexts; // Живут в потоках ввода-вывода, через них туда передаются задачи
+    std::size_t m_nextIoThread;
+
+    QMutex m_eventsMutex;
+    std::vector<NetworkEvent> m_pendingEvents;
+    bool m_drainScheduled;
 
     ClientConnectedCallback m_clientConnectedCb;
     ClientDisconnectedCallback m_clientDisconnectedCb;
@@ -8,11 +8,23 @@ CONFIG -= app_bundle
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+INCLUDEPATH += ../common
+
 SOURCES += \
+    ../common/chat_protocol.cpp \
+    ../common/frame_codec.cpp \
+    ../common/ring_buffer.cpp \
     ChatLogicServer.cpp \
+    admission_control.cpp \
+    heartbeat_monitor.cpp \
+    inbound_rate_limiter.cpp \
+    logger.cpp \
     main.cpp \
+    outbound_queue.cpp \
     qt_database_adapter.cpp \
     qt_network_adapter.cpp \
+    shared_frame.cpp \
+    wire_session.cpp \
 
 
 # Default rules for deployment.
@@ -21,9 +33,44 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
 
 HEADERS += \
+    ../common/chat_protocol.h \
+    ../common/frame_codec.h \
+    ../common/ring_buffer.h \
+    admission_control.h \
+    connection_registry.h \
+    heartbeat_monitor.h \
+    inbound_rate_limiter.h \
+    logger.h \
+    outbound_queue.h \
     qt_network_adapter.h \
+    shared_frame.h \
+    timing_wheel.h \
+    token_bucket.h \
+    wire_session.h \
     qt_database_adapter.h \
     network_interface.h \
     database_interface.h \
     chat_logic_server.h \
 
+
+# Бэкенды epoll и io_uring (--backend epoll / io_uring) и Unix-сокет (--unix-socket) есть только на Linux.
+# Сжатие (опция deflate) в них - через системный zlib, адаптер Qt пользуется qCompress
+linux {
+    LIBS += -lz
+    SOURCES += \
+        epoll_network_server.cpp \
+        frame_compression.cpp \
+        io_uring_network_server.cpp \
+        io_uring_queue.cpp \
+        multi_network_server.cpp \
+        socket_utils.cpp \
+        unix_socket_network_server.cpp
+    HEADERS += \
+        epoll_network_server.h \
+        frame_compression.h \
+        io_uring_network_server.h \
+        io_uring_queue.h \
+        multi_network_server.h \
+        socket_utils.h \
+        unix_socket_network_server.h
+}
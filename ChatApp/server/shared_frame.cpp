@@ -0,0 +1,30 @@
+#include "shared_frame.h"
+
+const EncodedMessage::Encoding& EncodedMessage::encoding(const WireOptions& options) const {
+    // Двоичный вид согласуется только вместе с utf8 и есть не у всех сообщений
+    const bool binary = options.binary && !m_binary.empty();
+    std::size_t index = 0;
+    if (binary) {
+        index = 3;
+    } else if (options.version >= FrameProtocol::StreamVersion) {
+        index = options.utf8 ? 2 : 1;
+    }
+    Encoding& encoding = m_encodings[index];
+    std::call_once(encoding.once, [this, &encoding, &options, binary]() {
+        encoding.frames = appendMessageFrames(encoding.bytes, options, binary ? m_binary : m_message);
+        if (encoding.frames == 0) {
+            encoding.bytes.clear();
+        }
+    });
+    return encoding;
+}
+
+int EncodedMessage::encodeCount() const {
+    int count = 0;
+    for (const Encoding& encoding : m_encodings) {
+        if (encoding.frames != 0) {
+            ++count;
+        }
+    }
+    return count;
+}
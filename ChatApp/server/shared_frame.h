@@ -0,0 +1,65 @@
+#ifndef SHARED_FRAME_H
+#define SHARED_FRAME_H
+
+#include "chat_protocol.h"
+#include "frame_codec.h"
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+// Неизменяемое сообщение для рассылки многим получателям. Кадры кодируются один раз на каждый
+// формат, который встретился среди получателей (v1, v2 с QDataStream, v2 с UTF-8, v2 с двоичным
+// видом сообщения), и дальше только копируются в буферы записи соединений. Кодирование потокобезопасно: адаптеры
+// с потоками ввода-вывода запрашивают кадры из своих потоков.
+class EncodedMessage {
+public:
+    explicit EncodedMessage(std::string message) : m_message(std::move(message)) {}
+    // binary - тот же ответ в двоичном виде (chat_protocol.h) для клиентов с опцией binary
+    EncodedMessage(std::string message, std::string binary)
+        : m_message(std::move(message)), m_binary(std::move(binary)) {}
+
+    EncodedMessage(const EncodedMessage&) = delete;
+    EncodedMessage& operator=(const EncodedMessage&) = delete;
+
+    // Текстовый вид: по нему классифицируется очередь и считается размер
+    const std::string& message() const { return m_message; }
+
+    // Кадры сообщения в формате options; пусто - сообщение не помещается в кадр версии 1
+    std::string_view frames(const WireOptions& options) const { return encoding(options).bytes; }
+    std::size_t frameCount(const WireOptions& options) const { return encoding(options).frames; }
+
+    // Сколько раз сообщение кодировалось на самом деле
+    int encodeCount() const;
+
+private:
+    struct Encoding {
+        std::once_flag once;
+        std::string bytes;
+        std::size_t frames = 0;
+    };
+
+    const Encoding& encoding(const WireOptions& options) const;
+
+    std::string m_message;
+    std::string m_binary;
+    mutable Encoding m_encodings[4];
+};
+
+using SharedFrame = std::shared_ptr<const EncodedMessage>;
+
+inline SharedFrame makeSharedFrame(std::string message) {
+    return std::make_shared<const EncodedMessage>(std::move(message));
+}
+
+// Забирает оба вида сообщения из message
+inline SharedFrame makeSharedFrame(ChatMessageWriter& message) {
+    return std::make_shared<const EncodedMessage>(message.takeText(), message.takeBinary());
+}
+
+inline SharedFrame makeSharedFrame(ChatMessageWriter&& message) {
+    return makeSharedFrame(message);
+}
+
+#endif // SHARED_FRAME_H
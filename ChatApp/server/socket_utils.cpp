@@ -0,0 +1,121 @@
+#include "socket_utils.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+std::string peerHost(const sockaddr_storage& address) {
+    char host[INET6_ADDRSTRLEN] = {};
+    if (address.ss_family == AF_INET6) {
+        const auto* in6 = reinterpret_cast<const sockaddr_in6*>(&address);
+        inet_ntop(AF_INET6, &in6->sin6_addr, host, sizeof(host));
+    } else {
+        const auto* in4 = reinterpret_cast<const sockaddr_in*>(&address);
+        inet_ntop(AF_INET, &in4->sin_addr, host, sizeof(host));
+    }
+    return host;
+}
+
+std::string describePeer(const sockaddr_storage& address) {
+    const int port = address.ss_family == AF_INET6 ? ntohs(reinterpret_cast<const sockaddr_in6*>(&address)->sin6_port)
+                                                   : ntohs(reinterpret_cast<const sockaddr_in*>(&address)->sin_port);
+    return peerHost(address) + ":" + std::to_string(port);
+}
+
+std::string describeUnixPeer(int fd) {
+    std::string id = "unix:";
+    ucred credentials{};
+    socklen_t length = sizeof(credentials);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0) {
+        id += "pid=" + std::to_string(credentials.pid) + ":";
+    }
+    // Дескриптор различает соединения одного процесса
+    return id + std::to_string(fd);
+}
+
+int createUnixListenSocket(const std::string& path, bool nonBlocking) {
+    sockaddr_un address{};
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    struct stat existing{};
+    if (::stat(path.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+        // Живой сервер ответит на connect, от упавшего остался только файл
+        const int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        const bool alive = probe >= 0
+            && ::connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+        if (probe >= 0) {
+            ::close(probe);
+        }
+        if (alive) {
+            errno = EADDRINUSE;
+            return -1;
+        }
+        ::unlink(path.c_str());
+    }
+
+    const int type = SOCK_STREAM | SOCK_CLOEXEC | (nonBlocking ? SOCK_NONBLOCK : 0);
+    const int fd = ::socket(AF_UNIX, type, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        const int error = errno;
+        ::close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+int createListenSocket(int port, bool nonBlocking) {
+    const int type = SOCK_STREAM | SOCK_CLOEXEC | (nonBlocking ? SOCK_NONBLOCK : 0);
+    int fd = ::socket(AF_INET6, type, 0);
+    if (fd >= 0) {
+        const int off = 0;
+        const int on = 1;
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        sockaddr_in6 address{};
+        address.sin6_family = AF_INET6;
+        address.sin6_addr = in6addr_any;
+        address.sin6_port = htons(static_cast<uint16_t>(port));
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+            return fd;
+        }
+        ::close(fd);
+    }
+
+    fd = ::socket(AF_INET, type, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    const int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int boundPort(int fd) {
+    sockaddr_storage bound{};
+    socklen_t boundLength = sizeof(bound);
+    if (getsockname(fd, reinterpret_cast<sockaddr*>(&bound), &boundLength) != 0) {
+        return 0;
+    }
+    return bound.ss_family == AF_INET6 ? ntohs(reinterpret_cast<sockaddr_in6*>(&bound)->sin6_port)
+                                       : ntohs(reinterpret_cast<sockaddr_in*>(&bound)->sin_port);
+}
@@ -0,0 +1,24 @@
+#ifndef SOCKET_UTILS_H
+#define SOCKET_UTILS_H
+
+#include <string>
+#include <sys/socket.h>
+
+// Общие для бэкендов на сырых сокетах функции (Linux)
+
+// Слушающий сокет на всех адресах: IPv6 с приёмом IPv4, если IPv6 недоступен - только IPv4.
+// Возвращает -1 при ошибке (errno сохраняется).
+int createListenSocket(int port, bool nonBlocking);
+// Слушающий Unix-сокет по пути path. Файл, оставшийся от упавшего процесса, удаляется;
+// если по пути уже кто-то слушает, возвращает -1 с errno == EADDRINUSE.
+int createUnixListenSocket(const std::string& path, bool nonBlocking);
+// Порт, на котором слушает сокет (нужен при port == 0)
+int boundPort(int fd);
+// Адрес без порта: по нему считается предел соединений с одного адреса
+std::string peerHost(const sockaddr_storage& address);
+// "адрес:порт" как идентификатор клиента
+std::string describePeer(const sockaddr_storage& address);
+// "unix:pid=<pid>:<fd>" для клиента Unix-сокета: адреса у таких клиентов обычно нет
+std::string describeUnixPeer(int fd);
+
+#endif // SOCKET_UTILS_H
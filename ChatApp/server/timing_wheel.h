@@ -0,0 +1,133 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Иерархическое колесо таймеров: Levels уровней по SlotCount слотов, слот уровня l покрывает
+// SlotCount^l тиков. Таймер кладётся в слот по своему тику срабатывания. Когда младший уровень
+// проходит круг, очередной слот старшего уровня пересыпается вниз. Поэтому работа на тик - O(1)
+// плюс сработавшие таймеры, сколько бы таймеров ни ждало.
+//
+// Отмена ленивая: запись остаётся в слоте и пропускается, если её ключ отменён или перенесён.
+// У каждого ключа не больше одного действующего таймера; schedule() заменяет предыдущий.
+class TimingWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr int Levels = 4;
+    static constexpr int SlotBits = 6;
+    static constexpr std::size_t SlotCount = std::size_t(1) << SlotBits;
+
+    explicit TimingWheel(std::chrono::milliseconds resolution = std::chrono::milliseconds(100),
+                         Clock::time_point start = Clock::now())
+        : m_resolution(resolution.count() > 0 ? resolution : std::chrono::milliseconds(1)), m_start(start) {}
+
+    std::chrono::milliseconds resolution() const { return m_resolution; }
+
+    // Срабатывает на первом тике не раньше deadline; прошедший deadline - на следующем тике
+    void schedule(std::uint64_t key, Clock::time_point deadline) {
+        std::uint64_t expiry = tickAt(deadline);
+        if (deadline > m_start + m_resolution * std::int64_t(expiry)) {
+            ++expiry; // Округляем вверх: раньше срока таймер не срабатывает
+        }
+        if (expiry <= m_tick) {
+            expiry = m_tick + 1;
+        }
+        m_timers[key] = expiry;
+        place(Entry{key, expiry});
+    }
+
+    void cancel(std::uint64_t key) { m_timers.erase(key); }
+    bool scheduled(std::uint64_t key) const { return m_timers.count(key) != 0; }
+    std::size_t size() const { return m_timers.size(); }
+
+    // Проходит тики до now и вызывает expire(key) для сработавших таймеров.
+    // Из expire можно вызывать schedule() и cancel(). Возвращает число сработавших
+    template<typename Fn>
+    std::size_t advance(Clock::time_point now, Fn&& expire) {
+        const std::uint64_t target = tickAt(now);
+        std::size_t fired = 0;
+        while (m_tick < target) {
+            ++m_tick;
+            cascade();
+            std::vector<Entry> due;
+            due.swap(m_slots[0][m_tick & SlotMask]);
+            for (const Entry& entry : due) {
+                const auto it = m_timers.find(entry.key);
+                if (it == m_timers.end() || it->second != entry.expiry) {
+                    continue; // Отменён или перенесён
+                }
+                m_timers.erase(it);
+                ++fired;
+                expire(entry.key);
+            }
+            // Отдаём буфер обратно слоту, чтобы не выделять память на каждый тик
+            if (m_slots[0][m_tick & SlotMask].empty()) {
+                due.clear();
+                m_slots[0][m_tick & SlotMask].swap(due);
+            }
+        }
+        return fired;
+    }
+
+private:
+    static constexpr std::uint64_t SlotMask = SlotCount - 1;
+
+    struct Entry {
+        std::uint64_t key;
+        std::uint64_t expiry; // Номер тика
+    };
+
+    std::uint64_t tickAt(Clock::time_point time) const {
+        if (time <= m_start) {
+            return 0;
+        }
+        return std::uint64_t((time - m_start) / m_resolution);
+    }
+
+    // Самый младший уровень, где до срабатывания меньше круга
+    void place(const Entry& entry) {
+        for (int level = 0; level < Levels; ++level) {
+            const int shift = level * SlotBits;
+            if ((entry.expiry >> shift) - (m_tick >> shift) < SlotCount) {
+                m_slots[level][(entry.expiry >> shift) & SlotMask].push_back(entry);
+                return;
+            }
+        }
+        // Дальше всех уровней: ждём в последнем слоте старшего уровня и пересыпаемся оттуда
+        const int shift = (Levels - 1) * SlotBits;
+        m_slots[Levels - 1][((m_tick >> shift) + SlotMask) & SlotMask].push_back(entry);
+    }
+
+    // Младший уровень начал новый круг: пересыпаем текущие слоты старших уровней вниз
+    void cascade() {
+        for (int level = 1; level < Levels; ++level) {
+            const int shift = level * SlotBits;
+            if ((m_tick & ((std::uint64_t(1) << shift) - 1)) != 0) {
+                break;
+            }
+            std::vector<Entry> entries;
+            entries.swap(m_slots[level][(m_tick >> shift) & SlotMask]);
+            for (const Entry& entry : entries) {
+                const auto it = m_timers.find(entry.key);
+                if (it != m_timers.end() && it->second == entry.expiry) {
+                    place(entry);
+                }
+            }
+        }
+    }
+
+    std::chrono::milliseconds m_resolution;
+    Clock::time_point m_start;
+    std::uint64_t m_tick = 0; // Последний пройденный тик
+    std::array<std::array<std::vector<Entry>, SlotCount>, Levels> m_slots;
+    std::unordered_map<std::uint64_t, std::uint64_t> m_timers; // Ключ -> тик срабатывания
+};
+
+#endif // TIMING_WHEEL_H
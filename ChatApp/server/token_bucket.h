@@ -0,0 +1,56 @@
+#ifndef TOKEN_BUCKET_H
+#define TOKEN_BUCKET_H
+
+#include <algorithm>
+#include <chrono>
+
+// Ведро токенов: пополняется со скоростью rate токенов в секунду и вмещает не больше burst.
+// Время передаётся снаружи, поэтому ведро не читает часы само и легко проверяется в тестах.
+class TokenBucket {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // rate <= 0 - без ограничения; burst меньше одного токена поднимается до одного
+    TokenBucket(double rate = 0.0, double burst = 0.0, Clock::time_point now = Clock::now())
+        : m_rate(rate), m_burst(std::max(burst, 1.0)), m_tokens(m_burst), m_updated(now) {}
+
+    bool unlimited() const { return m_rate <= 0.0; }
+
+    bool tryTake(Clock::time_point now, double tokens = 1.0) {
+        if (unlimited()) {
+            return true;
+        }
+        refill(now);
+        if (m_tokens < tokens) {
+            return false;
+        }
+        m_tokens -= tokens;
+        return true;
+    }
+
+    double available(Clock::time_point now) {
+        refill(now);
+        return m_tokens;
+    }
+    // Полное ведро ничем не отличается от нового, его можно выбросить
+    bool full(Clock::time_point now) {
+        return unlimited() || available(now) >= m_burst;
+    }
+
+private:
+    void refill(Clock::time_point now) {
+        if (now <= m_updated) {
+            return;
+        }
+        const double elapsed = std::chrono::duration<double>(now - m_updated).count();
+        m_tokens = std::min(m_burst, m_tokens + elapsed * m_rate);
+        m_updated = now;
+    }
+
+    double m_rate;
+    double m_burst;
+    double m_tokens;
+    Clock::time_point m_updated;
+};
+
+#endif // TOKEN_BUCKET_H
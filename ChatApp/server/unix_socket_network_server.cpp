@@ -0,0 +1,40 @@
+#include "unix_socket_network_server.h"
+#include "socket_utils.h"
+#include "logger.h"
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+UnixSocketNetworkServer::UnixSocketNetworkServer(std::string path)
+    : m_path(std::move(path)) {
+}
+
+UnixSocketNetworkServer::~UnixSocketNetworkServer() {
+    stop(); // Из деструктора базового класса наш stop() уже не вызовется
+}
+
+bool UnixSocketNetworkServer::start(int port) {
+    (void)port;
+    if (isListening()) {
+        return false;
+    }
+    const int fd = createUnixListenSocket(m_path, true);
+    if (fd < 0) {
+        CHAT_LOG(Error, "network_start_failed").field("backend", "unix").field("path", m_path).field("error", std::strerror(errno));
+        return false;
+    }
+    if (!startListening(fd)) {
+        ::unlink(m_path.c_str());
+        return false;
+    }
+    CHAT_LOG(Info, "network_started").field("backend", "unix").field("path", m_path);
+    return true;
+}
+
+void UnixSocketNetworkServer::stop() {
+    const bool listening = isListening();
+    EpollNetworkServer::stop();
+    if (listening) {
+        ::unlink(m_path.c_str());
+    }
+}
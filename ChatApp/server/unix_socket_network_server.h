@@ -0,0 +1,25 @@
+#ifndef UNIX_SOCKET_NETWORK_SERVER_H
+#define UNIX_SOCKET_NETWORK_SERVER_H
+
+#include "epoll_network_server.h"
+#include <string>
+
+// Транспорт для ботов и шлюзов на той же машине: Unix-сокет вместо TCP, без стека TCP/IP.
+// Кадры, HELLO и колбэки те же, что у EpollNetworkServer, поверх которого он сделан;
+// pollFd()/processEvents() встраиваются в цикл событий так же. Порт в start() не используется.
+class UnixSocketNetworkServer : public EpollNetworkServer {
+public:
+    explicit UnixSocketNetworkServer(std::string path);
+    ~UnixSocketNetworkServer() override;
+
+    bool start(int port) override;
+    // Закрывает соединения и удаляет файл сокета
+    void stop() override;
+
+    const std::string& path() const { return m_path; }
+
+private:
+    std::string m_path;
+};
+
+#endif // UNIX_SOCKET_NETWORK_SERVER_H
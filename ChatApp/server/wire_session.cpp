@@ -0,0 +1,70 @@
+#include "wire_session.h"
+
+WireSession::Result WireSession::next(std::string& message) {
+    for (;;) {
+        std::string_view payload;
+        bool more = false;
+        const FrameDecoder::Result result = m_decoder.next(payload, more);
+        if (result == FrameDecoder::Result::NeedMoreData) {
+            return Result::NeedMoreData;
+        }
+        if (result == FrameDecoder::Result::Error) {
+            m_decoder.reset();
+            return Result::Error;
+        }
+
+        std::size_t assembledSize = 0;
+        if (m_options.utf8) {
+            m_partialMessage.append(payload.data(), payload.size());
+            assembledSize = m_partialMessage.size();
+        } else {
+            if (!decodeQStringPayload(payload, m_partialText)) {
+                m_decoder.reset();
+                return Result::Error;
+            }
+            assembledSize = m_partialText.size() * sizeof(char16_t);
+        }
+        if (assembledSize > FrameProtocol::MaxMessageSize) {
+            m_partialMessage.clear();
+            m_partialText.clear();
+            return Result::Error;
+        }
+        if (more) {
+            continue; // Ждём продолжения сообщения
+        }
+
+        if (m_options.utf8) {
+            message.swap(m_partialMessage);
+            m_partialMessage.clear();
+        } else {
+            message = utf16ToUtf8(m_partialText);
+            m_partialText.clear();
+        }
+
+        if (!m_handshakeDone) {
+            m_handshakeDone = true;
+            WireOptions requested;
+            if (parseHello(message, requested)) {
+                const WireOptions accepted = negotiateWireOptions(requested);
+                // Ответ уходит ещё в старом формате, всё после него - уже в согласованном
+                const std::string reply = buildHelloReply(accepted);
+                message.clear();
+                appendMessageFrames(message, m_options, reply);
+                m_options = accepted;
+                m_decoder.setVersion(accepted.version);
+                return Result::Handshake;
+            }
+        }
+        return Result::Message;
+    }
+}
+
+void WireSession::release() {
+    m_decoder.release();
+    if (m_partialMessage.empty()) {
+        std::string().swap(m_partialMessage);
+    }
+    if (m_partialText.empty()) {
+        std::u16string().swap(m_partialText);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef WIRE_SESSION_H
+#define WIRE_SESSION_H
+
+#include "frame_codec.h"
+#include <string>
+#include <string_view>
+
+// Серверная сторона протокола одного соединения без Qt: разбор кадров, сборка фрагментов,
+// согласование HELLO и кодирование ответов. Используется бэкендами, не основанными на QTcpSocket.
+class WireSession {
+public:
+    enum class Result {
+        NeedMoreData,
+        Message,   // В message готово очередное сообщение в UTF-8
+        Handshake, // Клиент прислал HELLO, в message кадр ответа, который нужно отправить как есть
+        Error      // Поток повреждён, соединение нужно закрыть
+    };
+
+    void append(const char* data, std::size_t size) { m_decoder.append(data, size); }
+    Result next(std::string& message);
+
+    // Дописывает кадры сообщения в out, возвращает число кадров (0 - не отправлено)
+    std::size_t encode(std::string_view message, std::string& out) const {
+        return appendMessageFrames(out, m_options, message);
+    }
+
+    const WireOptions& options() const { return m_options; }
+    // Освобождает буферы простаивающего соединения
+    void release();
+
+private:
+    FrameDecoder m_decoder;
+    WireOptions m_options;
+    bool m_handshakeDone = false; // HELLO принимается только первым сообщением
+    std::string m_partialMessage;
+    std::u16string m_partialText;
+};
+
+#endif // WIRE_SESSION_H
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+#include "admission_control.h"
+#include <vector>
+
+namespace {
+
+using Clock = AdmissionController::Clock;
+using std::chrono::milliseconds;
+
+} // namespace
+
+// Ведро пополняется со временем, но не выше burst
+TEST(TokenBucketTests, RefillsUpToBurst) {
+    const Clock::time_point start = Clock::now();
+    TokenBucket bucket(10.0, 2.0, start);
+    EXPECT_TRUE(bucket.tryTake(start));
+    EXPECT_TRUE(bucket.tryTake(start));
+    EXPECT_FALSE(bucket.tryTake(start));
+    EXPECT_FALSE(bucket.tryTake(start + milliseconds(50)));
+    EXPECT_TRUE(bucket.tryTake(start + milliseconds(100)));
+    EXPECT_DOUBLE_EQ(bucket.available(start + milliseconds(10000)), 2.0);
+    EXPECT_TRUE(TokenBucket().tryTake(start, 1000.0));
+}
+
+// Общий предел и предел на адрес; release() возвращает место
+TEST(AdmissionControllerTests, LimitsConnections) {
+    AdmissionLimits limits;
+    limits.maxConnections = 3;
+    limits.maxConnectionsPerIp = 2;
+    AdmissionController admission(limits);
+
+    EXPECT_EQ(admission.admit("10.0.0.1"), AdmissionController::Decision::Accept);
+    EXPECT_EQ(admission.admit("10.0.0.1"), AdmissionController::Decision::Accept);
+    EXPECT_EQ(admission.admit("10.0.0.1"), AdmissionController::Decision::RejectPerIp);
+    EXPECT_EQ(admission.admit(""), AdmissionController::Decision::Accept); // Unix-сокет без адреса
+    EXPECT_EQ(admission.admit("10.0.0.2"), AdmissionController::Decision::RejectCapacity);
+    EXPECT_EQ(admission.connections(), 3u);
+
+    admission.release("10.0.0.1");
+    EXPECT_EQ(admission.admit("10.0.0.2"), AdmissionController::Decision::Accept);
+    admission.release("10.0.0.2");
+    admission.release("10.0.0.1");
+    EXPECT_EQ(admission.admit("10.0.0.1"), AdmissionController::Decision::Accept);
+
+    EXPECT_EQ(admission.stats().accepted, 5u);
+    EXPECT_EQ(admission.stats().rejectedPerIp, 1u);
+    EXPECT_EQ(admission.stats().rejectedCapacity, 1u);
+    EXPECT_EQ(admission.stats().rejected(), 2u);
+}
+
+// Шторм переподключений упирается в скорость приёма, отказ по пределам токен не тратит
+TEST(AdmissionControllerTests, LimitsAcceptRate) {
+    AdmissionLimits limits;
+    limits.acceptRate = 5.0;
+    limits.acceptBurst = 2.0;
+    limits.maxConnectionsPerIp = 1;
+    AdmissionController admission(limits);
+    const Clock::time_point start = Clock::now();
+
+    EXPECT_EQ(admission.admit("a", start), AdmissionController::Decision::Accept);
+    EXPECT_EQ(admission.admit("a", start), AdmissionController::Decision::RejectPerIp);
+    EXPECT_EQ(admission.admit("b", start), AdmissionController::Decision::Accept);
+    EXPECT_EQ(admission.admit("c", start), AdmissionController::Decision::RejectRate);
+    EXPECT_EQ(admission.admit("c", start + milliseconds(200)), AdmissionController::Decision::Accept);
+    EXPECT_EQ(admission.stats().rejectedRate, 1u);
+    EXPECT_EQ(admission.connections(), 3u);
+}
+
+// Таймаут входа: закрываются только не вошедшие, в порядке приёма
+TEST(AdmissionControllerTests, ReapsUnauthenticated) {
+    AdmissionLimits limits;
+    limits.preAuthTimeout = milliseconds(100);
+    AdmissionController admission(limits);
+    const Clock::time_point start = Clock::now();
+
+    admission.startPreAuth(1, start);
+    admission.startPreAuth(2, start + milliseconds(10));
+    admission.startPreAuth(3, start + milliseconds(20));
+    admission.finishPreAuth(2);
+
+    std::vector<std::uint64_t> reaped;
+    auto collect = [&](std::uint64_t key) { reaped.push_back(key); };
+    EXPECT_EQ(admission.reapExpired(start + milliseconds(50), collect), 0u);
+    EXPECT_EQ(admission.reapExpired(start + milliseconds(115), collect), 1u);
+    EXPECT_EQ(admission.reapExpired(start + milliseconds(1000), collect), 1u);
+    EXPECT_EQ(reaped, (std::vector<std::uint64_t>{1, 3}));
+    EXPECT_EQ(admission.stats().reapedPreAuth, 2u);
+
+    // Без таймаута ничего не отслеживается
+    AdmissionController unlimited;
+    unlimited.startPreAuth(7, start);
+    EXPECT_EQ(unlimited.reapExpired(start + std::chrono::hours(1), collect), 0u);
+}
@@ -0,0 +1,647 @@
+#include <gtest/gtest.h>
+#include "chat_logic_server.h"
+#include "logger.h"
+#include <algorithm>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// База в памяти: понимает ровно те запросы, которые делает ChatLogicServer. Незнакомый запрос
+// выполняется успешно и ничего не возвращает
+class FakeDatabase : public IDatabase {
+public:
+    struct GroupMessage {
+        long long id;
+        std::string chatId;
+        std::string sender;
+        std::string message;
+    };
+
+    long long addUser(const std::string& username) {
+        m_users.push_back({++m_lastUserId, username});
+        return m_lastUserId;
+    }
+    void addFriendship(const std::string& username1, const std::string& username2) {
+        m_friendships.insert({userId(username1), userId(username2)});
+        m_friendships.insert({userId(username2), userId(username1)});
+    }
+    void addGroup(const std::string& chatId, const std::string& name, const std::string& creator) {
+        m_groups[chatId] = {name, creator};
+        m_members.insert({chatId, creator});
+    }
+    void addMember(const std::string& chatId, const std::string& username) { m_members.insert({chatId, username}); }
+
+    const std::vector<GroupMessage>& groupMessages() const { return m_groupMessages; }
+    const std::vector<std::string>& executed() const { return m_executed; }
+    std::size_t countExecuted(const std::string& prefix) const {
+        return std::count_if(m_executed.begin(), m_executed.end(),
+                             [&prefix](const std::string& query) { return query.compare(0, prefix.size(), prefix) == 0; });
+    }
+
+    bool failCommit = false;
+    bool failGroupMessageInserts = false;
+
+    bool connect(const std::string&) override { return true; }
+    void disconnect() override {}
+
+    bool execute(const std::string& query) override { return execute(query, {}); }
+    bool execute(const std::string& query, const std::vector<std::any>& params) override {
+        m_executed.push_back(query);
+        if (starts(query, "BEGIN")) {
+            m_transactionStart = m_groupMessages.size();
+            m_inTransaction = true;
+        } else if (starts(query, "COMMIT")) {
+            if (failCommit) {
+                m_lastError = "database is locked";
+                return false;
+            }
+            m_inTransaction = false;
+        } else if (starts(query, "ROLLBACK")) {
+            if (m_inTransaction) {
+                m_groupMessages.resize(m_transactionStart);
+            }
+            m_inTransaction = false;
+        } else if (starts(query, "INSERT INTO group_chat_messages")) {
+            if (failGroupMessageInserts) {
+                m_lastError = "disk I/O error";
+                return false;
+            }
+            m_groupMessages.push_back({++m_lastMessageId, text(params, 0), text(params, 1), text(params, 2)});
+        } else if (starts(query, "INSERT INTO group_chats")) {
+            m_groups[text(params, 0)] = {text(params, 1), text(params, 2)};
+        } else if (starts(query, "INSERT INTO group_chat_members")) {
+            m_members.insert({text(params, 0), text(params, 1)});
+        } else if (starts(query, "DELETE FROM group_chat_messages")) {
+            const std::string chatId = text(params, 0);
+            m_groupMessages.erase(std::remove_if(m_groupMessages.begin(), m_groupMessages.end(),
+                                                 [&chatId](const GroupMessage& row) { return row.chatId == chatId; }),
+                                  m_groupMessages.end());
+        } else if (starts(query, "DELETE FROM group_chat_members WHERE chat_id = ? AND")) {
+            m_members.erase({text(params, 0), text(params, 1)});
+        } else if (starts(query, "DELETE FROM group_chat_members")) {
+            const std::string chatId = text(params, 0);
+            for (auto it = m_members.begin(); it != m_members.end();) {
+                it = it->first == chatId ? m_members.erase(it) : std::next(it);
+            }
+        } else if (starts(query, "DELETE FROM group_chats")) {
+            m_groups.erase(text(params, 0));
+        }
+        return true;
+    }
+
+    DbResult fetchAll(const std::string& query) override { return fetchAll(query, {}); }
+    DbResult fetchAll(const std::string& query, const std::vector<std::any>& params) override {
+        DbResult rows;
+        if (starts(query, "SELECT id, username FROM users")) {
+            for (const auto& user : m_users) {
+                rows.push_back({{"id", user.first}, {"username", user.second}});
+            }
+        } else if (starts(query, "SELECT u_friend.username") || starts(query, "SELECT u.username")) {
+            const long long id = std::any_cast<long long>(params.at(0));
+            for (const auto& friendship : m_friendships) {
+                if (friendship.first == id) {
+                    rows.push_back({{"username", username(friendship.second)}});
+                }
+            }
+        } else if (starts(query, "SELECT id, name, creator_username FROM group_chats")) {
+            for (const auto& group : m_groups) {
+                rows.push_back({{"id", group.first}, {"name", group.second.first}, {"creator_username", group.second.second}});
+            }
+        } else if (starts(query, "SELECT username FROM group_chat_members")) {
+            for (const auto& member : m_members) {
+                if (member.first == text(params, 0)) {
+                    rows.push_back({{"username", member.second}});
+                }
+            }
+        } else if (starts(query, "SELECT sender_username, message, timestamp FROM group_chat_messages")) {
+            for (const GroupMessage& row : m_groupMessages) {
+                if (row.chatId == text(params, 0)) {
+                    rows.push_back({{"sender_username", row.sender}, {"message", row.message},
+                                    {"timestamp", std::string("2024-01-01 00:00:00")}});
+                }
+            }
+        } else if (starts(query, "SELECT gc.id, gc.name")) {
+            for (const auto& member : m_members) {
+                auto group = m_groups.find(member.first);
+                if (member.second == text(params, 0) && group != m_groups.end()) {
+                    rows.push_back({{"id", group->first}, {"name", group->second.first}});
+                }
+            }
+        }
+        return rows;
+    }
+
+    std::optional<DbRow> fetchOne(const std::string& query) override { return fetchOne(query, {}); }
+    std::optional<DbRow> fetchOne(const std::string& query, const std::vector<std::any>& params) override {
+        if (starts(query, "SELECT password FROM users")) {
+            if (userId(text(params, 0)) >= 0) {
+                return DbRow{{"password", std::string("pw")}};
+            }
+        } else if (starts(query, "SELECT id FROM users") || starts(query, "SELECT 1 FROM users")) {
+            const long long id = userId(text(params, 0));
+            if (id >= 0) {
+                return DbRow{{"id", id}};
+            }
+        } else if (starts(query, "SELECT 1 FROM group_chats")) {
+            if (m_groups.count(text(params, 0))) {
+                return DbRow{{"1", 1LL}};
+            }
+        } else if (starts(query, "SELECT 1 FROM group_chat_members")) {
+            if (m_members.count({text(params, 0), text(params, 1)})) {
+                return DbRow{{"1", 1LL}};
+            }
+        } else if (starts(query, "SELECT name, creator_username FROM group_chats")
+                   || starts(query, "SELECT creator_username FROM group_chats")) {
+            auto group = m_groups.find(text(params, 0));
+            if (group != m_groups.end()) {
+                return DbRow{{"name", group->second.first}, {"creator_username", group->second.second}};
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::string lastError() const override { return m_lastError; }
+
+private:
+    static bool starts(const std::string& query, const char* prefix) { return query.rfind(prefix, 0) == 0; }
+    static std::string text(const std::vector<std::any>& params, std::size_t index) {
+        return std::any_cast<std::string>(params.at(index));
+    }
+    long long userId(const std::string& name) const {
+        for (const auto& user : m_users) {
+            if (user.second == name) {
+                return user.first;
+            }
+        }
+        return -1;
+    }
+    std::string username(long long id) const {
+        for (const auto& user : m_users) {
+            if (user.first == id) {
+                return user.second;
+            }
+        }
+        return std::string();
+    }
+
+    std::vector<std::pair<long long, std::string>> m_users;
+    long long m_lastUserId = 0;
+    std::set<std::pair<long long, long long>> m_friendships;
+    std::map<std::string, std::pair<std::string, std::string>> m_groups; // id -> имя, создатель
+    std::set<std::pair<std::string, std::string>> m_members;             // id чата, участник
+    std::vector<GroupMessage> m_groupMessages;
+    long long m_lastMessageId = 0;
+    std::size_t m_transactionStart = 0;
+    bool m_inTransaction = false;
+    std::vector<std::string> m_executed;
+    std::string m_lastError;
+};
+
+// Соединение, которое запоминает текстовый вид всего, что ему отправлено
+class FakeClient : public INetworkClient {
+public:
+    FakeClient(std::string id, bool presence) : m_id(std::move(id)), m_presence(presence) {}
+
+    void sendMessage(const std::string& message) override { received.push_back(message); }
+    void sendFrame(const SharedFrame& frame) override { received.push_back(frame->message()); }
+    std::string getClientId() const override { return m_id; }
+    bool isConnected() const override { return true; }
+    void disconnectClient() override {}
+    WireOptions wireOptions() const override {
+        WireOptions options;
+        options.presence = m_presence;
+        return options;
+    }
+
+    // Сколько получено сообщений, начинающихся с prefix
+    std::size_t count(const std::string& prefix) const {
+        return std::count_if(received.begin(), received.end(),
+                             [&prefix](const std::string& message) { return message.compare(0, prefix.size(), prefix) == 0; });
+    }
+    bool got(const std::string& message) const {
+        return std::find(received.begin(), received.end(), message) != received.end();
+    }
+
+    std::vector<std::string> received;
+
+private:
+    std::string m_id;
+    bool m_presence;
+};
+
+class FakeNetworkServer : public INetworkServer {
+public:
+    bool start(int) override { return true; }
+    void stop() override {}
+    void broadcastMessage(const std::string& message) override { broadcasts.push_back(message); }
+    void setClientConnectedCallback(ClientConnectedCallback) override {}
+    void setClientDisconnectedCallback(ClientDisconnectedCallback) override {}
+    void setMessageReceivedCallback(MessageReceivedCallback) override {}
+
+    std::vector<std::string> broadcasts;
+};
+
+// Перехватывает записи журнала уровня Error на время теста
+class ErrorLogCapture {
+public:
+    ErrorLogCapture() {
+        Logger::instance().flush();
+        Logger::instance().setSink([this](LogLevel level, std::string_view line) {
+            if (level == LogLevel::Error) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_lines.emplace_back(line);
+            }
+        });
+    }
+    ~ErrorLogCapture() {
+        Logger::instance().flush();
+        Logger::instance().setSink(nullptr);
+    }
+
+    std::vector<std::string> lines() {
+        Logger::instance().flush();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_lines;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::vector<std::string> m_lines;
+};
+
+// amy, bob, carol и dave с паролем "pw"; amy и bob - друзья
+class ChatLogicServerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        auto database = std::make_unique<FakeDatabase>();
+        db = database.get();
+        for (const char* name : {"amy", "bob", "carol", "dave"}) {
+            db->addUser(name);
+        }
+        db->addFriendship("amy", "bob");
+        server = std::make_unique<ChatLogicServer>(std::move(database));
+        server->setNetworkServer(network);
+        ASSERT_TRUE(server->initializeDatabase());
+    }
+
+    // Кэш перечитывается из базы: нужно после того, как тест добавил в неё группы или дружбу
+    void reload() { ASSERT_TRUE(server->initializeDatabase()); }
+
+    std::shared_ptr<FakeClient> connect(const std::string& id, bool presence = false) {
+        return std::make_shared<FakeClient>(id, presence);
+    }
+    // Входит под username с нового соединения; полученное при входе стирается
+    std::shared_ptr<FakeClient> login(const std::string& username, bool presence = false) {
+        auto client = connect(username + "-connection", presence);
+        send(client, "AUTH:" + username + ":pw");
+        EXPECT_TRUE(client->got("AUTH_SUCCESS")) << username;
+        client->received.clear();
+        return client;
+    }
+    void send(const std::shared_ptr<FakeClient>& client, const std::string& message) {
+        server->handleMessageReceived(client, message);
+    }
+
+    FakeDatabase* db = nullptr;
+    std::shared_ptr<FakeNetworkServer> network = std::make_shared<FakeNetworkServer>();
+    std::unique_ptr<ChatLogicServer> server;
+};
+
+} // namespace
+
+TEST_F(ChatLogicServerTest, SecondAuthForOnlineUserIsRefused) {
+    auto amy = login("amy");
+    auto bob = login("bob");
+
+    // Тот же пользователь с того же соединения и с другого: сессия остаётся у первого соединения
+    send(amy, "AUTH:amy:pw");
+    EXPECT_TRUE(amy->got("AUTH_FAIL:User already logged in."));
+    auto other = connect("other");
+    send(other, "AUTH:amy:pw");
+    EXPECT_TRUE(other->got("AUTH_FAIL:User already logged in."));
+
+    send(bob, "PRIVATE:amy:hi");
+    EXPECT_TRUE(amy->got("PRIVATE:bob:hi"));
+    EXPECT_EQ(other->count("PRIVATE:"), 0u);
+    send(other, "GET_USERLIST");
+    EXPECT_TRUE(other->got("ERROR:Authentication required to get user list."));
+}
+
+TEST_F(ChatLogicServerTest, AuthUnderAnotherNameReplacesSession) {
+    auto connection = login("amy");
+    auto bob = login("bob", true);
+
+    send(connection, "AUTH:carol:pw");
+    ASSERT_TRUE(connection->got("AUTH_SUCCESS"));
+    EXPECT_TRUE(bob->got("PRESENCE:amy:0"));
+
+    // Сообщения для amy больше не идут на это соединение, для carol - идут
+    connection->received.clear();
+    send(bob, "PRIVATE:amy:for amy");
+    send(bob, "PRIVATE:carol:for carol");
+    EXPECT_EQ(connection->received, std::vector<std::string>{"PRIVATE:bob:for carol"});
+
+    // Освободившееся имя можно занять с другого соединения
+    auto amy = login("amy");
+    send(bob, "PRIVATE:amy:again");
+    EXPECT_TRUE(amy->got("PRIVATE:bob:again"));
+}
+
+TEST_F(ChatLogicServerTest, LateDisconnectOfOldConnectionKeepsNewSession) {
+    auto first = login("amy");
+    auto bob = login("bob", true);
+    server->handleClientDisconnected(first);
+    auto second = login("amy");
+    bob->received.clear();
+
+    // Закрытие старого соединения дошло повторно: сессия нового соединения не трогается
+    server->handleClientDisconnected(first);
+    EXPECT_FALSE(bob->got("PRESENCE:amy:0"));
+    send(bob, "PRIVATE:amy:hi");
+    EXPECT_TRUE(second->got("PRIVATE:bob:hi"));
+}
+
+TEST_F(ChatLogicServerTest, EndedSessionDropsPresenceSubscriptions) {
+    auto amy = login("amy", true);
+    send(amy, "SUBSCRIBE_PRESENCE:carol");
+    EXPECT_TRUE(amy->got("PRESENCE:carol:0"));
+
+    auto carol = login("carol");
+    EXPECT_TRUE(amy->got("PRESENCE:carol:1"));
+
+    // Выход, а затем вход с нового соединения: подписка осталась у старой сессии
+    server->handleClientDisconnected(amy);
+    auto amyAgain = login("amy", true);
+    server->handleClientDisconnected(carol);
+    EXPECT_FALSE(amyAgain->got("PRESENCE:carol:0"));
+
+    // Вход под другим именем тоже закрывает сессию вместе с подписками
+    send(amyAgain, "SUBSCRIBE_PRESENCE:carol");
+    send(amyAgain, "AUTH:dave:pw");
+    amyAgain->received.clear();
+    login("carol");
+    EXPECT_EQ(amyAgain->count("PRESENCE:"), 0u);
+}
+
+TEST_F(ChatLogicServerTest, UnsubscribeStopsPresence) {
+    auto amy = login("amy", true);
+    send(amy, "SUBSCRIBE_PRESENCE:carol");
+    send(amy, "UNSUBSCRIBE_PRESENCE:carol");
+    amy->received.clear();
+
+    login("carol");
+    EXPECT_EQ(amy->count("PRESENCE:"), 0u);
+}
+
+TEST_F(ChatLogicServerTest, BinaryCommandWithTooFewFieldsIsRejected) {
+    auto amy = login("amy");
+    auto bob = login("bob");
+    amy->received.clear();
+
+    // Текстовый разбор сам превратил бы такую строку в Text, двоичная доходит до таблицы команд
+    send(amy, ChatMessageWriter(ChatMessageType::Private).field("bob").binary());
+    EXPECT_EQ(bob->count("PRIVATE:"), 0u);
+    EXPECT_TRUE(amy->received.empty());
+    EXPECT_EQ(server->commandStats(ChatMessageType::Private).calls, 1u);
+    EXPECT_EQ(server->commandStats(ChatMessageType::Private).rejected, 1u);
+
+    send(amy, ChatMessageWriter(ChatMessageType::Private).field("bob").field("hi").binary());
+    EXPECT_TRUE(bob->got("PRIVATE:amy:hi"));
+    EXPECT_EQ(server->commandStats(ChatMessageType::Private).rejected, 1u);
+}
+
+TEST_F(ChatLogicServerTest, CommandBeforeLoginIsRejected) {
+    auto guest = connect("guest");
+    auto bob = login("bob");
+
+    send(guest, "GET_USERLIST");
+    send(guest, "PRIVATE:bob:hi");
+    EXPECT_EQ(guest->received, (std::vector<std::string>{"ERROR:Authentication required to get user list.",
+                                                         "ERROR:Authentication required to send private messages."}));
+    EXPECT_EQ(bob->count("PRIVATE:"), 0u);
+
+    // У команды без текста ошибки отказ молчаливый
+    guest->received.clear();
+    send(guest, "GET_FRIENDS");
+    EXPECT_TRUE(guest->received.empty());
+
+    // Команды, которым вход не нужен, выполняются
+    send(guest, "SEARCH_USERS:am");
+    EXPECT_EQ(guest->count("SEARCH_RESULTS"), 1u);
+}
+
+TEST_F(ChatLogicServerTest, CommandStatsCountCallsAndRejections) {
+    auto guest = connect("guest");
+    send(guest, "GET_FRIENDS");
+    auto amy = login("amy");
+    send(amy, "GET_FRIENDS");
+    send(amy, "GET_FRIENDS");
+
+    const auto& friends = server->commandStats(ChatMessageType::GetFriends);
+    EXPECT_EQ(friends.calls, 3u);
+    EXPECT_EQ(friends.rejected, 1u);
+    EXPECT_GE(friends.totalNanoseconds, friends.maxNanoseconds);
+    EXPECT_EQ(amy->received, (std::vector<std::string>{"FRIENDS_LIST:bob", "FRIENDS_LIST:bob"}));
+
+    // Ответ сервера от клиента обработчика не имеет
+    send(amy, ChatMessageWriter(ChatMessageType::UserList).field("bob").number(1).field("U").field("").binary());
+    EXPECT_EQ(server->commandStats(ChatMessageType::UserList).calls, 1u);
+    EXPECT_EQ(server->commandStats(ChatMessageType::UserList).rejected, 1u);
+
+    EXPECT_EQ(server->commandStats(ChatMessageType::Auth).calls, 1u);
+    EXPECT_EQ(server->commandStats(ChatMessageType::Auth).rejected, 0u);
+}
+
+TEST_F(ChatLogicServerTest, PresenceClientGetsDeltas) {
+    auto bob = login("bob", true);
+
+    auto amy = login("amy");
+    EXPECT_EQ(bob->received, std::vector<std::string>{"PRESENCE:amy:1"});
+    server->handleClientDisconnected(amy);
+    EXPECT_EQ(bob->received, (std::vector<std::string>{"PRESENCE:amy:1", "PRESENCE:amy:0"}));
+
+    // Полный список - только по запросу
+    bob->received.clear();
+    send(bob, "GET_USERLIST");
+    ASSERT_EQ(bob->received.size(), 1u);
+    EXPECT_NE(bob->received[0].find("amy:0:U:F"), std::string::npos) << bob->received[0];
+    EXPECT_NE(bob->received[0].find("carol:0:U"), std::string::npos) << bob->received[0];
+}
+
+TEST_F(ChatLogicServerTest, LegacyClientGetsFullUserList) {
+    auto bob = login("bob");
+
+    auto amy = login("amy");
+    ASSERT_EQ(bob->received.size(), 1u);
+    EXPECT_EQ(bob->received[0].rfind("USERLIST:", 0), 0u) << bob->received[0];
+    EXPECT_NE(bob->received[0].find("amy:1:U:F"), std::string::npos) << bob->received[0];
+    EXPECT_EQ(bob->count("PRESENCE:"), 0u);
+
+    bob->received.clear();
+    server->handleClientDisconnected(amy);
+    ASSERT_EQ(bob->received.size(), 1u);
+    EXPECT_NE(bob->received[0].find("amy:0:U:F"), std::string::npos) << bob->received[0];
+}
+
+TEST_F(ChatLogicServerTest, LegacyClientSeesStatusOfEveryone) {
+    auto carol = login("carol");
+    auto dave = login("dave", true);
+    carol->received.clear();
+
+    // bob не друг ни carol, ни dave: старый клиент всё равно показывает его статус и получает новый
+    // список, а PRESENCE уходит только тем, кому bob интересен
+    auto bob = login("bob");
+    ASSERT_EQ(carol->received.size(), 1u);
+    EXPECT_NE(carol->received[0].find("bob:1:U"), std::string::npos) << carol->received[0];
+    EXPECT_TRUE(dave->received.empty());
+
+    carol->received.clear();
+    server->handleClientDisconnected(bob);
+    ASSERT_EQ(carol->received.size(), 1u);
+    EXPECT_NE(carol->received[0].find("bob:0:U"), std::string::npos) << carol->received[0];
+
+    // Открыв окно чата, клиент с presence узнаёт текущий статус
+    send(dave, "SUBSCRIBE_PRESENCE:bob");
+    EXPECT_EQ(dave->received, std::vector<std::string>{"PRESENCE:bob:0"});
+}
+
+TEST_F(ChatLogicServerTest, LoginAndLogoutInOneWindowCollapse) {
+    auto bob = login("bob", true);
+    auto carol = login("carol");
+    server->setRosterFlushInterval(std::chrono::milliseconds(100));
+    carol->received.clear();
+    const ChatLogicServer::RosterStats before = server->rosterStats();
+
+    auto amy = login("amy");
+    server->handleClientDisconnected(amy);
+    EXPECT_TRUE(bob->received.empty());
+    EXPECT_TRUE(carol->received.empty());
+
+    server->flushRosterUpdates();
+    EXPECT_EQ(bob->received, std::vector<std::string>{"PRESENCE:amy:0"});
+    ASSERT_EQ(carol->received.size(), 1u);
+    EXPECT_NE(carol->received[0].find("amy:0:U"), std::string::npos) << carol->received[0];
+
+    // Без склейки bob и carol получили бы по два сообщения
+    const ChatLogicServer::RosterStats& stats = server->rosterStats();
+    EXPECT_EQ(stats.requested - before.requested, 4u);
+    EXPECT_EQ(stats.sent - before.sent, 2u);
+    EXPECT_EQ(stats.flushes - before.flushes, 1u);
+
+    // Сбрасывать больше нечего
+    server->flushRosterUpdates();
+    EXPECT_EQ(server->rosterStats().flushes - before.flushes, 1u);
+}
+
+TEST_F(ChatLogicServerTest, OwnListChangeReplacesPresence) {
+    auto bob = login("bob", true);
+    server->setRosterFlushInterval(std::chrono::milliseconds(100));
+    const ChatLogicServer::RosterStats before = server->rosterStats();
+
+    // В одном окне вошла amy и дважды изменился собственный список bob (новый чат и его состав):
+    // PRESENCE ему не нужен, всё уходит одним USERLIST
+    login("amy");
+    send(bob, "CREATE_GROUP_CHAT:team");
+    bob->received.clear();
+    server->flushRosterUpdates();
+
+    ASSERT_EQ(bob->received.size(), 1u);
+    EXPECT_EQ(bob->received[0].rfind("USERLIST:", 0), 0u) << bob->received[0];
+    EXPECT_NE(bob->received[0].find("amy:1:U:F"), std::string::npos) << bob->received[0];
+    EXPECT_NE(bob->received[0].find(":1:G:team"), std::string::npos) << bob->received[0];
+
+    const ChatLogicServer::RosterStats& stats = server->rosterStats();
+    EXPECT_EQ(stats.requested - before.requested, 3u);
+    EXPECT_EQ(stats.sent - before.sent, 1u);
+    EXPECT_EQ(stats.coalesced() - before.coalesced(), 2u);
+}
+
+TEST_F(ChatLogicServerTest, GroupMessagesReachHistoryAndAreDeletedWithChat) {
+    db->addGroup("g1", "team", "amy");
+    db->addMember("g1", "bob");
+    reload();
+    server->setRosterFlushInterval(std::chrono::milliseconds(100));
+    auto amy = login("amy");
+    auto bob = login("bob");
+
+    // Участникам сообщение уходит сразу, в базу - при сбросе
+    send(amy, "GROUP_MESSAGE:g1:hi");
+    EXPECT_TRUE(bob->got("GROUP_MESSAGE:g1:amy:hi"));
+    EXPECT_TRUE(db->groupMessages().empty());
+
+    // История читает базу и поэтому сначала сбрасывает очередь
+    send(bob, "JOIN_GROUP_CHAT:g1");
+    EXPECT_TRUE(bob->got("GROUP_HISTORY_MSG:g1|2024-01-01 00:00:00|amy|hi"));
+    ASSERT_EQ(db->groupMessages().size(), 1u);
+    EXPECT_EQ(db->countExecuted("BEGIN"), 1u);
+    EXPECT_EQ(db->countExecuted("COMMIT"), 1u);
+
+    // Отложенное сообщение удаляемого чата пишется до удаления, а не после
+    send(amy, "GROUP_MESSAGE:g1:bye");
+    send(amy, "DELETE_GROUP_CHAT:g1");
+    EXPECT_TRUE(bob->got("GROUP_CHAT_DELETED:g1"));
+    EXPECT_TRUE(db->groupMessages().empty());
+    EXPECT_EQ(db->countExecuted("INSERT INTO group_chat_messages"), 2u);
+    const std::vector<std::string>& executed = db->executed();
+    auto lastInsert = std::find_if(executed.rbegin(), executed.rend(), [](const std::string& query) {
+        return query.rfind("INSERT INTO group_chat_messages", 0) == 0;
+    });
+    auto deleteMessages = std::find_if(executed.rbegin(), executed.rend(), [](const std::string& query) {
+        return query.rfind("DELETE FROM group_chat_messages", 0) == 0;
+    });
+    EXPECT_GT(lastInsert - executed.rbegin(), deleteMessages - executed.rbegin());
+
+    // Сообщение в удалённый чат никуда не уходит и не ставится в очередь
+    bob->received.clear();
+    send(amy, "GROUP_MESSAGE:g1:late");
+    server->flushGroupMessages();
+    EXPECT_TRUE(bob->received.empty());
+    EXPECT_EQ(db->countExecuted("INSERT INTO group_chat_messages"), 2u);
+}
+
+TEST_F(ChatLogicServerTest, FailedCommitRewritesGroupMessagesOneByOne) {
+    db->addGroup("g1", "team", "amy");
+    reload();
+    server->setRosterFlushInterval(std::chrono::milliseconds(100));
+    auto amy = login("amy");
+    ErrorLogCapture errors;
+
+    db->failCommit = true;
+    send(amy, "GROUP_MESSAGE:g1:one");
+    send(amy, "GROUP_MESSAGE:g1:two");
+    server->flushGroupMessages();
+
+    EXPECT_EQ(db->countExecuted("ROLLBACK"), 1u);
+    ASSERT_EQ(db->groupMessages().size(), 2u);
+    EXPECT_EQ(db->groupMessages()[0].message, "one");
+    EXPECT_EQ(db->groupMessages()[1].message, "two");
+    for (const std::string& line : errors.lines()) {
+        EXPECT_EQ(line.find("group_messages_lost"), std::string::npos) << line;
+    }
+}
+
+TEST_F(ChatLogicServerTest, LostGroupMessagesAreLoggedAsErrors) {
+    db->addGroup("g1", "team", "amy");
+    db->addGroup("g2", "other", "amy");
+    reload();
+    server->setRosterFlushInterval(std::chrono::milliseconds(100));
+    auto amy = login("amy");
+    ErrorLogCapture errors;
+
+    db->failGroupMessageInserts = true;
+    send(amy, "GROUP_MESSAGE:g1:one");
+    send(amy, "GROUP_MESSAGE:g2:two");
+    server->flushGroupMessages();
+
+    EXPECT_TRUE(db->groupMessages().empty());
+    const std::vector<std::string> lines = errors.lines();
+    const auto lost = std::find_if(lines.begin(), lines.end(), [](const std::string& line) {
+        return line.find("group_messages_lost") != std::string::npos;
+    });
+    ASSERT_NE(lost, lines.end());
+    EXPECT_NE(lost->find("count=2 total=2 chats=g1,g2"), std::string::npos) << *lost;
+}
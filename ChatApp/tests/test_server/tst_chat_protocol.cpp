@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+#include "chat_protocol.h"
+#include <string>
+
+TEST(ChatProtocolTests, RoundTripsVarints) {
+    for (std::uint64_t value : {std::uint64_t(0), std::uint64_t(1), std::uint64_t(127), std::uint64_t(128),
+                                std::uint64_t(300), std::uint64_t(1) << 35, ~std::uint64_t(0)}) {
+        std::string bytes;
+        appendVarint(bytes, value);
+        std::string_view input = bytes;
+        std::uint64_t decoded = 0;
+        ASSERT_TRUE(readVarint(input, decoded)) << value;
+        EXPECT_EQ(decoded, value);
+        EXPECT_TRUE(input.empty());
+    }
+
+    std::string bytes;
+    appendVarint(bytes, 300);
+    std::string_view truncated(bytes.data(), 1);
+    std::uint64_t decoded = 0;
+    EXPECT_FALSE(readVarint(truncated, decoded));
+    std::string_view overlong = "\xff\xff\xff\xff\xff\xff\xff\xff\xff\x7f";
+    EXPECT_FALSE(readVarint(overlong, decoded));
+}
+
+// Текстовый вид повторяет старый формат, двоичный несёт те же поля без разделителей
+TEST(ChatProtocolTests, WritesBothForms) {
+    ChatMessageWriter writer(ChatMessageType::UnreadCount);
+    writer.field("bob").number(-5);
+    EXPECT_EQ(writer.text(), "UNREAD_COUNT:bob:-5");
+
+    ChatMessage message;
+    ASSERT_TRUE(parseBinaryChatMessage(writer.binary(), message));
+    EXPECT_EQ(message.type(), ChatMessageType::UnreadCount);
+    EXPECT_EQ(message.name(), "UNREAD_COUNT");
+    ASSERT_EQ(message.size(), 2u);
+    EXPECT_EQ(message.text(0), "bob");
+    EXPECT_TRUE(message.at(1).isNumber);
+    EXPECT_EQ(message.number(1), -5);
+
+    ChatMessageWriter history(ChatMessageType::HistoryMsg);
+    history.field("2024-01-01 10:00:00").field("bob", '|').field("a|b:c", '|');
+    EXPECT_EQ(history.text(), "HISTORY_MSG:2024-01-01 10:00:00|bob|a|b:c");
+    ASSERT_TRUE(parseBinaryChatMessage(history.binary(), message));
+    ASSERT_EQ(message.size(), 3u);
+    EXPECT_EQ(message.text(2), "a|b:c");
+}
+
+TEST(ChatProtocolTests, KeepsEmptyAndBinaryOnlyFields) {
+    ChatMessageWriter list(ChatMessageType::UserList);
+    list.textOnly(":");
+    list.field("bob", ChatMessageWriter::NoSeparator).number(1).field("U").binaryOnly("");
+    list.field("42", ',').number(1).field("G").field("team");
+    EXPECT_EQ(list.text(), "USERLIST:bob:1:U,42:1:G:team");
+
+    ChatMessage message;
+    ASSERT_TRUE(parseBinaryChatMessage(list.binary(), message));
+    ASSERT_EQ(message.size(), 8u);
+    EXPECT_TRUE(message.text(3).empty());
+    EXPECT_EQ(message.text(7), "team");
+}
+
+// Старые команды разбираются как раньше: тело сообщения забирает остаток строки вместе с ':'
+TEST(ChatProtocolTests, ParsesLegacyTextCommands) {
+    ChatMessage message;
+    parseTextChatCommand("PRIVATE:bob:see you at 10:30", message);
+    EXPECT_EQ(message.type(), ChatMessageType::Private);
+    ASSERT_EQ(message.size(), 2u);
+    EXPECT_EQ(message.text(0), "bob");
+    EXPECT_EQ(message.text(1), "see you at 10:30");
+
+    // Лишние поля у остальных команд отбрасываются
+    parseTextChatCommand("AUTH:bob:secret:extra", message);
+    EXPECT_EQ(message.type(), ChatMessageType::Auth);
+    ASSERT_EQ(message.size(), 2u);
+    EXPECT_EQ(message.text(1), "secret");
+
+    parseTextChatCommand("GET_USERLIST", message);
+    EXPECT_EQ(message.type(), ChatMessageType::GetUserList);
+    EXPECT_EQ(message.size(), 0u);
+
+    // Без нужных полей и с неизвестным именем - строка в общий чат
+    parseTextChatCommand("AUTH:bob", message);
+    EXPECT_EQ(message.type(), ChatMessageType::Text);
+    EXPECT_EQ(message.name(), "AUTH");
+    ASSERT_EQ(message.size(), 1u);
+    EXPECT_EQ(message.text(0), "AUTH:bob");
+
+    parseTextChatCommand("USERLIST:fake", message);
+    EXPECT_EQ(message.type(), ChatMessageType::Text);
+}
+
+// Клиент переводит свою текстовую команду в двоичный вид, сервер получает те же поля
+TEST(ChatProtocolTests, ConvertsTextCommandToBinary) {
+    const std::string line = "GROUP_MESSAGE:chat1:a:b|c";
+    ChatMessage text;
+    parseTextChatCommand(line, text);
+    std::string binary;
+    appendBinaryChatMessage(binary, text);
+    ASSERT_TRUE(isBinaryChatMessage(binary));
+
+    ChatMessage message;
+    ASSERT_TRUE(parseChatMessage(binary, message));
+    EXPECT_TRUE(message.binary());
+    EXPECT_EQ(message.type(), ChatMessageType::GroupMessage);
+    ASSERT_EQ(message.size(), 2u);
+    EXPECT_EQ(message.text(0), "chat1");
+    EXPECT_EQ(message.text(1), "a:b|c");
+
+    parseTextChatCommand("hello: world", text);
+    binary.clear();
+    appendBinaryChatMessage(binary, text);
+    ASSERT_TRUE(parseChatMessage(binary, message));
+    EXPECT_EQ(message.type(), ChatMessageType::Text);
+    EXPECT_EQ(message.name(), "hello");
+    EXPECT_EQ(message.text(0), "hello: world");
+}
+
+// Каждая команда клиента находится по имени, ответы сервера и похожие имена - нет
+TEST(ChatProtocolTests, FindsEveryCommandByName) {
+    ChatMessage message;
+    for (auto code = std::uint16_t(ChatMessageType::Auth); code <= std::uint16_t(ChatMessageType::UnsubscribePresence); ++code) {
+        const auto type = ChatMessageType(code);
+        const std::string line = std::string(chatMessageTypeName(type)) + ":a:b";
+        parseTextChatCommand(line, message);
+        EXPECT_EQ(message.type(), type) << line;
+    }
+    for (const char* line : {"AUTH_SUCCESS", "UNREAD_COUNT:bob:1", "GET_FRIEND", "GET_FRIENDSX", "auth:bob:pw", ":x", ""}) {
+        parseTextChatCommand(line, message);
+        EXPECT_EQ(message.type(), ChatMessageType::Text) << line;
+    }
+}
+
+TEST(ChatProtocolTests, RejectsDamagedBinaryMessages) {
+    ChatMessageWriter writer(ChatMessageType::Private);
+    writer.field("bob").field("hello");
+    const std::string& binary = writer.binary();
+
+    ChatMessage message;
+    // Обрезанное поле
+    EXPECT_FALSE(parseBinaryChatMessage(std::string_view(binary.data(), binary.size() - 1), message));
+    // Неизвестный тип
+    std::string unknown(1, ChatProtocol::BinaryMarker);
+    appendVarint(unknown, 9999 << 1);
+    EXPECT_FALSE(parseBinaryChatMessage(unknown, message));
+    // Текст без строки
+    std::string text(1, ChatProtocol::BinaryMarker);
+    appendVarint(text, std::uint64_t(ChatMessageType::Text) << 1);
+    EXPECT_FALSE(parseBinaryChatMessage(text, message));
+}
+
+// Номер запроса есть только в двоичном виде и не мешает полям
+TEST(ChatProtocolTests, CarriesRequestIds) {
+    ChatMessageWriter reply(ChatMessageType::UnreadCount);
+    reply.field("bob").number(3).setRequestId(300);
+    EXPECT_EQ(reply.text(), "UNREAD_COUNT:bob:3");
+
+    ChatMessage message;
+    ASSERT_TRUE(parseBinaryChatMessage(reply.binary(), message));
+    EXPECT_EQ(message.requestId(), 300u);
+    ASSERT_EQ(message.size(), 2u);
+    EXPECT_EQ(message.text(0), "bob");
+
+    reply.setRequestId(0);
+    ASSERT_TRUE(parseBinaryChatMessage(reply.binary(), message));
+    EXPECT_EQ(message.requestId(), 0u);
+    EXPECT_EQ(message.number(1), 3);
+
+    ChatMessage text;
+    parseTextChatCommand("GET_UNREAD_COUNT:bob", text);
+    EXPECT_EQ(text.requestId(), 0u);
+    std::string binary;
+    appendBinaryChatMessage(binary, text, 7);
+    ASSERT_TRUE(parseChatMessage(binary, message));
+    EXPECT_EQ(message.type(), ChatMessageType::GetUnreadCount);
+    EXPECT_EQ(message.requestId(), 7u);
+    EXPECT_EQ(message.text(0), "bob");
+}
@@ -0,0 +1,51 @@
+#include <gtest/gtest.h>
+#include "connection_registry.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Освободившиеся id переиспользуются, поэтому остаются плотными
+TEST(ConnectionRegistryTests, ReusesIds) {
+    ConnectionRegistry<std::string> registry;
+    const auto a = registry.add("a");
+    const auto b = registry.add("b");
+    const auto c = registry.add("c");
+    EXPECT_EQ(a, 0u);
+    EXPECT_EQ(c, 2u);
+
+    EXPECT_TRUE(registry.remove(b));
+    EXPECT_FALSE(registry.remove(b));
+    EXPECT_EQ(registry.find(b), nullptr);
+    EXPECT_EQ(registry.size(), 2u);
+
+    EXPECT_EQ(registry.add("d"), b);
+    EXPECT_EQ(*registry.find(b), "d");
+    EXPECT_EQ(registry.capacity(), 3u);
+}
+
+// Удаление внутри обхода не ломает его: каждая живая запись посещается ровно один раз
+TEST(ConnectionRegistryTests, RemovesDuringIteration) {
+    ConnectionRegistry<int> registry;
+    for (int i = 0; i < 6; ++i) {
+        registry.add(i);
+    }
+
+    std::vector<int> visited;
+    registry.forEach([&](ConnectionRegistry<int>::Id id, int value) {
+        visited.push_back(value);
+        if (value == 1) {
+            registry.remove(id);
+            registry.remove(4); // Ещё не посещённая запись
+        }
+        if (value == 2) {
+            registry.add(100); // В текущий обход не попадает
+        }
+    });
+    EXPECT_EQ(visited, (std::vector<int>{ 0, 1, 2, 3, 5 }));
+    EXPECT_EQ(registry.size(), 5u);
+
+    visited.clear();
+    registry.forEach([&](ConnectionRegistry<int>::Id, int value) { visited.push_back(value); });
+    std::sort(visited.begin(), visited.end());
+    EXPECT_EQ(visited, (std::vector<int>{ 0, 2, 3, 5, 100 }));
+}
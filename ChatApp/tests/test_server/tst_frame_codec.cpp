@@ -0,0 +1,213 @@
+#include <gtest/gtest.h>
+#include "frame_codec.h"
+#include <algorithm>
+
+namespace {
+
+std::string makeFrame(int version, const std::string& payload, bool more = false) {
+    std::string frame(frameHeaderSize(version), '\0');
+    encodeFrameHeader(&frame[0], version, payload.size(), more);
+    return frame + payload;
+}
+
+} // namespace
+
+// Кадр версии 1: 16-битная длина
+TEST(FrameCodecTests, DecodesLegacyFrame) {
+    FrameDecoder decoder(FrameProtocol::LegacyVersion);
+    const std::string frame = makeFrame(FrameProtocol::LegacyVersion, "hello");
+    decoder.append(frame.data(), frame.size());
+
+    std::string_view payload;
+    bool more = true;
+    ASSERT_EQ(decoder.next(payload, more), FrameDecoder::Result::Frame);
+    EXPECT_EQ(payload, "hello");
+    EXPECT_FALSE(more);
+    EXPECT_EQ(decoder.next(payload, more), FrameDecoder::Result::NeedMoreData);
+}
+
+// Кадр приходит по одному байту
+TEST(FrameCodecTests, WaitsForCompleteFrame) {
+    FrameDecoder decoder(FrameProtocol::StreamVersion);
+    const std::string frame = makeFrame(FrameProtocol::StreamVersion, "payload");
+
+    std::string_view payload;
+    bool more = false;
+    for (std::size_t i = 0; i + 1 < frame.size(); ++i) {
+        decoder.append(&frame[i], 1);
+        ASSERT_EQ(decoder.next(payload, more), FrameDecoder::Result::NeedMoreData);
+    }
+    decoder.append(&frame.back(), 1);
+    ASSERT_EQ(decoder.next(payload, more), FrameDecoder::Result::Frame);
+    EXPECT_EQ(payload, "payload");
+}
+
+// Сообщение больше 64 КиБ, разбитое на фрагменты
+TEST(FrameCodecTests, DecodesChunkedLargeMessage) {
+    FrameDecoder decoder(FrameProtocol::StreamVersion);
+    const std::string big(200 * 1024, 'x');
+    std::string stream;
+    for (std::size_t offset = 0; offset < big.size(); offset += FrameProtocol::MaxChunkSize) {
+        const std::string chunk = big.substr(offset, FrameProtocol::MaxChunkSize);
+        stream += makeFrame(FrameProtocol::StreamVersion, chunk, offset + chunk.size() < big.size());
+    }
+    decoder.append(stream.data(), stream.size());
+
+    std::string assembled;
+    std::string_view payload;
+    bool more = true;
+    while (more) {
+        ASSERT_EQ(decoder.next(payload, more), FrameDecoder::Result::Frame);
+        assembled.append(payload.data(), payload.size());
+    }
+    EXPECT_EQ(assembled, big);
+}
+
+// Чтение прямо в буфер декодера кусками, которые режут кадры посередине: буфер не растёт,
+// хотя через него прошло во много раз больше байт, чем его ёмкость
+TEST(FrameCodecTests, ReusesBufferForDirectReads) {
+    FrameDecoder decoder(FrameProtocol::StreamVersion);
+    std::string stream;
+    constexpr int Frames = 2000;
+    for (int i = 0; i < Frames; ++i) {
+        stream += makeFrame(FrameProtocol::StreamVersion, "message " + std::to_string(i));
+    }
+
+    int decoded = 0;
+    std::size_t capacity = 0;
+    constexpr std::size_t ReadSize = 1000;
+    for (std::size_t offset = 0; offset < stream.size(); offset += ReadSize) {
+        const std::size_t size = std::min(ReadSize, stream.size() - offset);
+        stream.copy(decoder.prepare(size), size, offset);
+        decoder.commit(size);
+        if (capacity == 0) {
+            capacity = decoder.capacity();
+        }
+        std::string_view payload;
+        bool more = false;
+        while (decoder.next(payload, more) == FrameDecoder::Result::Frame) {
+            ASSERT_EQ(payload, "message " + std::to_string(decoded));
+            ++decoded;
+        }
+    }
+    EXPECT_EQ(decoded, Frames);
+    EXPECT_EQ(decoder.bufferedBytes(), 0u);
+    EXPECT_EQ(decoder.capacity(), capacity);
+}
+
+// Нагрузка QString разбирается без QDataStream, в том числе нулевая строка
+TEST(FrameCodecTests, DecodesQStringPayloadUnits) {
+    std::string payload;
+    appendQStringPayload(payload, u"Привет");
+    std::string_view units;
+    ASSERT_TRUE(qStringPayloadUnits(payload, units));
+    ASSERT_EQ(units.size(), 12u);
+    char16_t text[6];
+    decodeUtf16Be(units, text);
+    EXPECT_EQ(std::u16string_view(text, 6), u"Привет");
+
+    ASSERT_TRUE(qStringPayloadUnits(std::string("\xFF\xFF\xFF\xFF", 4), units));
+    EXPECT_TRUE(units.empty());
+    EXPECT_FALSE(qStringPayloadUnits(std::string("\0\0\0\x03xyz", 7), units)); // Нечётная длина
+}
+
+// Неизвестные флаги и слишком длинные кадры считаются ошибкой
+TEST(FrameCodecTests, RejectsMalformedStreamHeader) {
+    FrameDecoder decoder(FrameProtocol::StreamVersion);
+    const char badFlags[] = {0, 0, 0, 1, 0x40, 'x'};
+    decoder.append(badFlags, sizeof(badFlags));
+    std::string_view payload;
+    bool more = false;
+    EXPECT_EQ(decoder.next(payload, more), FrameDecoder::Result::Error);
+
+    decoder.reset();
+    const char tooLong[] = {0x7f, 0, 0, 0, 0};
+    decoder.append(tooLong, sizeof(tooLong));
+    EXPECT_EQ(decoder.next(payload, more), FrameDecoder::Result::Error);
+}
+
+// После HELLO остаток буфера разбирается уже в новой версии
+TEST(FrameCodecTests, SwitchesVersionMidStream) {
+    FrameDecoder decoder(FrameProtocol::LegacyVersion);
+    const std::string stream = makeFrame(FrameProtocol::LegacyVersion, "HELLO_OK:2")
+                             + makeFrame(FrameProtocol::StreamVersion, "AUTH_SUCCESS");
+    decoder.append(stream.data(), stream.size());
+
+    std::string_view payload;
+    bool more = false;
+    ASSERT_EQ(decoder.next(payload, more), FrameDecoder::Result::Frame);
+    WireOptions options;
+    ASSERT_TRUE(parseHelloReply(payload, options));
+    decoder.setVersion(options.version);
+    ASSERT_EQ(decoder.next(payload, more), FrameDecoder::Result::Frame);
+    EXPECT_EQ(payload, "AUTH_SUCCESS");
+}
+
+TEST(FrameCodecTests, ParsesHello) {
+    WireOptions requested;
+    requested.version = FrameProtocol::StreamVersion;
+    requested.utf8 = true;
+    EXPECT_EQ(buildHello(requested), "HELLO:2:utf8");
+
+    WireOptions options;
+    EXPECT_TRUE(parseHello(buildHello(requested), options));
+    EXPECT_EQ(options.version, 2);
+    EXPECT_TRUE(options.utf8);
+    EXPECT_TRUE(parseHello("HELLO:3:future,utf8", options));
+    EXPECT_EQ(options.version, 3);
+    EXPECT_TRUE(options.utf8);
+    EXPECT_FALSE(parseHello("HELLO", options));
+    EXPECT_FALSE(parseHello("HELLO:abc", options));
+    EXPECT_FALSE(parseHello("AUTH:user:pass", options));
+}
+
+// Сервер не даёт больше, чем умеет сам; UTF-8 только вместе с версией 2
+TEST(FrameCodecTests, NegotiatesSupportedOptions) {
+    WireOptions requested;
+    requested.version = 3;
+    requested.utf8 = true;
+    WireOptions accepted = negotiateWireOptions(requested);
+    EXPECT_EQ(accepted.version, FrameProtocol::StreamVersion);
+    EXPECT_TRUE(accepted.utf8);
+    EXPECT_EQ(buildHelloReply(accepted), "HELLO_OK:2:utf8");
+
+    requested.version = FrameProtocol::LegacyVersion;
+    requested.heartbeat = true;
+    accepted = negotiateWireOptions(requested);
+    EXPECT_EQ(accepted.version, FrameProtocol::LegacyVersion);
+    EXPECT_FALSE(accepted.utf8);
+    // PING/PONG - обычные сообщения, им версия 2 не нужна
+    EXPECT_TRUE(accepted.heartbeat);
+    EXPECT_EQ(buildHelloReply(accepted), "HELLO_OK:1:heartbeat");
+    EXPECT_TRUE(parseHelloReply("HELLO_OK:2:utf8,deflate,heartbeat", accepted));
+    EXPECT_TRUE(accepted.deflate);
+    EXPECT_TRUE(accepted.heartbeat);
+}
+
+// Двоичные сообщения - только поверх кадров UTF-8
+TEST(FrameCodecTests, NegotiatesBinaryOnlyWithUtf8) {
+    WireOptions requested;
+    requested.version = FrameProtocol::StreamVersion;
+    requested.binary = true;
+    EXPECT_FALSE(negotiateWireOptions(requested).binary);
+
+    requested.utf8 = true;
+    requested.heartbeat = true;
+    const WireOptions accepted = negotiateWireOptions(requested);
+    EXPECT_TRUE(accepted.binary);
+    EXPECT_EQ(buildHelloReply(accepted), "HELLO_OK:2:utf8,heartbeat,binary");
+
+    WireOptions parsed;
+    ASSERT_TRUE(parseHelloReply(buildHelloReply(accepted), parsed));
+    EXPECT_TRUE(parsed.binary);
+}
+
+// presence меняет только состав сообщений и принимается при любой версии кадров
+TEST(FrameCodecTests, NegotiatesPresenceWithAnyVersion) {
+    WireOptions requested;
+    ASSERT_TRUE(parseHello("HELLO:1:presence,heartbeat", requested));
+    EXPECT_TRUE(requested.presence);
+    const WireOptions accepted = negotiateWireOptions(requested);
+    EXPECT_TRUE(accepted.presence);
+    EXPECT_EQ(buildHelloReply(accepted), "HELLO_OK:1:heartbeat,presence");
+}
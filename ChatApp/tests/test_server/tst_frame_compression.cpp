@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+#include "frame_compression.h"
+#include <vector>
+#include <zlib.h>
+
+namespace {
+
+WireOptions deflateOptions() {
+    WireOptions options;
+    options.version = FrameProtocol::StreamVersion;
+    options.utf8 = true;
+    options.deflate = true;
+    return options;
+}
+
+// Разбирает поток так же, как клиент: сжатые пачки разжимаются (формат qUncompress) и вставляются обратно
+std::vector<std::string> decodeMessages(const std::string& stream, std::size_t& compressedFrames) {
+    FrameDecoder decoder(FrameProtocol::StreamVersion);
+    decoder.setCompressedFramesAllowed(true);
+    decoder.append(stream.data(), stream.size());
+    std::vector<std::string> messages;
+    std::string partial;
+    compressedFrames = 0;
+    for (;;) {
+        std::string_view payload;
+        bool more = false;
+        const FrameDecoder::Result result = decoder.next(payload, more);
+        if (result == FrameDecoder::Result::NeedMoreData) {
+            break;
+        }
+        if (result == FrameDecoder::Result::Error) {
+            ADD_FAILURE() << "Malformed stream";
+            break;
+        }
+        if (result == FrameDecoder::Result::Compressed) {
+            ++compressedFrames;
+            const auto* p = reinterpret_cast<const unsigned char*>(payload.data());
+            uLongf size = (uLongf(p[0]) << 24) | (uLongf(p[1]) << 16) | (uLongf(p[2]) << 8) | uLongf(p[3]);
+            std::string plain(size, '\0');
+            EXPECT_EQ(uncompress(reinterpret_cast<Bytef*>(&plain[0]), &size, p + 4, uLong(payload.size() - 4)), Z_OK);
+            decoder.insert(plain.data(), plain.size());
+            continue;
+        }
+        partial.append(payload.data(), payload.size());
+        if (!more) {
+            messages.push_back(partial);
+            partial.clear();
+        }
+    }
+    return messages;
+}
+
+} // namespace
+
+// История из однотипных строк сжимается пачкой и разжимается в те же сообщения
+TEST(FrameCompressionTests, CompressesHistoryBatch) {
+    std::vector<std::string> history;
+    std::string frames;
+    for (int i = 0; i < 500; ++i) {
+        history.push_back("HISTORY_MSG:2024-05-0" + std::to_string(i % 9 + 1) + " 12:00:00|Вася|сообщение номер " + std::to_string(i));
+        appendMessageFrames(frames, deflateOptions(), history.back());
+    }
+
+    FrameCompressor compressor;
+    CompressionStats stats;
+    std::string stream;
+    compressor.compress(frames, stream, stats);
+
+    EXPECT_EQ(stats.inputBytes, frames.size());
+    EXPECT_EQ(stats.outputBytes, stream.size());
+    EXPECT_EQ(stats.batches, 1u);
+    EXPECT_GT(stats.ratio(), 4.0);
+
+    std::size_t compressedFrames = 0;
+    EXPECT_EQ(decodeMessages(stream, compressedFrames), history);
+    EXPECT_EQ(compressedFrames, 1u);
+}
+
+// Большие пачки режутся по границам кадров, короткие и несжимаемые уходят как есть
+TEST(FrameCompressionTests, SplitsLargeAndSkipsSmallBatches) {
+    const std::string big(600 * 1024, 'a');
+    std::string frames;
+    appendMessageFrames(frames, deflateOptions(), big);
+
+    FrameCompressor compressor;
+    CompressionStats stats;
+    std::string stream;
+    compressor.compress(frames, stream, stats);
+    EXPECT_GE(stats.batches, 3u);
+
+    std::string small;
+    appendMessageFrames(small, deflateOptions(), "PRESENCE:user:1");
+    compressor.compress(small, stream, stats);
+    EXPECT_EQ(stats.skipped, 1u);
+
+    std::size_t compressedFrames = 0;
+    const std::vector<std::string> messages = decodeMessages(stream, compressedFrames);
+    ASSERT_EQ(messages.size(), 2u);
+    EXPECT_EQ(messages[0], big);
+    EXPECT_EQ(messages[1], "PRESENCE:user:1");
+    EXPECT_EQ(compressedFrames, stats.batches);
+}
+
+// Сжатый кадр без согласованного deflate и сжатый кадр внутри разжатой пачки - ошибка потока
+TEST(FrameCompressionTests, RejectsUnexpectedCompressedFrames) {
+    std::string frames;
+    for (int i = 0; i < 100; ++i) {
+        appendMessageFrames(frames, deflateOptions(), "USERLIST:Вася,Петя,Маша");
+    }
+    FrameCompressor compressor;
+    CompressionStats stats;
+    std::string stream;
+    compressor.compress(frames, stream, stats);
+    ASSERT_EQ(stats.batches, 1u);
+
+    FrameDecoder plain(FrameProtocol::StreamVersion);
+    plain.append(stream.data(), stream.size());
+    std::string_view payload;
+    bool more = false;
+    EXPECT_EQ(plain.next(payload, more), FrameDecoder::Result::Error);
+
+    FrameDecoder nested(FrameProtocol::StreamVersion);
+    nested.setCompressedFramesAllowed(true);
+    nested.insert(stream.data(), stream.size());
+    EXPECT_EQ(nested.next(payload, more), FrameDecoder::Result::Error);
+}
+
+TEST(FrameCompressionTests, NegotiatesDeflateOnlyForStreamFrames) {
+    WireOptions requested = deflateOptions();
+    WireOptions parsed;
+    ASSERT_TRUE(parseHello(buildHello(requested), parsed));
+    EXPECT_TRUE(parsed.utf8);
+    EXPECT_TRUE(parsed.deflate);
+    EXPECT_TRUE(negotiateWireOptions(parsed).deflate);
+
+    parsed.version = FrameProtocol::LegacyVersion;
+    EXPECT_FALSE(negotiateWireOptions(parsed).deflate);
+}
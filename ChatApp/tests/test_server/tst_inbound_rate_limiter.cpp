@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+#include "inbound_rate_limiter.h"
+
+namespace {
+
+using Clock = InboundRateLimiter::Clock;
+using std::chrono::milliseconds;
+
+// Любые разные адреса годятся как ключи соединений
+int connectionA = 0;
+int connectionB = 0;
+
+} // namespace
+
+TEST(InboundRateLimiterTests, ClassifiesCommands) {
+    EXPECT_EQ(classifyCommand("SEARCH_USERS"), CommandClass::Search);
+    EXPECT_EQ(classifyCommand("GET_PRIVATE_HISTORY"), CommandClass::History);
+    EXPECT_EQ(classifyCommand("AUTH"), CommandClass::Auth);
+    EXPECT_EQ(classifyCommand("hello everyone"), CommandClass::Message); // Уходит в общий чат
+    EXPECT_STREQ(commandClassName(CommandClass::Group), "group");
+}
+
+// Предел соединения не зависит от других соединений, предел пользователя - общий для всех его соединений
+TEST(InboundRateLimiterTests, LimitsPerConnectionAndPerUser) {
+    InboundRateLimiter limiter;
+    ASSERT_TRUE(limiter.applySpec("conn:search=1/3"));
+    ASSERT_TRUE(limiter.applySpec("user:search=1/4"));
+    const Clock::time_point now = Clock::now();
+
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_TRUE(limiter.allow(&connectionA, "alice", "SEARCH_USERS", now));
+    }
+    EXPECT_FALSE(limiter.allow(&connectionA, "alice", "SEARCH_USERS", now));
+    EXPECT_EQ(limiter.rejectedLimit(), "search");
+    // Второе соединение того же пользователя упирается в остаток его общего ведра
+    EXPECT_TRUE(limiter.allow(&connectionB, "alice", "SEARCH_USERS", now));
+    EXPECT_FALSE(limiter.allow(&connectionB, "alice", "SEARCH_USERS", now));
+    // Другие классы и пользователи не затронуты
+    EXPECT_TRUE(limiter.allow(&connectionA, "alice", "GET_USERLIST", now));
+    EXPECT_TRUE(limiter.allow(&connectionB, "bob", "SEARCH_USERS", now + milliseconds(1)));
+    // Ведро пополняется
+    EXPECT_TRUE(limiter.allow(&connectionA, "alice", "SEARCH_USERS", now + milliseconds(1000)));
+
+    EXPECT_EQ(limiter.stats().throttledPerConnection, 1u);
+    EXPECT_EQ(limiter.stats().throttledPerUser, 1u);
+    EXPECT_EQ(limiter.stats().throttledByClass[std::size_t(CommandClass::Search)], 2u);
+    EXPECT_EQ(limiter.throttledUsers().at("alice"), 2u);
+}
+
+// Предел отдельной команды отделён от её класса; rate 0 снимает предел
+TEST(InboundRateLimiterTests, AppliesCommandSpecs) {
+    InboundRateLimiter limiter;
+    ASSERT_TRUE(limiter.applySpec("GROUP_MESSAGE=0.5/1"));
+    ASSERT_TRUE(limiter.applySpec("auth=0"));
+    EXPECT_FALSE(limiter.applySpec("search"));
+    EXPECT_FALSE(limiter.applySpec("search=fast"));
+    EXPECT_FALSE(limiter.applySpec("=1"));
+    const Clock::time_point now = Clock::now();
+
+    EXPECT_TRUE(limiter.allow(&connectionA, "alice", "GROUP_MESSAGE", now));
+    EXPECT_FALSE(limiter.allow(&connectionA, "alice", "GROUP_MESSAGE", now + milliseconds(1000)));
+    EXPECT_EQ(limiter.rejectedLimit(), "GROUP_MESSAGE");
+    EXPECT_TRUE(limiter.allow(&connectionA, "alice", "PRIVATE", now));
+    EXPECT_TRUE(limiter.allow(&connectionA, "alice", "GROUP_MESSAGE", now + milliseconds(2000)));
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_TRUE(limiter.allow(&connectionA, "", "AUTH", now));
+    }
+
+    // Забытое соединение начинает с полного ведра
+    ASSERT_TRUE(limiter.applySpec("conn:query=1/1"));
+    EXPECT_TRUE(limiter.allow(&connectionB, "", "GET_USERS", now));
+    EXPECT_FALSE(limiter.allow(&connectionB, "", "GET_USERS", now));
+    limiter.forgetConnection(&connectionB);
+    EXPECT_TRUE(limiter.allow(&connectionB, "", "GET_USERS", now));
+}
+
+// Скорость 0 снимает предел и у вошедшего пользователя, у которого ещё нет ни одного ведра
+TEST(InboundRateLimiterTests, LiftsUserLimitWithZeroRate) {
+    InboundRateLimiter limiter;
+    ASSERT_TRUE(limiter.applySpec("user:search=0"));
+    ASSERT_TRUE(limiter.applySpec("conn:search=0"));
+    ASSERT_TRUE(limiter.applySpec("message=0"));
+    const Clock::time_point now = Clock::now();
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_TRUE(limiter.allow(&connectionA, "alice", "SEARCH_USERS", now));
+        EXPECT_TRUE(limiter.allow(&connectionB, "bob", "PRIVATE", now));
+    }
+}
@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+#include "logger.h"
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Перехватывает вывод журнала на время теста и возвращает прежний уровень
+class LogCapture {
+public:
+    explicit LogCapture(LogLevel level) : m_previousLevel(Logger::level()) {
+        Logger::instance().flush(); // Записи других тестов сюда не попадают
+        Logger::setLevel(level);
+        Logger::instance().setSink([this](LogLevel, std::string_view line) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_lines.emplace_back(line);
+        });
+    }
+    ~LogCapture() {
+        Logger::instance().flush();
+        Logger::instance().setSink(nullptr);
+        Logger::setLevel(m_previousLevel);
+    }
+
+    std::vector<std::string> lines() {
+        Logger::instance().flush();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_lines;
+    }
+
+private:
+    LogLevel m_previousLevel;
+    std::mutex m_mutex;
+    std::vector<std::string> m_lines;
+};
+
+} // namespace
+
+TEST(LoggerTests, FormatsKeyValueFields) {
+    LogRecord record(LogLevel::Info, "client_connected");
+    record.field("client", std::string("42")).field("bytes", std::size_t(17)).field("delta", -3)
+        .field("ok", true).field("ratio", 2.5).field("reason", "auth timeout").field("text", "a=\"b\"\n")
+        .field("user", "");
+    record.discard();
+    EXPECT_EQ(record.text(), "client_connected client=42 bytes=17 delta=-3 ok=true ratio=2.5 reason=\"auth timeout\" "
+                             "text=\"a=\\\"b\\\"\\n\" user=\"\"");
+}
+
+TEST(LoggerTests, TruncatesLongRecords) {
+    LogRecord record(LogLevel::Info, "message");
+    record.field("body", std::string(Logger::RecordCapacity * 2, 'x')).field("after", 1);
+    record.discard();
+    ASSERT_EQ(record.text().size(), Logger::RecordCapacity);
+    EXPECT_EQ(record.text().substr(record.text().size() - 3), "...");
+}
+
+TEST(LoggerTests, ParsesLevels) {
+    LogLevel level = LogLevel::Info;
+    EXPECT_TRUE(parseLogLevel("debug", level));
+    EXPECT_EQ(level, LogLevel::Debug);
+    EXPECT_TRUE(parseLogLevel("off", level));
+    EXPECT_EQ(level, LogLevel::Off);
+    EXPECT_FALSE(parseLogLevel("loud", level));
+    EXPECT_STREQ(logLevelName(LogLevel::Warn), "WARN");
+}
+
+// Выключенная запись не вычисляет аргументы и ничего не выводит
+TEST(LoggerTests, SkipsRecordsBelowLevel) {
+    LogCapture capture(LogLevel::Warn);
+    int evaluated = 0;
+    CHAT_LOG(Info, "tst_hidden").field("n", ++evaluated);
+    CHAT_LOG(Trace, "tst_hidden").field("n", ++evaluated);
+    CHAT_LOG(Warn, "tst_shown").field("n", ++evaluated);
+
+    const std::vector<std::string> lines = capture.lines();
+    EXPECT_EQ(evaluated, 1);
+    ASSERT_EQ(lines.size(), 1u);
+    EXPECT_NE(lines[0].find(" WARN tst_shown n=1"), std::string::npos);
+}
+
+TEST(LoggerTests, SamplerReportsSuppressedRecords) {
+    LogSampler sampler(2);
+    const LogSampler::Clock::time_point start = LogSampler::Clock::now();
+    std::uint64_t suppressed = 0;
+    EXPECT_TRUE(sampler.admit(start, suppressed));
+    EXPECT_TRUE(sampler.admit(start, suppressed));
+    EXPECT_FALSE(sampler.admit(start, suppressed));
+    EXPECT_FALSE(sampler.admit(start, suppressed));
+
+    ASSERT_TRUE(sampler.admit(start + std::chrono::seconds(1), suppressed));
+    EXPECT_EQ(suppressed, 2u);
+    ASSERT_TRUE(sampler.admit(start + std::chrono::seconds(1), suppressed));
+    EXPECT_EQ(suppressed, 0u);
+}
+
+TEST(LoggerTests, SampledMacroLimitsRecordsPerSecond) {
+    LogCapture capture(LogLevel::Debug);
+    for (int i = 0; i < 100; ++i) {
+        CHAT_LOG_SAMPLED(Debug, "tst_sampled", 5).field("i", i);
+    }
+    const std::vector<std::string> lines = capture.lines();
+    // Граница секунды могла попасть внутрь цикла
+    EXPECT_GE(lines.size(), 5u);
+    EXPECT_LE(lines.size(), 10u);
+}
+
+// Записи из многих потоков доходят все, и порядок записей каждого потока сохраняется
+TEST(LoggerTests, DeliversRecordsFromManyThreads) {
+    LogCapture capture(LogLevel::Info);
+    constexpr int Threads = 4;
+    constexpr int PerThread = 300; // Вместе меньше SlotCount, кольцо не переполняется
+    const LogStats before = Logger::instance().stats();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < Threads; ++t) {
+        threads.emplace_back([t] {
+            for (int i = 0; i < PerThread; ++i) {
+                CHAT_LOG(Info, "tst_thread").field("thread", t).field("seq", i);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    const std::vector<std::string> lines = capture.lines();
+    ASSERT_EQ(lines.size(), std::size_t(Threads * PerThread));
+    std::vector<int> next(Threads, 0);
+    for (const std::string& line : lines) {
+        const std::size_t position = line.find("tst_thread thread=");
+        ASSERT_NE(position, std::string::npos) << line;
+        const int thread = std::stoi(line.substr(position + 18));
+        const int seq = std::stoi(line.substr(line.find("seq=") + 4));
+        EXPECT_EQ(seq, next[thread]++);
+    }
+    const LogStats after = Logger::instance().stats();
+    EXPECT_EQ(after.written - before.written, std::uint64_t(Threads * PerThread));
+    EXPECT_EQ(after.dropped, before.dropped);
+}
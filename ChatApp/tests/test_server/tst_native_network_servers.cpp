@@ -0,0 +1,461 @@
+#include <gtest/gtest.h>
+#include "epoll_network_server.h"
+#include "io_uring_network_server.h"
+#include "multi_network_server.h"
+#include "unix_socket_network_server.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
+
+namespace {
+
+int connectTo(int port) {
+    const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int connectToUnix(const std::string& path) {
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    path.copy(address.sun_path, sizeof(address.sun_path) - 1);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+std::string testSocketPath() {
+    return "/tmp/chatapp-test-" + std::to_string(::getpid()) + ".sock";
+}
+
+void sendAll(int fd, const std::string& data) {
+    ASSERT_EQ(::send(fd, data.data(), data.size(), 0), ssize_t(data.size()));
+}
+
+// Крутит цикл сервера, пока клиент не получит сообщение целиком
+template<typename Server>
+std::string receiveMessage(Server& server, int fd, int version, bool utf8) {
+    FrameDecoder decoder(version);
+    std::string utf8Message;
+    std::u16string text;
+    char buffer[64 * 1024];
+    for (int attempt = 0; attempt < 200; ++attempt) {
+        server.processEvents(10);
+        const ssize_t received = ::recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (received > 0) {
+            decoder.append(buffer, std::size_t(received));
+        }
+        std::string_view payload;
+        bool more = false;
+        while (decoder.next(payload, more) == FrameDecoder::Result::Frame) {
+            if (utf8) {
+                utf8Message.append(payload.data(), payload.size());
+            } else {
+                decodeQStringPayload(payload, text);
+            }
+            if (!more) {
+                return utf8 ? utf8Message : utf16ToUtf8(text);
+            }
+        }
+    }
+    return std::string();
+}
+
+// То же для соединения с utf8 и deflate: сжатые пачки разжимаются и разбираются как обычные кадры
+template<typename Server>
+std::vector<std::string> receiveCompressedMessages(Server& server, int fd, std::size_t count) {
+    FrameDecoder decoder(FrameProtocol::StreamVersion);
+    decoder.setCompressedFramesAllowed(true);
+    std::vector<std::string> messages;
+    std::string partial;
+    char buffer[64 * 1024];
+    for (int attempt = 0; attempt < 200 && messages.size() < count; ++attempt) {
+        server.processEvents(10);
+        const ssize_t received = ::recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (received > 0) {
+            decoder.append(buffer, std::size_t(received));
+        }
+        std::string_view payload;
+        bool more = false;
+        for (;;) {
+            const FrameDecoder::Result result = decoder.next(payload, more);
+            if (result == FrameDecoder::Result::Compressed) {
+                const auto* p = reinterpret_cast<const unsigned char*>(payload.data());
+                uLongf size = (uLongf(p[0]) << 24) | (uLongf(p[1]) << 16) | (uLongf(p[2]) << 8) | uLongf(p[3]);
+                std::string plain(size, '\0');
+                if (uncompress(reinterpret_cast<Bytef*>(&plain[0]), &size, p + 4, uLong(payload.size() - 4)) != Z_OK) {
+                    return messages;
+                }
+                decoder.insert(plain.data(), plain.size());
+                continue;
+            }
+            if (result != FrameDecoder::Result::Frame) {
+                break;
+            }
+            partial.append(payload.data(), payload.size());
+            if (!more) {
+                messages.push_back(partial);
+                partial.clear();
+            }
+        }
+    }
+    return messages;
+}
+
+} // namespace
+
+// Бэкенды без Qt обязаны вести себя одинаково с точки зрения ChatLogicServer
+template<typename Server>
+class NativeNetworkServerTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        if (!server.start(0)) {
+            GTEST_SKIP() << "Backend is not available in this environment";
+        }
+    }
+
+    Server server;
+};
+
+using NativeServers = ::testing::Types<EpollNetworkServer, IoUringNetworkServer>;
+TYPED_TEST_SUITE(NativeNetworkServerTests, NativeServers);
+
+// Старый клиент без HELLO: кадры версии 1 в обе стороны
+TYPED_TEST(NativeNetworkServerTests, ServesLegacyClient) {
+    auto& server = this->server;
+    std::vector<std::string> received;
+    std::shared_ptr<INetworkClient> connected;
+    server.setClientConnectedCallback([&](std::shared_ptr<INetworkClient> client) { connected = client; });
+    server.setMessageReceivedCallback([&](std::shared_ptr<INetworkClient> client, const std::string& message) {
+        received.push_back(message);
+        client->sendMessage("ECHO:" + message);
+    });
+
+    const int fd = connectTo(server.port());
+    ASSERT_GE(fd, 0);
+    std::string frames;
+    appendMessageFrames(frames, WireOptions(), "AUTH:Вася:pass");
+    sendAll(fd, frames);
+
+    EXPECT_EQ(receiveMessage(server, fd, FrameProtocol::LegacyVersion, false), "ECHO:AUTH:Вася:pass");
+    ASSERT_EQ(received.size(), 1u);
+    EXPECT_EQ(received[0], "AUTH:Вася:pass");
+    ASSERT_TRUE(connected);
+    EXPECT_EQ(server.connectionCount(), 1u);
+    ::close(fd);
+}
+
+// HELLO переключает соединение на UTF-8 кадры, disconnectClient закрывает его после отправки очереди
+TYPED_TEST(NativeNetworkServerTests, NegotiatesAndDisconnects) {
+    auto& server = this->server;
+    std::shared_ptr<INetworkClient> connected;
+    bool disconnected = false;
+    server.setClientConnectedCallback([&](std::shared_ptr<INetworkClient> client) { connected = client; });
+    server.setClientDisconnectedCallback([&](std::shared_ptr<INetworkClient>) { disconnected = true; });
+
+    const int fd = connectTo(server.port());
+    ASSERT_GE(fd, 0);
+    WireOptions requested;
+    requested.version = FrameProtocol::StreamVersion;
+    requested.utf8 = true;
+    std::string frames;
+    appendMessageFrames(frames, WireOptions(), buildHello(requested));
+    sendAll(fd, frames);
+
+    WireOptions accepted;
+    ASSERT_TRUE(parseHelloReply(receiveMessage(server, fd, FrameProtocol::LegacyVersion, false), accepted));
+    EXPECT_TRUE(accepted.utf8);
+
+    ASSERT_TRUE(connected);
+    const std::string large(100 * 1024, 'x');
+    connected->sendMessage(large);
+    connected->disconnectClient();
+    EXPECT_FALSE(connected->isConnected());
+    EXPECT_EQ(receiveMessage(server, fd, FrameProtocol::StreamVersion, true), large);
+
+    for (int attempt = 0; attempt < 100 && !disconnected; ++attempt) {
+        server.processEvents(10);
+    }
+    EXPECT_TRUE(disconnected);
+    EXPECT_EQ(server.connectionCount(), 0u);
+    EXPECT_GE(server.writeStats().frames, 5u);
+    ::close(fd);
+}
+
+// Клиент, который не читает, отключается по верхней отметке; presence-обновления ему перестают слать раньше
+TYPED_TEST(NativeNetworkServerTests, EvictsSlowConsumer) {
+    auto& server = this->server;
+    OutboundQueueLimits limits;
+    limits.highWaterMark = 256 * 1024;
+    limits.lowWaterMark = 64 * 1024;
+    server.setOutboundLimits(limits);
+
+    std::shared_ptr<INetworkClient> connected;
+    bool disconnected = false;
+    server.setClientConnectedCallback([&](std::shared_ptr<INetworkClient> client) { connected = client; });
+    server.setClientDisconnectedCallback([&](std::shared_ptr<INetworkClient>) { disconnected = true; });
+
+    const int fd = connectTo(server.port());
+    ASSERT_GE(fd, 0);
+    for (int attempt = 0; attempt < 100 && !connected; ++attempt) {
+        server.processEvents(10);
+    }
+    ASSERT_TRUE(connected);
+
+    const std::string chunk(16 * 1024, 'x'); // Помещается в кадр версии 1
+    for (int i = 0; i < 4096 && connected->isConnected(); ++i) {
+        connected->sendMessage("PRESENCE:user:1");
+        connected->sendMessage(chunk);
+        server.processEvents(0);
+    }
+    EXPECT_FALSE(connected->isConnected());
+
+    for (int attempt = 0; attempt < 100 && !disconnected; ++attempt) {
+        server.processEvents(10);
+    }
+    EXPECT_TRUE(disconnected);
+    EXPECT_EQ(server.connectionCount(), 0u);
+    const OutboundQueueStats stats = server.outboundStats();
+    EXPECT_EQ(stats.evicted, 1u);
+    EXPECT_GE(stats.coalesced, 1u); // PRESENCE при перегрузке откладывается, а не теряется
+    EXPECT_GE(stats.maxQueuedBytes, limits.highWaterMark);
+    EXPECT_EQ(stats.queuedBytes, 0u);
+    ::close(fd);
+}
+
+// Рассылка кодирует сообщение один раз на формат, но каждый клиент получает свои кадры
+TYPED_TEST(NativeNetworkServerTests, BroadcastsSharedFrame) {
+    auto& server = this->server;
+    std::size_t connected = 0;
+    server.setClientConnectedCallback([&](std::shared_ptr<INetworkClient>) { ++connected; });
+
+    const int legacyFd = connectTo(server.port());
+    const int utf8Fd = connectTo(server.port());
+    ASSERT_GE(legacyFd, 0);
+    ASSERT_GE(utf8Fd, 0);
+    WireOptions requested;
+    requested.version = FrameProtocol::StreamVersion;
+    requested.utf8 = true;
+    std::string hello;
+    appendMessageFrames(hello, WireOptions(), buildHello(requested));
+    sendAll(utf8Fd, hello);
+    EXPECT_FALSE(receiveMessage(server, utf8Fd, FrameProtocol::LegacyVersion, false).empty());
+    ASSERT_EQ(connected, 2u);
+
+    server.broadcastMessage("SERVER:привет всем");
+    EXPECT_EQ(receiveMessage(server, legacyFd, FrameProtocol::LegacyVersion, false), "SERVER:привет всем");
+    EXPECT_EQ(receiveMessage(server, utf8Fd, FrameProtocol::StreamVersion, true), "SERVER:привет всем");
+    ::close(legacyFd);
+    ::close(utf8Fd);
+}
+
+// После согласования deflate история уходит сжатыми пачками, ответ на HELLO - нет
+TYPED_TEST(NativeNetworkServerTests, CompressesHistoryForDeflateClient) {
+    auto& server = this->server;
+    std::shared_ptr<INetworkClient> connected;
+    server.setClientConnectedCallback([&](std::shared_ptr<INetworkClient> client) { connected = client; });
+    server.setMessageReceivedCallback([&](std::shared_ptr<INetworkClient> client, const std::string& message) {
+        if (message == "GET_HISTORY") {
+            for (int i = 0; i < 300; ++i) {
+                client->sendMessage("HISTORY_MSG:2024-05-01 12:00:00|Вася|сообщение номер " + std::to_string(i));
+            }
+        }
+    });
+
+    const int fd = connectTo(server.port());
+    ASSERT_GE(fd, 0);
+    WireOptions requested;
+    requested.version = FrameProtocol::StreamVersion;
+    requested.utf8 = true;
+    requested.deflate = true;
+    std::string frames;
+    appendMessageFrames(frames, WireOptions(), buildHello(requested));
+    sendAll(fd, frames);
+
+    WireOptions accepted;
+    ASSERT_TRUE(parseHelloReply(receiveMessage(server, fd, FrameProtocol::LegacyVersion, false), accepted));
+    EXPECT_TRUE(accepted.deflate);
+
+    frames.clear();
+    appendMessageFrames(frames, accepted, "GET_HISTORY");
+    sendAll(fd, frames);
+    const std::vector<std::string> history = receiveCompressedMessages(server, fd, 300);
+    ASSERT_EQ(history.size(), 300u);
+    EXPECT_EQ(history.back(), "HISTORY_MSG:2024-05-01 12:00:00|Вася|сообщение номер 299");
+
+    const CompressionStats stats = server.compressionStats();
+    EXPECT_GE(stats.batches, 1u);
+    EXPECT_GT(stats.ratio(), 2.0);
+    ::close(fd);
+}
+
+// Лишние соединения закрываются сразу, не вошедшее за таймаут - отключается
+TYPED_TEST(NativeNetworkServerTests, EnforcesAdmissionLimits) {
+    auto& server = this->server;
+    std::shared_ptr<INetworkClient> authenticated;
+    int disconnected = 0;
+    server.setClientDisconnectedCallback([&](std::shared_ptr<INetworkClient>) { ++disconnected; });
+    server.setMessageReceivedCallback([&](std::shared_ptr<INetworkClient> client, const std::string&) {
+        client->markAuthenticated();
+        authenticated = client;
+    });
+    AdmissionLimits limits;
+    limits.maxConnections = 2;
+    limits.preAuthTimeout = std::chrono::milliseconds(50);
+    server.setAdmissionLimits(limits);
+
+    const int idle = connectTo(server.port());
+    const int active = connectTo(server.port());
+    const int extra = connectTo(server.port());
+    ASSERT_GE(idle, 0);
+    ASSERT_GE(active, 0);
+    ASSERT_GE(extra, 0);
+    std::string frames;
+    appendMessageFrames(frames, WireOptions(), "AUTH:user:pass");
+    sendAll(active, frames);
+
+    char byte = 0;
+    ssize_t received = -1;
+    for (int attempt = 0; attempt < 100 && received != 0; ++attempt) {
+        server.processEvents(10);
+        received = ::recv(extra, &byte, 1, MSG_DONTWAIT);
+    }
+    EXPECT_EQ(received, 0); // Отклонённое соединение закрыто сервером
+    for (int attempt = 0; attempt < 100 && disconnected == 0; ++attempt) {
+        server.processEvents(10);
+        server.checkTimeouts();
+    }
+    EXPECT_EQ(disconnected, 1);
+    ASSERT_TRUE(authenticated);
+    EXPECT_TRUE(authenticated->isConnected());
+    EXPECT_EQ(server.connectionCount(), 1u);
+    EXPECT_EQ(server.admissionStats().rejectedCapacity, 1u);
+    EXPECT_EQ(server.admissionStats().reapedPreAuth, 1u);
+    ::close(idle);
+    ::close(active);
+    ::close(extra);
+}
+
+// Клиент с heartbeat получает PING; ответивший PONG остаётся, молчащий отключается с уведомлением
+TYPED_TEST(NativeNetworkServerTests, ReapsClientsThatStopAnsweringPing) {
+    auto& server = this->server;
+    std::vector<std::string> received;
+    std::vector<std::shared_ptr<INetworkClient>> disconnected;
+    server.setMessageReceivedCallback([&](std::shared_ptr<INetworkClient>, const std::string& message) {
+        received.push_back(message);
+    });
+    server.setClientDisconnectedCallback([&](std::shared_ptr<INetworkClient> client) { disconnected.push_back(client); });
+    HeartbeatLimits limits;
+    limits.pingInterval = std::chrono::milliseconds(50);
+    limits.idleTimeout = std::chrono::milliseconds(200);
+    server.setHeartbeatLimits(limits);
+
+    WireOptions requested;
+    requested.heartbeat = true;
+    std::string hello;
+    appendMessageFrames(hello, WireOptions(), buildHello(requested));
+    const int alive = connectTo(server.port());
+    const int silent = connectTo(server.port());
+    ASSERT_GE(alive, 0);
+    ASSERT_GE(silent, 0);
+    sendAll(alive, hello);
+    sendAll(silent, hello);
+    WireOptions accepted;
+    ASSERT_TRUE(parseHelloReply(receiveMessage(server, alive, FrameProtocol::LegacyVersion, false), accepted));
+    EXPECT_TRUE(accepted.heartbeat);
+
+    std::string pong;
+    appendMessageFrames(pong, accepted, "PONG");
+    for (int round = 0; round < 6; ++round) {
+        const std::string message = receiveMessage(server, alive, FrameProtocol::LegacyVersion, false);
+        EXPECT_EQ(message, "PING");
+        if (message != "PING") {
+            break;
+        }
+        sendAll(alive, pong);
+        server.checkTimeouts();
+    }
+    EXPECT_EQ(disconnected.size(), 1u);
+    EXPECT_TRUE(received.empty()); // PONG до ChatLogicServer не доходит
+    EXPECT_EQ(server.connectionCount(), 1u);
+    EXPECT_GE(server.heartbeatStats().pingsSent, 7u);
+    EXPECT_EQ(server.heartbeatStats().idleReaped, 1u);
+    ::close(alive);
+    ::close(silent);
+}
+
+// Unix-сокет: те же кадры и колбэки, файл сокета удаляется при остановке
+TEST(UnixSocketNetworkServerTests, ServesLocalClient) {
+    UnixSocketNetworkServer server(testSocketPath());
+    ASSERT_TRUE(server.start(0));
+    std::string clientId;
+    server.setClientConnectedCallback([&](std::shared_ptr<INetworkClient> client) { clientId = client->getClientId(); });
+    server.setMessageReceivedCallback([&](std::shared_ptr<INetworkClient> client, const std::string& message) {
+        client->sendMessage("ECHO:" + message);
+    });
+
+    // Второй сервер на том же пути не должен отобрать сокет у живого
+    UnixSocketNetworkServer duplicate(testSocketPath());
+    EXPECT_FALSE(duplicate.start(0));
+
+    const int fd = connectToUnix(server.path());
+    ASSERT_GE(fd, 0);
+    WireOptions requested;
+    requested.version = FrameProtocol::StreamVersion;
+    requested.utf8 = true;
+    std::string frames;
+    appendMessageFrames(frames, WireOptions(), buildHello(requested));
+    sendAll(fd, frames);
+    EXPECT_FALSE(receiveMessage(server, fd, FrameProtocol::LegacyVersion, false).empty());
+
+    frames.clear();
+    appendMessageFrames(frames, requested, "AUTH:bot:pass");
+    sendAll(fd, frames);
+    EXPECT_EQ(receiveMessage(server, fd, FrameProtocol::StreamVersion, true), "ECHO:AUTH:bot:pass");
+    EXPECT_EQ(clientId.rfind("unix:pid=", 0), 0u);
+    ::close(fd);
+
+    server.stop();
+    EXPECT_NE(::access(server.path().c_str(), F_OK), 0);
+}
+
+// TCP и Unix-сокет под одним набором колбэков: рассылка доходит до клиентов обоих транспортов
+TEST(UnixSocketNetworkServerTests, RunsNextToTcpListener) {
+    auto tcp = std::make_shared<EpollNetworkServer>();
+    auto local = std::make_shared<UnixSocketNetworkServer>(testSocketPath());
+    MultiNetworkServer server({tcp, local});
+    std::size_t connected = 0;
+    server.setClientConnectedCallback([&](std::shared_ptr<INetworkClient>) { ++connected; });
+    ASSERT_TRUE(server.start(0));
+
+    const int tcpFd = connectTo(tcp->port());
+    const int localFd = connectToUnix(local->path());
+    ASSERT_GE(tcpFd, 0);
+    ASSERT_GE(localFd, 0);
+    for (int attempt = 0; attempt < 100 && connected < 2; ++attempt) {
+        tcp->processEvents(5);
+        local->processEvents(5);
+    }
+    ASSERT_EQ(connected, 2u);
+
+    server.broadcastMessage("SERVER:всем");
+    EXPECT_EQ(receiveMessage(*tcp, tcpFd, FrameProtocol::LegacyVersion, false), "SERVER:всем");
+    EXPECT_EQ(receiveMessage(*local, localFd, FrameProtocol::LegacyVersion, false), "SERVER:всем");
+    ::close(tcpFd);
+    ::close(localFd);
+    server.stop();
+}
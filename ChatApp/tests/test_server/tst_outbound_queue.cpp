@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include "outbound_queue.h"
+
+namespace {
+
+OutboundQueueLimits smallLimits() {
+    OutboundQueueLimits limits;
+    limits.highWaterMark = 1000;
+    limits.lowWaterMark = 100;
+    return limits;
+}
+
+} // namespace
+
+TEST(OutboundQueueTests, ClassifiesMessages) {
+    EXPECT_EQ(classifyOutboundMessage("PRESENCE:alice:1"), OutboundClass::Presence);
+    EXPECT_EQ(classifyOutboundMessage("USERLIST:alice:1:U"), OutboundClass::Roster);
+    EXPECT_EQ(classifyOutboundMessage("PRIVATE:alice:USERLIST:"), OutboundClass::Regular);
+}
+
+// Пока очередь ниже верхней отметки, всё отправляется
+TEST(OutboundQueueTests, SendsBelowHighWaterMark) {
+    OutboundQueueGuard guard(smallLimits());
+    EXPECT_EQ(guard.admit("PRESENCE:alice:1", 999), OutboundQueueGuard::Action::Send);
+    EXPECT_EQ(guard.admit("USERLIST:", 999), OutboundQueueGuard::Action::Send);
+    EXPECT_FALSE(guard.congested());
+}
+
+// Перегрузка: presence и USERLIST откладываются, обычные сообщения
+// между отметками проходят, выше верхней - отключение
+TEST(OutboundQueueTests, AppliesPolicyPerClass) {
+    OutboundQueueGuard guard(smallLimits());
+    EXPECT_EQ(guard.admit("PRESENCE:alice:1", 1000), OutboundQueueGuard::Action::Skip);
+    EXPECT_TRUE(guard.congested());
+    EXPECT_EQ(guard.admit("USERLIST:a", 1000), OutboundQueueGuard::Action::Skip);
+    EXPECT_EQ(guard.admit("USERLIST:b", 500), OutboundQueueGuard::Action::Skip);
+    EXPECT_EQ(guard.admit("GROUP_MESSAGE:1:bob:hi", 500), OutboundQueueGuard::Action::Send);
+    EXPECT_EQ(guard.admit("GROUP_MESSAGE:1:bob:hi", 1200), OutboundQueueGuard::Action::Disconnect);
+
+    const OutboundQueueStats& stats = guard.stats();
+    EXPECT_EQ(stats.congestions, 1u);
+    EXPECT_EQ(stats.dropped, 0u);
+    EXPECT_EQ(stats.coalesced, 3u);
+    EXPECT_EQ(stats.evicted, 1u);
+    EXPECT_EQ(stats.maxQueuedBytes, 1200u);
+}
+
+// Отложенный USERLIST отдаётся только после спуска до нижней отметки
+TEST(OutboundQueueTests, ReleasesDeferredRosterAtLowWaterMark) {
+    OutboundQueueGuard guard(smallLimits());
+    guard.admit("USERLIST:a", 1000);
+    guard.admit("USERLIST:b", 1000);
+
+    std::vector<std::string> deferred;
+    EXPECT_FALSE(guard.drained(500, deferred));
+    EXPECT_TRUE(guard.congested());
+    ASSERT_TRUE(guard.drained(100, deferred));
+    EXPECT_EQ(deferred, std::vector<std::string>{"USERLIST:b"});
+    EXPECT_FALSE(guard.congested());
+    deferred.clear();
+    EXPECT_FALSE(guard.drained(0, deferred));
+    EXPECT_TRUE(deferred.empty());
+    EXPECT_EQ(guard.admit("PRESENCE:alice:0", 0), OutboundQueueGuard::Action::Send);
+}
+
+// PRESENCE - изменения, а не снимок: пропущенные статусы склеиваются и уходят после разгрузки,
+// а отложенный USERLIST поглощает всё, что пришло до него
+TEST(OutboundQueueTests, MergesPresenceUntilDrained) {
+    OutboundQueueGuard guard(smallLimits());
+    EXPECT_EQ(guard.admit("PRESENCE:alice:1:bob:1", 1000), OutboundQueueGuard::Action::Skip);
+    EXPECT_EQ(guard.admit("USERLIST:a", 1000), OutboundQueueGuard::Action::Skip);
+    EXPECT_EQ(guard.admit("PRESENCE:bob:0", 1000), OutboundQueueGuard::Action::Skip);
+    EXPECT_EQ(guard.admit("PRESENCE:carol:1:bob:1", 1000), OutboundQueueGuard::Action::Skip);
+
+    std::vector<std::string> deferred;
+    ASSERT_TRUE(guard.drained(100, deferred));
+    EXPECT_EQ(deferred, (std::vector<std::string>{"USERLIST:a", "PRESENCE:bob:1:carol:1"}));
+
+    // Без USERLIST уходят только статусы
+    guard.admit("PRESENCE:alice:0", 1000);
+    deferred.clear();
+    ASSERT_TRUE(guard.drained(0, deferred));
+    EXPECT_EQ(deferred, std::vector<std::string>{"PRESENCE:alice:0"});
+}
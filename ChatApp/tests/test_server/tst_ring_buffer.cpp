@@ -0,0 +1,37 @@
+#include <gtest/gtest.h>
+#include "ring_buffer.h"
+
+// Память выделяется только при первой записи
+TEST(RingBufferTests, AllocatesLazily) {
+    RingBuffer buffer(16);
+    EXPECT_EQ(buffer.capacity(), 0u);
+    buffer.append("abc");
+    EXPECT_EQ(buffer.capacity(), 16u);
+    EXPECT_EQ(buffer.first(), "abc");
+    EXPECT_TRUE(buffer.second().empty());
+}
+
+// Данные, перешедшие через конец буфера, читаются двумя кусками
+TEST(RingBufferTests, WrapsAround) {
+    RingBuffer buffer(8);
+    buffer.append("123456");
+    buffer.consume(4);
+    buffer.append("abcd");
+    EXPECT_EQ(buffer.size(), 6u);
+    EXPECT_EQ(std::string(buffer.first()) + std::string(buffer.second()), "56abcd");
+    EXPECT_EQ(buffer.capacity(), 8u);
+}
+
+// Рост сохраняет порядок байт
+TEST(RingBufferTests, GrowsKeepingOrder) {
+    RingBuffer buffer(4);
+    buffer.append("xyz");
+    buffer.consume(2);
+    buffer.append("0123456789");
+    EXPECT_EQ(buffer.first(), "z0123456789");
+    EXPECT_TRUE(buffer.second().empty());
+
+    buffer.consume(buffer.size());
+    buffer.release();
+    EXPECT_EQ(buffer.capacity(), 0u);
+}
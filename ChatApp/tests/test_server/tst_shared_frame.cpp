@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+#include "network_interface.h"
+#include "shared_frame.h"
+#include <vector>
+
+namespace {
+
+// Клиент без своей реализации sendFrame: получает исходную строку
+class RecordingClient : public INetworkClient {
+public:
+    void sendMessage(const std::string& message) override { messages.push_back(message); }
+    std::string getClientId() const override { return "recording"; }
+    bool isConnected() const override { return true; }
+    void disconnectClient() override {}
+
+    std::vector<std::string> messages;
+};
+
+} // namespace
+
+// Кадры совпадают с обычным кодированием и считаются один раз на формат
+TEST(SharedFrameTests, EncodesOncePerFormat) {
+    const SharedFrame frame = makeSharedFrame("GROUP_MESSAGE:1:Вася:привет");
+    WireOptions legacy;
+    WireOptions utf8;
+    utf8.version = FrameProtocol::StreamVersion;
+    utf8.utf8 = true;
+
+    std::string expected;
+    ASSERT_EQ(appendMessageFrames(expected, utf8, frame->message()), 1u);
+    EXPECT_EQ(frame->frames(utf8), expected);
+    EXPECT_EQ(frame->frames(utf8).data(), frame->frames(utf8).data());
+    EXPECT_EQ(frame->encodeCount(), 1);
+
+    expected.clear();
+    appendMessageFrames(expected, legacy, frame->message());
+    EXPECT_EQ(frame->frames(legacy), expected);
+    EXPECT_EQ(frame->frameCount(legacy), 1u);
+    EXPECT_EQ(frame->encodeCount(), 2);
+}
+
+// Сообщение больше кадра версии 1 старым клиентам не кодируется
+TEST(SharedFrameTests, ReportsOversizedLegacyMessage) {
+    const SharedFrame frame = makeSharedFrame(std::string(40 * 1024, 'x'));
+    EXPECT_TRUE(frame->frames(WireOptions()).empty());
+    EXPECT_EQ(frame->frameCount(WireOptions()), 0u);
+}
+
+TEST(SharedFrameTests, FallsBackToSendMessage) {
+    RecordingClient client;
+    client.sendFrame(makeSharedFrame("USERLIST:"));
+    EXPECT_EQ(client.messages, std::vector<std::string>{ "USERLIST:" });
+}
+
+// Клиенту с опцией binary уходит двоичный вид, остальным - текст
+TEST(SharedFrameTests, EncodesBinaryFormForBinaryClients) {
+    const SharedFrame frame = makeSharedFrame(ChatMessageWriter(ChatMessageType::GroupMessage).field("1").field("bob").field("a:b"));
+    EXPECT_EQ(frame->message(), "GROUP_MESSAGE:1:bob:a:b");
+
+    WireOptions utf8;
+    utf8.version = FrameProtocol::StreamVersion;
+    utf8.utf8 = true;
+    WireOptions binary = utf8;
+    binary.binary = true;
+
+    FrameDecoder decoder(FrameProtocol::StreamVersion);
+    const std::string_view frames = frame->frames(binary);
+    decoder.append(frames.data(), frames.size());
+    std::string_view payload;
+    bool more = false;
+    ASSERT_EQ(decoder.next(payload, more), FrameDecoder::Result::Frame);
+    ChatMessage message;
+    ASSERT_TRUE(parseBinaryChatMessage(payload, message));
+    ASSERT_EQ(message.size(), 3u);
+    EXPECT_EQ(message.text(2), "a:b");
+
+    std::string expected;
+    appendMessageFrames(expected, utf8, frame->message());
+    EXPECT_EQ(frame->frames(utf8), expected);
+    EXPECT_EQ(frame->encodeCount(), 2);
+
+    // У сообщения без двоичного вида клиент с binary получает текст
+    const SharedFrame text = makeSharedFrame("USERLIST:");
+    EXPECT_EQ(text->frames(binary), text->frames(utf8));
+}
@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+#include "heartbeat_monitor.h"
+#include "timing_wheel.h"
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+using Clock = TimingWheel::Clock;
+using std::chrono::milliseconds;
+
+} // namespace
+
+// Таймеры на всех уровнях срабатывают на своём тике, не раньше
+TEST(TimingWheelTests, FiresAcrossLevels) {
+    const Clock::time_point start = Clock::now();
+    TimingWheel wheel(milliseconds(10), start);
+    const std::vector<int> delays = {5, 10, 630, 650, 41000, 2700000};
+    for (std::size_t i = 0; i < delays.size(); ++i) {
+        wheel.schedule(i, start + milliseconds(delays[i]));
+    }
+    EXPECT_EQ(wheel.size(), delays.size());
+
+    std::vector<std::uint64_t> fired;
+    for (int ms = 0; ms <= 2700000; ms += 10) {
+        const Clock::time_point now = start + milliseconds(ms);
+        wheel.advance(now, [&](std::uint64_t key) {
+            EXPECT_GE(now, start + milliseconds(delays[key]));
+            EXPECT_LT(now, start + milliseconds(delays[key] + 20));
+            fired.push_back(key);
+        });
+    }
+    EXPECT_EQ(fired, (std::vector<std::uint64_t>{0, 1, 2, 3, 4, 5}));
+    EXPECT_EQ(wheel.size(), 0u);
+}
+
+// Перенос заменяет таймер, отмена убирает его; из expire можно ставить новый
+TEST(TimingWheelTests, ReschedulesAndCancels) {
+    const Clock::time_point start = Clock::now();
+    TimingWheel wheel(milliseconds(10), start);
+    wheel.schedule(1, start + milliseconds(100));
+    wheel.schedule(1, start + milliseconds(5000));
+    wheel.schedule(2, start + milliseconds(100));
+    wheel.cancel(2);
+    wheel.schedule(3, start - milliseconds(100)); // Уже прошёл - на ближайшем тике
+
+    std::vector<std::uint64_t> fired;
+    auto collect = [&](std::uint64_t key) {
+        fired.push_back(key);
+        if (key == 3 && fired.size() == 1) {
+            wheel.schedule(3, start + milliseconds(200));
+        }
+    };
+    EXPECT_EQ(wheel.advance(start + milliseconds(10), collect), 1u);
+    EXPECT_EQ(wheel.advance(start + milliseconds(1000), collect), 1u);
+    EXPECT_EQ(fired, (std::vector<std::uint64_t>{3, 3}));
+    EXPECT_TRUE(wheel.scheduled(1));
+    EXPECT_EQ(wheel.advance(start + milliseconds(5000), collect), 1u);
+    EXPECT_EQ(fired.back(), 1u);
+}
+
+// Замолчавшему - PING, активный не трогается, не ответивший закрывается
+TEST(HeartbeatMonitorTests, PingsAndReapsSilentConnections) {
+    const Clock::time_point start = Clock::now();
+    HeartbeatLimits limits;
+    limits.pingInterval = milliseconds(100);
+    limits.idleTimeout = milliseconds(300);
+    HeartbeatMonitor monitor(limits, start);
+    monitor.add(1, start); // Отвечает на PING
+    monitor.add(2, start); // Молчит
+    monitor.add(3, start); // Закрыт до срока
+
+    std::vector<std::uint64_t> pinged;
+    std::vector<std::uint64_t> expired;
+    auto run = [&](int ms) {
+        monitor.tick(start + milliseconds(ms), [&](std::uint64_t key) { pinged.push_back(key); },
+                     [&](std::uint64_t key) { expired.push_back(key); });
+    };
+    monitor.remove(3);
+    run(50);
+    EXPECT_TRUE(pinged.empty());
+    run(120);
+    std::sort(pinged.begin(), pinged.end());
+    EXPECT_EQ(pinged, (std::vector<std::uint64_t>{1, 2}));
+    monitor.touch(1, start + milliseconds(130)); // PONG
+    run(290);
+    EXPECT_TRUE(expired.empty());
+    run(320);
+    EXPECT_EQ(expired, (std::vector<std::uint64_t>{2}));
+    EXPECT_EQ(pinged.size(), 3u); // Второй PING первому через интервал после PONG
+    EXPECT_EQ(monitor.size(), 1u);
+    EXPECT_EQ(monitor.stats().pingsSent, 3u);
+    EXPECT_EQ(monitor.stats().idleReaped, 1u);
+
+    HeartbeatMonitor disabled;
+    disabled.add(1, start);
+    EXPECT_EQ(disabled.size(), 0u);
+}